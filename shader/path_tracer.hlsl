@@ -1,457 +1,849 @@
-
-// by simon yeung, 26/05/2018
-// all rights reserved
-
-#define PI			3.14159265358979323846
-#define MAXLIGHT	(4)
-
-struct VSInput
-{
-	float2 pos	: POSITION;
-};
-
-struct PSInput
-{
-	float4 pos	: SV_POSITION;
-	float2 uv	: TEXCOORD;
-};
-
-struct Material
-{
-	float4 albedo;
-	float4 emissive;
-};
-
-struct AreaLight
-{
-	float4x4	xform;
-	float4x4	xformInv;
-	float4		radiance;
-	float		halfWidth;
-	float		halfHeight;
-	float		oneOverArea;
-	int			padding0;
-};
-
-struct Ray
-{
-	float3		pos;
-	float3		dir;
-};
-
-cbuffer SceneConstantBuffer : register(b0)
-{
-	AreaLight	areaLight[MAXLIGHT];
-	int			numLight;
-	int			numMesh;
-};
-
-cbuffer ViewConstantBuffer : register(b1)
-{
-	float4x4	projInv;
-	float3		camPos;
-	int			frameIdx;
-	float2		camPixelOffset;
-	int2		viewportSize;
-	int			randSeedInterval;
-	int			randSeedOffset;
-	int			randSeedAdd;
-	int			isEnableBlur;
-};
-
-SamplerState					linear_sampler				: register(s0);
-Texture2D						path_trace_tex				: register(t0);
-StructuredBuffer<float4		>	scene_bufferTriPos			: register(t1);
-StructuredBuffer<float4		>	scene_bufferTriNor			: register(t2);
-StructuredBuffer<int		>	scene_bufferTriIdx			: register(t3);
-StructuredBuffer<Material	>	scene_bufferMeshMaterial	: register(t4);
-StructuredBuffer<int2		>	scene_bufferMeshIdxRange	: register(t5);
-
-uint wang_hash(uint seed)
-{
-	seed = (seed ^ 61) ^ (seed >> 16);
-	seed *= 9;
-	seed = seed ^ (seed >> 4);
-	seed *= 0x27d4eb2d;
-	seed = seed ^ (seed >> 15);
-	return seed;
-}
-
-float rand(inout uint seed)
-{
-	float r= wang_hash(seed) * (1.0 / 4294967296.0);
-	seed+= randSeedAdd;
-	return r;
-}
-
-float3	createPerpendicularVector(float3 u)
-{
-	float3 a = abs(u);
-
-	uint tmpX = (asuint(a.x - a.y) & 0x80000000) >> 31;
-	uint tmpY = (asuint(a.x - a.z) & 0x80000000) >> 31;
-	uint tmpZ = (asuint(a.y - a.z) & 0x80000000) >> 31;
-
-	uint uyx = tmpX;
-	uint uzx = tmpY;
-	uint uzy = tmpZ;
-
-	uint xm = uyx & uzx;
-	uint ym = (1 ^ xm) & uzy;
-	uint zm = 1 ^ (xm & ym);
-
-	float3 v = cross(u, float3((float)xm, (float)ym, (float)zm));
-	return normalize(v);
-}
-
-// return float3(t, u, v), t < 0 implies not intersect
-float3 rayTriIntersect(Ray ray, float3 vertex0, float3 vertex1, float3 vertex2)
-{
-	const float epsilon = 0.00001f;
-	float3 edge1, edge2, h, s, q;
-	float a, f, u, v;
-	edge1 = vertex1 - vertex0;
-	edge2 = vertex2 - vertex0;
-	h = cross(ray.dir, edge2);
-	a = dot(edge1, h);
-	if (
-#if 0	// is back-face culling?
-		a > -epsilon &&
-#endif
-		a < epsilon)
-		return float3(-1.0, 0, 0);
-
-	f = 1 / a;
-	s = ray.pos - vertex0;
-	u = f * dot(s, h);
-	if (u < 0.0 || u > 1.0)
-		return float3(-1.0, 0, 0);
-
-	q = cross(s, edge1);
-	v = f * dot(ray.dir, q);
-	if (v < 0.0 || u + v > 1.0)
-		return float3(-1.0, 0, 0);
-
-	// At this stage we can compute t to find out where the intersection point is on the line.
-	float t = f * dot(edge2, q);
-	if (t <= epsilon)
-		return float3(-1.0, 0, 0); // This means that there is a line intersection but not a ray intersection.
-	else
-		return float3(t, u, v);
-}
-
-float3	sceneRayCast(Ray ray, out int hitMeshIdx, out int3 hitTriIdx)
-{
-	const float MAX_T	= 999999999999999.0f;
-	float3	hitTUV		= float3(MAX_T, 0, 0);
-	int		hit_meshIdx = 0;
-	int3	hit_triIdx	= int3(0, 0, 0);
-	int		num_mesh	= numMesh;
-	for (int mesh = 0; mesh < num_mesh; ++mesh)
-	{
-		int2 meshIdxRange = scene_bufferMeshIdxRange[mesh];
-		for (int triIdx = meshIdxRange.x; triIdx < meshIdxRange.y; triIdx+= 3)
-		{
-			int idx0	= scene_bufferTriIdx[triIdx  ];
-			int idx1	= scene_bufferTriIdx[triIdx+1];
-			int idx2	= scene_bufferTriIdx[triIdx+2];
-
-			float4 pos0 = scene_bufferTriPos[idx0];
-			float4 pos1 = scene_bufferTriPos[idx1];
-			float4 pos2 = scene_bufferTriPos[idx2];
-
-			float3 tuv	= rayTriIntersect(ray, pos0.xyz, pos1.xyz, pos2.xyz);
-			if (tuv.x < hitTUV.x && tuv.x >= 0)
-			{
-				hitTUV		= tuv;
-				hit_meshIdx = mesh;
-				hit_triIdx	= int3(idx0, idx1, idx2);
-			}
-		}
-	}
-
-	hitMeshIdx	= hit_meshIdx;
-	hitTriIdx	= hit_triIdx;
-	if (hitTUV.x == MAX_T)
-		return float3(-1.0f, 0, 0);
-	else
-		return hitTUV;
-}
-
-void sampleBrdfDir_uniformHemiSphere(Material material, inout float3 outDir, inout float outPropability, inout uint randSeed)
-{
-	float r0 = rand(randSeed);
-	float r1 = rand(randSeed);
-	float r0_1_minus_sqrt = sqrt(1.0f - r0*r0);
-	float r1_2_pi = 2.0f * PI * r1;
-	outDir = float3(	cos(r1_2_pi) * r0_1_minus_sqrt	,
-						sin(r1_2_pi) * r0_1_minus_sqrt	,
-						r0								);
-	outPropability = 1.0f / (2.0 * PI);
-}
-
-void sampleBrdfDir_cosWeightHemiSphere(Material material, inout float3 outDir, inout float outPropability, inout uint randSeed)
-{
-	float r0;
-	float r1;
-	r0				= rand(randSeed);
-	r1				= max(rand(randSeed), 0.001);	// otherwise outPropability will be too close to zero which result in artificat when dividing this pdf
-	float phi		= 2.0 * PI * r0;
-	float sinPhi	= sin(phi);
-	float cosPhi	= cos(phi);
-	float cosTheta	= sqrt(r1);
-	float sinTheta	= sqrt(1.0f - r1);
-
-	outDir = float3(	sinTheta * cosPhi	,
-						sinTheta * sinPhi	,
-						cosTheta			);
-	outPropability = cosTheta / PI;
-}
-
-void sampleBrdfDir(Material material, inout float3 outDir, inout float outPropability, inout uint randSeed)
-{
-	sampleBrdfDir_cosWeightHemiSphere(material, outDir, outPropability, randSeed);
-//	sampleBrdfDir_uniformHemiSphere(material, outDir, outPropability, randSeed);
-}
-
-float3	sampleAreaLightPos(AreaLight light, inout uint randSeed)
-{
-	float2 posLS_xz	= mad(float2(rand(randSeed), rand(randSeed)), 2, -1) * float2(light.halfWidth, light.halfHeight);
-	return mul(light.xform, float4(posLS_xz.x, 0, posLS_xz.y, 1)).xyz;
-}
-
-float3	sampleAreaLightRadiance(AreaLight light, float3 emitDir, out float propability)
-{
-	propability= light.oneOverArea;
-	float	cosAngle	= dot(emitDir, light.xform[1].xyz);
-	return cosAngle > 0 ? light.radiance.xyz : float3(0, 0, 0);
-}
-
-PSInput fullscreenQuad_vs(VSInput input_vs)
-{
-	PSInput result;
-
-	result.pos	= float4(input_vs.pos, 0, 1);
-	result.uv	= mad(input_vs.pos, float2(0.5, -0.5), 0.5);
-
-	return result;
-}
-
-float4 debug_rand_num_ps(PSInput input_ps) : SV_TARGET
-{
-	//  random number debug display
-	int2	px_pos		= (int2)input_ps.pos.xy;
-	uint	randSeed	= (px_pos.y * viewportSize.x + px_pos.x) * randSeedInterval + randSeedOffset;
-
-	float r = rand(randSeed);
-	return float4(r, r, r, 1);
-}
-
-float4 tonemap_ps(PSInput input_ps) : SV_TARGET
-{
-	// current not tonemap for simplicity...
-	const int blurFrame= 16;
-	if ((frameIdx < blurFrame) && isEnableBlur)
-	{
-		float4		centerColor		= path_trace_tex.SampleLevel(linear_sampler, input_ps.uv, 0);
-
-		// early out to save performance
-		[branch]
-		if (centerColor.a	== 0)
-			return float4(0, 0, 0, 0);
-
-		// blur to reduce noise for the first few frames
-		const int	maxBlurSmaple	= 12;
-		const int	num				= maxBlurSmaple - max(frameIdx - (blurFrame - maxBlurSmaple), 0);
-		float2		pxOffset		= rcp((float2)viewportSize);
-		float4		avgColor		= float4(0, 0, 0, 0);
-		float		weight			= 0;
-		for(int x=-num; x<=num; ++x)
-			for(int y=-num; y<=num; ++y)
-			{
-				float4	color= path_trace_tex.SampleLevel(linear_sampler, input_ps.uv +  float2( x * pxOffset.x	,  y * pxOffset.y), 0);
-				float	w	 = abs(color.a - centerColor.a) < 0.1;		// only average for the same surface geometry hash
-				avgColor	 += color * w;
-				weight		 += w;
-			}
-		avgColor/= weight;
-
-		return avgColor;
-	}
-	else
-		return path_trace_tex.SampleLevel(linear_sampler, input_ps.uv, 0);
-}
-
-PSInput pathTrace_vs(VSInput input_vs)
-{
-	PSInput result;
-
-	result.pos	= float4(input_vs.pos, 0, 1);
-	result.uv	= input_vs.pos;
-
-	return result;
-}
-
-float4 pathTrace_ps(PSInput input_ps) : SV_TARGET
-{
-	// generate rand seed
-	int2	px_pos		= (int2)input_ps.pos.xy;
-	uint	randSeed	= (px_pos.y * viewportSize.x + px_pos.x) * randSeedInterval + randSeedOffset;
-
-	// generate primary ray
-	float4 pos_ndc	= float4(input_ps.uv + camPixelOffset, -1.0, 1.0);
-	float4 pos_ws	= mul(projInv, pos_ndc);
-	pos_ws			/= pos_ws.w;
-
-	Ray ray;
-	ray.pos			= camPos;
-	ray.dir			= pos_ws.xyz - camPos;
-	
-	int		trace_depth					= 10;	// choose a small number to have better performance, but a biased result...
-	float3	coef_brdf					= float3(1, 1, 1);
-	float3	totalOutgoingRadiance		= float3(0, 0, 0);
-	float	russianRoulettePropability	= 1;
-	float3	triTUV;
-	int		hitMeshIdx;
-	int3	hitTriIdx;
-	
-	int		firstHhitMeshIdx			= -1;
-	float3	firstHitNormal				= float3(0, 0, 0);
-
-	// path tracing iteration
-	[loop]
-	for(int d=0; d<trace_depth; ++d)
-	{
-		triTUV= sceneRayCast(ray, hitMeshIdx, hitTriIdx);
-		if (triTUV.x < 0.0)
-			break;
-
-		// compute hit surface parameter
-		Material	hitMaterial	= scene_bufferMeshMaterial[hitMeshIdx];
-		float3		hitPos		= ray.pos + ray.dir * triTUV.x;
-		float3		hitNormal	=(	scene_bufferTriNor[hitTriIdx.x] * (1.0f - triTUV.y - triTUV.z)	+
-									scene_bufferTriNor[hitTriIdx.y] * triTUV.y						+
-									scene_bufferTriNor[hitTriIdx.z] * triTUV.z						).xyz;
-		hitNormal				= normalize(hitNormal);
-
-		// store first hit mesh for de-noise
-		[unroll]
-		if (d ==0)
-		{
-			firstHhitMeshIdx	= hitMeshIdx;
-			firstHitNormal		= hitNormal;
-		}
-		
-		// direct lighting
-		totalOutgoingRadiance += coef_brdf * hitMaterial.emissive.xyz;
-		for(int l= 0; l<numLight; ++l)
-		{
-			// sample light surface pos
-			Ray			shadowRay;
-			float		shadowRayEpsilon	= 0.000001;
-			AreaLight	light				= areaLight[l];
-			float3		lightSurfacePosWS	= sampleAreaLightPos(light, randSeed);
-			float3		lightDir			= lightSurfacePosWS - hitPos;
-			float	len2					= dot(lightDir, lightDir);
-			float	len						= sqrt(len2);
-			lightDir						= lightDir / len;	// normalize
-			shadowRay.dir					= lightDir;
-			shadowRay.pos					= hitPos + shadowRay.dir * shadowRayEpsilon;
-
-			// cast shadow ray
-			float3	shadowTriTUV;
-			int		shadowHitMeshIdx;
-			int3	shadowHitTriIdx;
-			shadowTriTUV= sceneRayCast(shadowRay, shadowHitMeshIdx, shadowHitTriIdx);
-
-			// skip light if in shadow
-			if (shadowTriTUV.x >= shadowRayEpsilon && (shadowTriTUV.x < len) )
-				continue;
-
-			// sample light radiance
-			float	propability;
-			float3	radiance	= sampleAreaLightRadiance(light, -lightDir, propability);
-			propability			*= russianRoulettePropability;
-			float	lightAngle	= max(dot(light.xform[1].xyz, -lightDir), 0.0f);
-			float	cosFactor	= max(dot(lightDir, hitNormal), 0.0f);
-			totalOutgoingRadiance += radiance * coef_brdf * hitMaterial.albedo.xyz * (cosFactor / propability) *(lightAngle / len2);
-		}
-		
-		// russian roulette terminate
-		if (d > 5)	// skip russian roulette in first few iteration to reduce noise
-		{
-			float terminatePropability = max(hitMaterial.albedo.x, max(hitMaterial.albedo.y, hitMaterial.albedo.z))*PI;
-			russianRoulettePropability *= terminatePropability;
-			if (rand(randSeed) > terminatePropability)
-				break;
-		}
-		
-		// path traced
-		float3	randDirTS;
-		float	randDirProbability;
-		sampleBrdfDir(hitMaterial, randDirTS, randDirProbability, randSeed);
-		
-		// convert randDirTS to world space
-		float3	binormal	= createPerpendicularVector(hitNormal);
-		float3	tangent		= cross(hitNormal, binormal);
-		binormal			= normalize(binormal);
-		tangent				= normalize(tangent );
-		float3x3	basis;
-		basis[0]			= tangent;
-		basis[1]			= binormal;
-		basis[2]			= hitNormal;
-		float3 randDirWS	= mul(randDirTS, basis);
-
-		ray.pos				= hitPos;
-		ray.dir				= randDirWS;
-		coef_brdf			*= hitMaterial.albedo.xyz * max(dot(randDirWS, hitNormal), 0.0f) / randDirProbability;
-	}
-	
-	// light directly hit the camera
-	pos_ndc	= float4(input_ps.uv, -1.0, 1.0);
-	pos_ws	= mul(projInv, pos_ndc);
-	pos_ws			/= pos_ws.w;
-	for(int l= 0; l<numLight; ++l)
-	{
-		AreaLight	light				= areaLight[l];
-		float4		lightPlaneLS		= float4(0, 1, 0, 0);	// LS == local space
-
-		// use un-jitter ray to avoid strong contrast light color bleed to geometry during de-noise pass
-		Ray unJitterCameraRay;
-		unJitterCameraRay.pos			= camPos;
-		unJitterCameraRay.dir			= pos_ws.xyz - camPos;
-
-		Ray rayInv;
-		rayInv.pos	= mul(light.xformInv, float4(unJitterCameraRay.pos, 1)).xyz;
-		rayInv.dir	= mul(light.xformInv, float4(unJitterCameraRay.dir, 0)).xyz;
-		
-        float dirDotNormal= dot(rayInv.dir, lightPlaneLS.xyz);
-        float hitT	=  dirDotNormal == 0 ? -1 : -(dot(rayInv.pos, lightPlaneLS.xyz) + lightPlaneLS.w)/dirDotNormal;
-		if (hitT <= 0 || dirDotNormal >= 0)	// check if ray hit light ray and is back face culled
-			continue;
-		
-		float3	hitPos	= mad(rayInv.dir, hitT, rayInv.pos);
-		if (abs(hitPos.x) > light.halfWidth ||
-			abs(hitPos.z) > light.halfHeight )
-			continue;
-		
-		// cast ray to check if light is blocked by other geometry
-		float	shadowRayEpsilon	= 0.000001;
-		float3	shadowTriTUV;
-		int		shadowHitMeshIdx;
-		int3	shadowHitTriIdx;
-		shadowTriTUV= sceneRayCast(unJitterCameraRay, shadowHitMeshIdx, shadowHitTriIdx);
-		if (shadowTriTUV.x >= shadowRayEpsilon && shadowTriTUV.x < hitT )
-			continue;
-
-		totalOutgoingRadiance	+= light.radiance.xyz;
-		firstHitNormal			= 0;
-		firstHhitMeshIdx		= numMesh + l;
-	}
-
-	// use normal as geometry hash because all mesh are cube
-	float geometryHash	=	firstHhitMeshIdx	== -1 ? 0 : 
-							dot(firstHitNormal, float3(1, 10, 100)) + (firstHhitMeshIdx + 1) * 1000;	
-							// firstHhitMeshIdx + 1 to identify hit pixel with alpha == 0 for de-noise
-	return float4(totalOutgoingRadiance * rcp(frameIdx+1), geometryHash); 
-}
+
+// by simon yeung, 26/05/2018
+// all rights reserved
+
+#define PI			3.14159265358979323846
+#define MAXLIGHT	(4)
+#define MESH_FLAG_FLAT	(1)
+#define AREA_LIGHT_SAMPLING_SOLID_ANGLE	(1)		// AreaLightSampling_SolidAngle in Scene.h
+#define AREA_LIGHT_SOLID_ANGLE_MIN		(0.05)	// in steradian, lights subtending less are area sampled
+
+struct VSInput
+{
+	float2 pos	: POSITION;
+};
+
+struct PSInput
+{
+	float4 pos	: SV_POSITION;
+	float2 uv	: TEXCOORD;
+};
+
+struct Material
+{
+	float4 albedo;
+	float4 emissive;
+};
+
+struct AreaLight
+{
+	float4x4	xform;
+	float4x4	xformInv;
+	float4		radiance;
+	float		halfWidth;
+	float		halfHeight;
+	float		oneOverArea;
+	int			sampling;
+};
+
+struct QuadPrim
+{
+	float3		pos;
+	float3		edge0;
+	float3		edge1;
+	int			meshIdx;
+};
+
+struct BoxPrim
+{
+	float3		center;
+	float3		axis0;		// scaled by the half extent
+	float3		axis1;
+	float3		axis2;
+	int			meshIdx;
+};
+
+struct AliasTableEntry
+{
+	float		threshold;
+	int			alias;
+	float		pdf;
+};
+
+struct Ray
+{
+	float3		pos;
+	float3		dir;
+};
+
+cbuffer SceneConstantBuffer : register(b0)
+{
+	AreaLight	areaLight[MAXLIGHT];
+	int			numLight;
+	int			numMesh;
+	int			numQuad;
+	int			numBox;
+	int			numEmissiveTri;
+	int			envMapWidth;		// 0 if there is no environment map
+	int			envMapHeight;
+	int			envMapSampling;		// 0: uniform sphere, 1: importance
+};
+
+cbuffer ViewConstantBuffer : register(b1)
+{
+	float4x4	projInv;
+	float3		camPos;
+	int			frameIdx;
+	float2		camPixelOffset;
+	int2		viewportSize;
+	int			randSeedInterval;
+	int			randSeedOffset;
+	int			randSeedAdd;
+	int			isEnableBlur;
+	float2		renderUvScale;		// the path trace pass renders to the top left of path_trace_tex, (1, 1) at full resolution
+	int			traceDepth;
+	int			viewPadding;
+};
+
+SamplerState					linear_sampler				: register(s0);
+Texture2D						path_trace_tex				: register(t0);
+StructuredBuffer<float3		>	scene_bufferTriPos			: register(t1);
+StructuredBuffer<uint		>	scene_bufferTriNor			: register(t2);	// octahedral encoded
+StructuredBuffer<int		>	scene_bufferTriIdx			: register(t3);
+StructuredBuffer<Material	>	scene_bufferMeshMaterial	: register(t4);
+StructuredBuffer<int2		>	scene_bufferMeshIdxRange	: register(t5);
+StructuredBuffer<int		>	scene_bufferMeshFlag		: register(t6);
+StructuredBuffer<QuadPrim	>	scene_bufferQuad			: register(t7);
+StructuredBuffer<BoxPrim	>	scene_bufferBox				: register(t8);
+StructuredBuffer<int2		>	scene_bufferEmissiveTri		: register(t9);		// x: first index in scene_bufferTriIdx, y: mesh index
+StructuredBuffer<AliasTableEntry>	scene_bufferEmissiveTable	: register(t10);
+StructuredBuffer<float3		>	scene_bufferEnvMapPixel		: register(t11);	// lat-long, row 0 is +y
+StructuredBuffer<AliasTableEntry>	scene_bufferEnvMapTable		: register(t12);
+
+uint wang_hash(uint seed)
+{
+	seed = (seed ^ 61) ^ (seed >> 16);
+	seed *= 9;
+	seed = seed ^ (seed >> 4);
+	seed *= 0x27d4eb2d;
+	seed = seed ^ (seed >> 15);
+	return seed;
+}
+
+float rand(inout uint seed)
+{
+	float r= wang_hash(seed) * (1.0 / 4294967296.0);
+	seed+= randSeedAdd;
+	return r;
+}
+
+float3	createPerpendicularVector(float3 u)
+{
+	float3 a = abs(u);
+
+	uint tmpX = (asuint(a.x - a.y) & 0x80000000) >> 31;
+	uint tmpY = (asuint(a.x - a.z) & 0x80000000) >> 31;
+	uint tmpZ = (asuint(a.y - a.z) & 0x80000000) >> 31;
+
+	uint uyx = tmpX;
+	uint uzx = tmpY;
+	uint uzy = tmpZ;
+
+	uint xm = uyx & uzx;
+	uint ym = (1 ^ xm) & uzy;
+	uint zm = 1 ^ (xm & ym);
+
+	float3 v = cross(u, float3((float)xm, (float)ym, (float)zm));
+	return normalize(v);
+}
+
+// return float3(t, u, v), t < 0 implies not intersect
+float3 rayTriIntersect(Ray ray, float3 vertex0, float3 vertex1, float3 vertex2)
+{
+	const float epsilon = 0.00001f;
+	const float detEpsilon = 0.000000000001f;	// determinant scale with triangle area, keep it small for dense meshes
+	float3 edge1, edge2, h, s, q;
+	float a, f, u, v;
+	edge1 = vertex1 - vertex0;
+	edge2 = vertex2 - vertex0;
+	h = cross(ray.dir, edge2);
+	a = dot(edge1, h);
+	if (
+#if 0	// is back-face culling?
+		a > -detEpsilon &&
+#endif
+		a < detEpsilon)
+		return float3(-1.0, 0, 0);
+
+	f = 1 / a;
+	s = ray.pos - vertex0;
+	u = f * dot(s, h);
+	if (u < 0.0 || u > 1.0)
+		return float3(-1.0, 0, 0);
+
+	q = cross(s, edge1);
+	v = f * dot(ray.dir, q);
+	if (v < 0.0 || u + v > 1.0)
+		return float3(-1.0, 0, 0);
+
+	// At this stage we can compute t to find out where the intersection point is on the line.
+	float t = f * dot(edge2, q);
+	if (t <= epsilon)
+		return float3(-1.0, 0, 0); // This means that there is a line intersection but not a ray intersection.
+	else
+		return float3(t, u, v);
+}
+
+// same as rayTriIntersect() with the u + v <= 1 test replaced by v <= 1
+float3 rayQuadIntersect(Ray ray, QuadPrim quad)
+{
+	const float epsilon = 0.00001f;
+	const float detEpsilon = 0.000000000001f;
+	float3 h = cross(ray.dir, quad.edge1);
+	float a = dot(quad.edge0, h);
+	if (a < detEpsilon)
+		return float3(-1.0, 0, 0);
+
+	float f = 1 / a;
+	float3 s = ray.pos - quad.pos;
+	float u = f * dot(s, h);
+	if (u < 0.0 || u > 1.0)
+		return float3(-1.0, 0, 0);
+
+	float3 q = cross(s, quad.edge0);
+	float v = f * dot(ray.dir, q);
+	if (v < 0.0 || v > 1.0)
+		return float3(-1.0, 0, 0);
+
+	float t = f * dot(quad.edge1, q);
+	if (t <= epsilon)
+		return float3(-1.0, 0, 0);
+	else
+		return float3(t, u, v);
+}
+
+// slab test in the box space, only the entering face is hit, return the face in outFace (axis * 2 + 0 for -axis, + 1 for +axis)
+float3 rayBoxIntersect(Ray ray, BoxPrim box, out int outFace)
+{
+	const float epsilon = 0.00001f;
+	float3	s		= ray.pos - box.center;
+	float3	lenSqInv= 1.0f / float3(dot(box.axis0, box.axis0), dot(box.axis1, box.axis1), dot(box.axis2, box.axis2));
+	float3	pos		= float3(dot(s		, box.axis0), dot(s			, box.axis1), dot(s			, box.axis2)) * lenSqInv;
+	float3	dir		= float3(dot(ray.dir, box.axis0), dot(ray.dir	, box.axis1), dot(ray.dir	, box.axis2)) * lenSqInv;
+	float	tNear	= -999999999999999.0f;
+	float	tFar	=  999999999999999.0f;
+	int		face	= -1;
+	outFace			= 0;
+	[unroll]
+	for (int i = 0; i < 3; ++i)
+	{
+		if (dir[i] == 0.0f)
+		{
+			if (pos[i] < -1.0f || pos[i] > 1.0f)
+				return float3(-1.0, 0, 0);
+			continue;
+		}
+		float dirInv	= 1.0f / dir[i];
+		float t0		= (-1.0f - pos[i]) * dirInv;
+		float t1		= ( 1.0f - pos[i]) * dirInv;
+		if (dirInv < 0.0f)
+		{
+			float tmp	= t0;
+			t0			= t1;
+			t1			= tmp;
+		}
+		if (t0 > tNear)
+		{
+			tNear		= t0;
+			face		= i * 2 + (dir[i] > 0.0f ? 0 : 1);
+		}
+		tFar			= min(t1, tFar);
+	}
+	if (face < 0 || tNear > tFar || tNear <= epsilon)
+		return float3(-1.0, 0, 0);
+
+	int		axisU	= face < 2 ? 1 : 0;
+	int		axisV	= face < 4 ? 2 : 1;
+	outFace			= face;
+	return float3(tNear, (pos[axisU] + dir[axisU] * tNear) * 0.5f + 0.5f, (pos[axisV] + dir[axisV] * tNear) * 0.5f + 0.5f);
+}
+
+float3	decodeOctahedral(uint packed)
+{
+	float2	f	= float2((int)(packed << 16) >> 16, (int)packed >> 16) * (1.0f / 32767.0f);
+	float3	n	= float3(f.x, f.y, 1.0f - abs(f.x) - abs(f.y));
+	float	t	= saturate(-n.z);
+	n.xy		+= n.xy >= 0 ? -t : t;
+	return normalize(n);
+}
+
+// hitTriIdx is int3(-1, quad index, -1) or int3(-2, box index, face) for the analytic primitives
+float3	computeHitNormal(int hitMeshIdx, int3 hitTriIdx, float2 hitUV)
+{
+	[branch]
+	if (hitTriIdx.x == -1)
+	{
+		QuadPrim quad = scene_bufferQuad[hitTriIdx.y];
+		return normalize(cross(quad.edge0, quad.edge1));
+	}
+	[branch]
+	if (hitTriIdx.x == -2)
+	{
+		BoxPrim	box		= scene_bufferBox[hitTriIdx.y];
+		int		axis	= hitTriIdx.z >> 1;
+		float3	normal	= normalize(axis == 0 ? box.axis0 : (axis == 1 ? box.axis1 : box.axis2));
+		return (hitTriIdx.z & 1) ? normal : -normal;
+	}
+	[branch]
+	if (scene_bufferMeshFlag[hitMeshIdx] & MESH_FLAG_FLAT)
+	{	// derive from the hit triangle instead of fetching 3 normals
+		float3 pos0 = scene_bufferTriPos[hitTriIdx.x];
+		return normalize(cross(scene_bufferTriPos[hitTriIdx.y] - pos0, scene_bufferTriPos[hitTriIdx.z] - pos0));
+	}
+	float3 normal	=	decodeOctahedral(scene_bufferTriNor[hitTriIdx.x]) * (1.0f - hitUV.x - hitUV.y)	+
+						decodeOctahedral(scene_bufferTriNor[hitTriIdx.y]) * hitUV.x						+
+						decodeOctahedral(scene_bufferTriNor[hitTriIdx.z]) * hitUV.y						;
+	return normalize(normal);
+}
+
+float3	sceneRayCast(Ray ray, out int hitMeshIdx, out int3 hitTriIdx)
+{
+	const float MAX_T	= 999999999999999.0f;
+	float3	hitTUV		= float3(MAX_T, 0, 0);
+	int		hit_meshIdx = 0;
+	int3	hit_triIdx	= int3(0, 0, 0);
+	int		num_mesh	= numMesh;
+	for (int mesh = 0; mesh < num_mesh; ++mesh)
+	{
+		int2 meshIdxRange = scene_bufferMeshIdxRange[mesh];
+		for (int triIdx = meshIdxRange.x; triIdx < meshIdxRange.y; triIdx+= 3)
+		{
+			int idx0	= scene_bufferTriIdx[triIdx  ];
+			int idx1	= scene_bufferTriIdx[triIdx+1];
+			int idx2	= scene_bufferTriIdx[triIdx+2];
+
+			float3 pos0 = scene_bufferTriPos[idx0];
+			float3 pos1 = scene_bufferTriPos[idx1];
+			float3 pos2 = scene_bufferTriPos[idx2];
+
+			float3 tuv	= rayTriIntersect(ray, pos0, pos1, pos2);
+			if (tuv.x < hitTUV.x && tuv.x >= 0)
+			{
+				hitTUV		= tuv;
+				hit_meshIdx = mesh;
+				hit_triIdx	= int3(idx0, idx1, idx2);
+			}
+		}
+	}
+
+	int	num_quad	= numQuad;
+	for (int quadIdx = 0; quadIdx < num_quad; ++quadIdx)
+	{
+		QuadPrim	quad	= scene_bufferQuad[quadIdx];
+		float3		tuv		= rayQuadIntersect(ray, quad);
+		if (tuv.x < hitTUV.x && tuv.x >= 0)
+		{
+			hitTUV		= tuv;
+			hit_meshIdx = quad.meshIdx;
+			hit_triIdx	= int3(-1, quadIdx, -1);
+		}
+	}
+
+	int	num_box		= numBox;
+	for (int boxIdx = 0; boxIdx < num_box; ++boxIdx)
+	{
+		BoxPrim		box		= scene_bufferBox[boxIdx];
+		int			face;
+		float3		tuv		= rayBoxIntersect(ray, box, face);
+		if (tuv.x < hitTUV.x && tuv.x >= 0)
+		{
+			hitTUV		= tuv;
+			hit_meshIdx = box.meshIdx;
+			hit_triIdx	= int3(-2, boxIdx, face);
+		}
+	}
+
+	hitMeshIdx	= hit_meshIdx;
+	hitTriIdx	= hit_triIdx;
+	if (hitTUV.x == MAX_T)
+		return float3(-1.0f, 0, 0);
+	else
+		return hitTUV;
+}
+
+void sampleBrdfDir_uniformHemiSphere(Material material, inout float3 outDir, inout float outPropability, inout uint randSeed)
+{
+	float r0 = rand(randSeed);
+	float r1 = rand(randSeed);
+	float r0_1_minus_sqrt = sqrt(1.0f - r0*r0);
+	float r1_2_pi = 2.0f * PI * r1;
+	outDir = float3(	cos(r1_2_pi) * r0_1_minus_sqrt	,
+						sin(r1_2_pi) * r0_1_minus_sqrt	,
+						r0								);
+	outPropability = 1.0f / (2.0 * PI);
+}
+
+void sampleBrdfDir_cosWeightHemiSphere(Material material, inout float3 outDir, inout float outPropability, inout uint randSeed)
+{
+	float r0;
+	float r1;
+	r0				= rand(randSeed);
+	r1				= max(rand(randSeed), 0.001);	// otherwise outPropability will be too close to zero which result in artificat when dividing this pdf
+	float phi		= 2.0 * PI * r0;
+	float sinPhi	= sin(phi);
+	float cosPhi	= cos(phi);
+	float cosTheta	= sqrt(r1);
+	float sinTheta	= sqrt(1.0f - r1);
+
+	outDir = float3(	sinTheta * cosPhi	,
+						sinTheta * sinPhi	,
+						cosTheta			);
+	outPropability = cosTheta / PI;
+}
+
+void sampleBrdfDir(Material material, inout float3 outDir, inout float outPropability, inout uint randSeed)
+{
+	sampleBrdfDir_cosWeightHemiSphere(material, outDir, outPropability, randSeed);
+//	sampleBrdfDir_uniformHemiSphere(material, outDir, outPropability, randSeed);
+}
+
+float3	sampleAreaLightPos(AreaLight light, float2 uv)
+{
+	float2 posLS_xz	= mad(uv, 2, -1) * float2(light.halfWidth, light.halfHeight);
+	return mul(light.xform, float4(posLS_xz.x, 0, posLS_xz.y, 1)).xyz;
+}
+
+// spherical rectangle sampling (Urena et al. 2013) in the light space, same as sampleAreaLightSolidAngle() in CpuPathTracer.cpp,
+// return the solid angle of the light, or 0 if it is too small to be worth the cost
+float	sampleAreaLightSolidAngle(AreaLight light, float3 posLS, float2 uv, out float3 outDirLS)
+{
+	outDirLS		= float3(0, 0, 0);
+	float	dist2	= dot(posLS, posLS);
+	if (posLS.y < AREA_LIGHT_SOLID_ANGLE_MIN * light.oneOverArea * dist2 * sqrt(dist2))
+		return 0;
+
+	// rect relative to posLS in the frame (x, z, -y), so that the rect lies on the plane at depth z0 < 0
+	float	x0		= -light.halfWidth	- posLS.x;
+	float	x1		=  light.halfWidth	- posLS.x;
+	float	y0		= -light.halfHeight	- posLS.z;
+	float	y1		=  light.halfHeight	- posLS.z;
+	float	z0		= -posLS.y;
+	float	z0sq	= z0 * z0;
+
+	// normals of the 4 planes through posLS and the rect edges
+	float3	n0		= float3(0	, z0	, -y0	) * rsqrt(z0sq + y0 * y0);
+	float3	n1		= float3(-z0, 0		, x1	) * rsqrt(z0sq + x1 * x1);
+	float3	n2		= float3(0	, -z0	, y1	) * rsqrt(z0sq + y1 * y1);
+	float3	n3		= float3(z0	, 0		, -x0	) * rsqrt(z0sq + x0 * x0);
+
+	// internal angles of the spherical rect
+	float	g0		= acos(clamp(-dot(n0, n1), -1, 1));
+	float	g1		= acos(clamp(-dot(n1, n2), -1, 1));
+	float	g2		= acos(clamp(-dot(n2, n3), -1, 1));
+	float	g3		= acos(clamp(-dot(n3, n0), -1, 1));
+	float	b0		= n0.z;
+	float	b1		= n2.z;
+	float	k		= 2 * PI - g2 - g3;
+	float	solidAngle	= g0 + g1 - k;
+	if (solidAngle <= 0)
+		return 0;
+
+	// sample x so that the sub-rect [x0, xu] covers u of the solid angle
+	float	au		= uv.x * solidAngle + k;
+	float	fu		= (cos(au) * b0 - b1) / sin(au);
+	float	cu		= clamp((fu > 0 ? 1 : -1) * rsqrt(fu * fu + b0 * b0), -1, 1);
+	float	xu		= clamp(-(cu * z0) * rsqrt(max(1 - cu * cu, 1e-12)), x0, x1);
+
+	// sample y uniformly in the projected height
+	float	d		= sqrt(xu * xu + z0sq);
+	float	h0		= y0 * rsqrt(d * d + y0 * y0);
+	float	h1		= y1 * rsqrt(d * d + y1 * y1);
+	float	hv		= lerp(h0, h1, uv.y);
+	float	hv2		= hv * hv;
+	float	yv		= hv2 < 1 - 1e-6 ? (hv * d) * rsqrt(1 - hv2) : y1;
+	outDirLS		= float3(xu, z0, yv);
+	return solidAngle;
+}
+
+// sample a direction from pos toward the light, return the pdf in solid angle, or 0 if pos is behind the light
+float	sampleAreaLightDir(AreaLight light, float3 pos, inout uint randSeed, out float3 outDir, out float outDist)
+{
+	float2	uv;
+	uv.x			= rand(randSeed);
+	uv.y			= rand(randSeed);
+	outDir			= float3(0, 1, 0);
+	outDist			= 0;
+	float3	posLS	= mul(light.xformInv, float4(pos, 1)).xyz;
+	if (posLS.y <= 0)
+		return 0;
+
+	float3	dirLS;
+	float	solidAngle	= light.sampling == AREA_LIGHT_SAMPLING_SOLID_ANGLE ? sampleAreaLightSolidAngle(light, posLS, uv, dirLS) : 0;
+	[branch]
+	if (solidAngle > 0)
+	{
+		float3	dir		= mul(light.xform, float4(dirLS, 0)).xyz;
+		outDist			= length(dir);
+		outDir			= dir / outDist;
+		return 1 / solidAngle;
+	}
+
+	// uniform over the area, converted to solid angle
+	float3	dir			= sampleAreaLightPos(light, uv) - pos;
+	float	dist2		= dot(dir, dir);
+	outDist				= sqrt(dist2);
+	outDir				= dir / outDist;
+	float	lightAngle	= -dot(outDir, mul(light.xform, float4(0, 1, 0, 0)).xyz);
+	return lightAngle > 0 ? light.oneOverArea * dist2 / lightAngle : 0;
+}
+
+// pick an emissive triangle in proportion to its power and a uniform point on it, same as sampleEmissiveTriangle() in CpuPathTracer.cpp,
+// return the pdf in solid angle, or 0 if the front face of the triangle does not face pos
+float	sampleEmissiveTriangle(float3 pos, inout uint randSeed, out float3 outDir, out float outDist, out int3 outTriIdx, out int outMeshIdx)
+{
+	float	x		= rand(randSeed) * numEmissiveTri;
+	int		i		= min((int)x, numEmissiveTri - 1);
+	AliasTableEntry	entry	= scene_bufferEmissiveTable[i];
+	if (x - i >= entry.threshold)
+	{
+		i			= entry.alias;
+		entry		= scene_bufferEmissiveTable[i];
+	}
+	float	su		= sqrt(rand(randSeed));
+	float	v		= rand(randSeed);
+	int2	tri		= scene_bufferEmissiveTri[i];
+	outTriIdx		= int3(scene_bufferTriIdx[tri.x], scene_bufferTriIdx[tri.x + 1], scene_bufferTriIdx[tri.x + 2]);
+	outMeshIdx		= tri.y;
+	float3	pos0	= scene_bufferTriPos[outTriIdx.x];
+	float3	pos1	= scene_bufferTriPos[outTriIdx.y];
+	float3	pos2	= scene_bufferTriPos[outTriIdx.z];
+	float3	normal	= cross(pos1 - pos0, pos2 - pos0);
+	float	area	= length(normal) * 0.5f;
+	normal			*= 0.5f / area;
+
+	float3	dir			= pos0 * (1 - su) + pos1 * (su * (1 - v)) + pos2 * (su * v) - pos;
+	float	dist2		= dot(dir, dir);
+	outDist				= sqrt(dist2);
+	outDir				= dir / outDist;
+	float	lightAngle	= -dot(outDir, normal);
+	return lightAngle > 0 ? entry.pdf / area * dist2 / lightAngle : 0;
+}
+
+// nearest pixel of the environment map, same as EnvMap::lookup()
+float3	envMapLookup(float3 dir)
+{
+	float	theta	= acos(clamp(dir.y, -1, 1));
+	float	phi		= atan2(dir.z, dir.x);
+	phi				= phi < 0 ? phi + 2 * PI : phi;
+	int		x		= min((int)(phi * (envMapWidth / (2 * PI))), envMapWidth - 1);
+	int		y		= min((int)(theta * (envMapHeight / PI)), envMapHeight - 1);
+	return scene_bufferEnvMapPixel[y * envMapWidth + x];
+}
+
+// same as EnvMap::sample(), return the pdf in solid angle
+float	sampleEnvMap(inout uint randSeed, out float3 outDir, out float3 outRadiance)
+{
+	float	u0		= rand(randSeed);
+	float	u1		= rand(randSeed);
+	float	u2		= rand(randSeed);
+	[branch]
+	if (envMapSampling == 0)
+	{
+		float	cosTheta	= 1 - 2 * u1;
+		float	sinTheta	= sqrt(max(1 - cosTheta * cosTheta, 0));
+		float	phi			= 2 * PI * u2;
+		outDir				= float3(sinTheta * cos(phi), cosTheta, sinTheta * sin(phi));
+		outRadiance			= envMapLookup(outDir);
+		return 1 / (4 * PI);
+	}
+
+	// pick a pixel, then a uniform (phi, theta) inside it
+	int		num		= envMapWidth * envMapHeight;
+	float	x		= u0 * num;
+	int		i		= min((int)x, num - 1);
+	AliasTableEntry	entry	= scene_bufferEnvMapTable[i];
+	if (x - i >= entry.threshold)
+	{
+		i			= entry.alias;
+		entry		= scene_bufferEnvMapTable[i];
+	}
+	float	theta		= ((i / envMapWidth) + u2) * (PI / envMapHeight);
+	float	phi			= ((i % envMapWidth) + u1) * (2 * PI / envMapWidth);
+	float	sinTheta	= sin(theta);
+	outDir				= float3(sinTheta * cos(phi), cos(theta), sinTheta * sin(phi));
+	outRadiance			= scene_bufferEnvMapPixel[i];
+	return sinTheta > 0 ? entry.pdf * num / (2 * PI * PI * sinTheta) : 0;
+}
+
+PSInput fullscreenQuad_vs(VSInput input_vs)
+{
+	PSInput result;
+
+	result.pos	= float4(input_vs.pos, 0, 1);
+	result.uv	= mad(input_vs.pos, float2(0.5, -0.5), 0.5);
+
+	return result;
+}
+
+float4 debug_rand_num_ps(PSInput input_ps) : SV_TARGET
+{
+	//  random number debug display
+	int2	px_pos		= (int2)input_ps.pos.xy;
+	uint	randSeed	= (px_pos.y * viewportSize.x + px_pos.x) * randSeedInterval + randSeedOffset;
+
+	float r = rand(randSeed);
+	return float4(r, r, r, 1);
+}
+
+float4 tonemap_ps(PSInput input_ps) : SV_TARGET
+{
+	// the path trace result of a lower resolution is upsampled by the bilinear filter, clamped to the rendered texels
+	float2		pxOffset		= rcp((float2)viewportSize) * renderUvScale;		// 1 texel of path_trace_tex
+	float2		uvMax			= renderUvScale - 0.5 * pxOffset;
+	float2		uv				= min(input_ps.uv * renderUvScale, uvMax);
+
+	// current not tonemap for simplicity...
+	const int blurFrame= 16;
+	if ((frameIdx < blurFrame) && isEnableBlur)
+	{
+		float4		centerColor		= path_trace_tex.SampleLevel(linear_sampler, uv, 0);
+
+		// early out to save performance
+		[branch]
+		if (centerColor.a	== 0)
+			return float4(0, 0, 0, 0);
+
+		// blur to reduce noise for the first few frames
+		const int	maxBlurSmaple	= 12;
+		const int	num				= maxBlurSmaple - max(frameIdx - (blurFrame - maxBlurSmaple), 0);
+		float4		avgColor		= float4(0, 0, 0, 0);
+		float		weight			= 0;
+		for(int x=-num; x<=num; ++x)
+			for(int y=-num; y<=num; ++y)
+			{
+				float4	color= path_trace_tex.SampleLevel(linear_sampler, min(uv +  float2( x * pxOffset.x	,  y * pxOffset.y), uvMax), 0);
+				float	w	 = abs(color.a - centerColor.a) < 0.1;		// only average for the same surface geometry hash
+				avgColor	 += color * w;
+				weight		 += w;
+			}
+		avgColor/= weight;
+
+		return avgColor;
+	}
+	else
+		return path_trace_tex.SampleLevel(linear_sampler, uv, 0);
+}
+
+PSInput pathTrace_vs(VSInput input_vs)
+{
+	PSInput result;
+
+	result.pos	= float4(input_vs.pos, 0, 1);
+	result.uv	= input_vs.pos;
+
+	return result;
+}
+
+float4 pathTrace_ps(PSInput input_ps) : SV_TARGET
+{
+	// generate rand seed
+	int2	px_pos		= (int2)input_ps.pos.xy;
+	uint	randSeed	= (px_pos.y * viewportSize.x + px_pos.x) * randSeedInterval + randSeedOffset;
+
+	// generate primary ray
+	float4 pos_ndc	= float4(input_ps.uv + camPixelOffset, -1.0, 1.0);
+	float4 pos_ws	= mul(projInv, pos_ndc);
+	pos_ws			/= pos_ws.w;
+
+	Ray ray;
+	ray.pos			= camPos;
+	ray.dir			= pos_ws.xyz - camPos;
+	
+	int		trace_depth					= traceDepth;	// a small number has better performance, but a biased result, only used while the camera moves
+	float3	coef_brdf					= float3(1, 1, 1);
+	float3	totalOutgoingRadiance		= float3(0, 0, 0);
+	float	russianRoulettePropability	= 1;
+	float3	triTUV;
+	int		hitMeshIdx;
+	int3	hitTriIdx;
+	
+	int		firstHhitMeshIdx			= -1;
+	float3	firstHitNormal				= float3(0, 0, 0);
+
+	// path tracing iteration
+	[loop]
+	for(int d=0; d<trace_depth; ++d)
+	{
+		triTUV= sceneRayCast(ray, hitMeshIdx, hitTriIdx);
+		if (triTUV.x < 0.0)
+		{
+			// the environment map hit by the BRDF sampled rays is already counted by the light sampling below
+			if (d == 0 && envMapWidth > 0)
+				totalOutgoingRadiance += envMapLookup(ray.dir);
+			break;
+		}
+
+		// compute hit surface parameter
+		Material	hitMaterial	= scene_bufferMeshMaterial[hitMeshIdx];
+		float3		hitPos		= ray.pos + ray.dir * triTUV.x;
+		float3		hitNormal	= computeHitNormal(hitMeshIdx, hitTriIdx, triTUV.yz);
+
+		// store first hit mesh for de-noise
+		[unroll]
+		if (d ==0)
+		{
+			firstHhitMeshIdx	= hitMeshIdx;
+			firstHitNormal		= hitNormal;
+		}
+		
+		// direct lighting, the emissive triangles hit by the BRDF sampled rays are already counted by the light sampling below
+		if (d == 0 || numEmissiveTri == 0 || hitTriIdx.x < 0)
+			totalOutgoingRadiance += coef_brdf * hitMaterial.emissive.xyz;
+		for(int l= 0; l<numLight; ++l)
+		{
+			// sample light direction
+			Ray			shadowRay;
+			float		shadowRayEpsilon	= 0.000001;
+			AreaLight	light				= areaLight[l];
+			float3		lightDir;
+			float		len;
+			float		propability			= sampleAreaLightDir(light, hitPos, randSeed, lightDir, len);
+			if (propability <= 0)
+				continue;
+			shadowRay.dir					= lightDir;
+			shadowRay.pos					= hitPos + shadowRay.dir * shadowRayEpsilon;
+
+			// cast shadow ray
+			float3	shadowTriTUV;
+			int		shadowHitMeshIdx;
+			int3	shadowHitTriIdx;
+			shadowTriTUV= sceneRayCast(shadowRay, shadowHitMeshIdx, shadowHitTriIdx);
+
+			// skip light if in shadow
+			if (shadowTriTUV.x >= shadowRayEpsilon && (shadowTriTUV.x < len) )
+				continue;
+
+			// light radiance, the propability is in solid angle so no geometry term
+			propability			*= russianRoulettePropability;
+			float	cosFactor	= max(dot(lightDir, hitNormal), 0.0f);
+			totalOutgoingRadiance += light.radiance.xyz * coef_brdf * hitMaterial.albedo.xyz * (cosFactor / propability);
+		}
+		[branch]
+		if (numEmissiveTri > 0)
+		{
+			// sample 1 emissive triangle
+			float		shadowRayEpsilon	= 0.000001;
+			float3		lightDir;
+			float		len;
+			int3		lightTriIdx;
+			int			lightMeshIdx;
+			float		propability			= sampleEmissiveTriangle(hitPos, randSeed, lightDir, len, lightTriIdx, lightMeshIdx);
+			float		cosFactor			= dot(lightDir, hitNormal);
+			[branch]
+			if (propability > 0 && cosFactor > 0)
+			{
+				// cast shadow ray, hitting the sampled triangle itself is not a shadow
+				Ray		shadowRay;
+				shadowRay.dir				= lightDir;
+				shadowRay.pos				= hitPos + shadowRay.dir * shadowRayEpsilon;
+				float3	shadowTriTUV;
+				int		shadowHitMeshIdx;
+				int3	shadowHitTriIdx;
+				shadowTriTUV= sceneRayCast(shadowRay, shadowHitMeshIdx, shadowHitTriIdx);
+				bool	isShadowed			= shadowTriTUV.x >= shadowRayEpsilon && shadowTriTUV.x < len && any(shadowHitTriIdx != lightTriIdx);
+				if (!isShadowed)
+					totalOutgoingRadiance	+= scene_bufferMeshMaterial[lightMeshIdx].emissive.xyz * coef_brdf * hitMaterial.albedo.xyz * (cosFactor / (propability * russianRoulettePropability));
+			}
+		}
+		[branch]
+		if (envMapWidth > 0)
+		{
+			// sample 1 environment map direction, any hit is a shadow
+			float		shadowRayEpsilon	= 0.000001;
+			float3		lightDir;
+			float3		radiance;
+			float		propability			= sampleEnvMap(randSeed, lightDir, radiance);
+			float		cosFactor			= dot(lightDir, hitNormal);
+			[branch]
+			if (propability > 0 && cosFactor > 0)
+			{
+				Ray		shadowRay;
+				shadowRay.dir				= lightDir;
+				shadowRay.pos				= hitPos + shadowRay.dir * shadowRayEpsilon;
+				float3	shadowTriTUV;
+				int		shadowHitMeshIdx;
+				int3	shadowHitTriIdx;
+				shadowTriTUV= sceneRayCast(shadowRay, shadowHitMeshIdx, shadowHitTriIdx);
+				if (shadowTriTUV.x < shadowRayEpsilon)
+					totalOutgoingRadiance	+= radiance * coef_brdf * hitMaterial.albedo.xyz * (cosFactor / (propability * russianRoulettePropability));
+			}
+		}
+		
+		// russian roulette terminate
+		if (d > 5)	// skip russian roulette in first few iteration to reduce noise
+		{
+			float terminatePropability = max(hitMaterial.albedo.x, max(hitMaterial.albedo.y, hitMaterial.albedo.z))*PI;
+			russianRoulettePropability *= terminatePropability;
+			if (rand(randSeed) > terminatePropability)
+				break;
+		}
+		
+		// path traced
+		float3	randDirTS;
+		float	randDirProbability;
+		sampleBrdfDir(hitMaterial, randDirTS, randDirProbability, randSeed);
+		
+		// convert randDirTS to world space
+		float3	binormal	= createPerpendicularVector(hitNormal);
+		float3	tangent		= cross(hitNormal, binormal);
+		binormal			= normalize(binormal);
+		tangent				= normalize(tangent );
+		float3x3	basis;
+		basis[0]			= tangent;
+		basis[1]			= binormal;
+		basis[2]			= hitNormal;
+		float3 randDirWS	= mul(randDirTS, basis);
+
+		ray.pos				= hitPos;
+		ray.dir				= randDirWS;
+		coef_brdf			*= hitMaterial.albedo.xyz * max(dot(randDirWS, hitNormal), 0.0f) / randDirProbability;
+	}
+	
+	// light directly hit the camera
+	pos_ndc	= float4(input_ps.uv, -1.0, 1.0);
+	pos_ws	= mul(projInv, pos_ndc);
+	pos_ws			/= pos_ws.w;
+	for(int l= 0; l<numLight; ++l)
+	{
+		AreaLight	light				= areaLight[l];
+		float4		lightPlaneLS		= float4(0, 1, 0, 0);	// LS == local space
+
+		// use un-jitter ray to avoid strong contrast light color bleed to geometry during de-noise pass
+		Ray unJitterCameraRay;
+		unJitterCameraRay.pos			= camPos;
+		unJitterCameraRay.dir			= pos_ws.xyz - camPos;
+
+		Ray rayInv;
+		rayInv.pos	= mul(light.xformInv, float4(unJitterCameraRay.pos, 1)).xyz;
+		rayInv.dir	= mul(light.xformInv, float4(unJitterCameraRay.dir, 0)).xyz;
+		
+        float dirDotNormal= dot(rayInv.dir, lightPlaneLS.xyz);
+        float hitT	=  dirDotNormal == 0 ? -1 : -(dot(rayInv.pos, lightPlaneLS.xyz) + lightPlaneLS.w)/dirDotNormal;
+		if (hitT <= 0 || dirDotNormal >= 0)	// check if ray hit light ray and is back face culled
+			continue;
+		
+		float3	hitPos	= mad(rayInv.dir, hitT, rayInv.pos);
+		if (abs(hitPos.x) > light.halfWidth ||
+			abs(hitPos.z) > light.halfHeight )
+			continue;
+		
+		// cast ray to check if light is blocked by other geometry
+		float	shadowRayEpsilon	= 0.000001;
+		float3	shadowTriTUV;
+		int		shadowHitMeshIdx;
+		int3	shadowHitTriIdx;
+		shadowTriTUV= sceneRayCast(unJitterCameraRay, shadowHitMeshIdx, shadowHitTriIdx);
+		if (shadowTriTUV.x >= shadowRayEpsilon && shadowTriTUV.x < hitT )
+			continue;
+
+		totalOutgoingRadiance	+= light.radiance.xyz;
+		firstHitNormal			= 0;
+		firstHhitMeshIdx		= numMesh + l;
+	}
+
+	// use normal as geometry hash because all mesh are cube
+	float geometryHash	=	firstHhitMeshIdx	== -1 ? 0 : 
+							dot(firstHitNormal, float3(1, 10, 100)) + (firstHhitMeshIdx + 1) * 1000;	
+							// firstHhitMeshIdx + 1 to identify hit pixel with alpha == 0 for de-noise
+	return float4(totalOutgoingRadiance * rcp(frameIdx+1), geometryHash); 
+}
@@ -0,0 +1,87 @@
+
+// all rights reserved
+
+#include "AccumBuffer.h"
+#include <stdio.h>
+#include <algorithm>
+
+AccumBuffer::AccumBuffer()
+{
+	width	= 0;
+	height	= 0;
+}
+
+void	AccumBuffer::resize(int w, int h)
+{
+	width	= w;
+	height	= h;
+	radianceSum.resize(w * h);
+	sampleCount.resize(w * h);
+	clear();
+}
+
+void	AccumBuffer::clear()
+{
+	std::fill(radianceSum.begin(), radianceSum.end(), Vector4(0, 0, 0, 0));
+	std::fill(sampleCount.begin(), sampleCount.end(), 0);
+}
+
+void	AccumBuffer::merge(const AccumBuffer& other)
+{
+	merge(other.radianceSum.data(), other.sampleCount.data());
+}
+
+void	AccumBuffer::merge(const Vector4* otherRadianceSum, const int* otherSampleCount)
+{
+	// each pixel is weighted by its own sample count, so adding the sums and counts is enough
+	int num = width * height;
+	for(int i=0; i<num; ++i)
+	{
+		radianceSum[i].x	+= otherRadianceSum[i].x;
+		radianceSum[i].y	+= otherRadianceSum[i].y;
+		radianceSum[i].z	+= otherRadianceSum[i].z;
+		sampleCount[i]		+= otherSampleCount[i];
+	}
+}
+
+Vector3	AccumBuffer::getPixel(int x, int y) const
+{
+	int idx = y * width + x;
+	int cnt = sampleCount[idx];
+	if (cnt == 0)
+		return Vector3(0, 0, 0);
+	return radianceSum[idx].xyz() / (float)cnt;
+}
+
+int		AccumBuffer::getTotalSampleCount() const
+{
+	int total = 0;
+	int num = width * height;
+	for(int i=0; i<num; ++i)
+		total += sampleCount[i];
+	return total;
+}
+
+bool	AccumBuffer::savePfm(const char* fileName) const
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, fileName, "wb") != 0 || !file)
+		return false;
+
+	// PFM store scanline from bottom to top
+	fprintf(file, "PF\n%i %i\n-1.0\n", width, height);
+	std::vector<float> row(width * 3);
+	for(int y= height - 1; y>=0; --y)
+	{
+		for(int x=0; x<width; ++x)
+		{
+			Vector3 c		= getPixel(x, y);
+			row[x * 3 + 0]	= c.x;
+			row[x * 3 + 1]	= c.y;
+			row[x * 3 + 2]	= c.z;
+		}
+		fwrite(row.data(), sizeof(float), row.size(), file);
+	}
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include "math.h"
+
+// per pixel radiance sum with sample count, partial buffers rendered with
+// different sample ranges can be merged by simply adding them together
+struct AccumBuffer
+{
+	int						width;
+	int						height;
+	std::vector<Vector4	>	radianceSum;	// xyz: radiance sum, w: unused
+	std::vector<int		>	sampleCount;
+
+	AccumBuffer();
+
+	void	resize(int w, int h);
+	void	clear();
+	void	merge(const AccumBuffer& other);
+	void	merge(const Vector4* otherRadianceSum, const int* otherSampleCount);	// width * height pixels each, e.g. received from a worker
+
+	Vector3	getPixel(int x, int y) const;	// averaged radiance
+	int		getTotalSampleCount() const;
+	bool	savePfm(const char* fileName) const;
+};
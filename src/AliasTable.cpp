@@ -0,0 +1,53 @@
+
+// all rights reserved
+
+#include "AliasTable.h"
+
+float	aliasTableBuild(const float* weight, int num, std::vector<AliasTableEntry>* table)
+{
+	table->clear();
+	double sum = 0.0;
+	for (int i = 0; i < num; ++i)
+		sum += weight[i];
+	if (sum <= 0.0)
+		return 0.0f;
+
+	// Vose's algorithm, entries are split into the ones below and above the average weight,
+	// each small entry is filled up to the average by a large entry, which becomes its alias
+	table->resize(num);
+	std::vector<double>	scaled(num);
+	std::vector<int>	small;
+	std::vector<int>	large;
+	for (int i = 0; i < num; ++i)
+	{
+		AliasTableEntry& entry	= (*table)[i];
+		entry.pdf				= (float)(weight[i] / sum);
+		entry.alias				= i;
+		scaled[i]				= weight[i] * num / sum;
+		if (scaled[i] < 1.0)
+			small.push_back(i);
+		else
+			large.push_back(i);
+	}
+	while (!small.empty() && !large.empty())
+	{
+		int s = small.back();
+		int l = large.back();
+		small.pop_back();
+		(*table)[s].threshold	= (float)scaled[s];
+		(*table)[s].alias		= l;
+		scaled[l]				-= 1.0 - scaled[s];
+		if (scaled[l] < 1.0)
+		{
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	// the remaining entries are 1 up to rounding error
+	for (int i = 0; i < (int)small.size(); ++i)
+		(*table)[small[i]].threshold = 1.0f;
+	for (int i = 0; i < (int)large.size(); ++i)
+		(*table)[large[i]].threshold = 1.0f;
+	return (float)sum;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+
+// Walker's alias method: an entry is picked uniformly, then it is kept with probability threshold or replaced by its alias,
+// so sampling a discrete distribution is O(1). The layout is shared with path_tracer.hlsl.
+struct AliasTableEntry
+{
+	float	threshold;
+	int		alias;
+	float	pdf;		// probability of sampling this entry
+};
+
+// return the sum of the weights, the table is empty if the sum is 0
+float	aliasTableBuild(const float* weight, int num, std::vector<AliasTableEntry>* table);
+
+// u in [0, 1)
+inline int	aliasTableSample(const AliasTableEntry* table, int num, float u)
+{
+	float	x	= u * num;
+	int		i	= (int)x;
+	i			= i < num - 1 ? i : num - 1;
+	return (x - i) < table[i].threshold ? i : table[i].alias;
+}
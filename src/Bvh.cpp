@@ -0,0 +1,1915 @@
+
+// all rights reserved
+
+#include "Bvh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <xmmintrin.h>
+
+#define BVH_NUM_BIN				(16)
+#define BVH_COST_TRAVERSAL		(1.0f)
+#define BVH_COST_INTERSECT		(1.0f)
+#define BVH_TASK_MIN_PRIM		(4096)		// smaller subtrees are built by the thread which split their parent
+#define BVH_PARALLEL_MIN_PRIM	(65536)		// larger nodes compute their bound and bins with parallelFor
+#define BVH_MAX_CHUNK			(64)
+#define BVH_RADIX_BIT			(8)
+#define BVH_RADIX_SIZE			(1 << BVH_RADIX_BIT)
+#define BVH_SUBTREE_DEPTH		(6)			// up to 64 subtrees for parallel refit and partial rebuild
+#define BVH_REBUILD_SAH_RATIO	(1.3f)		// rebuild when the SAH cost grow by this ratio since it is built
+#define BVH_SBVH_MIN_OVERLAP	(1.0e-5f)	// spatial splits are only tried when the object split children overlap by this fraction of the root area
+#define BVH_TREELET_SIZE		(4096 / BVH_CACHE_LINE_SIZE)	// sibling pairs per treelet, 1 page
+
+void	Aabb::setEmpty()
+{
+	boundMin = Vector3( 999999999999999.0f,  999999999999999.0f,  999999999999999.0f);
+	boundMax = Vector3(-999999999999999.0f, -999999999999999.0f, -999999999999999.0f);
+}
+
+void	Aabb::grow(const Vector3& p)
+{
+	boundMin = vecMin(boundMin, p);
+	boundMax = vecMax(boundMax, p);
+}
+
+void	Aabb::grow(const Aabb& box)
+{
+	boundMin = vecMin(boundMin, box.boundMin);
+	boundMax = vecMax(boundMax, box.boundMax);
+}
+
+float	Aabb::surfaceArea() const
+{
+	Vector3 d = boundMax - boundMin;
+	if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f)
+		return 0.0f;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static float	getAxis(const Vector3& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+int		bvhGetNumPrim(const BvhGeometry& geometry)
+{
+	return geometry.numTri + geometry.numQuad + geometry.numBox;
+}
+
+int		bvhGetPrimId(const BvhGeometry& geometry, int primIdx)
+{
+	if (primIdx < geometry.numTri)
+		return primIdx;
+	primIdx -= geometry.numTri;
+	if (primIdx < geometry.numQuad)
+		return RAY_PRIM_QUAD | primIdx;
+	return RAY_PRIM_BOX | ((primIdx - geometry.numQuad) * 6);
+}
+
+// vertices of a triangle or a quad, return 0 for a box
+static int	getPrimPolygon(const BvhGeometry& geometry, int prim, Vector3* vtx)
+{
+	int type = prim & RAY_PRIM_TYPE_MASK;
+	if (type == 0)
+	{
+		const int* idx = geometry.triIdx + prim * 3;
+		vtx[0] = geometry.triPos[idx[0]];
+		vtx[1] = geometry.triPos[idx[1]];
+		vtx[2] = geometry.triPos[idx[2]];
+		return 3;
+	}
+	if (type == RAY_PRIM_QUAD)
+	{
+		const QuadPrim& quad = geometry.quads[prim & RAY_PRIM_IDX_MASK];
+		vtx[0] = quad.pos;
+		vtx[1] = quad.pos + quad.edge0;
+		vtx[2] = quad.pos + quad.edge0 + quad.edge1;
+		vtx[3] = quad.pos + quad.edge1;
+		return 4;
+	}
+	return 0;
+}
+
+void	bvhGetPrimBound(const BvhGeometry& geometry, int prim, Aabb* bound)
+{
+	Vector3	vtx[4];
+	int		numVtx = getPrimPolygon(geometry, prim, vtx);
+	bound->setEmpty();
+	for (int i = 0; i < numVtx; ++i)
+		bound->grow(vtx[i]);
+	if (numVtx > 0)
+		return;
+
+	// the box extent along each world axis is the sum of the projected half axes
+	const BoxPrim&	box		= geometry.boxes[(prim & RAY_PRIM_IDX_MASK) / 6];
+	Vector3			extent	= Vector3(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 3; ++i)
+		extent += Vector3(fabsf(box.axis[i].x), fabsf(box.axis[i].y), fabsf(box.axis[i].z));
+	bound->boundMin	= box.center - extent;
+	bound->boundMax	= box.center + extent;
+}
+
+float	bvhIntersectPrim(const BvhGeometry& geometry, int prim, const Ray& ray, float* outU, float* outV, int* outId)
+{
+	int type	= prim & RAY_PRIM_TYPE_MASK;
+	*outId		= prim;
+	if (type == 0)
+	{
+		const int* idx = geometry.triIdx + prim * 3;
+		return rayTriIntersect(ray, geometry.triPos[idx[0]], geometry.triPos[idx[1]], geometry.triPos[idx[2]], outU, outV);
+	}
+	if (type == RAY_PRIM_QUAD)
+		return rayQuadIntersect(ray, geometry.quads[prim & RAY_PRIM_IDX_MASK], outU, outV);
+
+	int		face;
+	float	t	= rayBoxIntersect(ray, geometry.boxes[(prim & RAY_PRIM_IDX_MASK) / 6], outU, outV, &face);
+	*outId		= prim + face;
+	return t;
+}
+
+void	bvhSetPrimHit(const BvhGeometry& geometry, int id, RayHit* hit)
+{
+	int type		= id & RAY_PRIM_TYPE_MASK;
+	hit->triangle	= id;
+	if (type == 0)
+	{
+		hit->meshIdx	= geometry.triMeshIdx[id];
+		hit->triIdx[0]	= geometry.triIdx[id * 3	];
+		hit->triIdx[1]	= geometry.triIdx[id * 3 + 1];
+		hit->triIdx[2]	= geometry.triIdx[id * 3 + 2];
+		return;
+	}
+	hit->meshIdx	= type == RAY_PRIM_QUAD ? geometry.quads[id & RAY_PRIM_IDX_MASK].meshIdx : geometry.boxes[(id & RAY_PRIM_IDX_MASK) / 6].meshIdx;
+	hit->triIdx[0]	= -1;
+	hit->triIdx[1]	= id;
+	hit->triIdx[2]	= -1;
+}
+
+struct BvhBuildPrim
+{
+	Aabb		bound;
+	Vector3		centroid;
+	int			tri;
+};
+
+struct BvhBuildBin
+{
+	Aabb		bound;
+	int			count;
+};
+
+struct BvhSpatialBin
+{
+	Aabb		bound;				// bound of the clipped references
+	int			numEntry;			// references starting in this bin
+	int			numExit;			// references ending in this bin
+};
+
+struct BvhMortonPrim
+{
+	unsigned int	code;
+	int				prim;
+};
+
+struct BvhBuilder;
+
+// a range of primitives split into chunks for parallelFor, each chunk write its own result, which are merged after all chunks are done
+struct BvhChunkJob
+{
+	BvhBuilder*		builder;
+	int				primStart;
+	int				primEnd;
+	int				numChunk;
+
+	void	getChunkRange(int chunk, int* start, int* end) const
+	{
+		int count	= primEnd - primStart;
+		*start		= primStart + (int)((long long)count *  chunk		/ numChunk);
+		*end		= primStart + (int)((long long)count * (chunk + 1)	/ numChunk);
+	}
+};
+
+struct BvhBoundJob : BvhChunkJob
+{
+	Aabb			bound			[BVH_MAX_CHUNK];
+	Aabb			centroidBound	[BVH_MAX_CHUNK];
+};
+
+struct BvhBinJob : BvhChunkJob
+{
+	float			centroidMin	[3];
+	float			binScale	[3];		// 0 if the centroid extent of the axis is 0
+	BvhBuildBin		bins		[BVH_MAX_CHUNK][3][BVH_NUM_BIN];
+};
+
+struct BvhMortonJob : BvhChunkJob
+{
+	Vector3			centroidMin;
+	Vector3			scale;
+	BvhMortonPrim*	sortSrc;
+	BvhMortonPrim*	sortDst;
+	int				sortShift;
+	int				histogram	[BVH_MAX_CHUNK][BVH_RADIX_SIZE];		// count, then write offset
+};
+
+struct BvhSubtreeJob
+{
+	BvhBuilder*		builder;
+	int				nodeIdx;
+	int				primStart;
+	int				primEnd;
+};
+
+// each subtree is added as its own job of 1, the job index is always 0
+static void	buildSahSubtreeJob(void* userData, int);
+static void	buildLbvhSubtreeJob(void* userData, int);
+
+static int	getBin(const BvhBuildPrim& prim, int axis, float centroidMin, float binScale)
+{
+	int bin = (int)((getAxis(prim.centroid, axis) - centroidMin) * binScale);
+	return bin < 0 ? 0 : (bin >= BVH_NUM_BIN ? BVH_NUM_BIN - 1 : bin);
+}
+
+static void	computeRangeBound(const BvhBuildPrim* prims, int primStart, int primEnd, Aabb* bound, Aabb* centroidBound)
+{
+	bound->setEmpty();
+	centroidBound->setEmpty();
+	for (int i = primStart; i < primEnd; ++i)
+	{
+		bound->grow(prims[i].bound);
+		centroidBound->grow(prims[i].centroid);
+	}
+}
+
+// bin all axes in a single pass over the primitives
+static void	binRange(const BvhBuildPrim* prims, int primStart, int primEnd, const float* centroidMin, const float* binScale, BvhBuildBin (*bins)[BVH_NUM_BIN])
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		for (int i = 0; i < BVH_NUM_BIN; ++i)
+		{
+			bins[axis][i].bound.setEmpty();
+			bins[axis][i].count = 0;
+		}
+	}
+	for (int i = primStart; i < primEnd; ++i)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			BvhBuildBin& bin = bins[axis][getBin(prims[i], axis, centroidMin[axis], binScale[axis])];
+			bin.bound.grow(prims[i].bound);
+			++bin.count;
+		}
+	}
+}
+
+// find the split with the lowest SAH cost (area * count of both sides) among the bin boundaries of all axes,
+// bestAxis is -1 if the bins cannot be split
+static float	findBinSplit(const BvhBuildBin (*axisBins)[BVH_NUM_BIN], const float* binScale, int* bestAxis, int* bestSplit)
+{
+	float bestCost	= 999999999999999.0f;
+	*bestAxis		= -1;
+	*bestSplit		= 0;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (binScale[axis] == 0.0f)
+			continue;
+		const BvhBuildBin* bins = axisBins[axis];
+
+		// sweep from right to get the cost of the right side of each split
+		float	rightArea[BVH_NUM_BIN];
+		int		rightCount[BVH_NUM_BIN];
+		Aabb	box;
+		int		count	= 0;
+		box.setEmpty();
+		for (int i = BVH_NUM_BIN - 1; i > 0; --i)
+		{
+			box.grow(bins[i].bound);
+			count			+= bins[i].count;
+			rightArea[i]	= box.surfaceArea();
+			rightCount[i]	= count;
+		}
+		box.setEmpty();
+		count = 0;
+		for (int i = 0; i < BVH_NUM_BIN - 1; ++i)
+		{
+			box.grow(bins[i].bound);
+			count += bins[i].count;
+			if (count == 0 || rightCount[i + 1] == 0)
+				continue;
+			float cost = box.surfaceArea() * count + rightArea[i + 1] * rightCount[i + 1];
+			if (cost < bestCost)
+			{
+				bestCost	= cost;
+				*bestAxis	= axis;
+				*bestSplit	= i;
+			}
+		}
+	}
+	return bestCost;
+}
+
+// bounds of the part of a primitive on each side of an axis aligned plane, clamped to the reference bound, which
+// is smaller than the primitive bound if the reference is already split, a box simply split the reference bound
+static void	splitPrimBound(const BvhGeometry* geometry, int prim, const Aabb& refBound, int axis, float plane, Aabb* left, Aabb* right)
+{
+	Vector3	vtx[4];
+	int		numVtx = getPrimPolygon(*geometry, prim, vtx);
+	if (numVtx == 0)
+	{
+		*left					= refBound;
+		*right					= refBound;
+		(&left ->boundMax.x)[axis]	= plane;
+		(&right->boundMin.x)[axis]	= plane;
+		return;
+	}
+	left->setEmpty();
+	right->setEmpty();
+	for (int i = 0; i < numVtx; ++i)
+	{
+		const Vector3&	v0	= vtx[i];
+		const Vector3&	v1	= vtx[i == numVtx - 1 ? 0 : i + 1];
+		float			p0	= getAxis(v0, axis);
+		float			p1	= getAxis(v1, axis);
+		if (p0 <= plane)
+			left->grow(v0);
+		if (p0 >= plane)
+			right->grow(v0);
+		if ((p0 < plane && p1 > plane) || (p0 > plane && p1 < plane))
+		{
+			Vector3 p = v0 + (v1 - v0) * ((plane - p0) / (p1 - p0));
+			left->grow(p);
+			right->grow(p);
+		}
+	}
+	left->boundMin	= vecMax(left->boundMin	, refBound.boundMin);
+	left->boundMax	= vecMin(left->boundMax	, refBound.boundMax);
+	right->boundMin	= vecMax(right->boundMin, refBound.boundMin);
+	right->boundMax	= vecMin(right->boundMax, refBound.boundMax);
+}
+
+static bool	isBoundEmpty(const Aabb& box)
+{
+	return box.boundMin.x > box.boundMax.x || box.boundMin.y > box.boundMax.y || box.boundMin.z > box.boundMax.z;
+}
+
+static void	initPrimJob(void* userData, int chunk);
+static void	boundJob(void* userData, int chunk);
+static void	binJob(void* userData, int chunk);
+static void	mortonCodeJob(void* userData, int chunk);
+static void	radixHistogramJob(void* userData, int chunk);
+static void	radixScatterJob(void* userData, int chunk);
+static void	mortonGatherJob(void* userData, int chunk);
+
+struct BvhBuilder
+{
+	const BvhGeometry*			geometry;
+	const int*					primTri;			// triangles to build, NULL for all triangles of geometry
+	std::vector<BvhBuildPrim>	prims;
+	std::vector<BvhBuildPrim>	primsSorted;		// LBVH only, prims in Morton order
+	std::vector<BvhMortonPrim>	morton;				// LBVH only, sorted Morton code of prims
+	std::vector<BvhMortonPrim>	mortonTemp;
+	BvhNode*					nodes;				// allocated for the maximum 2 * numPrim - 1 nodes
+	std::atomic<int>			numNode;
+	ThreadPool*					threadPool;			// NULL for single threaded build
+	std::atomic<int>			jobCounter;			// subtree jobs in flight
+
+	// LBVH node bounds are computed bottom up, nodes with a child built by another job are fixed after all jobs are done
+	std::vector<int>			pendingBoundNode;
+	std::mutex					pendingBoundMutex;
+
+	// SBVH only, the references are split and duplicated, so they are copied to leafPrims in leaf order
+	std::vector<BvhBuildPrim>	leafPrims;
+	int							refBudget;			// number of references which can still be added
+	float						rootArea;
+
+	int		getNumChunk(int numPrim) const
+	{
+		if (threadPool == NULL || threadPool->getNumThread() <= 1 || numPrim < BVH_PARALLEL_MIN_PRIM)
+			return 1;
+		int numChunk = threadPool->getNumThread() * 4;
+		return numChunk < BVH_MAX_CHUNK ? numChunk : BVH_MAX_CHUNK;
+	}
+
+	void	initChunkJob(BvhChunkJob* job, int primStart, int primEnd)
+	{
+		job->builder	= this;
+		job->primStart	= primStart;
+		job->primEnd	= primEnd;
+		job->numChunk	= getNumChunk(primEnd - primStart);
+	}
+
+	void	runChunks(ThreadPoolJobFunc func, BvhChunkJob* job)
+	{
+		if (job->numChunk > 1)
+			threadPool->parallelFor(func, job, job->numChunk);
+		else
+			func(job, 0);
+	}
+
+	void	initPrims(const int* tris, int numPrim)
+	{
+		primTri = tris;
+		prims.resize(numPrim);
+		BvhChunkJob job;
+		initChunkJob(&job, 0, numPrim);
+		runChunks(initPrimJob, &job);
+	}
+
+	// nodes[0] is the root, return the number of nodes written
+	int		buildTree(BvhBuildMode mode, BvhNode* nodeBuffer)
+	{
+		int numPrim	= (int)prims.size();
+		nodes		= nodeBuffer;
+		numNode		= 1;
+		jobCounter	= 0;
+		if (mode == BvhBuildMode_Lbvh)
+		{
+			initMorton();
+			buildLbvh(0, 0, numPrim);
+			if (threadPool != NULL)
+				threadPool->wait(&jobCounter);
+			finishPendingBound();
+		}
+		else if (mode == BvhBuildMode_Sbvh)
+		{
+			std::vector<BvhBuildPrim> refs;
+			refs.swap(prims);
+			Aabb bound, centroidBound;
+			computeRangeBound(&refs[0], 0, numPrim, &bound, &centroidBound);
+			rootArea = bound.surfaceArea();
+			leafPrims.clear();
+			leafPrims.reserve(numPrim + refBudget);
+			buildSbvh(0, &refs);
+			prims.swap(leafPrims);
+		}
+		else
+		{
+			buildSah(0, 0, numPrim);
+			if (threadPool != NULL)
+				threadPool->wait(&jobCounter);
+		}
+		return numNode;
+	}
+
+	void	computeBound(int primStart, int primEnd, Aabb* bound, Aabb* centroidBound)
+	{
+		if (getNumChunk(primEnd - primStart) == 1)
+		{
+			computeRangeBound(&prims[0], primStart, primEnd, bound, centroidBound);
+			return;
+		}
+		BvhBoundJob* job = new BvhBoundJob();
+		initChunkJob(job, primStart, primEnd);
+		runChunks(boundJob, job);
+		bound->setEmpty();
+		centroidBound->setEmpty();
+		for (int i = 0; i < job->numChunk; ++i)
+		{
+			bound->grow(job->bound[i]);
+			centroidBound->grow(job->centroidBound[i]);
+		}
+		delete job;
+	}
+
+	// bins of all chunks are merged into bins
+	void	computeBins(int primStart, int primEnd, const float* centroidMin, const float* binScale, BvhBuildBin (*bins)[BVH_NUM_BIN])
+	{
+		if (getNumChunk(primEnd - primStart) == 1)
+		{
+			binRange(&prims[0], primStart, primEnd, centroidMin, binScale, bins);
+			return;
+		}
+		BvhBinJob* job = new BvhBinJob();
+		initChunkJob(job, primStart, primEnd);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			job->centroidMin[axis]	= centroidMin[axis];
+			job->binScale	[axis]	= binScale	 [axis];
+		}
+		runChunks(binJob, job);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (int i = 0; i < BVH_NUM_BIN; ++i)
+			{
+				bins[axis][i] = job->bins[0][axis][i];
+				for (int chunk = 1; chunk < job->numChunk; ++chunk)
+				{
+					bins[axis][i].bound.grow(job->bins[chunk][axis][i].bound);
+					bins[axis][i].count += job->bins[chunk][axis][i].count;
+				}
+			}
+		}
+		delete job;
+	}
+
+	// ---------------- binned SAH ----------------
+
+	void	buildSahChild(int nodeIdx, int primStart, int primEnd)
+	{
+		if (threadPool != NULL && primEnd - primStart >= BVH_TASK_MIN_PRIM)
+		{
+			BvhSubtreeJob* job	= new BvhSubtreeJob();
+			job->builder		= this;
+			job->nodeIdx		= nodeIdx;
+			job->primStart		= primStart;
+			job->primEnd		= primEnd;
+			threadPool->addJob(buildSahSubtreeJob, job, 1, &jobCounter);
+		}
+		else
+			buildSah(nodeIdx, primStart, primEnd);
+	}
+
+	void	buildSah(int nodeIdx, int primStart, int primEnd)
+	{
+		int		primCount	= primEnd - primStart;
+		Aabb	bound;
+		Aabb	centroidBound;
+		computeBound(primStart, primEnd, &bound, &centroidBound);
+		nodes[nodeIdx].boundMin			= bound.boundMin;
+		nodes[nodeIdx].boundMax			= bound.boundMax;
+		nodes[nodeIdx].childOrPrimIdx	= primStart;
+		nodes[nodeIdx].primCount		= primCount;
+		if (primCount <= 1)
+			return;
+
+		float		centroidMin[3];
+		float		binScale[3];
+		BvhBuildBin	axisBins[3][BVH_NUM_BIN];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float centroidExt	= getAxis(centroidBound.boundMax, axis) - getAxis(centroidBound.boundMin, axis);
+			centroidMin[axis]	= getAxis(centroidBound.boundMin, axis);
+			binScale	[axis]	= centroidExt > 0.0f ? BVH_NUM_BIN / centroidExt : 0.0f;
+		}
+		computeBins(primStart, primEnd, centroidMin, binScale, axisBins);
+
+		int		bestAxis;
+		int		bestSplit;
+		float	bestCost		= findBinSplit(axisBins, binScale, &bestAxis, &bestSplit);
+
+		int primMid;
+		if (bestAxis < 0)
+		{
+			// all centroids are at the same position, split in the middle if too many triangles
+			if (primCount <= BVH_MAX_LEAF_SIZE)
+				return;
+			primMid = primStart + primCount / 2;
+		}
+		else
+		{
+			float leafCost	= BVH_COST_INTERSECT * primCount;
+			float splitCost	= BVH_COST_TRAVERSAL + BVH_COST_INTERSECT * bestCost / bound.surfaceArea();
+			if (primCount <= BVH_MAX_LEAF_SIZE && leafCost <= splitCost)
+				return;
+
+			primMid = primStart;
+			for (int i = primStart; i < primEnd; ++i)
+			{
+				if (getBin(prims[i], bestAxis, centroidMin[bestAxis], binScale[bestAxis]) <= bestSplit)
+				{
+					BvhBuildPrim tmp	= prims[i];
+					prims[i]			= prims[primMid];
+					prims[primMid]		= tmp;
+					++primMid;
+				}
+			}
+		}
+
+		int childIdx = numNode.fetch_add(2);
+		nodes[nodeIdx].childOrPrimIdx	= childIdx;
+		nodes[nodeIdx].primCount		= 0;
+		buildSahChild(childIdx    , primStart, primMid);
+		buildSah	 (childIdx + 1, primMid  , primEnd);
+	}
+
+	// ---------------- SBVH ----------------
+
+	// chop the references into the spatial bins they overlap, return the split plane with the lowest SAH cost,
+	// with the bound and the reference count of both sides
+	float	findSpatialSplit(const std::vector<BvhBuildPrim>& refs, const Aabb& bound, int* bestAxis, float* bestPlane,
+							 Aabb* bestLeft, Aabb* bestRight, int* bestNumLeft, int* bestNumRight) const
+	{
+		float bestCost	= 999999999999999.0f;
+		*bestAxis		= -1;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float boundMin	= getAxis(bound.boundMin, axis);
+			float extent	= getAxis(bound.boundMax, axis) - boundMin;
+			if (extent <= 0.0f)
+				continue;
+			float binSize	= extent / BVH_NUM_BIN;
+			float binScale	= BVH_NUM_BIN / extent;
+
+			BvhSpatialBin bins[BVH_NUM_BIN];
+			for (int i = 0; i < BVH_NUM_BIN; ++i)
+			{
+				bins[i].bound.setEmpty();
+				bins[i].numEntry	= 0;
+				bins[i].numExit		= 0;
+			}
+			for (int i = 0; i < (int)refs.size(); ++i)
+			{
+				const BvhBuildPrim& ref = refs[i];
+				int first	= (int)((getAxis(ref.bound.boundMin, axis) - boundMin) * binScale);
+				int last	= (int)((getAxis(ref.bound.boundMax, axis) - boundMin) * binScale);
+				first		= first < 0 ? 0 : (first >= BVH_NUM_BIN ? BVH_NUM_BIN - 1 : first);
+				last		= last < first ? first : (last >= BVH_NUM_BIN ? BVH_NUM_BIN - 1 : last);
+				Aabb rest	= ref.bound;
+				for (int bin = first; bin < last; ++bin)
+				{
+					Aabb left, right;
+					splitPrimBound(geometry, ref.tri, rest, axis, boundMin + binSize * (bin + 1), &left, &right);
+					bins[bin].bound.grow(left);
+					rest = right;
+				}
+				bins[last].bound.grow(rest);
+				++bins[first].numEntry;
+				++bins[last	].numExit;
+			}
+
+			Aabb	rightBound[BVH_NUM_BIN];
+			int		rightCount[BVH_NUM_BIN];
+			Aabb	box;
+			int		count	= 0;
+			box.setEmpty();
+			for (int i = BVH_NUM_BIN - 1; i > 0; --i)
+			{
+				box.grow(bins[i].bound);
+				count			+= bins[i].numExit;
+				rightBound[i]	= box;
+				rightCount[i]	= count;
+			}
+			box.setEmpty();
+			count = 0;
+			for (int i = 0; i < BVH_NUM_BIN - 1; ++i)
+			{
+				box.grow(bins[i].bound);
+				count += bins[i].numEntry;
+				if (count == 0 || rightCount[i + 1] == 0)
+					continue;
+				float cost = box.surfaceArea() * count + rightBound[i + 1].surfaceArea() * rightCount[i + 1];
+				if (cost < bestCost)
+				{
+					bestCost		= cost;
+					*bestAxis		= axis;
+					*bestPlane		= boundMin + binSize * (i + 1);
+					*bestLeft		= box;
+					*bestRight		= rightBound[i + 1];
+					*bestNumLeft	= count;
+					*bestNumRight	= rightCount[i + 1];
+				}
+			}
+		}
+		return bestCost;
+	}
+
+	// references crossing the plane are split if it is cheaper than moving them to 1 side and the budget allow,
+	// the side bounds and counts are from findSpatialSplit() and updated as references are moved
+	void	partitionSpatial(const std::vector<BvhBuildPrim>& refs, int axis, float plane, Aabb leftBound, Aabb rightBound, int numLeft, int numRight,
+							 std::vector<BvhBuildPrim>* left, std::vector<BvhBuildPrim>* right)
+	{
+		for (int i = 0; i < (int)refs.size(); ++i)
+		{
+			const BvhBuildPrim& ref = refs[i];
+			if (getAxis(ref.bound.boundMax, axis) <= plane)
+			{
+				left->push_back(ref);
+				continue;
+			}
+			if (getAxis(ref.bound.boundMin, axis) >= plane)
+			{
+				right->push_back(ref);
+				continue;
+			}
+
+			Aabb leftPart, rightPart;
+			splitPrimBound(geometry, ref.tri, ref.bound, axis, plane, &leftPart, &rightPart);
+			Aabb leftUnion	= leftBound;
+			Aabb rightUnion	= rightBound;
+			leftUnion.grow(ref.bound);
+			rightUnion.grow(ref.bound);
+			float splitCost	= leftBound.surfaceArea() * numLeft + rightBound.surfaceArea() * numRight;
+			float leftCost	= leftUnion.surfaceArea() * numLeft + rightBound.surfaceArea() * (numRight - 1);
+			float rightCost	= leftBound.surfaceArea() * (numLeft - 1) + rightUnion.surfaceArea() * numRight;
+			bool  isSplit	= refBudget > 0 && splitCost < leftCost && splitCost < rightCost && !isBoundEmpty(leftPart) && !isBoundEmpty(rightPart);
+			if (isSplit)
+			{
+				BvhBuildPrim prim	= ref;
+				prim.bound			= leftPart;
+				prim.centroid		= (leftPart.boundMin + leftPart.boundMax) * 0.5f;
+				left->push_back(prim);
+				prim.bound			= rightPart;
+				prim.centroid		= (rightPart.boundMin + rightPart.boundMax) * 0.5f;
+				right->push_back(prim);
+				--refBudget;
+			}
+			else if (leftCost <= rightCost)
+			{
+				left->push_back(ref);
+				leftBound	= leftUnion;
+				--numRight;
+			}
+			else
+			{
+				right->push_back(ref);
+				rightBound	= rightUnion;
+				--numLeft;
+			}
+		}
+	}
+
+	// SAH cost of a child, not divided by the parent area, as the cheaper of a leaf and its best object split
+	float	computeChildCost(const std::vector<BvhBuildPrim>& refs) const
+	{
+		int		primCount	= (int)refs.size();
+		Aabb	bound;
+		Aabb	centroidBound;
+		computeRangeBound(&refs[0], 0, primCount, &bound, &centroidBound);
+		float	area		= bound.surfaceArea();
+		float	leafCost	= area * BVH_COST_INTERSECT * primCount;
+		if (primCount <= 1)
+			return leafCost;
+
+		float		centroidMin[3];
+		float		binScale[3];
+		BvhBuildBin	axisBins[3][BVH_NUM_BIN];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float centroidExt	= getAxis(centroidBound.boundMax, axis) - getAxis(centroidBound.boundMin, axis);
+			centroidMin[axis]	= getAxis(centroidBound.boundMin, axis);
+			binScale	[axis]	= centroidExt > 0.0f ? BVH_NUM_BIN / centroidExt : 0.0f;
+		}
+		binRange(&refs[0], 0, primCount, centroidMin, binScale, axisBins);
+		int		bestAxis;
+		int		bestSplit;
+		float	bestCost	= findBinSplit(axisBins, binScale, &bestAxis, &bestSplit);
+		float	splitCost	= area * BVH_COST_TRAVERSAL + BVH_COST_INTERSECT * bestCost;
+		return bestAxis >= 0 && splitCost < leafCost ? splitCost : leafCost;
+	}
+
+	void	buildSbvh(int nodeIdx, std::vector<BvhBuildPrim>* refs)
+	{
+		int		primCount	= (int)refs->size();
+		Aabb	bound;
+		Aabb	centroidBound;
+		computeRangeBound(&(*refs)[0], 0, primCount, &bound, &centroidBound);
+		nodes[nodeIdx].boundMin			= bound.boundMin;
+		nodes[nodeIdx].boundMax			= bound.boundMax;
+		nodes[nodeIdx].childOrPrimIdx	= (int)leafPrims.size();
+		nodes[nodeIdx].primCount		= primCount;
+
+		// object split, same as buildSah()
+		float		centroidMin[3];
+		float		binScale[3];
+		BvhBuildBin	axisBins[3][BVH_NUM_BIN];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float centroidExt	= getAxis(centroidBound.boundMax, axis) - getAxis(centroidBound.boundMin, axis);
+			centroidMin[axis]	= getAxis(centroidBound.boundMin, axis);
+			binScale	[axis]	= centroidExt > 0.0f ? BVH_NUM_BIN / centroidExt : 0.0f;
+		}
+		int		objectAxis	= -1;
+		int		objectSplit	= 0;
+		float	objectCost	= 999999999999999.0f;
+		if (primCount > 1)
+		{
+			binRange(&(*refs)[0], 0, primCount, centroidMin, binScale, axisBins);
+			objectCost = findBinSplit(axisBins, binScale, &objectAxis, &objectSplit);
+		}
+
+		// spatial split, only when the children of the object split overlap
+		int		spatialAxis	= -1;
+		float	spatialPlane;
+		float	spatialCost	= 999999999999999.0f;
+		Aabb	spatialLeft, spatialRight;
+		int		spatialNumLeft, spatialNumRight;
+		if (primCount > 1 && refBudget > 0)
+		{
+			float overlapArea = objectAxis < 0 ? rootArea : 0.0f;
+			if (objectAxis >= 0)
+			{
+				Aabb left, right;
+				left.setEmpty();
+				right.setEmpty();
+				for (int i = 0; i < BVH_NUM_BIN; ++i)
+					(i <= objectSplit ? left : right).grow(axisBins[objectAxis][i].bound);
+				Aabb overlap;
+				overlap.boundMin	= vecMax(left.boundMin, right.boundMin);
+				overlap.boundMax	= vecMin(left.boundMax, right.boundMax);
+				overlapArea			= isBoundEmpty(overlap) ? 0.0f : overlap.surfaceArea();
+			}
+			if (overlapArea > rootArea * BVH_SBVH_MIN_OVERLAP)
+				spatialCost = findSpatialSplit(*refs, bound, &spatialAxis, &spatialPlane, &spatialLeft, &spatialRight, &spatialNumLeft, &spatialNumRight);
+		}
+
+		float bestCost		= objectCost < spatialCost ? objectCost : spatialCost;
+		bool  isSplitFound	= objectAxis >= 0 || spatialAxis >= 0;
+		float leafCost		= BVH_COST_INTERSECT * primCount;
+		float splitCost		= BVH_COST_TRAVERSAL + BVH_COST_INTERSECT * bestCost / bound.surfaceArea();
+		if (primCount <= 1 || (primCount <= BVH_MAX_LEAF_SIZE && (!isSplitFound || leafCost <= splitCost)))
+		{
+			leafPrims.insert(leafPrims.end(), refs->begin(), refs->end());
+			return;
+		}
+
+		// object split, or the middle if all centroids are at the same position
+		std::vector<BvhBuildPrim> left;
+		std::vector<BvhBuildPrim> right;
+		for (int i = 0; i < primCount; ++i)
+		{
+			bool isLeft = objectAxis >= 0 ?	getBin((*refs)[i], objectAxis, centroidMin[objectAxis], binScale[objectAxis]) <= objectSplit :
+											i < primCount / 2;
+			(isLeft ? left : right).push_back((*refs)[i]);
+		}
+
+		// the SAH cost treats the children as leaves, so a spatial split can be cheaper than the object split at this node
+		// but make the subtrees below more expensive (e.g. cutting the sphere of cornell_sphere in half at the root),
+		// it is only kept when it is still cheaper with the best object split of its children
+		if (spatialAxis >= 0 && spatialCost < objectCost)
+		{
+			std::vector<BvhBuildPrim>	spatialRefLeft;
+			std::vector<BvhBuildPrim>	spatialRefRight;
+			int							prevRefBudget = refBudget;
+			partitionSpatial(*refs, spatialAxis, spatialPlane, spatialLeft, spatialRight, spatialNumLeft, spatialNumRight, &spatialRefLeft, &spatialRefRight);
+			if (!spatialRefLeft.empty() && !spatialRefRight.empty() &&
+				computeChildCost(spatialRefLeft) + computeChildCost(spatialRefRight) < computeChildCost(left) + computeChildCost(right))
+			{
+				left.swap(spatialRefLeft);
+				right.swap(spatialRefRight);
+			}
+			else
+				refBudget = prevRefBudget;
+		}
+		std::vector<BvhBuildPrim>().swap(*refs);
+
+		int childIdx = numNode.fetch_add(2);
+		nodes[nodeIdx].childOrPrimIdx	= childIdx;
+		nodes[nodeIdx].primCount		= 0;
+		buildSbvh(childIdx	  , &left);
+		buildSbvh(childIdx + 1, &right);
+	}
+
+	// ---------------- LBVH ----------------
+
+	void	sortMorton(BvhMortonJob* job)
+	{
+		// LSD radix sort, each chunk scatter its primitives in order, so every pass is stable
+		mortonTemp.resize(morton.size());
+		job->sortSrc = &morton[0];
+		job->sortDst = &mortonTemp[0];
+		for (job->sortShift = 0; job->sortShift < 30; job->sortShift += BVH_RADIX_BIT)
+		{
+			runChunks(radixHistogramJob, job);
+			int offset = 0;
+			for (int digit = 0; digit < BVH_RADIX_SIZE; ++digit)
+			{
+				for (int chunk = 0; chunk < job->numChunk; ++chunk)
+				{
+					int count						= job->histogram[chunk][digit];
+					job->histogram[chunk][digit]	= offset;
+					offset							+= count;
+				}
+			}
+			runChunks(radixScatterJob, job);
+			BvhMortonPrim* tmp	= job->sortSrc;
+			job->sortSrc		= job->sortDst;
+			job->sortDst		= tmp;
+		}
+		if (job->sortSrc != &morton[0])
+			morton.swap(mortonTemp);
+	}
+
+	// sort prims by the 30 bit Morton code of the centroid
+	void	initMorton()
+	{
+		int numPrim = (int)prims.size();
+		Aabb bound, centroidBound;
+		computeBound(0, numPrim, &bound, &centroidBound);
+
+		BvhMortonJob*	job		= new BvhMortonJob();
+		Vector3			extent	= centroidBound.boundMax - centroidBound.boundMin;
+		initChunkJob(job, 0, numPrim);
+		job->centroidMin		= centroidBound.boundMin;
+		job->scale				= Vector3(	extent.x > 0.0f ? 1023.0f / extent.x : 0.0f,
+											extent.y > 0.0f ? 1023.0f / extent.y : 0.0f,
+											extent.z > 0.0f ? 1023.0f / extent.z : 0.0f);
+		morton.resize(numPrim);
+		runChunks(mortonCodeJob, job);
+		sortMorton(job);
+
+		primsSorted.resize(numPrim);
+		runChunks(mortonGatherJob, job);
+		prims.swap(primsSorted);
+		delete job;
+	}
+
+	// return false if the node bound is not computed yet because part of the subtree is built by another job
+	bool	buildLbvhChild(int nodeIdx, int primStart, int primEnd)
+	{
+		if (threadPool != NULL && primEnd - primStart >= BVH_TASK_MIN_PRIM)
+		{
+			BvhSubtreeJob* job	= new BvhSubtreeJob();
+			job->builder		= this;
+			job->nodeIdx		= nodeIdx;
+			job->primStart		= primStart;
+			job->primEnd		= primEnd;
+			threadPool->addJob(buildLbvhSubtreeJob, job, 1, &jobCounter);
+			return false;
+		}
+		return buildLbvh(nodeIdx, primStart, primEnd);
+	}
+
+	bool	buildLbvh(int nodeIdx, int primStart, int primEnd)
+	{
+		int primCount = primEnd - primStart;
+		if (primCount <= BVH_MAX_LEAF_SIZE)
+		{
+			Aabb bound;
+			bound.setEmpty();
+			for (int i = primStart; i < primEnd; ++i)
+				bound.grow(prims[i].bound);
+			nodes[nodeIdx].boundMin			= bound.boundMin;
+			nodes[nodeIdx].boundMax			= bound.boundMax;
+			nodes[nodeIdx].childOrPrimIdx	= primStart;
+			nodes[nodeIdx].primCount		= primCount;
+			return true;
+		}
+
+		// split at the highest bit which differ within the range, the codes having that bit set form the upper part
+		int				primMid;
+		unsigned int	codeFirst	= morton[primStart	].code;
+		unsigned int	codeLast	= morton[primEnd - 1].code;
+		if (codeFirst == codeLast)
+			primMid = primStart + primCount / 2;
+		else
+		{
+			unsigned int splitBit = codeFirst ^ codeLast;
+			while (splitBit & (splitBit - 1))
+				splitBit &= splitBit - 1;
+			int lo = primStart;
+			int hi = primEnd - 1;
+			while (lo + 1 < hi)
+			{	// morton[lo] has the bit cleared, morton[hi] has the bit set
+				int mid = (lo + hi) / 2;
+				if (morton[mid].code & splitBit)
+					hi = mid;
+				else
+					lo = mid;
+			}
+			primMid = hi;
+		}
+
+		int childIdx = numNode.fetch_add(2);
+		nodes[nodeIdx].childOrPrimIdx	= childIdx;
+		nodes[nodeIdx].primCount		= 0;
+		bool isChild0Done				= buildLbvhChild(childIdx    , primStart, primMid);
+		bool isChild1Done				= buildLbvh		(childIdx + 1, primMid  , primEnd);
+		if (!isChild0Done || !isChild1Done)
+		{
+			std::lock_guard<std::mutex> lock(pendingBoundMutex);
+			pendingBoundNode.push_back(nodeIdx);
+			return false;
+		}
+		updateInteriorBound(nodeIdx);
+		return true;
+	}
+
+	void	updateInteriorBound(int nodeIdx)
+	{
+		const BvhNode* child = &nodes[nodes[nodeIdx].childOrPrimIdx];
+		nodes[nodeIdx].boundMin = vecMin(child[0].boundMin, child[1].boundMin);
+		nodes[nodeIdx].boundMax = vecMax(child[0].boundMax, child[1].boundMax);
+	}
+
+	void	finishPendingBound()
+	{
+		// children are always allocated after their parent, so process from the largest node index
+		std::sort(pendingBoundNode.begin(), pendingBoundNode.end());
+		for (int i = (int)pendingBoundNode.size() - 1; i >= 0; --i)
+			updateInteriorBound(pendingBoundNode[i]);
+		pendingBoundNode.clear();
+	}
+};
+
+static void	buildSahSubtreeJob(void* userData, int)
+{
+	BvhSubtreeJob* job = (BvhSubtreeJob*)userData;
+	job->builder->buildSah(job->nodeIdx, job->primStart, job->primEnd);
+	delete job;
+}
+
+static void	buildLbvhSubtreeJob(void* userData, int)
+{
+	BvhSubtreeJob* job = (BvhSubtreeJob*)userData;
+	job->builder->buildLbvh(job->nodeIdx, job->primStart, job->primEnd);
+	delete job;
+}
+
+static void	initPrimJob(void* userData, int chunk)
+{
+	BvhChunkJob*		job			= (BvhChunkJob*)userData;
+	const BvhGeometry*	geometry	= job->builder->geometry;
+	int start, end;
+	job->getChunkRange(chunk, &start, &end);
+	for (int i = start; i < end; ++i)
+	{
+		BvhBuildPrim&	prim	= job->builder->prims[i];
+		prim.tri				= job->builder->primTri != NULL ? job->builder->primTri[i] : bvhGetPrimId(*geometry, i);
+		bvhGetPrimBound(*geometry, prim.tri, &prim.bound);
+		prim.centroid = (prim.bound.boundMin + prim.bound.boundMax) * 0.5f;
+	}
+}
+
+static void	boundJob(void* userData, int chunk)
+{
+	BvhBoundJob* job = (BvhBoundJob*)userData;
+	int start, end;
+	job->getChunkRange(chunk, &start, &end);
+	computeRangeBound(&job->builder->prims[0], start, end, &job->bound[chunk], &job->centroidBound[chunk]);
+}
+
+static void	binJob(void* userData, int chunk)
+{
+	BvhBinJob* job = (BvhBinJob*)userData;
+	int start, end;
+	job->getChunkRange(chunk, &start, &end);
+	binRange(&job->builder->prims[0], start, end, job->centroidMin, job->binScale, job->bins[chunk]);
+}
+
+static void	mortonCodeJob(void* userData, int chunk)
+{
+	BvhMortonJob*		job		= (BvhMortonJob*)userData;
+	const BvhBuildPrim*	prims	= &job->builder->prims[0];
+	BvhMortonPrim*		morton	= &job->builder->morton[0];
+	int start, end;
+	job->getChunkRange(chunk, &start, &end);
+	for (int i = start; i < end; ++i)
+	{
+		morton[i].code = computeMortonCode(prims[i].centroid, job->centroidMin, job->scale);
+		morton[i].prim = i;
+	}
+}
+
+static void	radixHistogramJob(void* userData, int chunk)
+{
+	BvhMortonJob*	job			= (BvhMortonJob*)userData;
+	int*			histogram	= job->histogram[chunk];
+	int start, end;
+	job->getChunkRange(chunk, &start, &end);
+	for (int i = 0; i < BVH_RADIX_SIZE; ++i)
+		histogram[i] = 0;
+	for (int i = start; i < end; ++i)
+		++histogram[(job->sortSrc[i].code >> job->sortShift) & (BVH_RADIX_SIZE - 1)];
+}
+
+static void	radixScatterJob(void* userData, int chunk)
+{
+	BvhMortonJob*	job			= (BvhMortonJob*)userData;
+	int*			offset		= job->histogram[chunk];
+	int start, end;
+	job->getChunkRange(chunk, &start, &end);
+	for (int i = start; i < end; ++i)
+	{
+		const BvhMortonPrim& prim = job->sortSrc[i];
+		job->sortDst[offset[(prim.code >> job->sortShift) & (BVH_RADIX_SIZE - 1)]++] = prim;
+	}
+}
+
+static void	mortonGatherJob(void* userData, int chunk)
+{
+	BvhChunkJob*	job		= (BvhChunkJob*)userData;
+	BvhBuilder*		builder	= job->builder;
+	int start, end;
+	job->getChunkRange(chunk, &start, &end);
+	for (int i = start; i < end; ++i)
+		builder->primsSorted[i] = builder->prims[builder->morton[i].prim];
+}
+
+Bvh::Bvh()
+{
+	m_geometry.triPos		= NULL;
+	m_geometry.triIdx		= NULL;
+	m_geometry.triMeshIdx	= NULL;
+	m_geometry.quads		= NULL;
+	m_geometry.boxes		= NULL;
+	m_geometry.numTri		= 0;
+	m_geometry.numQuad		= 0;
+	m_geometry.numBox		= 0;
+	m_buildMode				= BvhBuildMode_Sah;
+	m_layout				= BvhLayout_DepthFirst;
+	m_spatialSplitBudget	= 0.3f;
+	m_usePrefetch			= true;
+	m_topCost				= 0.0f;
+	m_topBuildCost			= 0.0f;
+	m_maxDepth				= 0;
+}
+
+void	Bvh::clear()
+{
+	m_nodes.clear();
+	m_primTri.clear();
+	m_subtrees.clear();
+	m_topNodes.clear();
+	m_parents.clear();
+	m_maxDepth			= 0;
+	m_geometry.numTri	= 0;
+	m_geometry.numQuad	= 0;
+	m_geometry.numBox	= 0;
+}
+
+void	Bvh::build(const BvhGeometry& geometry, BvhBuildMode mode, ThreadPool* threadPool)
+{
+	clear();
+	m_geometry	= geometry;
+	m_buildMode	= mode;
+	int numPrim	= bvhGetNumPrim(geometry);
+	if (numPrim <= 0)
+		return;
+
+	BvhBuilder* builder	= new BvhBuilder();
+	builder->geometry	= &m_geometry;
+	builder->threadPool	= threadPool != NULL && threadPool->getNumThread() > 1 ? threadPool : NULL;
+	builder->refBudget	= mode == BvhBuildMode_Sbvh ? (int)(numPrim * m_spatialSplitBudget) : 0;
+	builder->initPrims(NULL, numPrim);
+	m_nodes.resize((numPrim + builder->refBudget) * 2 - 1);
+	m_nodes.resize(builder->buildTree(mode, &m_nodes[0]));
+
+	// SBVH may reference a primitive from several leaves
+	int numRef			= (int)builder->prims.size();
+	m_primTri.resize(numRef);
+	for (int i = 0; i < numRef; ++i)
+		m_primTri[i] = builder->prims[i].tri;
+	delete builder;
+	if (m_layout != BvhLayout_BuildOrder)
+		reorderNodes();
+	initSubtrees(false);
+	initParents();
+}
+
+static float	getNodeArea(const BvhNode& node)
+{
+	Aabb box;
+	box.boundMin	= node.boundMin;
+	box.boundMax	= node.boundMax;
+	return box.surfaceArea();
+}
+
+static float	getNodeCost(const BvhNode& node)
+{
+	return getNodeArea(node) * (node.primCount > 0 ? BVH_COST_INTERSECT * node.primCount : BVH_COST_TRAVERSAL);
+}
+
+void	Bvh::initSubtrees(bool isKeepBuildCost)
+{
+	std::vector<BvhSubtree> prevSubtrees;
+	prevSubtrees.swap(m_subtrees);
+	m_topNodes.clear();
+	if (m_nodes.empty())
+		return;
+
+	// depth first, so the subtree order only depend on the nodes above them
+	int stackNode [BVH_SUBTREE_DEPTH * 2 + 2];
+	int stackDepth[BVH_SUBTREE_DEPTH * 2 + 2];
+	int stackSize	= 1;
+	stackNode [0]	= 0;
+	stackDepth[0]	= 0;
+	while (stackSize > 0)
+	{
+		--stackSize;
+		int				nodeIdx	= stackNode [stackSize];
+		int				depth	= stackDepth[stackSize];
+		const BvhNode&	node	= m_nodes[nodeIdx];
+		if (node.primCount > 0 || depth == BVH_SUBTREE_DEPTH)
+		{
+			// child 0 always hold the lower part of the triangle range
+			int firstLeaf	= nodeIdx;
+			int lastLeaf	= nodeIdx;
+			while (m_nodes[firstLeaf].primCount == 0)
+				firstLeaf	= m_nodes[firstLeaf].childOrPrimIdx;
+			while (m_nodes[lastLeaf	].primCount == 0)
+				lastLeaf	= m_nodes[lastLeaf	].childOrPrimIdx + 1;
+
+			BvhSubtree subtree;
+			subtree.nodeIdx		= nodeIdx;
+			subtree.primStart	= m_nodes[firstLeaf].childOrPrimIdx;
+			subtree.primCount	= m_nodes[lastLeaf].childOrPrimIdx + m_nodes[lastLeaf].primCount - subtree.primStart;
+			subtree.cost		= computeSubtreeCost(nodeIdx);
+			subtree.buildCost	= subtree.cost;
+			m_subtrees.push_back(subtree);
+			continue;
+		}
+		m_topNodes.push_back(nodeIdx);
+		stackNode [stackSize	]	= node.childOrPrimIdx + 1;
+		stackDepth[stackSize	]	= depth + 1;
+		stackNode [stackSize + 1]	= node.childOrPrimIdx;
+		stackDepth[stackSize + 1]	= depth + 1;
+		stackSize += 2;
+	}
+
+	if (isKeepBuildCost && prevSubtrees.size() == m_subtrees.size())
+	{
+		for (int i = 0; i < (int)m_subtrees.size(); ++i)
+			m_subtrees[i].buildCost = prevSubtrees[i].buildCost;
+	}
+	else
+	{
+		m_topCost = 0.0f;
+		for (int i = 0; i < (int)m_topNodes.size(); ++i)
+			m_topCost += getNodeCost(m_nodes[m_topNodes[i]]);
+		m_topBuildCost = m_topCost;
+	}
+}
+
+void	Bvh::initParents()
+{
+	m_parents.resize(m_nodes.size());
+	m_maxDepth = computeMaxDepth();
+	if (m_nodes.empty())
+		return;
+	m_parents[0] = -1;
+	for (int i = 0; i < (int)m_nodes.size(); ++i)
+	{
+		if (m_nodes[i].primCount > 0)
+			continue;
+		m_parents[m_nodes[i].childOrPrimIdx		] = i;
+		m_parents[m_nodes[i].childOrPrimIdx + 1	] = i;
+	}
+}
+
+float	Bvh::computeSubtreeCost(int nodeIdx) const
+{
+	const BvhNode& node = m_nodes[nodeIdx];
+	if (node.primCount > 0)
+		return getNodeCost(node);
+	return getNodeCost(node) + computeSubtreeCost(node.childOrPrimIdx) + computeSubtreeCost(node.childOrPrimIdx + 1);
+}
+
+float	Bvh::refitNode(int nodeIdx)
+{
+	BvhNode& node = m_nodes[nodeIdx];
+	if (node.primCount > 0)
+	{
+		Aabb bound;
+		bound.setEmpty();
+		for (int i = node.childOrPrimIdx; i < node.childOrPrimIdx + node.primCount; ++i)
+		{
+			Aabb primBound;
+			bvhGetPrimBound(m_geometry, m_primTri[i], &primBound);
+			bound.grow(primBound);
+		}
+		node.boundMin	= bound.boundMin;
+		node.boundMax	= bound.boundMax;
+		return getNodeCost(node);
+	}
+
+	int		childIdx	= node.childOrPrimIdx;
+	float	cost		= refitNode(childIdx) + refitNode(childIdx + 1);
+	node.boundMin		= vecMin(m_nodes[childIdx].boundMin, m_nodes[childIdx + 1].boundMin);
+	node.boundMax		= vecMax(m_nodes[childIdx].boundMax, m_nodes[childIdx + 1].boundMax);
+	return cost + getNodeCost(node);
+}
+
+static void	refitSubtreeJob(void* userData, int jobIdx)
+{
+	Bvh*		bvh		= (Bvh*)userData;
+	BvhSubtree&	subtree	= bvh->m_subtrees[jobIdx];
+	subtree.cost		= bvh->refitNode(subtree.nodeIdx);
+}
+
+void	Bvh::refit(ThreadPool* threadPool)
+{
+	if (m_nodes.empty())
+		return;
+	if (threadPool != NULL && threadPool->getNumThread() > 1)
+		threadPool->parallelFor(refitSubtreeJob, this, (int)m_subtrees.size());
+	else
+		for (int i = 0; i < (int)m_subtrees.size(); ++i)
+			refitSubtreeJob(this, i);
+
+	// the nodes above the subtrees are in depth first order, so children are updated before their parent in reverse order
+	m_topCost = 0.0f;
+	for (int i = (int)m_topNodes.size() - 1; i >= 0; --i)
+	{
+		BvhNode&	node		= m_nodes[m_topNodes[i]];
+		int			childIdx	= node.childOrPrimIdx;
+		node.boundMin			= vecMin(m_nodes[childIdx].boundMin, m_nodes[childIdx + 1].boundMin);
+		node.boundMax			= vecMax(m_nodes[childIdx].boundMax, m_nodes[childIdx + 1].boundMax);
+		m_topCost				+= getNodeCost(node);
+	}
+}
+
+BvhBuildMode	Bvh::getRangeBuildMode() const
+{
+	// a spatial split subtree may have more references than its range can hold
+	return m_buildMode == BvhBuildMode_Sbvh ? BvhBuildMode_Sah : m_buildMode;
+}
+
+void	Bvh::rebuildSubtree(BvhSubtree* subtree, ThreadPool* threadPool)
+{
+	BvhBuilder* builder	= new BvhBuilder();
+	builder->geometry	= &m_geometry;
+	builder->threadPool	= threadPool != NULL && threadPool->getNumThread() > 1 ? threadPool : NULL;
+	builder->initPrims(&m_primTri[subtree->primStart], subtree->primCount);
+	std::vector<BvhNode> nodes(subtree->primCount * 2 - 1);
+	int numNode			= builder->buildTree(getRangeBuildMode(), &nodes[0]);
+
+	// the root replace the subtree root, the other nodes are appended, the old nodes are removed by reorderNodes()
+	int nodeOffset		= (int)m_nodes.size() - 1;
+	m_nodes.reserve(m_nodes.size() + numNode - 1);
+	for (int i = 0; i < numNode; ++i)
+	{
+		BvhNode node		= nodes[i];
+		node.childOrPrimIdx	+= node.primCount > 0 ? subtree->primStart : nodeOffset;
+		if (i == 0)
+			m_nodes[subtree->nodeIdx] = node;
+		else
+			m_nodes.push_back(node);
+	}
+	for (int i = 0; i < subtree->primCount; ++i)
+		m_primTri[subtree->primStart + i] = builder->prims[i].tri;
+	delete builder;
+
+	subtree->cost		= computeSubtreeCost(subtree->nodeIdx);
+	subtree->buildCost	= subtree->cost;
+}
+
+// first child index of the reachable sibling pairs in depth first order, the children of a node are visited
+// in index order, or the child with the larger surface area first
+static void	orderPairsDepthFirst(const BvhNode* nodes, bool isLargerFirst, std::vector<int>* pairOrder)
+{
+	std::vector<int> stack(1, 0);
+	while (!stack.empty())
+	{
+		int nodeIdx = stack.back();
+		stack.pop_back();
+		if (nodes[nodeIdx].primCount > 0)
+			continue;
+		int		childIdx		= nodes[nodeIdx].childOrPrimIdx;
+		bool	isChild1First	= isLargerFirst && getNodeArea(nodes[childIdx + 1]) > getNodeArea(nodes[childIdx]);
+		pairOrder->push_back(childIdx);
+		stack.push_back(isChild1First ? childIdx	 : childIdx + 1);
+		stack.push_back(isChild1First ? childIdx + 1 : childIdx	);
+	}
+}
+
+// the pairs are grouped into page sized treelets, each treelet is grown from its root by the pair whose parent has
+// the largest surface area (i.e. most likely visited), the nodes left on the frontier are the roots of the next treelets
+static void	orderPairsTreelet(const BvhNode* nodes, std::vector<int>* pairOrder)
+{
+	std::vector<int>						roots(1, 0);		// interior nodes whose children are not placed yet
+	std::vector<std::pair<float, int> >		frontier;			// max heap of (surface area, node)
+	while (!roots.empty())
+	{
+		int rootIdx = roots.back();
+		roots.pop_back();
+		frontier.clear();
+		frontier.push_back(std::make_pair(getNodeArea(nodes[rootIdx]), rootIdx));
+		for (int numPair = 0; numPair < BVH_TREELET_SIZE && !frontier.empty(); ++numPair)
+		{
+			std::pop_heap(frontier.begin(), frontier.end());
+			int childIdx = nodes[frontier.back().second].childOrPrimIdx;
+			frontier.pop_back();
+			pairOrder->push_back(childIdx);
+			for (int i = childIdx; i < childIdx + 2; ++i)
+			{
+				if (nodes[i].primCount > 0)
+					continue;
+				frontier.push_back(std::make_pair(getNodeArea(nodes[i]), i));
+				std::push_heap(frontier.begin(), frontier.end());
+			}
+		}
+
+		// the largest remaining node start the next treelet
+		std::sort(frontier.begin(), frontier.end());
+		for (int i = 0; i < (int)frontier.size(); ++i)
+			roots.push_back(frontier[i].second);
+	}
+}
+
+void	Bvh::reorderNodes()
+{
+	// nodes are moved in sibling pairs, so the root stay at index 0 and every pair start at an odd index
+	std::vector<int> pairOrder;
+	pairOrder.reserve(m_nodes.size() / 2);
+	if (m_nodes[0].primCount == 0)
+	{
+		if (m_layout == BvhLayout_Treelet)
+			orderPairsTreelet(&m_nodes[0], &pairOrder);
+		else
+			orderPairsDepthFirst(&m_nodes[0], m_layout == BvhLayout_DepthFirst, &pairOrder);
+	}
+
+	std::vector<int> newChildIdx(m_nodes.size(), -1);
+	for (int i = 0; i < (int)pairOrder.size(); ++i)
+		newChildIdx[pairOrder[i]] = i * 2 + 1;
+	BvhNodeArray nodes(pairOrder.size() * 2 + 1);
+	nodes[0] = m_nodes[0];
+	for (int i = 0; i < (int)pairOrder.size(); ++i)
+	{
+		nodes[i * 2 + 1] = m_nodes[pairOrder[i]	 ];
+		nodes[i * 2 + 2] = m_nodes[pairOrder[i] + 1];
+	}
+	for (int i = 0; i < (int)nodes.size(); ++i)
+		if (nodes[i].primCount == 0)
+			nodes[i].childOrPrimIdx = newChildIdx[nodes[i].childOrPrimIdx];
+	m_nodes.swap(nodes);
+}
+
+void	Bvh::setLayout(BvhLayout layout)
+{
+	m_layout = layout;
+	if (m_nodes.empty())
+		return;
+	reorderNodes();
+	initSubtrees(true);
+	initParents();
+}
+
+BvhUpdateResult	Bvh::update(ThreadPool* threadPool)
+{
+	if (m_nodes.empty())
+		return BvhUpdate_Refit;
+	refit(threadPool);
+
+	int numRebuild = 0;
+	for (int i = 0; i < (int)m_subtrees.size(); ++i)
+	{
+		if (m_subtrees[i].cost > m_subtrees[i].buildCost * BVH_REBUILD_SAH_RATIO)
+		{
+			rebuildSubtree(&m_subtrees[i], threadPool);
+			++numRebuild;
+		}
+	}
+	if (numRebuild > 0)
+	{
+		reorderNodes();
+		initSubtrees(true);
+		initParents();
+	}
+
+	// the nodes above the subtrees are never rebuilt partially
+	float cost		= m_topCost;
+	float buildCost	= m_topBuildCost;
+	for (int i = 0; i < (int)m_subtrees.size(); ++i)
+	{
+		cost		+= m_subtrees[i].cost;
+		buildCost	+= m_subtrees[i].buildCost;
+	}
+	if (cost > buildCost * BVH_REBUILD_SAH_RATIO)
+	{
+		BvhGeometry geometry = m_geometry;
+		build(geometry, m_buildMode, threadPool);
+		return BvhUpdate_FullRebuild;
+	}
+	return numRebuild > 0 ? BvhUpdate_PartialRebuild : BvhUpdate_Refit;
+}
+
+static float	getUnionArea(const BvhNode& node, const Aabb& box)
+{
+	Aabb unionBox;
+	unionBox.boundMin	= vecMin(node.boundMin, box.boundMin);
+	unionBox.boundMax	= vecMax(node.boundMax, box.boundMax);
+	return unionBox.surfaceArea();
+}
+
+int		Bvh::findInsertSibling(const Aabb& bound, std::vector<int>* ancestors) const
+{
+	// greedy descent on the SAH cost: pairing with a node cost the area of its union with the bound,
+	// and every node above it grow by the area of its union minus its own area
+	std::vector<int> path;
+	int		bestIdx		= 0;
+	int		bestDepth	= 0;
+	float	bestCost	= getUnionArea(m_nodes[0], bound);
+	float	inherited	= 0.0f;
+	int		nodeIdx		= 0;
+	while (m_nodes[nodeIdx].primCount == 0)
+	{
+		const BvhNode&	node	= m_nodes[nodeIdx];
+		Aabb			nodeBox;
+		nodeBox.boundMin		= node.boundMin;
+		nodeBox.boundMax		= node.boundMax;
+		inherited				+= getUnionArea(node, bound) - nodeBox.surfaceArea();
+		if (inherited >= bestCost)
+			break;
+
+		int		childIdx	= node.childOrPrimIdx;
+		float	cost0		= inherited + getUnionArea(m_nodes[childIdx	], bound);
+		float	cost1		= inherited + getUnionArea(m_nodes[childIdx + 1], bound);
+		path.push_back(nodeIdx);
+		nodeIdx				= cost0 <= cost1 ? childIdx : childIdx + 1;
+		float	cost		= minf(cost0, cost1);
+		if (cost < bestCost)
+		{
+			bestCost	= cost;
+			bestIdx		= nodeIdx;
+			bestDepth	= (int)path.size();
+		}
+	}
+	path.resize(bestDepth);
+	ancestors->swap(path);
+	return bestIdx;
+}
+
+void	Bvh::insert(const BvhGeometry& geometry, int triStart, ThreadPool* threadPool)
+{
+	if (m_nodes.empty())
+	{
+		build(geometry, m_buildMode, threadPool);
+		return;
+	}
+	m_geometry		= geometry;
+	int numNewTri	= geometry.numTri - triStart;
+	if (numNewTri <= 0)
+		return;
+
+	std::vector<int> newTri(numNewTri);
+	for (int i = 0; i < numNewTri; ++i)
+		newTri[i] = triStart + i;
+	BvhBuilder* builder	= new BvhBuilder();
+	builder->geometry	= &m_geometry;
+	builder->threadPool	= threadPool != NULL && threadPool->getNumThread() > 1 ? threadPool : NULL;
+	builder->initPrims(&newTri[0], numNewTri);
+	std::vector<BvhNode> nodes(numNewTri * 2 - 1);
+	int numNode			= builder->buildTree(getRangeBuildMode(), &nodes[0]);
+
+	Aabb bound;
+	bound.boundMin		= nodes[0].boundMin;
+	bound.boundMax		= nodes[0].boundMax;
+	std::vector<int> ancestors;
+	int siblingIdx		= findInsertSibling(bound, &ancestors);
+
+	// the new triangles are placed right after the triangle range of the sibling, so every subtree still cover a continuous range
+	int lastLeaf		= siblingIdx;
+	while (m_nodes[lastLeaf].primCount == 0)
+		lastLeaf		= m_nodes[lastLeaf].childOrPrimIdx + 1;
+	int primInsert		= m_nodes[lastLeaf].childOrPrimIdx + m_nodes[lastLeaf].primCount;
+	for (int i = 0; i < (int)m_nodes.size(); ++i)
+		if (m_nodes[i].primCount > 0 && m_nodes[i].childOrPrimIdx >= primInsert)
+			m_nodes[i].childOrPrimIdx += numNewTri;
+	m_primTri.insert(m_primTri.begin() + primInsert, numNewTri, 0);
+	for (int i = 0; i < numNewTri; ++i)
+		m_primTri[primInsert + i] = builder->prims[i].tri;
+	delete builder;
+
+	// the sibling is paired with the new subtree root, its slot become their parent
+	int		childIdx	= (int)m_nodes.size();
+	BvhNode	sibling		= m_nodes[siblingIdx];
+	m_nodes.reserve(m_nodes.size() + numNode + 1);
+	m_nodes.push_back(sibling);
+	for (int i = 0; i < numNode; ++i)
+	{
+		BvhNode node		= nodes[i];
+		node.childOrPrimIdx	+= node.primCount > 0 ? primInsert : childIdx + 1;
+		m_nodes.push_back(node);
+	}
+	BvhNode& parent			= m_nodes[siblingIdx];
+	parent.childOrPrimIdx	= childIdx;
+	parent.primCount		= 0;
+	parent.boundMin			= vecMin(sibling.boundMin, bound.boundMin);
+	parent.boundMax			= vecMax(sibling.boundMax, bound.boundMax);
+	for (int i = 0; i < (int)ancestors.size(); ++i)
+	{
+		BvhNode& node	= m_nodes[ancestors[i]];
+		node.boundMin	= vecMin(node.boundMin, bound.boundMin);
+		node.boundMax	= vecMax(node.boundMax, bound.boundMax);
+	}
+
+	// the subtree split may change, the SAH cost since the last build is reset
+	if (m_layout != BvhLayout_BuildOrder)
+		reorderNodes();
+	initSubtrees(false);
+	initParents();
+}
+
+void	Bvh::refitRegionNode(int nodeIdx, const Aabb& region)
+{
+	BvhNode& node = m_nodes[nodeIdx];
+	if (node.boundMin.x > region.boundMax.x || node.boundMin.y > region.boundMax.y || node.boundMin.z > region.boundMax.z ||
+		node.boundMax.x < region.boundMin.x || node.boundMax.y < region.boundMin.y || node.boundMax.z < region.boundMin.z	)
+		return;
+	if (node.primCount > 0)
+	{
+		refitNode(nodeIdx);
+		return;
+	}
+
+	int childIdx	= node.childOrPrimIdx;
+	refitRegionNode(childIdx	, region);
+	refitRegionNode(childIdx + 1, region);
+	node.boundMin	= vecMin(m_nodes[childIdx].boundMin, m_nodes[childIdx + 1].boundMin);
+	node.boundMax	= vecMax(m_nodes[childIdx].boundMax, m_nodes[childIdx + 1].boundMax);
+}
+
+void	Bvh::refitRegion(const Aabb& region)
+{
+	// a node containing a modified triangle must overlap the region, the other nodes are unchanged
+	if (!m_nodes.empty())
+		refitRegionNode(0, region);
+}
+
+void	Bvh::intersectLeaf(const Ray& ray, int primStart, int primCount, RayHit* hit) const
+{
+	for (int i = primStart; i < primStart + primCount; ++i)
+	{
+		float	u, v;
+		int		id;
+		float	t = bvhIntersectPrim(m_geometry, m_primTri[i], ray, &u, &v, &id);
+		if (t >= 0 && isCloserHit(t, id, *hit))
+		{
+			hit->t			= t;
+			hit->u			= u;
+			hit->v			= v;
+			bvhSetPrimHit(m_geometry, id, hit);
+		}
+	}
+}
+
+bool	Bvh::rayCast(const Ray& ray, RayHit* hit) const
+{
+	// the stack holds at most 1 node per level, a deeper tree is traversed with the parent pointers instead
+	if (m_maxDepth > BVH_STACK_SIZE)
+		return rayCastStackless(ray, hit);
+	resetRayHit(hit);
+	if (m_nodes.empty())
+		return false;
+	rayCastNode(ray, 0, hit);
+	return hit->t != RAY_MAX_T;
+}
+
+void	Bvh::rayCastNode(const Ray& ray, int nodeIdx, RayHit* hit) const
+{
+	Vector3	dirInv	= rayDirInverse(ray.dir);
+	float	tNear;
+	if (!rayAabbIntersect(m_nodes[nodeIdx].boundMin, m_nodes[nodeIdx].boundMax, ray.pos, dirInv, hit->t, &tNear))
+		return;
+
+	// the stack store nodes which already passed their slab test, together with the entry distance
+	int		stackNode[BVH_STACK_SIZE];
+	float	stackT[BVH_STACK_SIZE];
+	int		stackSize		= 1;
+	stackNode[0]			= nodeIdx;
+	stackT[0]				= tNear;
+	while (stackSize > 0)
+	{
+		--stackSize;
+		if (stackT[stackSize] > hit->t)
+			continue;
+		const BvhNode* node = &m_nodes[stackNode[stackSize]];
+		if (node->primCount > 0)
+		{
+			intersectLeaf(ray, node->childOrPrimIdx, node->primCount, hit);
+			continue;
+		}
+
+		int				childIdx	= node->childOrPrimIdx;
+		const BvhNode*	child		= &m_nodes[childIdx];
+		float			t0, t1;
+		bool			hit0		= rayAabbIntersect(child[0].boundMin, child[0].boundMax, ray.pos, dirInv, hit->t, &t0);
+		bool			hit1		= rayAabbIntersect(child[1].boundMin, child[1].boundMax, ray.pos, dirInv, hit->t, &t1);
+		if (hit0 && hit1)
+		{	// push the far child first
+			bool	isNear0						= t0 <= t1;
+			stackNode[stackSize]				= isNear0 ? childIdx + 1 : childIdx;
+			stackT	 [stackSize]				= isNear0 ? t1 : t0;
+			stackNode[stackSize + 1]			= isNear0 ? childIdx : childIdx + 1;
+			stackT	 [stackSize + 1]			= isNear0 ? t0 : t1;
+			stackSize += 2;
+
+			// the far child is visited later, its children can be loaded while the near subtree is traversed
+			const BvhNode& farChild = child[isNear0 ? 1 : 0];
+			if (m_usePrefetch && farChild.primCount == 0)
+				_mm_prefetch((const char*)&m_nodes[farChild.childOrPrimIdx], _MM_HINT_T0);
+		}
+		else if (hit0 || hit1)
+		{
+			stackNode[stackSize]				= hit0 ? childIdx : childIdx + 1;
+			stackT	 [stackSize]				= hit0 ? t0 : t1;
+			++stackSize;
+		}
+	}
+}
+
+// the child order only depend on the ray direction, so it is the same when the traversal walk back up the tree
+static inline int	getNearChild(const BvhNode* nodes, int nodeIdx, const Vector3& dir)
+{
+	int				childIdx	= nodes[nodeIdx].childOrPrimIdx;
+	const BvhNode*	child		= nodes + childIdx;
+	Vector3			offset		= (child[1].boundMin + child[1].boundMax) - (child[0].boundMin + child[0].boundMax);
+	return offset.dot(dir) >= 0.0f ? childIdx : childIdx + 1;
+}
+
+int		Bvh::findNextFarChild(int nodeIdx, const Ray& ray, const Vector3& dirInv, float tMax, float* tNear) const
+{
+	// the subtree of nodeIdx is done, every far child above it is visited after its near sibling,
+	// return -1 when the root is reached
+	while (nodeIdx > 0)
+	{
+		int parentIdx	= m_parents[nodeIdx];
+		int nearIdx		= getNearChild(&m_nodes[0], parentIdx, ray.dir);
+		if (nodeIdx == nearIdx)
+		{
+			int farIdx	= m_nodes[parentIdx].childOrPrimIdx * 2 + 1 - nearIdx;
+			if (rayAabbIntersect(m_nodes[farIdx].boundMin, m_nodes[farIdx].boundMax, ray.pos, dirInv, tMax, tNear))
+				return farIdx;
+		}
+		nodeIdx = parentIdx;
+	}
+	return -1;
+}
+
+bool	Bvh::rayCastShortStack(const Ray& ray, int stackSize, RayHit* hit) const
+{
+	resetRayHit(hit);
+	if (m_nodes.empty())
+		return false;
+	Vector3	dirInv	= rayDirInverse(ray.dir);
+	float	tNear;
+	if (!rayAabbIntersect(m_nodes[0].boundMin, m_nodes[0].boundMax, ray.pos, dirInv, hit->t, &tNear))
+		return false;
+	stackSize		= stackSize < 1 ? 1 : (stackSize > BVH_SHORT_STACK_MAX_SIZE ? BVH_SHORT_STACK_MAX_SIZE : stackSize);
+
+	// ring buffer of the far children, the oldest entry is dropped when it is full
+	int		stackNode[BVH_SHORT_STACK_MAX_SIZE];
+	float	stackT[BVH_SHORT_STACK_MAX_SIZE];
+	int		stackTop		= 0;		// ring index of the next push
+	int		stackCount		= 0;
+	bool	isOverflowed	= false;
+	int		restartIdx		= 0;		// last node taken from the stack, the dropped entries are far children above it
+	int		nodeIdx			= 0;
+	while (nodeIdx >= 0)
+	{
+		const BvhNode& node = m_nodes[nodeIdx];
+		if (node.primCount == 0)
+		{
+			int		nearIdx		= getNearChild(&m_nodes[0], nodeIdx, ray.dir);
+			int		farIdx		= node.childOrPrimIdx * 2 + 1 - nearIdx;
+			float	t0, t1;
+			bool	hitNear		= rayAabbIntersect(m_nodes[nearIdx	].boundMin, m_nodes[nearIdx	].boundMax, ray.pos, dirInv, hit->t, &t0);
+			bool	hitFar		= rayAabbIntersect(m_nodes[farIdx	].boundMin, m_nodes[farIdx	].boundMax, ray.pos, dirInv, hit->t, &t1);
+			if (hitNear && hitFar)
+			{
+				isOverflowed		|= stackCount == stackSize;
+				stackNode[stackTop]	= farIdx;
+				stackT	 [stackTop]	= t1;
+				stackTop			= stackTop + 1 == stackSize ? 0 : stackTop + 1;
+				stackCount			= stackCount == stackSize ? stackSize : stackCount + 1;
+				nodeIdx				= nearIdx;
+				continue;
+			}
+			if (hitNear || hitFar)
+			{
+				nodeIdx = hitNear ? nearIdx : farIdx;
+				continue;
+			}
+		}
+		else
+			intersectLeaf(ray, node.childOrPrimIdx, node.primCount, hit);
+
+		// pop the next far child, skip the entries behind the closest hit
+		nodeIdx = -1;
+		while (stackCount > 0 && nodeIdx < 0)
+		{
+			stackTop	= (stackTop == 0 ? stackSize : stackTop) - 1;
+			restartIdx	= stackNode[stackTop];
+			--stackCount;
+			if (stackT[stackTop] <= hit->t)
+				nodeIdx = restartIdx;
+		}
+		if (nodeIdx < 0 && isOverflowed)
+		{
+			nodeIdx		= findNextFarChild(restartIdx, ray, dirInv, hit->t, &tNear);
+			restartIdx	= nodeIdx;
+		}
+	}
+	return hit->t != RAY_MAX_T;
+}
+
+bool	Bvh::rayCastStackless(const Ray& ray, RayHit* hit) const
+{
+	resetRayHit(hit);
+	if (m_nodes.empty())
+		return false;
+	Vector3	dirInv	= rayDirInverse(ray.dir);
+	float	tNear;
+	if (!rayAabbIntersect(m_nodes[0].boundMin, m_nodes[0].boundMax, ray.pos, dirInv, hit->t, &tNear))
+		return false;
+
+	// descend to the near child if its box is hit, else the far child, when both are missed or a leaf is reached,
+	// walk up to the next far child whose box is hit
+	int nodeIdx = 0;
+	while (nodeIdx >= 0)
+	{
+		const BvhNode& node = m_nodes[nodeIdx];
+		if (node.primCount == 0)
+		{
+			int nearIdx	= getNearChild(&m_nodes[0], nodeIdx, ray.dir);
+			int farIdx	= node.childOrPrimIdx * 2 + 1 - nearIdx;
+			if (rayAabbIntersect(m_nodes[nearIdx].boundMin, m_nodes[nearIdx].boundMax, ray.pos, dirInv, hit->t, &tNear))
+			{
+				nodeIdx = nearIdx;
+				continue;
+			}
+			if (rayAabbIntersect(m_nodes[farIdx].boundMin, m_nodes[farIdx].boundMax, ray.pos, dirInv, hit->t, &tNear))
+			{
+				nodeIdx = farIdx;
+				continue;
+			}
+		}
+		else
+			intersectLeaf(ray, node.childOrPrimIdx, node.primCount, hit);
+		nodeIdx = findNextFarChild(nodeIdx, ray, dirInv, hit->t, &tNear);
+	}
+	return hit->t != RAY_MAX_T;
+}
+
+int		Bvh::collectWideChildren(int nodeIdx, int maxChild, int* children) const
+{
+	const BvhNode& node = m_nodes[nodeIdx];
+	if (node.primCount > 0)
+	{
+		children[0] = nodeIdx;
+		return 1;
+	}
+
+	int numChild = 0;
+	children[numChild++] = node.childOrPrimIdx;
+	children[numChild++] = node.childOrPrimIdx + 1;
+	while (numChild < maxChild)
+	{
+		int		openIdx		= -1;
+		float	openArea	= -1.0f;
+		for (int i = 0; i < numChild; ++i)
+		{
+			const BvhNode& child = m_nodes[children[i]];
+			if (child.primCount > 0)
+				continue;
+			Aabb box;
+			box.boundMin	= child.boundMin;
+			box.boundMax	= child.boundMax;
+			float area		= box.surfaceArea();
+			if (area > openArea)
+			{
+				openArea	= area;
+				openIdx		= i;
+			}
+		}
+		if (openIdx < 0)
+			break;
+		int grandChild			= m_nodes[children[openIdx]].childOrPrimIdx;
+		children[openIdx]		= grandChild;
+		children[numChild++]	= grandChild + 1;
+	}
+	return numChild;
+}
+
+float	Bvh::computeSahCost() const
+{
+	if (m_nodes.empty())
+		return 0.0f;
+	Aabb root;
+	root.boundMin = m_nodes[0].boundMin;
+	root.boundMax = m_nodes[0].boundMax;
+	float rootAreaInv = 1.0f / root.surfaceArea();
+	float cost = 0.0f;
+	for (int i = 0; i < (int)m_nodes.size(); ++i)
+	{
+		Aabb box;
+		box.boundMin	= m_nodes[i].boundMin;
+		box.boundMax	= m_nodes[i].boundMax;
+		float area		= box.surfaceArea() * rootAreaInv;
+		if (m_nodes[i].primCount > 0)
+			cost		+= area * BVH_COST_INTERSECT * m_nodes[i].primCount;
+		else
+			cost		+= area * BVH_COST_TRAVERSAL;
+	}
+	return cost;
+}
+
+int		Bvh::computeMaxDepth() const
+{
+	if (m_nodes.empty())
+		return 0;
+	int maxDepth = 0;
+	std::vector<int> stackNode (1, 0);
+	std::vector<int> stackDepth(1, 1);
+	while (!stackNode.empty())
+	{
+		int nodeIdx	= stackNode.back();
+		int depth	= stackDepth.back();
+		stackNode.pop_back();
+		stackDepth.pop_back();
+		maxDepth	= depth > maxDepth ? depth : maxDepth;
+		if (m_nodes[nodeIdx].primCount > 0)
+			continue;
+		stackNode.push_back(m_nodes[nodeIdx].childOrPrimIdx		);
+		stackNode.push_back(m_nodes[nodeIdx].childOrPrimIdx + 1	);
+		stackDepth.push_back(depth + 1);
+		stackDepth.push_back(depth + 1);
+	}
+	return maxDepth;
+}
+
+int		Bvh::getNodeMemorySize() const
+{
+	return (int)(m_nodes.size() * sizeof(BvhNode));
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include <malloc.h>
+#include "math.h"
+#include "Ray.h"
+
+#define BVH_MAX_LEAF_SIZE		(4)
+#define BVH_STACK_SIZE			(128)
+#define BVH_SHORT_STACK_MAX_SIZE	(8)
+#define BVH_CACHE_LINE_SIZE		(64)
+
+class ThreadPool;
+
+enum BvhBuildMode
+{
+	BvhBuildMode_Sah,				// top down binned SAH, subtrees are built as parallel jobs
+	BvhBuildMode_Lbvh,				// split at the Morton code bits of the sorted triangle centroids, faster to build with higher SAH cost
+	BvhBuildMode_Sbvh,				// binned SAH with spatial splits, which clip and duplicate triangle references across the split plane,
+									// built on 1 thread, refit grows the clipped leaf bounds back to the triangle bounds
+};
+
+enum BvhLayout
+{
+	BvhLayout_BuildOrder,			// nodes are stored in build order, compacted in depth first order after a partial rebuild
+	BvhLayout_DepthFirst,			// depth first with the larger child first, so its children are stored next to it
+	BvhLayout_Treelet,				// page sized treelets, each grown from its root by the largest surface area node
+};
+
+struct Aabb
+{
+	Vector3		boundMin;
+	Vector3		boundMax;
+
+	void	setEmpty();
+	void	grow(const Vector3& p);
+	void	grow(const Aabb& box);
+	float	surfaceArea() const;
+};
+
+// triangles and analytic primitives of a Scene, referenced by pointer, so the acceleration structure
+// need to be rebuilt whenever the Scene arrays are modified
+struct BvhGeometry
+{
+	const Vector3*	triPos;
+	const int*		triIdx;			// 3 vertex index per triangle
+	const int*		triMeshIdx;		// mesh index per triangle
+	const QuadPrim*	quads;
+	const BoxPrim*	boxes;
+	int				numTri;
+	int				numQuad;
+	int				numBox;
+};
+
+enum BvhUpdateResult
+{
+	BvhUpdate_Refit,
+	BvhUpdate_PartialRebuild,		// some subtrees are rebuilt
+	BvhUpdate_FullRebuild,
+};
+
+struct BvhNode
+{	// 32 byte, interior node have its 2 children stored next to each other
+	Vector3		boundMin;
+	int			childOrPrimIdx;		// first child node if primCount == 0, else first index into Bvh::m_primTri
+	Vector3		boundMax;
+	int			primCount;
+};
+
+// the root is stored alone and every sibling pair start at an odd index, so the allocation is offset by 1 node
+// to keep the 2 children of a node in the same cache line
+template<class T>
+struct BvhNodeAllocator
+{
+	typedef T	value_type;
+
+	BvhNodeAllocator() {}
+	template<class U>
+	BvhNodeAllocator(const BvhNodeAllocator<U>&) {}
+
+	T*		allocate(size_t n)			{ return (T*)_aligned_offset_malloc(n * sizeof(T), BVH_CACHE_LINE_SIZE, sizeof(T)); }
+	void	deallocate(T* p, size_t)	{ _aligned_free(p); }
+
+	template<class U>
+	bool	operator==(const BvhNodeAllocator<U>&) const { return true; }
+	template<class U>
+	bool	operator!=(const BvhNodeAllocator<U>&) const { return false; }
+};
+typedef std::vector<BvhNode, BvhNodeAllocator<BvhNode> >	BvhNodeArray;
+
+// the tree is split at a fixed depth into subtrees, which are refitted in parallel and rebuilt individually
+struct BvhSubtree
+{
+	int		nodeIdx;
+	int		primStart;		// the leaves of a subtree cover a continuous range of Bvh::m_primTri
+	int		primCount;
+	float	cost;			// SAH cost not normalized by the root area
+	float	buildCost;		// cost when the subtree is built
+};
+
+// full precision binary BVH
+class Bvh
+{
+public:
+	BvhNodeArray				m_nodes;
+	std::vector<int			>	m_primTri;		// primitive id (RAY_PRIM_XXX), sorted in leaf order, SBVH may reference a primitive from several leaves
+	BvhGeometry					m_geometry;
+	BvhBuildMode				m_buildMode;
+	BvhLayout					m_layout;
+	float						m_spatialSplitBudget;	// SBVH only, extra triangle references allowed as a fraction of the triangle count
+	bool						m_usePrefetch;	// prefetch the children of the far child when it is pushed to the stack
+	std::vector<BvhSubtree	>	m_subtrees;
+	std::vector<int			>	m_topNodes;		// interior nodes above the subtrees, in depth first order
+	float						m_topCost;
+	float						m_topBuildCost;
+	std::vector<int			>	m_parents;		// parent node index, -1 for the root, used by the short stack and stackless traversal
+	int							m_maxDepth;		// a full stack traversal push at most m_maxDepth entries, rayCast() fall back to
+												// rayCastStackless() when it is larger than BVH_STACK_SIZE (e.g. degenerate LBVH and SBVH trees)
+
+	Bvh();
+
+	void	clear();
+	void	build(const BvhGeometry& geometry, BvhBuildMode mode, ThreadPool* threadPool);		// threadPool can be NULL for a single threaded build
+	bool	rayCast(const Ray& ray, RayHit* hit) const;
+	void	rayCastNode(const Ray& ray, int nodeIdx, RayHit* hit) const;		// continue from the closest hit so far, only the subtree of nodeIdx is traversed,
+																				// m_maxDepth must not be larger than BVH_STACK_SIZE
+	float	computeSahCost() const;			// normalized by root surface area
+	int		computeMaxDepth() const;
+
+	// traversal with less memory per ray for many rays in flight, return the same closest hit as rayCast():
+	// the short stack keep only the last stackSize (<= BVH_SHORT_STACK_MAX_SIZE) entries and walk up the parent pointers
+	// to find the dropped entries, the stackless traversal only walk the parent pointers
+	bool	rayCastShortStack(const Ray& ray, int stackSize, RayHit* hit) const;
+	bool	rayCastStackless(const Ray& ray, RayHit* hit) const;
+
+	// after the triangle positions are modified: refit the bounds, and rebuild the subtrees (or the whole tree)
+	// whose SAH cost grow too much since they are built, the triangle arrays must not be resized
+	BvhUpdateResult	update(ThreadPool* threadPool);
+	void			refit(ThreadPool* threadPool);
+	float			refitNode(int nodeIdx);		// refit a subtree, return its SAH cost
+	int		getNodeMemorySize() const;		// byte
+	void	setLayout(BvhLayout layout);	// reorder the nodes of the current tree, later builds also use this layout
+
+	// runtime scene editing without a rebuild, the geometry is passed again as the arrays may be reallocated
+	void	insert(const BvhGeometry& geometry, int triStart, ThreadPool* threadPool);		// add triangle triStart ... geometry.numTri - 1 as a new subtree
+	void	refitRegion(const Aabb& region);	// refit only the nodes overlapping the region, after the triangles inside it are modified
+
+	// collapse helper for wide BVH: starting from the children of nodeIdx, open the interior child with the
+	// largest surface area until there are maxChild children, return the number of children written
+	int		collectWideChildren(int nodeIdx, int maxChild, int* children) const;
+
+	// intersect primitive m_primTri[primStart ... primStart + primCount - 1], shared by other BVH layouts which keep the same leaf order
+	void	intersectLeaf(const Ray& ray, int primStart, int primCount, RayHit* hit) const;
+
+private:
+	void	initSubtrees(bool isKeepBuildCost);
+	void	initParents();				// also update m_maxDepth, called after every change of the tree topology
+	int		findNextFarChild(int nodeIdx, const Ray& ray, const Vector3& dirInv, float tMax, float* tNear) const;
+	float	computeSubtreeCost(int nodeIdx) const;
+	void	rebuildSubtree(BvhSubtree* subtree, ThreadPool* threadPool);
+	BvhBuildMode	getRangeBuildMode() const;		// build mode of rebuildSubtree() and insert(), which keep the number of triangle references
+	void	reorderNodes();					// store the nodes in m_layout order, the nodes no longer referenced after rebuildSubtree() are removed
+	int		findInsertSibling(const Aabb& bound, std::vector<int>* ancestors) const;
+	void	refitRegionNode(int nodeIdx, const Aabb& region);
+};
+
+// the primitives of a BvhGeometry are the triangles, followed by the quads and the boxes
+int		bvhGetNumPrim(const BvhGeometry& geometry);
+int		bvhGetPrimId(const BvhGeometry& geometry, int primIdx);		// primIdx in [0, bvhGetNumPrim()) to RAY_PRIM_XXX id
+void	bvhGetPrimBound(const BvhGeometry& geometry, int prim, Aabb* bound);
+float	bvhIntersectPrim(const BvhGeometry& geometry, int prim, const Ray& ray, float* outU, float* outV, int* outId);	// outId is the hit face id of a box
+void	bvhSetPrimHit(const BvhGeometry& geometry, int id, RayHit* hit);		// set the mesh index, vertex index and primitive id of the hit
+
+// slab test, tNear is only written when return true
+inline bool	rayAabbIntersect(const Vector3& boundMin, const Vector3& boundMax, const Vector3& rayPos, const Vector3& rayDirInv, float tMax, float* tNear)
+{
+	float tx0	= (boundMin.x - rayPos.x) * rayDirInv.x;
+	float tx1	= (boundMax.x - rayPos.x) * rayDirInv.x;
+	float ty0	= (boundMin.y - rayPos.y) * rayDirInv.y;
+	float ty1	= (boundMax.y - rayPos.y) * rayDirInv.y;
+	float tz0	= (boundMin.z - rayPos.z) * rayDirInv.z;
+	float tz1	= (boundMax.z - rayPos.z) * rayDirInv.z;
+	float t0	= maxf(maxf(minf(tx0, tx1), minf(ty0, ty1)), minf(tz0, tz1));
+	float t1	= minf(minf(maxf(tx0, tx1), maxf(ty0, ty1)), maxf(tz0, tz1));
+	t1			*= 1.00000024f;	// 1 + 2 * gamma(3), conservative against rounding error, so grazing rays are not missed
+	if (t0 > t1 || t1 < 0.0f || t0 > tMax)
+		return false;
+	*tNear		= t0;
+	return true;
+}
+
+inline Vector3	rayDirInverse(const Vector3& dir)
+{
+	return Vector3(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+}
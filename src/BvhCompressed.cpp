@@ -0,0 +1,218 @@
+
+// all rights reserved
+
+#include "BvhCompressed.h"
+#include <malloc.h>
+#include <string.h>
+
+static float	scaleFromExp(int biasedExp)
+{
+	unsigned int	bits	= (unsigned int)biasedExp << 23;
+	float			scale;
+	memcpy(&scale, &bits, sizeof(float));
+	return scale;
+}
+
+// smallest power of 2 scale which can cover the extent with 255 steps
+static int		computeScaleExp(float extent)
+{
+	if (extent <= 0.0f)
+		return 1;
+	int exp;
+	frexpf(extent / 255.0f, &exp);	// extent / 255 <= 2^exp
+	int biasedExp = exp + 127;
+	return biasedExp < 1 ? 1 : (biasedExp > 254 ? 254 : biasedExp);
+}
+
+// round outward, the decoded value origin + q * scale is the same expression used during traversal,
+// q * scale is exact, so the only rounding happens in the add, which is monotonic
+static unsigned char	quantizeMin(float value, float origin, float scale)
+{
+	float	q	= floorf((value - origin) / scale);
+	int		qi	= q < 0.0f ? 0 : (q > 255.0f ? 255 : (int)q);
+	while (qi > 0 && origin + qi * scale > value)
+		--qi;
+	return (unsigned char)qi;
+}
+
+static unsigned char	quantizeMax(float value, float origin, float scale)
+{
+	float	q	= ceilf((value - origin) / scale);
+	int		qi	= q < 0.0f ? 0 : (q > 255.0f ? 255 : (int)q);
+	while (qi < 255 && origin + qi * scale < value)
+		++qi;
+	return (unsigned char)qi;
+}
+
+BvhCompressed::BvhCompressed()
+{
+	m_nodes		= NULL;
+	m_numNodes	= 0;
+	m_capacity	= 0;
+	m_bvh		= NULL;
+}
+
+BvhCompressed::~BvhCompressed()
+{
+	clear();
+}
+
+void	BvhCompressed::clear()
+{
+	if (m_nodes)
+		_aligned_free(m_nodes);
+	m_nodes		= NULL;
+	m_numNodes	= 0;
+	m_capacity	= 0;
+	m_bvh		= NULL;
+}
+
+int		BvhCompressed::allocNode()
+{
+	int idx = m_numNodes++;
+	memset(&m_nodes[idx], 0, sizeof(BvhCompressedNode));
+	return idx;
+}
+
+int		BvhCompressed::collapse(int bvhNodeIdx)
+{
+	const BvhNodeArray&			bvhNodes	= m_bvh->m_nodes;
+	const BvhNode&				bvhNode		= bvhNodes[bvhNodeIdx];
+
+	int children[BVH_COMPRESSED_WIDTH];
+	int numChild = m_bvh->collectWideChildren(bvhNodeIdx, BVH_COMPRESSED_WIDTH, children);
+
+	int					nodeIdx	= allocNode();
+	BvhCompressedNode*	node	= &m_nodes[nodeIdx];
+	float				scale[3];
+	node->origin[0]		= bvhNode.boundMin.x;
+	node->origin[1]		= bvhNode.boundMin.y;
+	node->origin[2]		= bvhNode.boundMin.z;
+	node->scaleExp[0]	= (unsigned char)computeScaleExp(bvhNode.boundMax.x - bvhNode.boundMin.x);
+	node->scaleExp[1]	= (unsigned char)computeScaleExp(bvhNode.boundMax.y - bvhNode.boundMin.y);
+	node->scaleExp[2]	= (unsigned char)computeScaleExp(bvhNode.boundMax.z - bvhNode.boundMin.z);
+	node->numChild		= (unsigned char)numChild;
+	for (int axis = 0; axis < 3; ++axis)
+		scale[axis]		= scaleFromExp(node->scaleExp[axis]);
+	for (int i = 0; i < numChild; ++i)
+	{
+		const BvhNode&	child		= bvhNodes[children[i]];
+		const float*	childMin	= &child.boundMin.x;
+		const float*	childMax	= &child.boundMax.x;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			node->qMin[axis][i]	= quantizeMin(childMin[axis], node->origin[axis], scale[axis]);
+			node->qMax[axis][i]	= quantizeMax(childMax[axis], node->origin[axis], scale[axis]);
+		}
+	}
+
+	// children are allocated after this node, m_nodes is pre-allocated in build() so the pointer stay valid
+	for (int i = 0; i < numChild; ++i)
+	{
+		const BvhNode& child = bvhNodes[children[i]];
+		if (child.primCount > 0)
+		{
+			node->childIdx[i]		= (unsigned int)child.childOrPrimIdx;
+			node->childPrimCount[i]	= (unsigned char)child.primCount;
+		}
+		else
+		{
+			node->childIdx[i]		= (unsigned int)collapse(children[i]);
+			node->childPrimCount[i]	= 0;
+		}
+	}
+	return nodeIdx;
+}
+
+void	BvhCompressed::build(const Bvh* bvh)
+{
+	clear();
+	m_bvh = bvh;
+	if (bvh->m_nodes.empty())
+		return;
+
+	// every compressed node consume at least 1 interior node of the binary tree
+	m_capacity	= (int)bvh->m_nodes.size() / 2 + 1;
+	m_nodes		= (BvhCompressedNode*)_aligned_malloc(m_capacity * sizeof(BvhCompressedNode), 64);
+	collapse(0);
+
+	// shrink to fit
+	BvhCompressedNode* nodes = (BvhCompressedNode*)_aligned_malloc(m_numNodes * sizeof(BvhCompressedNode), 64);
+	memcpy(nodes, m_nodes, m_numNodes * sizeof(BvhCompressedNode));
+	_aligned_free(m_nodes);
+	m_nodes		= nodes;
+	m_capacity	= m_numNodes;
+}
+
+bool	BvhCompressed::rayCast(const Ray& ray, RayHit* hit) const
+{
+	resetRayHit(hit);
+	if (m_numNodes == 0)
+		return false;
+
+	// a stack entry is either a node or a leaf, both already passed their slab test
+	unsigned int	stackIdx[BVH_STACK_SIZE];
+	int				stackPrimCount[BVH_STACK_SIZE];
+	float			stackT[BVH_STACK_SIZE];
+	int				stackSize	= 1;
+	stackIdx[0]					= 0;
+	stackPrimCount[0]			= 0;
+	stackT[0]					= 0.0f;
+
+	Vector3			dirInv		= rayDirInverse(ray.dir);
+	while (stackSize > 0)
+	{
+		--stackSize;
+		if (stackT[stackSize] > hit->t)
+			continue;
+		if (stackPrimCount[stackSize] > 0)
+		{
+			m_bvh->intersectLeaf(ray, (int)stackIdx[stackSize], stackPrimCount[stackSize], hit);
+			continue;
+		}
+
+		const BvhCompressedNode* node = &m_nodes[stackIdx[stackSize]];
+		Vector3	origin(node->origin[0], node->origin[1], node->origin[2]);
+		Vector3	scale(scaleFromExp(node->scaleExp[0]), scaleFromExp(node->scaleExp[1]), scaleFromExp(node->scaleExp[2]));
+
+		// slab test all children, then push them from far to near
+		int		hitChild[BVH_COMPRESSED_WIDTH];
+		float	hitT	[BVH_COMPRESSED_WIDTH];
+		int		numHit	= 0;
+		for (int i = 0; i < node->numChild; ++i)
+		{
+			Vector3 boundMin(	origin.x + node->qMin[0][i] * scale.x,
+								origin.y + node->qMin[1][i] * scale.y,
+								origin.z + node->qMin[2][i] * scale.z);
+			Vector3 boundMax(	origin.x + node->qMax[0][i] * scale.x,
+								origin.y + node->qMax[1][i] * scale.y,
+								origin.z + node->qMax[2][i] * scale.z);
+			float t;
+			if (!rayAabbIntersect(boundMin, boundMax, ray.pos, dirInv, hit->t, &t))
+				continue;
+			int j = numHit++;
+			for (; j > 0 && hitT[j - 1] < t; --j)
+			{
+				hitT	[j]	= hitT	  [j - 1];
+				hitChild[j]	= hitChild[j - 1];
+			}
+			hitT	[j]	= t;
+			hitChild[j]	= i;
+		}
+		if (stackSize + numHit > BVH_STACK_SIZE)
+			return m_bvh->rayCast(ray, hit);		// only a tree collapsed from a degenerate binary BVH is this deep
+		for (int i = 0; i < numHit; ++i)
+		{
+			stackIdx		[stackSize]	= node->childIdx	  [hitChild[i]];
+			stackPrimCount	[stackSize]	= node->childPrimCount[hitChild[i]];
+			stackT			[stackSize]	= hitT[i];
+			++stackSize;
+		}
+	}
+	return hit->t != RAY_MAX_T;
+}
+
+int		BvhCompressed::getNodeMemorySize() const
+{
+	return m_numNodes * (int)sizeof(BvhCompressedNode);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// all rights reserved
+
+#include "Bvh.h"
+
+#define BVH_COMPRESSED_WIDTH		(4)
+
+// 4-wide node in a single 64 byte cache line, child bounds are quantized to 8 bit
+// relative to the node bound: bound = origin + q * 2^(scaleExp - 127)
+// the quantized bounds are rounded outward, so they always enclose the full precision child bounds
+struct alignas(64) BvhCompressedNode
+{
+	float			origin[3];
+	unsigned char	scaleExp[3];									// biased exponent of the per axis power of 2 scale
+	unsigned char	numChild;
+	unsigned char	qMin[3][BVH_COMPRESSED_WIDTH];					// [axis][child]
+	unsigned char	qMax[3][BVH_COMPRESSED_WIDTH];
+	unsigned int	childIdx[BVH_COMPRESSED_WIDTH];					// node index if childPrimCount == 0, else first index into Bvh::m_primTri
+	unsigned char	childPrimCount[BVH_COMPRESSED_WIDTH];
+	unsigned int	padding0;
+};
+
+// converted from the full precision binary Bvh at build time by collapsing it into 4-wide nodes,
+// the leaves and triangle order are shared with the source Bvh, which must be kept alive
+class BvhCompressed
+{
+public:
+	BvhCompressedNode*	m_nodes;
+	int					m_numNodes;
+	int					m_capacity;
+	const Bvh*			m_bvh;
+
+	BvhCompressed();
+	~BvhCompressed();
+
+	void	clear();
+	void	build(const Bvh* bvh);
+	bool	rayCast(const Ray& ray, RayHit* hit) const;
+	int		getNodeMemorySize() const;		// byte
+
+private:
+	BvhCompressed(const BvhCompressed&);
+	BvhCompressed& operator=(const BvhCompressed&);
+
+	int		allocNode();
+	int		collapse(int bvhNodeIdx);
+};
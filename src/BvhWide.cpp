@@ -0,0 +1,404 @@
+
+// all rights reserved
+
+#include "BvhWide.h"
+#include "ThreadPool.h"
+#include <intrin.h>
+#include <immintrin.h>
+#include <malloc.h>
+#include <string.h>
+
+#define BVH_WIDE_FAR_SCALE		(1.00000024f)		// same conservative factor as rayAabbIntersect()
+#define BVH_WIDE_REFIT_JOB		(64)
+
+template<int W, typename Node>
+static int	collapseNode(const Bvh* bvh, int bvhNodeIdx, Node* nodes, int* numNodes, std::vector<int>* srcNode)
+{
+	int children[W];
+	int numChild	= bvh->collectWideChildren(bvhNodeIdx, W, children);
+	int nodeIdx		= (*numNodes)++;
+	for (int i = 0; i < W; ++i)
+	{
+		const BvhNode*	child	= i < numChild ? &bvh->m_nodes[children[i]] : NULL;
+		Node*			node	= &nodes[nodeIdx];
+		node->boundMin[0][i]	= child ? child->boundMin.x :  INFINITY;
+		node->boundMin[1][i]	= child ? child->boundMin.y :  INFINITY;
+		node->boundMin[2][i]	= child ? child->boundMin.z :  INFINITY;
+		node->boundMax[0][i]	= child ? child->boundMax.x : -INFINITY;
+		node->boundMax[1][i]	= child ? child->boundMax.y : -INFINITY;
+		node->boundMax[2][i]	= child ? child->boundMax.z : -INFINITY;
+		node->childIdx[i]		= 0;
+		node->childPrimCount[i]	= 0;
+		(*srcNode)[nodeIdx * W + i]	= child ? children[i] : -1;
+		if (child == NULL)
+			continue;
+		if (child->primCount > 0)
+		{
+			node->childIdx[i]		= child->childOrPrimIdx;
+			node->childPrimCount[i]	= child->primCount;
+		}
+		else
+		{
+			int childNodeIdx		= collapseNode<W, Node>(bvh, children[i], nodes, numNodes, srcNode);
+			nodes[nodeIdx].childIdx[i] = childNodeIdx;
+		}
+	}
+	return nodeIdx;
+}
+
+template<typename Node>
+static Node*	allocNodes(int numNodes)
+{
+	return (Node*)_aligned_malloc(numNodes * sizeof(Node), sizeof(Node));
+}
+
+template<int W, typename Node>
+static Node*	buildNodes(const Bvh* bvh, int* numNodes, std::vector<int>* srcNode)
+{
+	// every wide node consume at least 1 interior node of the binary tree
+	int maxNodes	= (int)bvh->m_nodes.size() / 2 + 1;
+	*numNodes		= 0;
+	Node* nodes		= allocNodes<Node>(maxNodes);
+	srcNode->resize(maxNodes * W);
+	collapseNode<W, Node>(bvh, 0, nodes, numNodes, srcNode);
+	srcNode->resize(*numNodes * W);
+
+	// shrink to fit
+	Node* result	= allocNodes<Node>(*numNodes);
+	memcpy(result, nodes, *numNodes * sizeof(Node));
+	_aligned_free(nodes);
+	return result;
+}
+
+// traversal stack shared by all widths, an entry is either a node or a leaf, both already passed their slab test
+struct BvhWideStack
+{
+	int		idx		[BVH_STACK_SIZE];
+	int		primCount[BVH_STACK_SIZE];
+	float	t		[BVH_STACK_SIZE];
+	int		size;
+
+	// push the hit children from far to near, so the nearest one is popped first,
+	// return false if they do not fit, which only happen to the deep trees collapsed from a degenerate binary BVH
+	template<int W, typename Node>
+	bool	pushChildren(const Node* node, int hitMask, const float* tNear)
+	{
+		int		hitChild[W];
+		float	hitT	[W];
+		int		numHit	= 0;
+		for (int i = 0; i < W; ++i)
+		{
+			if ((hitMask & (1 << i)) == 0)
+				continue;
+			int j = numHit++;
+			for (; j > 0 && hitT[j - 1] < tNear[i]; --j)
+			{
+				hitT	[j]	= hitT	  [j - 1];
+				hitChild[j]	= hitChild[j - 1];
+			}
+			hitT	[j]	= tNear[i];
+			hitChild[j]	= i;
+		}
+		if (size + numHit > BVH_STACK_SIZE)
+			return false;
+		for (int i = 0; i < numHit; ++i)
+		{
+			idx		 [size]	= node->childIdx	  [hitChild[i]];
+			primCount[size]	= node->childPrimCount[hitChild[i]];
+			t		 [size]	= hitT[i];
+			++size;
+		}
+		return true;
+	}
+};
+
+template<int W, typename Node>
+static bool	rayCastScalar(const Bvh* bvh, const Node* nodes, int numNodes, const Ray& ray, RayHit* hit)
+{
+	resetRayHit(hit);
+	if (numNodes == 0)
+		return false;
+
+	// select the near / far plane by the ray direction sign instead of a min / max per axis
+	Vector3			dirInv		= rayDirInverse(ray.dir);
+	const float*	rayPos		= &ray.pos.x;
+	const float*	rayDirInv	= &dirInv.x;
+	bool			isNegative[3];
+	for (int axis = 0; axis < 3; ++axis)
+		isNegative[axis]		= rayDirInv[axis] < 0.0f;
+
+	BvhWideStack stack;
+	stack.size			= 1;
+	stack.idx[0]		= 0;
+	stack.primCount[0]	= 0;
+	stack.t[0]			= 0.0f;
+	while (stack.size > 0)
+	{
+		--stack.size;
+		if (stack.t[stack.size] > hit->t)
+			continue;
+		if (stack.primCount[stack.size] > 0)
+		{
+			bvh->intersectLeaf(ray, stack.idx[stack.size], stack.primCount[stack.size], hit);
+			continue;
+		}
+
+		const Node*	node		= &nodes[stack.idx[stack.size]];
+		int			hitMask		= 0;
+		float		tNear[W];
+		for (int i = 0; i < W; ++i)
+		{
+			float t0 = 0.0f;
+			float t1 = 999999999999999.0f;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float nearPlane	= isNegative[axis] ? node->boundMax[axis][i] : node->boundMin[axis][i];
+				float farPlane	= isNegative[axis] ? node->boundMin[axis][i] : node->boundMax[axis][i];
+				t0				= maxf((nearPlane	- rayPos[axis]) * rayDirInv[axis], t0);
+				t1				= minf((farPlane	- rayPos[axis]) * rayDirInv[axis], t1);
+			}
+			tNear[i] = t0;
+			if (t0 <= minf(t1 * BVH_WIDE_FAR_SCALE, hit->t))
+				hitMask |= 1 << i;
+		}
+		if (!stack.pushChildren<W, Node>(node, hitMask, tNear))
+			return bvh->rayCast(ray, hit);
+	}
+	return hit->t != RAY_MAX_T;
+}
+
+BvhWide::BvhWide()
+{
+	m_nodes4	= NULL;
+	m_nodes8	= NULL;
+	m_numNodes	= 0;
+	m_width		= 4;
+	m_useSimd	= true;
+	m_bvh		= NULL;
+}
+
+BvhWide::~BvhWide()
+{
+	clear();
+}
+
+void	BvhWide::clear()
+{
+	if (m_nodes4)
+		_aligned_free(m_nodes4);
+	if (m_nodes8)
+		_aligned_free(m_nodes8);
+	m_nodes4	= NULL;
+	m_nodes8	= NULL;
+	m_numNodes	= 0;
+	m_bvh		= NULL;
+	m_srcNode.clear();
+}
+
+void	BvhWide::build(const Bvh* bvh, int width)
+{
+	clear();
+	m_bvh	= bvh;
+	m_width	= width == 8 ? 8 : 4;
+	if (bvh->m_nodes.empty())
+		return;
+	if (m_width == 8)
+		m_nodes8 = buildNodes<8, BvhWideNode8>(bvh, &m_numNodes, &m_srcNode);
+	else
+		m_nodes4 = buildNodes<4, BvhWideNode4>(bvh, &m_numNodes, &m_srcNode);
+}
+
+template<int W, typename Node>
+static void	refitNodes(const Bvh* bvh, const int* srcNode, Node* nodes, int nodeStart, int nodeEnd)
+{
+	for (int nodeIdx = nodeStart; nodeIdx < nodeEnd; ++nodeIdx)
+	{
+		Node* node = &nodes[nodeIdx];
+		for (int i = 0; i < W; ++i)
+		{
+			int src = srcNode[nodeIdx * W + i];
+			if (src < 0)
+				continue;
+			const BvhNode& child	= bvh->m_nodes[src];
+			node->boundMin[0][i]	= child.boundMin.x;
+			node->boundMin[1][i]	= child.boundMin.y;
+			node->boundMin[2][i]	= child.boundMin.z;
+			node->boundMax[0][i]	= child.boundMax.x;
+			node->boundMax[1][i]	= child.boundMax.y;
+			node->boundMax[2][i]	= child.boundMax.z;
+		}
+	}
+}
+
+static void	refitJob(void* userData, int jobIdx)
+{
+	BvhWide*	bvhWide		= (BvhWide*)userData;
+	int			nodeStart	= (int)((long long)bvhWide->m_numNodes *  jobIdx		/ BVH_WIDE_REFIT_JOB);
+	int			nodeEnd		= (int)((long long)bvhWide->m_numNodes * (jobIdx + 1)	/ BVH_WIDE_REFIT_JOB);
+	if (bvhWide->m_width == 8)
+		refitNodes<8, BvhWideNode8>(bvhWide->m_bvh, &bvhWide->m_srcNode[0], bvhWide->m_nodes8, nodeStart, nodeEnd);
+	else
+		refitNodes<4, BvhWideNode4>(bvhWide->m_bvh, &bvhWide->m_srcNode[0], bvhWide->m_nodes4, nodeStart, nodeEnd);
+}
+
+void	BvhWide::refit(ThreadPool* threadPool)
+{
+	if (m_numNodes == 0)
+		return;
+	if (threadPool != NULL && threadPool->getNumThread() > 1)
+		threadPool->parallelFor(refitJob, this, BVH_WIDE_REFIT_JOB);
+	else
+		for (int i = 0; i < BVH_WIDE_REFIT_JOB; ++i)
+			refitJob(this, i);
+}
+
+bool	BvhWide::rayCast(const Ray& ray, RayHit* hit) const
+{
+	if (m_width == 8)
+		return m_useSimd ? rayCastAvx2(ray, hit) : rayCastScalar<8, BvhWideNode8>(m_bvh, m_nodes8, m_numNodes, ray, hit);
+	else
+		return m_useSimd ? rayCastSse (ray, hit) : rayCastScalar<4, BvhWideNode4>(m_bvh, m_nodes4, m_numNodes, ray, hit);
+}
+
+bool	BvhWide::rayCastSse(const Ray& ray, RayHit* hit) const
+{
+	resetRayHit(hit);
+	if (m_numNodes == 0)
+		return false;
+
+	Vector3	dirInv		= rayDirInverse(ray.dir);
+	int		nearX		= dirInv.x < 0.0f ? 1 : 0;		// 0 == boundMin is the near plane
+	int		nearY		= dirInv.y < 0.0f ? 1 : 0;
+	int		nearZ		= dirInv.z < 0.0f ? 1 : 0;
+	__m128	posX		= _mm_set1_ps(ray.pos.x);
+	__m128	posY		= _mm_set1_ps(ray.pos.y);
+	__m128	posZ		= _mm_set1_ps(ray.pos.z);
+	__m128	invX		= _mm_set1_ps(dirInv.x);
+	__m128	invY		= _mm_set1_ps(dirInv.y);
+	__m128	invZ		= _mm_set1_ps(dirInv.z);
+	__m128	zero		= _mm_setzero_ps();
+	__m128	farScale	= _mm_set1_ps(BVH_WIDE_FAR_SCALE);
+
+	BvhWideStack stack;
+	stack.size			= 1;
+	stack.idx[0]		= 0;
+	stack.primCount[0]	= 0;
+	stack.t[0]			= 0.0f;
+	while (stack.size > 0)
+	{
+		--stack.size;
+		if (stack.t[stack.size] > hit->t)
+			continue;
+		if (stack.primCount[stack.size] > 0)
+		{
+			m_bvh->intersectLeaf(ray, stack.idx[stack.size], stack.primCount[stack.size], hit);
+			continue;
+		}
+
+		const BvhWideNode4*	node	= &m_nodes4[stack.idx[stack.size]];
+		const float*		bounds	= &node->boundMin[0][0];		// boundMax follow boundMin
+		__m128	tNearX	= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + (    nearX) * 12 + 0), posX), invX);
+		__m128	tNearY	= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + (    nearY) * 12 + 4), posY), invY);
+		__m128	tNearZ	= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + (    nearZ) * 12 + 8), posZ), invZ);
+		__m128	tFarX	= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + (1 - nearX) * 12 + 0), posX), invX);
+		__m128	tFarY	= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + (1 - nearY) * 12 + 4), posY), invY);
+		__m128	tFarZ	= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds + (1 - nearZ) * 12 + 8), posZ), invZ);
+		__m128	tNear	= _mm_max_ps(tNearX, _mm_max_ps(tNearY, _mm_max_ps(tNearZ, zero)));
+		__m128	tFar	= _mm_min_ps(_mm_mul_ps(_mm_min_ps(tFarX, _mm_min_ps(tFarY, tFarZ)), farScale), _mm_set1_ps(hit->t));
+		int		hitMask	= _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+		if (hitMask == 0)
+			continue;
+
+		alignas(16) float tNearArray[4];
+		_mm_store_ps(tNearArray, tNear);
+		if (!stack.pushChildren<4, BvhWideNode4>(node, hitMask, tNearArray))
+			return m_bvh->rayCast(ray, hit);		// the binary traversal handles any depth
+	}
+	return hit->t != RAY_MAX_T;
+}
+
+bool	BvhWide::rayCastAvx2(const Ray& ray, RayHit* hit) const
+{
+	resetRayHit(hit);
+	if (m_numNodes == 0)
+		return false;
+
+	Vector3	dirInv		= rayDirInverse(ray.dir);
+	int		nearX		= dirInv.x < 0.0f ? 1 : 0;
+	int		nearY		= dirInv.y < 0.0f ? 1 : 0;
+	int		nearZ		= dirInv.z < 0.0f ? 1 : 0;
+	__m256	posX		= _mm256_set1_ps(ray.pos.x);
+	__m256	posY		= _mm256_set1_ps(ray.pos.y);
+	__m256	posZ		= _mm256_set1_ps(ray.pos.z);
+	__m256	invX		= _mm256_set1_ps(dirInv.x);
+	__m256	invY		= _mm256_set1_ps(dirInv.y);
+	__m256	invZ		= _mm256_set1_ps(dirInv.z);
+	__m256	zero		= _mm256_setzero_ps();
+	__m256	farScale	= _mm256_set1_ps(BVH_WIDE_FAR_SCALE);
+
+	BvhWideStack stack;
+	stack.size			= 1;
+	stack.idx[0]		= 0;
+	stack.primCount[0]	= 0;
+	stack.t[0]			= 0.0f;
+	while (stack.size > 0)
+	{
+		--stack.size;
+		if (stack.t[stack.size] > hit->t)
+			continue;
+		if (stack.primCount[stack.size] > 0)
+		{
+			m_bvh->intersectLeaf(ray, stack.idx[stack.size], stack.primCount[stack.size], hit);
+			continue;
+		}
+
+		const BvhWideNode8*	node	= &m_nodes8[stack.idx[stack.size]];
+		const float*		bounds	= &node->boundMin[0][0];
+		__m256	tNearX	= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + (    nearX) * 24 +  0), posX), invX);
+		__m256	tNearY	= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + (    nearY) * 24 +  8), posY), invY);
+		__m256	tNearZ	= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + (    nearZ) * 24 + 16), posZ), invZ);
+		__m256	tFarX	= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + (1 - nearX) * 24 +  0), posX), invX);
+		__m256	tFarY	= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + (1 - nearY) * 24 +  8), posY), invY);
+		__m256	tFarZ	= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bounds + (1 - nearZ) * 24 + 16), posZ), invZ);
+		__m256	tNear	= _mm256_max_ps(tNearX, _mm256_max_ps(tNearY, _mm256_max_ps(tNearZ, zero)));
+		__m256	tFar	= _mm256_min_ps(_mm256_mul_ps(_mm256_min_ps(tFarX, _mm256_min_ps(tFarY, tFarZ)), farScale), _mm256_set1_ps(hit->t));
+		int		hitMask	= _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+		if (hitMask == 0)
+			continue;
+
+		alignas(32) float tNearArray[8];
+		_mm256_store_ps(tNearArray, tNear);
+		if (!stack.pushChildren<8, BvhWideNode8>(node, hitMask, tNearArray))
+			return m_bvh->rayCast(ray, hit);		// the binary traversal handles any depth
+	}
+	return hit->t != RAY_MAX_T;
+}
+
+int		BvhWide::getNodeMemorySize() const
+{
+	return m_numNodes * (m_width == 8 ? (int)sizeof(BvhWideNode8) : (int)sizeof(BvhWideNode4));
+}
+
+bool	BvhWide::isAvx2Supported()
+{
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// the OS must save the YMM registers
+	__cpuid(info, 1);
+	bool isOsxsave	= (info[2] & (1 << 27)) != 0;
+	bool isAvx		= (info[2] & (1 << 28)) != 0;
+	if (!isOsxsave || !isAvx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+}
+
+int		BvhWide::getBestWidth()
+{
+	static int bestWidth = isAvx2Supported() ? 8 : 4;
+	return bestWidth;
+}
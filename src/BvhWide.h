@@ -0,0 +1,56 @@
+#pragma once
+
+// all rights reserved
+
+#include "Bvh.h"
+
+// SoA child bounds, so all children are slab tested with one SIMD instruction per plane,
+// unused child slots have an inverted infinite bound which never pass the slab test
+struct alignas(16) BvhWideNode4
+{	// 128 byte
+	float	boundMin[3][4];		// [axis][child]
+	float	boundMax[3][4];
+	int		childIdx[4];		// node index if childPrimCount == 0, else first index into Bvh::m_primTri
+	int		childPrimCount[4];
+};
+
+struct alignas(32) BvhWideNode8
+{	// 256 byte
+	float	boundMin[3][8];
+	float	boundMax[3][8];
+	int		childIdx[8];
+	int		childPrimCount[8];
+};
+
+// 4-wide (SSE) or 8-wide (AVX2) BVH collapsed from the binary Bvh, the leaves and triangle order
+// are shared with the source Bvh, which must be kept alive
+class BvhWide
+{
+public:
+	BvhWideNode4*	m_nodes4;
+	BvhWideNode8*	m_nodes8;
+	int				m_numNodes;
+	int				m_width;
+	bool			m_useSimd;		// false to run the scalar slab test on the same nodes
+	const Bvh*		m_bvh;
+	std::vector<int>	m_srcNode;		// binary BVH node of each child slot, -1 for unused slot
+
+	BvhWide();
+	~BvhWide();
+
+	void	clear();
+	void	build(const Bvh* bvh, int width);
+	void	refit(ThreadPool* threadPool);		// copy the child bounds from the source Bvh after Bvh::refit()
+	bool	rayCast(const Ray& ray, RayHit* hit) const;
+	int		getNodeMemorySize() const;		// byte
+
+	static bool	isAvx2Supported();
+	static int	getBestWidth();				// 8 if the CPU support AVX2, else 4
+
+private:
+	BvhWide(const BvhWide&);
+	BvhWide& operator=(const BvhWide&);
+
+	bool	rayCastSse(const Ray& ray, RayHit* hit) const;
+	bool	rayCastAvx2(const Ray& ray, RayHit* hit) const;
+};
@@ -0,0 +1,728 @@
+
+// all rights reserved
+
+#include "CpuPathTracer.h"
+
+#define CPU_PATH_TRACER_FRUSTUM_MARGIN	(0.01f)		// in pixel, the packet frustum is enlarged to stay conservative against rounding
+#define CPU_PATH_TRACER_GUIDE_VERTEX	(16)		// bounces of a path recorded to the path guide
+#define CPU_PATH_TRACER_ROULETTE_DEPTH	(3)			// first vertex where PathTermination_Throughput may terminate the path, earlier costs more noise than time in the Cornell box
+#define CPU_PATH_TRACER_SURVIVAL_MIN	(0.05f)		// lower bound of the survival probability, so a surviving path never gets a huge weight
+#define CPU_PATH_TRACER_WEIGHT_WINDOW	(5.0f)		// ratio between the upper and lower bound of the expected contribution left untouched
+#define CPU_PATH_TRACER_SPLIT_MAX		(4)			// paths split at 1 vertex
+#define CPU_PATH_TRACER_BRANCH_MAX		(16)		// split paths waiting to be traced
+#define CPU_PATH_TRACER_PASS_SPP_MAX	(256)
+#define CPU_PATH_TRACER_PASS_GROWTH		(2)			// the samples of a pass grow by at most this factor, a noisy first measurement cannot overshoot the budget much
+#define CPU_PATH_TRACER_PASS_SMOOTH		(0.5f)		// weight of the latest pass in the averaged sample time
+
+// a split path waiting to be traced from the vertex at depth
+struct PathBranch
+{
+	Ray				ray;
+	Vector3			coefBrdf;
+	int				depth;
+	unsigned int	randSeed;
+};
+
+// radiance added to the path before the ray leaving the vertex, so the incident radiance along it is known at the end of the path
+struct GuidePathVertex
+{
+	Vector3	pos;
+	Vector3	dir;
+	Vector3	coefBrdf;			// including the bounce
+	Vector3	radianceBefore;
+	float	cosTheta;
+	float	pdf;
+};
+
+static Vector3	createPerpendicularVector(const Vector3& u)
+{
+	// cross with the axis which is most perpendicular to u
+	float ax = fabsf(u.x);
+	float ay = fabsf(u.y);
+	float az = fabsf(u.z);
+	Vector3 axis;
+	if (ax <= ay && ax <= az)
+		axis = Vector3(1, 0, 0);
+	else if (ay <= az)
+		axis = Vector3(0, 1, 0);
+	else
+		axis = Vector3(0, 0, 1);
+	Vector3 v = u.cross(axis);
+	v.normalize();
+	return v;
+}
+
+// sample the direction leaving a vertex from the guiding distribution or the cosine weighted hemisphere,
+// return the pdf of the combination, or 0 if the guide sampled a direction below the surface
+static float	sampleBounceDir(const PathGuideDirTree* guideTree, const Vector3& hitNormal, unsigned int* randSeed, Vector3* outDir, float* outCosTheta)
+{
+	// the guiding distribution and the cosine weighted hemisphere are combined by one-sample MIS with the balance heuristic,
+	// the BRDF alone can sample every direction, so the result is unbiased whatever the guide learnt
+	Vector3	randDirWS;
+	float	cosTheta;
+	float	guidePdf	= 0.0f;
+	if (guideTree && randFloat(randSeed) < PATH_GUIDE_SAMPLE_RATIO)
+	{
+		float	u0	= randFloat(randSeed);
+		float	u1	= randFloat(randSeed);
+		randDirWS	= guideTree->sample(u0, u1, &guidePdf);
+		cosTheta	= randDirWS.dot(hitNormal);
+		if (cosTheta <= 0.0f)
+			return 0.0f;
+	}
+	else
+	{
+		// cosine weighted hemisphere sampling
+		float	r0			= randFloat(randSeed);
+		float	r1			= fmaxf(randFloat(randSeed), 0.001f);
+		float	phi			= 2.0f * PI * r0;
+		float	sinTheta	= sqrtf(1.0f - r1);
+		cosTheta			= sqrtf(r1);
+
+		// convert to world space
+		Vector3	binormal	= createPerpendicularVector(hitNormal);
+		Vector3	tangent		= hitNormal.cross(binormal);
+		tangent.normalize();
+		randDirWS			= tangent * (sinTheta * cosf(phi)) + binormal * (sinTheta * sinf(phi)) + hitNormal * cosTheta;
+		if (guideTree)
+			guidePdf		= guideTree->pdf(randDirWS);
+	}
+	float	pdf		= cosTheta / PI;
+	if (guideTree)
+		pdf			= (1.0f - PATH_GUIDE_SAMPLE_RATIO) * pdf + PATH_GUIDE_SAMPLE_RATIO * guidePdf;
+	*outDir			= randDirWS;
+	*outCosTheta	= cosTheta;
+	return pdf;
+}
+
+static Vector3	getAreaLightNormal(const AreaLight& light)
+{
+	// local space y axis
+	return Vector3(light.xform.f[4], light.xform.f[5], light.xform.f[6]);
+}
+
+static Vector3	sampleAreaLightPos(const AreaLight& light, float u, float v)
+{
+	float x = (u * 2.0f - 1.0f) * light.halfWidth;
+	float z = (v * 2.0f - 1.0f) * light.halfHeight;
+	return (light.xform * Vector4(x, 0, z, 1)).xyz();
+}
+
+// spherical rectangle sampling (Urena et al. 2013) in the light space, where the light is the rect
+// [-halfWidth, halfWidth] x [-halfHeight, halfHeight] on the xz plane facing +y and posLS.y > 0,
+// return the solid angle of the light, or 0 if it is too small to be worth the cost
+static float	sampleAreaLightSolidAngle(const AreaLight& light, const Vector3& posLS, float u, float v, Vector3* outDirLS)
+{
+	// a far light is sampled almost uniformly in solid angle by area sampling already
+	float	dist2	= posLS.length2();
+	if (posLS.y < AREA_LIGHT_SOLID_ANGLE_MIN * light.oneOverArea * dist2 * sqrtf(dist2))
+		return 0.0f;
+
+	// rect relative to posLS in the frame (x, z, -y), so that the rect lies on the plane at depth z0 < 0
+	float	x0		= -light.halfWidth	- posLS.x;
+	float	x1		=  light.halfWidth	- posLS.x;
+	float	y0		= -light.halfHeight	- posLS.z;
+	float	y1		=  light.halfHeight	- posLS.z;
+	float	z0		= -posLS.y;
+	float	z0sq	= z0 * z0;
+
+	// normals of the 4 planes through posLS and the rect edges
+	float	len0	= 1.0f / sqrtf(z0sq + y0 * y0);
+	float	len1	= 1.0f / sqrtf(z0sq + x1 * x1);
+	float	len2	= 1.0f / sqrtf(z0sq + y1 * y1);
+	float	len3	= 1.0f / sqrtf(z0sq + x0 * x0);
+	Vector3	n0		= Vector3(0.0f	, z0	, -y0	) * len0;
+	Vector3	n1		= Vector3(-z0	, 0.0f	, x1	) * len1;
+	Vector3	n2		= Vector3(0.0f	, -z0	, y1	) * len2;
+	Vector3	n3		= Vector3(z0	, 0.0f	, -x0	) * len3;
+
+	// internal angles of the spherical rect
+	float	g0		= acosf(clampf(-n0.dot(n1), -1.0f, 1.0f));
+	float	g1		= acosf(clampf(-n1.dot(n2), -1.0f, 1.0f));
+	float	g2		= acosf(clampf(-n2.dot(n3), -1.0f, 1.0f));
+	float	g3		= acosf(clampf(-n3.dot(n0), -1.0f, 1.0f));
+	float	b0		= n0.z;
+	float	b1		= n2.z;
+	float	k		= 2.0f * PI - g2 - g3;
+	float	solidAngle	= g0 + g1 - k;
+	if (solidAngle <= 0.0f)
+		return 0.0f;
+
+	// sample x so that the sub-rect [x0, xu] covers u of the solid angle
+	float	au		= u * solidAngle + k;
+	float	fu		= (cosf(au) * b0 - b1) / sinf(au);
+	float	cu		= clampf((fu > 0.0f ? 1.0f : -1.0f) / sqrtf(fu * fu + b0 * b0), -1.0f, 1.0f);
+	float	xu		= clampf(-(cu * z0) / sqrtf(maxf(1.0f - cu * cu, 1e-12f)), x0, x1);
+
+	// sample y uniformly in the projected height
+	float	d		= sqrtf(xu * xu + z0sq);
+	float	h0		= y0 / sqrtf(d * d + y0 * y0);
+	float	h1		= y1 / sqrtf(d * d + y1 * y1);
+	float	hv		= h0 + v * (h1 - h0);
+	float	hv2		= hv * hv;
+	float	yv		= hv2 < 1.0f - 1e-6f ? (hv * d) / sqrtf(1.0f - hv2) : y1;
+	*outDirLS		= Vector3(xu, z0, yv);
+	return solidAngle;
+}
+
+// sample a direction from pos toward the light, return the pdf in solid angle, or 0 if pos is behind the light
+static float	sampleAreaLightDir(const AreaLight& light, const Vector3& pos, unsigned int* randSeed, Vector3* outDir, float* outDist)
+{
+	float	u		= randFloat(randSeed);
+	float	v		= randFloat(randSeed);
+	Vector3	posLS	= (light.xformInv * Vector4(pos, 1)).xyz();
+	if (posLS.y <= 0.0f)
+		return 0.0f;
+
+	Vector3	dirLS;
+	float	solidAngle	= light.sampling == AreaLightSampling_SolidAngle ? sampleAreaLightSolidAngle(light, posLS, u, v, &dirLS) : 0.0f;
+	if (solidAngle > 0.0f)
+	{
+		Vector3	dir		= (light.xform * Vector4(dirLS, 0)).xyz();
+		float	dist	= dir.length();
+		*outDir			= dir / dist;
+		*outDist		= dist;
+		return 1.0f / solidAngle;
+	}
+
+	// uniform over the area, converted to solid angle
+	Vector3	dir			= sampleAreaLightPos(light, u, v) - pos;
+	float	dist2		= dir.length2();
+	float	dist		= sqrtf(dist2);
+	dir					= dir / dist;
+	float	lightAngle	= -dir.dot(getAreaLightNormal(light));
+	*outDir				= dir;
+	*outDist			= dist;
+	return lightAngle > 0.0f ? light.oneOverArea * dist2 / lightAngle : 0.0f;
+}
+
+// pick an emissive triangle in proportion to its power and a uniform point on it,
+// return the pdf in solid angle, or 0 if the front face of the triangle does not face pos
+static float	sampleEmissiveTriangle(const Scene& scene, const Vector3& pos, unsigned int* randSeed, Vector3* outDir, float* outDist, int2* outTri)
+{
+	int				i		= aliasTableSample(&scene.emissiveTable[0], (int)scene.emissiveTable.size(), randFloat(randSeed));
+	float			su		= sqrtf(randFloat(randSeed));
+	float			v		= randFloat(randSeed);
+	int2			tri		= scene.emissiveTri[i];
+	const Vector3&	pos0	= scene.triPos[scene.triIdx[tri.x	 ]];
+	const Vector3&	pos1	= scene.triPos[scene.triIdx[tri.x + 1]];
+	const Vector3&	pos2	= scene.triPos[scene.triIdx[tri.x + 2]];
+	Vector3			normal	= (pos1 - pos0).cross(pos2 - pos0);
+	float			area	= normal.length() * 0.5f;
+	normal					= normal * (0.5f / area);
+
+	Vector3	dir			= pos0 * (1.0f - su) + pos1 * (su * (1.0f - v)) + pos2 * (su * v) - pos;
+	float	dist2		= dir.length2();
+	float	dist		= sqrtf(dist2);
+	dir					= dir / dist;
+	float	lightAngle	= -dir.dot(normal);
+	*outDir				= dir;
+	*outDist			= dist;
+	*outTri				= tri;
+	return lightAngle > 0.0f ? scene.emissiveTable[i].pdf / area * dist2 / lightAngle : 0.0f;
+}
+
+CpuPathTracer::CpuPathTracer()
+{
+	m_scene			= nullptr;
+	m_width			= 0;
+	m_height		= 0;
+	m_traceDepth	= 10;
+	m_usePacket		= true;
+	m_radianceCache	= nullptr;
+	m_radianceCacheDepth	= 1;
+	m_pathGuide		= nullptr;
+	m_termination	= PathTermination_Albedo;
+	m_terminationCache	= nullptr;
+}
+
+void	CpuPathTracer::init(const Scene* scene)
+{
+	m_scene		= scene;
+}
+
+void	CpuPathTracer::setCamera(const CpuCamera& camera, int width, int height)
+{
+	m_camera	= camera;
+	m_width		= width;
+	m_height	= height;
+
+	// same as RayTracer::updateViewConstantBuffer()
+	Matrix4x4	camLookAt	= Matrix4x4::CreateLookAt(	camera.pos,
+														camera.lookAt,
+														Vector3(0.0f, 1.0f, 0.0f)			);
+	Matrix4x4	camProj		= Matrix4x4::CreatePerspectiveProjection(camera.fovY, width / (float)height, 0.100f, 1.000f);
+	m_projInv				= (camProj * camLookAt).inverse();
+}
+
+Ray		CpuPathTracer::generateCameraRay(float x, float y) const
+{
+	float	ndcX	= (x / m_width ) * 2.0f - 1.0f;
+	float	ndcY	= 1.0f - (y / m_height) * 2.0f;
+	Vector4	posWS	= m_projInv * Vector4(ndcX, ndcY, -1.0f, 1.0f);
+	posWS			= posWS / posWS.w;
+
+	Ray ray;
+	ray.pos			= m_camera.pos;
+	ray.dir			= posWS.xyz() - m_camera.pos;
+	ray.dir.normalize();
+	return ray;
+}
+
+void	CpuPathTracer::renderTile(AccumBuffer* accum, int x0, int y0, int x1, int y1, int sampleStart, int sampleCount) const
+{
+	if (isPacketEnabled())
+	{
+		for(int y= y0; y<y1; y+= RAY_PACKET_WIDTH)
+			for(int x= x0; x<x1; x+= RAY_PACKET_WIDTH)
+				renderBlock(accum, x, y, x + RAY_PACKET_WIDTH < x1 ? x + RAY_PACKET_WIDTH : x1, y + RAY_PACKET_WIDTH < y1 ? y + RAY_PACKET_WIDTH : y1, sampleStart, sampleCount);
+		return;
+	}
+
+	for(int y= y0; y<y1; ++y)
+		for(int x= x0; x<x1; ++x)
+		{
+			// accumulate in register and write once per pixel
+			Vector3 sum(0, 0, 0);
+			for(int s=0; s<sampleCount; ++s)
+				sum += tracePath(x, y, sampleStart + s);
+
+			int idx = y * accum->width + x;
+			accum->radianceSum[idx].x	+= sum.x;
+			accum->radianceSum[idx].y	+= sum.y;
+			accum->radianceSum[idx].z	+= sum.z;
+			accum->sampleCount[idx]		+= sampleCount;
+		}
+}
+
+void	CpuPathTracer::renderBlock(AccumBuffer* accum, int x0, int y0, int x1, int y1, int sampleStart, int sampleCount) const
+{
+	// the jittered camera rays of each sample are traced as a packet, then every path continue on its own,
+	// the random sequence is the same as tracePath() so the result does not depend on m_usePacket
+	Vector3			sum[RAY_PACKET_SIZE];
+	unsigned int	randSeed[RAY_PACKET_SIZE];
+	RayHit			hits[RAY_PACKET_SIZE];
+	RayPacket		packet;
+	int				blockWidth	= x1 - x0;
+	int				numPixel	= blockWidth * (y1 - y0);
+	for(int i=0; i<numPixel; ++i)
+		sum[i] = Vector3(0, 0, 0);
+	for(int s=0; s<sampleCount; ++s)
+	{
+		initPacket(&packet, x0, y0, x1, y1);
+		for(int i=0; i<numPixel; ++i)
+		{
+			Ray ray;
+			randSeed[i] = initPath(x0 + i % blockWidth, y0 + i / blockWidth, sampleStart + s, &ray);
+			rayPacketAddRay(&packet, ray.dir);
+		}
+		rayPacketCast(m_scene->bvh, packet, hits, NULL);
+		for(int i=0; i<numPixel; ++i)
+		{
+			Ray ray;
+			ray.pos	= packet.pos;
+			ray.dir	= Vector3(packet.dirX[i], packet.dirY[i], packet.dirZ[i]);
+			sum[i]	+= shadePath(ray, hits[i], randSeed[i], NULL);
+		}
+	}
+
+	for(int i=0; i<numPixel; ++i)
+	{
+		int idx = (y0 + i / blockWidth) * accum->width + x0 + i % blockWidth;
+		accum->radianceSum[idx].x	+= sum[i].x;
+		accum->radianceSum[idx].y	+= sum[i].y;
+		accum->radianceSum[idx].z	+= sum[i].z;
+		accum->sampleCount[idx]		+= sampleCount;
+	}
+}
+
+bool	CpuPathTracer::isPacketEnabled() const
+{
+	return m_usePacket && m_scene->accel != SceneAccel_BruteForce && !m_scene->bvh.m_nodes.empty();
+}
+
+void	CpuPathTracer::initPacket(RayPacket* packet, int x0, int y0, int x1, int y1) const
+{
+	const float	margin		= CPU_PATH_TRACER_FRUSTUM_MARGIN;
+	Vector3		cornerDir[4];
+	cornerDir[0]			= generateCameraRay(x0 - margin, y0 - margin).dir;
+	cornerDir[1]			= generateCameraRay(x1 + margin, y0 - margin).dir;
+	cornerDir[2]			= generateCameraRay(x1 + margin, y1 + margin).dir;
+	cornerDir[3]			= generateCameraRay(x0 - margin, y1 + margin).dir;
+	rayPacketInit(packet, m_camera.pos);
+	rayPacketSetFrustum(packet, cornerDir);
+}
+
+void	CpuPathTracer::tracePrimaryHits(int x0, int y0, int x1, int y1, RayHit* hits, RayPacketStats* stats) const
+{
+	int width = x1 - x0;
+	if (!isPacketEnabled())
+	{
+		for(int y= y0; y<y1; ++y)
+			for(int x= x0; x<x1; ++x)
+				m_scene->rayCast(generateCameraRay(x + 0.5f, y + 0.5f), &hits[(y - y0) * width + x - x0]);
+		return;
+	}
+
+	RayPacket	packet;
+	RayHit		blockHits[RAY_PACKET_SIZE];
+	for(int by= y0; by<y1; by+= RAY_PACKET_WIDTH)
+		for(int bx= x0; bx<x1; bx+= RAY_PACKET_WIDTH)
+		{
+			int bx1 = bx + RAY_PACKET_WIDTH < x1 ? bx + RAY_PACKET_WIDTH : x1;
+			int by1 = by + RAY_PACKET_WIDTH < y1 ? by + RAY_PACKET_WIDTH : y1;
+			initPacket(&packet, bx, by, bx1, by1);
+			for(int y= by; y<by1; ++y)
+				for(int x= bx; x<bx1; ++x)
+					rayPacketAddRay(&packet, generateCameraRay(x + 0.5f, y + 0.5f).dir);
+			rayPacketCast(m_scene->bvh, packet, blockHits, stats);
+
+			int i = 0;
+			for(int y= by; y<by1; ++y)
+				for(int x= bx; x<bx1; ++x)
+					hits[(y - y0) * width + x - x0] = blockHits[i++];
+		}
+}
+
+void	CpuPathTracer::renderSamples(AccumBuffer* accum, int sampleStart, int sampleCount) const
+{
+	renderTile(accum, 0, 0, m_width, m_height, sampleStart, sampleCount);
+}
+
+CpuPassBudget::CpuPassBudget()
+{
+	init(0.0f);
+}
+
+void	CpuPassBudget::init(float passBudgetMs)
+{
+	budgetMs		= passBudgetMs;
+	sampleTimeMs	= 0.0;
+	lastSampleCount	= 0;
+}
+
+int		CpuPassBudget::getSampleCount(int sampleLeft) const
+{
+	int num = 1;
+	if (sampleTimeMs > 0.0)
+	{
+		int numMax	= lastSampleCount * CPU_PATH_TRACER_PASS_GROWTH < CPU_PATH_TRACER_PASS_SPP_MAX ? lastSampleCount * CPU_PATH_TRACER_PASS_GROWTH : CPU_PATH_TRACER_PASS_SPP_MAX;
+		num			= (int)(budgetMs / sampleTimeMs);
+		num			= num < 1 ? 1 : (num > numMax ? numMax : num);
+	}
+	return num < sampleLeft ? num : sampleLeft;
+}
+
+void	CpuPassBudget::addPass(int sampleCount, double elapsedMs)
+{
+	double time		= elapsedMs / sampleCount;
+	sampleTimeMs	= sampleTimeMs > 0.0 ? sampleTimeMs + (time - sampleTimeMs) * CPU_PATH_TRACER_PASS_SMOOTH : time;
+	lastSampleCount	= sampleCount;
+}
+
+void	CpuPathTracer::computeTermination(int depth, const Vector3& coefBrdf, const Vector3& albedo, const Vector3& emissive, const Vector3& hitPos, const Vector3& hitNormal,
+											float pixelEstimate, float* outSurvival, int* outSplit) const
+{
+	*outSurvival	= 1.0f;
+	*outSplit		= 1;
+	if (m_termination == PathTermination_Throughput)
+	{
+		// throughput after the cosine weighted bounce, so a surviving path is weighted back to about 1
+		if (depth >= CPU_PATH_TRACER_ROULETTE_DEPTH)
+			*outSurvival = clampf((coefBrdf * albedo).maxComponent() * PI, CPU_PATH_TRACER_SURVIVAL_MIN, 1.0f);
+		return;
+	}
+
+	// weight window around the pixel estimate: the expected contribution of the path leaving the vertex is its throughput times
+	// the cached outgoing radiance without the emission, which over-estimates it by the light sampled at the vertex.
+	// Paths below the window survive with the probability to reach the pixel estimate, paths above it are split to get back into it
+	Vector3 radiance;
+	if (m_termination == PathTermination_Adjoint && pixelEstimate > 0.0f && m_terminationCache && m_terminationCache->query(hitPos, hitNormal, &radiance))
+	{
+		Vector3	contribution	= coefBrdf * (radiance - emissive);
+		float	expected		= (contribution.x + contribution.y + contribution.z) * (1.0f / 3.0f);
+		float	windowMin		= pixelEstimate * (2.0f / (1.0f + CPU_PATH_TRACER_WEIGHT_WINDOW));
+		if (expected < windowMin)
+			*outSurvival	= maxf(expected / pixelEstimate, CPU_PATH_TRACER_SURVIVAL_MIN);
+		else if (expected > windowMin * CPU_PATH_TRACER_WEIGHT_WINDOW)
+		{
+			int numSplit	= (int)ceilf(expected / pixelEstimate);
+			*outSplit		= numSplit < CPU_PATH_TRACER_SPLIT_MAX ? numSplit : CPU_PATH_TRACER_SPLIT_MAX;
+		}
+		return;
+	}
+
+	// skip russian roulette in first few iteration to reduce noise
+	if (depth > 5)
+		*outSurvival = minf(albedo.maxComponent() * PI, 1.0f);
+}
+
+Vector3	CpuPathTracer::tracePath(int px, int py, int sampleIdx) const
+{
+	Ray				primaryRay;
+	RayHit			primaryHit;
+	unsigned int	randSeed	= initPath(px, py, sampleIdx, &primaryRay);
+	m_scene->rayCast(primaryRay, &primaryHit);
+	return shadePath(primaryRay, primaryHit, randSeed, NULL);
+}
+
+unsigned int	CpuPathTracer::initPath(int px, int py, int sampleIdx, Ray* primaryRay) const
+{
+	unsigned int	randSeed	= wangHash((unsigned int)(py * m_width + px) * 9781u + wangHash((unsigned int)sampleIdx + 1));
+
+	// generate primary ray with sub-pixel jitter
+	float	jitterX		= randFloat(&randSeed);
+	float	jitterY		= randFloat(&randSeed);
+	*primaryRay			= generateCameraRay(px + jitterX, py + jitterY);
+	return randSeed;
+}
+
+Vector3	CpuPathTracer::shadePath(const Ray& primaryRay, const RayHit& primaryHit, unsigned int randSeed, const Vector3* primaryEmissiveDirect) const
+{
+	const Scene&	scene		= *m_scene;
+	Ray				ray			= primaryRay;
+
+	Vector3	coefBrdf				= Vector3(1, 1, 1);
+	Vector3	totalOutgoingRadiance	= Vector3(0, 0, 0);
+	float	primaryHitT				= -1.0f;
+	RayHit	hit						= primaryHit;
+
+	// a training path is traced to the end and writes the outgoing radiance of its vertex at m_radianceCacheDepth to the cache,
+	// other paths are terminated there by the cache. Deeper vertices are not written, as the path depth limit leaves them
+	// fewer bounces than the one replaced by the cache, which would darken it
+	bool	isCacheTraining			= m_radianceCache && randFloat(&randSeed) < RADIANCE_CACHE_TRAIN_RATIO;
+	bool	isCacheVertexHit		= false;
+	Vector3	cacheVertexPos				= Vector3(0, 0, 0);
+	Vector3	cacheVertexNormal			= Vector3(0, 0, 0);
+	Vector3	cacheVertexCoef				= Vector3(0, 0, 0);
+	Vector3	cacheVertexRadianceBefore	= Vector3(0, 0, 0);
+
+	GuidePathVertex	guideVertex[CPU_PATH_TRACER_GUIDE_VERTEX];
+	int				numGuideVertex	= 0;
+
+	// path tracing iteration, the primary hit is already traced, then the split paths from the last one
+	PathBranch	branches[CPU_PATH_TRACER_BRANCH_MAX];
+	int			numBranch		= 0;
+	int			depthStart		= 0;
+	float		pixelEstimate	= 0.0f;		// 0 if unknown
+	for(;;)
+	{
+		for(int d=depthStart; d<m_traceDepth; ++d)
+		{
+			bool isHit = d == 0 ? hit.t != RAY_MAX_T : scene.rayCast(ray, &hit);
+			if (!isHit)
+			{
+				// the environment map hit by the BRDF sampled rays is already counted by the light sampling below
+				if (d == 0 && !scene.envMap.isEmpty())
+					totalOutgoingRadiance += scene.envMap.lookup(ray.dir);
+				break;
+			}
+
+			// compute hit surface parameter
+			const Material&	hitMaterial	= scene.meshMaterial[hit.meshIdx];
+			Vector3			albedo		= hitMaterial.albedo.xyz();
+			Vector3			hitPos		= ray.pos + ray.dir * hit.t;
+			Vector3			hitNormal	= scene.computeHitNormal(hit);
+			if (d == 0)
+			{
+				primaryHitT = hit.t;
+				Vector3 cachedRadiance;
+				if (m_termination == PathTermination_Adjoint && m_terminationCache && m_terminationCache->query(hitPos, hitNormal, &cachedRadiance))
+					pixelEstimate = (cachedRadiance.x + cachedRadiance.y + cachedRadiance.z) * (1.0f / 3.0f);
+			}
+			if (m_radianceCache && d == m_radianceCacheDepth)
+			{
+				Vector3 cachedRadiance;
+				if (isCacheTraining)
+				{
+					isCacheVertexHit			= true;
+					cacheVertexPos				= hitPos;
+					cacheVertexNormal			= hitNormal;
+					cacheVertexCoef				= coefBrdf;
+					cacheVertexRadianceBefore	= totalOutgoingRadiance;
+				}
+				else if (m_radianceCache->query(hitPos, hitNormal, &cachedRadiance))
+				{
+					totalOutgoingRadiance += coefBrdf * cachedRadiance;
+					break;
+				}
+			}
+
+			// direct lighting, the emissive triangles hit by the BRDF sampled rays are already counted by the light sampling below
+			bool isEmissionSampled = d > 0 && !scene.emissiveTri.empty() && (scene.meshFlag[hit.meshIdx] & MESH_FLAG_ANALYTIC) == 0;
+			if (!isEmissionSampled)
+				totalOutgoingRadiance += coefBrdf * hitMaterial.emissive.xyz();
+			for(int l= 0; l<scene.numLight; ++l)
+			{
+				// sample light direction
+				const float			shadowRayEpsilon	= 0.000001f;
+				const AreaLight&	light				= scene.areaLight[l];
+				Vector3				lightDir;
+				float				len;
+				float				propability			= sampleAreaLightDir(light, hitPos, &randSeed, &lightDir, &len);
+				float				cosFactor			= lightDir.dot(hitNormal);
+				if (propability <= 0.0f || cosFactor <= 0.0f)
+					continue;
+
+				// cast shadow ray
+				Ray		shadowRay;
+				RayHit	shadowHit;
+				shadowRay.dir	= lightDir;
+				shadowRay.pos	= hitPos + lightDir * shadowRayEpsilon;
+				if (scene.rayCast(shadowRay, &shadowHit) && shadowHit.t >= shadowRayEpsilon && shadowHit.t < len)
+					continue;
+
+				totalOutgoingRadiance	+= light.radiance.xyz() * coefBrdf * albedo * (cosFactor / propability);
+			}
+			if (d == 0 && primaryEmissiveDirect)
+				totalOutgoingRadiance += *primaryEmissiveDirect;
+			else if (!scene.emissiveTri.empty())
+			{
+				// sample 1 emissive triangle
+				const float	shadowRayEpsilon	= 0.000001f;
+				Vector3		lightDir;
+				float		len;
+				int2		lightTri;
+				float		propability			= sampleEmissiveTriangle(scene, hitPos, &randSeed, &lightDir, &len, &lightTri);
+				float		cosFactor			= lightDir.dot(hitNormal);
+				if (propability > 0.0f && cosFactor > 0.0f)
+				{
+					// cast shadow ray, hitting the sampled triangle itself is not a shadow
+					Ray		shadowRay;
+					RayHit	shadowHit;
+					shadowRay.dir	= lightDir;
+					shadowRay.pos	= hitPos + lightDir * shadowRayEpsilon;
+					bool	isShadowed	= scene.rayCast(shadowRay, &shadowHit) && shadowHit.t >= shadowRayEpsilon && shadowHit.t < len && shadowHit.triangle != lightTri.x / 3;
+					if (!isShadowed)
+						totalOutgoingRadiance	+= scene.meshMaterial[lightTri.y].emissive.xyz() * coefBrdf * albedo * (cosFactor / propability);
+				}
+			}
+			if (!scene.envMap.isEmpty())
+			{
+				// sample 1 environment map direction, any hit is a shadow
+				const float	shadowRayEpsilon	= 0.000001f;
+				Vector3		lightDir;
+				Vector3		radiance;
+				float		u0					= randFloat(&randSeed);
+				float		u1					= randFloat(&randSeed);
+				float		u2					= randFloat(&randSeed);
+				float		propability			= scene.envMap.sample(u0, u1, u2, &lightDir, &radiance);
+				float		cosFactor			= lightDir.dot(hitNormal);
+				if (propability > 0.0f && cosFactor > 0.0f)
+				{
+					Ray		shadowRay;
+					RayHit	shadowHit;
+					shadowRay.dir	= lightDir;
+					shadowRay.pos	= hitPos + lightDir * shadowRayEpsilon;
+					if (!scene.rayCast(shadowRay, &shadowHit) || shadowHit.t < shadowRayEpsilon)
+						totalOutgoingRadiance	+= radiance * coefBrdf * albedo * (cosFactor / propability);
+				}
+			}
+
+			// russian roulette and splitting, the weight of the surviving paths is raised to stay unbiased
+			float	survival;
+			int		numSplit;
+			computeTermination(d, coefBrdf, albedo, hitMaterial.emissive.xyz(), hitPos, hitNormal, pixelEstimate, &survival, &numSplit);
+			if (survival < 1.0f)
+			{
+				if (randFloat(&randSeed) > survival)
+					break;
+				coefBrdf *= 1.0f / survival;
+			}
+
+			// a split path is traced after this one with its own random sequence, the guide and the cache training
+			// expect 1 chain of vertices, so their paths are never split
+			const PathGuideDirTree*	guideTree	= m_pathGuide ? m_pathGuide->findSamplingTree(hitPos) : NULL;
+			if (!m_pathGuide && !isCacheTraining && d + 1 < m_traceDepth)
+				numSplit = numSplit < CPU_PATH_TRACER_BRANCH_MAX - numBranch + 1 ? numSplit : CPU_PATH_TRACER_BRANCH_MAX - numBranch + 1;
+			else
+				numSplit = 1;
+			if (numSplit > 1)
+				coefBrdf *= 1.0f / numSplit;
+			for(int i=1; i<numSplit; ++i)
+			{
+				Vector3			splitDir;
+				float			splitCosTheta;
+				unsigned int	splitSeed	= wangHash(randSeed ^ (i * 0x9e3779b9u));
+				float			splitPdf	= sampleBounceDir(guideTree, hitNormal, &splitSeed, &splitDir, &splitCosTheta);
+				if (splitPdf <= 0.0f)
+					continue;
+				PathBranch& branch	= branches[numBranch++];
+				branch.ray.pos		= hitPos;
+				branch.ray.dir		= splitDir;
+				branch.coefBrdf		= coefBrdf * albedo * (splitCosTheta / splitPdf);
+				branch.depth		= d + 1;
+				branch.randSeed		= splitSeed;
+			}
+
+			Vector3	randDirWS;
+			float	cosTheta;
+			float	pdf			= sampleBounceDir(guideTree, hitNormal, &randSeed, &randDirWS, &cosTheta);
+			if (pdf <= 0.0f)
+				break;
+
+			ray.pos				= hitPos;
+			ray.dir				= randDirWS;
+			coefBrdf			*= albedo * (cosTheta / pdf);
+			if (m_pathGuide && d + 1 < m_traceDepth && numGuideVertex < CPU_PATH_TRACER_GUIDE_VERTEX)
+			{
+				GuidePathVertex& vertex	= guideVertex[numGuideVertex++];
+				vertex.pos				= hitPos;
+				vertex.dir				= randDirWS;
+				vertex.coefBrdf			= coefBrdf;
+				vertex.radianceBefore	= totalOutgoingRadiance;
+				vertex.cosTheta			= cosTheta;
+				vertex.pdf				= pdf;
+			}
+		}
+		if (numBranch == 0)
+			break;
+		const PathBranch& branch	= branches[--numBranch];
+		ray							= branch.ray;
+		coefBrdf					= branch.coefBrdf;
+		depthStart					= branch.depth;
+		randSeed					= branch.randSeed;
+	}
+
+	// outgoing radiance of the vertex is the radiance added after it, without the throughput before it
+	if (isCacheVertexHit && cacheVertexCoef.x > 0.0f && cacheVertexCoef.y > 0.0f && cacheVertexCoef.z > 0.0f)
+	{
+		Vector3 radiance = totalOutgoingRadiance - cacheVertexRadianceBefore;
+		m_radianceCache->update(cacheVertexPos, cacheVertexNormal, Vector3(radiance.x / cacheVertexCoef.x, radiance.y / cacheVertexCoef.y, radiance.z / cacheVertexCoef.z));
+	}
+
+	// incident radiance along each sampled ray, divided by its pdf to estimate the energy of the quadrant containing it,
+	// the light sampled directly is not recorded, so the guide learns the indirect light only
+	for(int i=0; i<numGuideVertex; ++i)
+	{
+		const GuidePathVertex&	vertex		= guideVertex[i];
+		Vector3					radiance	= totalOutgoingRadiance - vertex.radianceBefore;
+		Vector3					incident	= Vector3(	vertex.coefBrdf.x > 0.0f ? radiance.x / vertex.coefBrdf.x : 0.0f,
+														vertex.coefBrdf.y > 0.0f ? radiance.y / vertex.coefBrdf.y : 0.0f,
+														vertex.coefBrdf.z > 0.0f ? radiance.z / vertex.coefBrdf.z : 0.0f	);
+		m_pathGuide->record(vertex.pos, vertex.dir, (incident.x + incident.y + incident.z) * (1.0f / 3.0f) * vertex.cosTheta / vertex.pdf);
+	}
+
+	// light directly hit the camera
+	{
+		for(int l= 0; l<scene.numLight; ++l)
+		{
+			const AreaLight&	light	= scene.areaLight[l];
+			Vector3				posLS	= (light.xformInv * Vector4(primaryRay.pos, 1)).xyz();
+			Vector3				dirLS	= (light.xformInv * Vector4(primaryRay.dir, 0)).xyz();
+			if (dirLS.y >= 0)	// back face culled
+				continue;
+
+			float	hitT	= -posLS.y / dirLS.y;
+			Vector3	hitPos	= posLS + dirLS * hitT;
+			if (hitT <= 0 || fabsf(hitPos.x) > light.halfWidth || fabsf(hitPos.z) > light.halfHeight)
+				continue;
+			if (primaryHitT >= 0 && primaryHitT < hitT)
+				continue;
+
+			totalOutgoingRadiance += light.radiance.xyz();
+		}
+	}
+
+	return totalOutgoingRadiance;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// all rights reserved
+
+#include "Scene.h"
+#include "AccumBuffer.h"
+#include "RayPacket.h"
+#include "RadianceCache.h"
+#include "PathGuide.h"
+
+struct CpuCamera
+{
+	Vector3		pos;
+	Vector3		lookAt;
+	float		fovY;		// in radian
+};
+
+// samples per pixel of each progressive pass chosen to fill a time budget, from the measured time of the previous passes.
+// renderTile() accumulates the samples of a pass in registers, so the AccumBuffer is read and written once per pass
+struct CpuPassBudget
+{
+	float	budgetMs;
+	double	sampleTimeMs;		// averaged time of 1 sample per pixel of a pass, 0 before the first pass
+	int		lastSampleCount;
+
+	CpuPassBudget();
+
+	void	init(float passBudgetMs);
+	int		getSampleCount(int sampleLeft) const;		// the first pass takes 1 sample to measure the cost
+	void	addPass(int sampleCount, double elapsedMs);
+};
+
+// russian roulette and splitting of the path after the light sampling at each vertex
+enum PathTermination
+{
+	PathTermination_Albedo,			// same as pathTrace_ps(), roulette by the albedo of the vertex after a fixed number of bounces
+	PathTermination_Throughput,		// roulette by the throughput of the path
+	PathTermination_Adjoint,		// roulette and splitting by the expected contribution to the pixel (Vorba and Krivanek 2016),
+									// estimated by m_terminationCache, the vertices outside of the cached cells use PathTermination_Albedo
+};
+
+// CPU port of pathTrace_ps() in path_tracer.hlsl, used for off-line / distributed rendering.
+// Random numbers are derived from (pixel, sample index) only, so any sample range can be
+// rendered independently and merged later.
+class CpuPathTracer
+{
+public:
+	const Scene*	m_scene;
+	CpuCamera		m_camera;
+	Matrix4x4		m_projInv;
+	int				m_width;
+	int				m_height;
+	int				m_traceDepth;
+	bool			m_usePacket;		// trace the camera rays of each pixel block as a packet when the scene has a BVH
+	RadianceCache*	m_radianceCache;		// NULL to trace every path to the end, may be shared by the tracers on other threads
+	int				m_radianceCacheDepth;	// path vertex where the cache is queried once, 1 is the first indirect hit
+	PathGuide*		m_pathGuide;			// NULL for BRDF sampling only, else the guiding trees are sampled and trained by every path
+	PathTermination	m_termination;
+	const RadianceCache*	m_terminationCache;		// coarse outgoing radiance for PathTermination_Adjoint, only queried, trained by a pre-pass
+
+	CpuPathTracer();
+
+	void	init(const Scene* scene);
+	void	setCamera(const CpuCamera& camera, int width, int height);
+
+	// trace samples [sampleStart, sampleStart + sampleCount) for every pixel inside the rect [x0, x1) x [y0, y1)
+	void	renderTile(AccumBuffer* accum, int x0, int y0, int x1, int y1, int sampleStart, int sampleCount) const;
+	void	renderSamples(AccumBuffer* accum, int sampleStart, int sampleCount) const;
+
+	Vector3	tracePath(int px, int py, int sampleIdx) const;
+	Ray		generateCameraRay(float x, float y) const;		// (x, y) in pixel unit
+
+	// primary visibility only: closest hit of the camera ray through each pixel center of the rect [x0, x1) x [y0, y1),
+	// hits are stored row by row, stats can be NULL and is only updated by packets
+	void	tracePrimaryHits(int x0, int y0, int x1, int y1, RayHit* hits, RayPacketStats* stats) const;
+
+	unsigned int	initPath(int px, int py, int sampleIdx, Ray* primaryRay) const;		// return the random seed after the jitter
+	// primaryEmissiveDirect replaces the emissive triangle light sampling at the primary hit if not NULL, used by CpuRestir
+	Vector3			shadePath(const Ray& primaryRay, const RayHit& primaryHit, unsigned int randSeed, const Vector3* primaryEmissiveDirect) const;
+
+private:
+	bool			isPacketEnabled() const;
+	void			initPacket(RayPacket* packet, int x0, int y0, int x1, int y1) const;
+	void			renderBlock(AccumBuffer* accum, int x0, int y0, int x1, int y1, int sampleStart, int sampleCount) const;
+	// survival probability and the number of paths to split into, for the path leaving the vertex at depth
+	void			computeTermination(int depth, const Vector3& coefBrdf, const Vector3& albedo, const Vector3& emissive, const Vector3& hitPos, const Vector3& hitNormal,
+										float pixelEstimate, float* outSurvival, int* outSplit) const;
+};
@@ -0,0 +1,200 @@
+
+// all rights reserved
+
+#include "CpuRenderThread.h"
+#include "ThreadPool.h"
+#include <chrono>
+
+#define TRIPLE_BUFFER_FRESH			(4)		// flag of TripleBuffer::m_middle, the slot index takes the lower 2 bits
+#define CPU_RENDER_THREAD_IDLE_MS	(1)		// sleep time after samplePerPixelMax is reached
+#define CPU_RENDER_THREAD_WAIT_YIELD	(16)	// yields while waiting for a camera being published, then sleeps CPU_RENDER_THREAD_IDLE_MS
+
+TripleBuffer::TripleBuffer()
+{
+	reset();
+}
+
+void	TripleBuffer::reset()
+{
+	m_writeIdx	= 0;
+	m_middle	= 1;
+	m_readIdx	= 2;
+}
+
+int		TripleBuffer::getWriteIdx() const
+{
+	return m_writeIdx;
+}
+
+void	TripleBuffer::publish()
+{
+	// release the written slot and take the previous middle one, which the consumer no longer reads
+	int old		= m_middle.exchange(m_writeIdx | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+	m_writeIdx	= old & (TRIPLE_BUFFER_FRESH - 1);
+}
+
+bool	TripleBuffer::acquire()
+{
+	if ((m_middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH) == 0)
+		return false;
+	int old		= m_middle.exchange(m_readIdx, std::memory_order_acq_rel);
+	m_readIdx	= old & (TRIPLE_BUFFER_FRESH - 1);
+	return true;
+}
+
+int		TripleBuffer::getReadIdx() const
+{
+	return m_readIdx;
+}
+
+struct CpuRenderTileJob
+{
+	const CpuPathTracer*					tracer;
+	AccumBuffer*							accum;
+	const std::vector<TileSchedulerTile>*	tiles;
+	const std::atomic<unsigned int>*		latestVersion;
+	unsigned int							cameraVersion;
+	bool									isRestartEnabled;
+	std::atomic<bool>						isRestarted;
+};
+
+static void	renderTileJob(void* userData, int jobIdx)
+{
+	// the remaining tiles are skipped once the camera is changed
+	CpuRenderTileJob* job = (CpuRenderTileJob*)userData;
+	if (job->isRestartEnabled && job->latestVersion->load(std::memory_order_relaxed) != job->cameraVersion)
+	{
+		job->isRestarted.store(true, std::memory_order_relaxed);
+		return;
+	}
+	const TileSchedulerTile& tile = (*job->tiles)[jobIdx];
+	job->tracer->renderTile(job->accum, tile.x0, tile.y0, tile.x1, tile.y1, tile.sampleStart, tile.sampleCount);
+}
+
+CpuRenderThread::CpuRenderThread()
+{
+	m_samplePerPixelMax	= 0;
+	m_isQuit			= false;
+	m_cameraVersion		= 0;
+}
+
+CpuRenderThread::~CpuRenderThread()
+{
+	stop();
+}
+
+void	CpuRenderThread::start(const Scene* scene, int width, int height, int samplePerPixelMax, const CpuCamera& camera)
+{
+	stop();
+	m_tracer.init(scene);
+	m_tracer.setCamera(camera, width, height);
+	m_accum.resize(width, height);
+	m_scheduler.init(width, height);
+	m_samplePerPixelMax	= samplePerPixelMax;
+	m_isQuit			= false;
+	m_cameraBuffer.reset();
+	m_frameBuffer.reset();
+	setCamera(camera);
+	m_thread			= std::thread(&CpuRenderThread::threadMain, this);
+}
+
+void	CpuRenderThread::stop()
+{
+	if (!m_thread.joinable())
+		return;
+	m_isQuit = true;
+	m_thread.join();
+}
+
+unsigned int	CpuRenderThread::setCamera(const CpuCamera& camera)
+{
+	// the version is incremented first, so the tiles stop before the snapshot is published rather than after
+	unsigned int		version	= m_cameraVersion.fetch_add(1, std::memory_order_relaxed) + 1;
+	CpuRenderCamera&	slot	= m_cameraSlots[m_cameraBuffer.getWriteIdx()];
+	slot.camera					= camera;
+	slot.version				= version;
+	slot.publishTime			= timeGetAbsoulteTime();
+	m_cameraBuffer.publish();
+	return version;
+}
+
+const CpuRenderFrame*	CpuRenderThread::acquireFrame()
+{
+	return m_frameBuffer.acquire() ? &m_frameSlots[m_frameBuffer.getReadIdx()] : NULL;
+}
+
+void	CpuRenderThread::threadMain()
+{
+	CpuRenderCamera	camera;
+	LONGLONG		acquireTime		= 0;
+	int				spp				= 0;
+	int				numWait			= 0;
+	camera.version					= 0;
+	while (!m_isQuit.load(std::memory_order_relaxed))
+	{
+		if (m_cameraBuffer.acquire())
+		{
+			camera		= m_cameraSlots[m_cameraBuffer.getReadIdx()];
+			acquireTime	= timeGetAbsoulteTime();
+			spp			= 0;
+			m_tracer.setCamera(camera.camera, m_accum.width, m_accum.height);
+			m_accum.clear();
+			m_scheduler.init(m_accum.width, m_accum.height);
+		}
+
+		// the version is incremented before the snapshot is published, wait for the input thread to publish it
+		if (camera.version != m_cameraVersion.load(std::memory_order_relaxed))
+		{
+			if (++numWait < CPU_RENDER_THREAD_WAIT_YIELD)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(CPU_RENDER_THREAD_IDLE_MS));
+			continue;
+		}
+		numWait = 0;
+
+		if (spp >= m_samplePerPixelMax)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(CPU_RENDER_THREAD_IDLE_MS));
+			continue;
+		}
+
+		// the first pass of a camera is not restarted, a newer camera waits for it rather than throwing the partial pass away
+		if (!renderPass(camera.version, spp > 0))
+			continue;
+		++spp;
+		publishFrame(camera, acquireTime, spp);
+	}
+}
+
+bool	CpuRenderThread::renderPass(unsigned int cameraVersion, bool isRestartEnabled)
+{
+	m_scheduler.buildPass(&m_tiles);
+
+	CpuRenderTileJob job;
+	job.tracer				= &m_tracer;
+	job.accum				= &m_accum;
+	job.tiles				= &m_tiles;
+	job.latestVersion		= &m_cameraVersion;
+	job.cameraVersion		= cameraVersion;
+	job.isRestartEnabled	= isRestartEnabled;
+	job.isRestarted			= false;
+	threadPoolGetShared()->parallelFor(renderTileJob, &job, (int)m_tiles.size());
+	return !job.isRestarted.load(std::memory_order_relaxed);
+}
+
+void	CpuRenderThread::publishFrame(const CpuRenderCamera& camera, LONGLONG acquireTime, int samplePerPixel)
+{
+	CpuRenderFrame& frame	= m_frameSlots[m_frameBuffer.getWriteIdx()];
+	frame.width				= m_accum.width;
+	frame.height			= m_accum.height;
+	frame.samplePerPixel	= samplePerPixel;
+	frame.cameraVersion		= camera.version;
+	frame.cameraPublishTime	= camera.publishTime;
+	frame.cameraAcquireTime	= acquireTime;
+	frame.radiance.resize(m_accum.width * m_accum.height);
+	for(int y=0; y<m_accum.height; ++y)
+		for(int x=0; x<m_accum.width; ++x)
+			frame.radiance[y * m_accum.width + x] = m_accum.getPixel(x, y);
+	m_frameBuffer.publish();
+}
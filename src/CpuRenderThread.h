@@ -0,0 +1,90 @@
+#pragma once
+
+// all rights reserved
+
+#include <thread>
+#include <atomic>
+#include "CpuPathTracer.h"
+#include "TileScheduler.h"
+#include "Timer.h"
+
+// Lock free hand off of the latest value from 1 producer thread to 1 consumer thread, the caller keeps 3 slots of data.
+// The producer fills the slot of getWriteIdx() then publish() it, the consumer acquire() and reads the slot of getReadIdx().
+// Neither side ever waits, the consumer always gets the latest published slot and the older ones are dropped.
+class TripleBuffer
+{
+public:
+	TripleBuffer();
+
+	void	reset();					// only when neither thread is using it
+	int		getWriteIdx() const;		// producer
+	void	publish();					// producer
+	bool	acquire();					// consumer, false if nothing is published since the last acquire(), the read slot is unchanged then
+	int		getReadIdx() const;			// consumer
+
+private:
+	std::atomic<int>	m_middle;		// slot of the middle buffer, with TRIPLE_BUFFER_FRESH set if it is published but not acquired
+	int					m_writeIdx;
+	int					m_readIdx;
+};
+
+// camera snapshot published by the input thread
+struct CpuRenderCamera
+{
+	CpuCamera		camera;
+	unsigned int	version;
+	LONGLONG		publishTime;
+};
+
+// averaged radiance of a finished pass
+struct CpuRenderFrame
+{
+	std::vector<Vector3>	radiance;			// row by row
+	int						width;
+	int						height;
+	int						samplePerPixel;
+	unsigned int			cameraVersion;
+	LONGLONG				cameraPublishTime;
+	LONGLONG				cameraAcquireTime;	// when the render thread started the accumulation of this camera
+};
+
+// Progressive CPU rendering on its own thread, so the input and display thread never waits for tracing.
+// The camera is published through a triple buffer, the tiles of a pass are rendered on the shared thread pool and each tile
+// checks the camera version first, so a new camera restarts the accumulation after at most 1 tile of work per thread.
+// Only the passes of a camera already shown are restarted, the first pass of a camera is always finished and shown,
+// so no partial work is thrown away while input faster than a pass keeps arriving.
+// Every finished pass is resolved into a frame handed to the display through a second triple buffer.
+class CpuRenderThread
+{
+public:
+	CpuRenderThread();
+	~CpuRenderThread();
+
+	void	start(const Scene* scene, int width, int height, int samplePerPixelMax, const CpuCamera& camera);
+	void	stop();
+
+	unsigned int			setCamera(const CpuCamera& camera);		// input thread, return the version of the snapshot
+	const CpuRenderFrame*	acquireFrame();							// display thread, NULL if no pass is finished since the last call,
+																	// valid until the next call
+private:
+	CpuPathTracer				m_tracer;
+	AccumBuffer					m_accum;
+	TileScheduler				m_scheduler;
+	int							m_samplePerPixelMax;
+	std::vector<TileSchedulerTile>	m_tiles;
+	std::thread					m_thread;
+	std::atomic<bool>			m_isQuit;
+
+	CpuRenderCamera				m_cameraSlots[3];
+	TripleBuffer				m_cameraBuffer;
+	std::atomic<unsigned int>	m_cameraVersion;		// latest version, incremented before the snapshot is published
+	CpuRenderFrame				m_frameSlots[3];
+	TripleBuffer				m_frameBuffer;
+
+	CpuRenderThread(const CpuRenderThread&);
+	CpuRenderThread& operator=(const CpuRenderThread&);
+
+	void	threadMain();
+	bool	renderPass(unsigned int cameraVersion, bool isRestartEnabled);		// return false if restarted by a new camera
+	void	publishFrame(const CpuRenderCamera& camera, LONGLONG acquireTime, int samplePerPixel);
+};
@@ -0,0 +1,261 @@
+
+// all rights reserved
+
+#include "CpuRestir.h"
+
+static float	getLuminance(const Vector3& c)
+{
+	return c.dot(Vector3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// uniform point (su = sqrt(u), v) on an emissive triangle, return the area
+static float	getEmissivePoint(const Scene& scene, int lightIdx, float su, float v, Vector3* outPos, Vector3* outNormal)
+{
+	int				idx		= scene.emissiveTri[lightIdx].x;
+	const Vector3&	pos0	= scene.triPos[scene.triIdx[idx	   ]];
+	const Vector3&	pos1	= scene.triPos[scene.triIdx[idx + 1]];
+	const Vector3&	pos2	= scene.triPos[scene.triIdx[idx + 2]];
+	Vector3			normal	= (pos1 - pos0).cross(pos2 - pos0);
+	float			area	= normal.length() * 0.5f;
+	*outNormal				= normal * (0.5f / area);
+	*outPos					= pos0 * (1.0f - su) + pos1 * (su * (1.0f - v)) + pos2 * (su * v);
+	return area;
+}
+
+// unshadowed contribution of the light sample to the surface in unit of area measure, the visibility is left to the shading
+static float	getTargetPdf(const Scene& scene, const RestirSurface& surface, const RestirReservoir& sample)
+{
+	if (surface.depth < 0.0f || sample.lightIdx < 0)
+		return 0.0f;
+	Vector3	dir		= sample.lightPos - surface.pos;
+	float	dist2	= dir.length2();
+	if (dist2 <= 0.0f)
+		return 0.0f;
+	dir				= dir / sqrtf(dist2);
+	float	cosX	= dir.dot(surface.normal);
+	float	cosY	= -dir.dot(sample.lightNormal);
+	if (cosX <= 0.0f || cosY <= 0.0f)
+		return 0.0f;
+	Vector3	emissive	= scene.meshMaterial[scene.emissiveTri[sample.lightIdx].y].emissive.xyz();
+	return getLuminance(emissive * surface.albedo) * cosX * cosY / dist2;
+}
+
+static bool		isSimilarSurface(const RestirSurface& a, const RestirSurface& b)
+{
+	return	a.depth >= 0.0f && b.depth >= 0.0f &&
+			a.normal.dot(b.normal) >= RESTIR_NORMAL_THRESHOLD &&
+			fabsf(a.depth - b.depth) <= RESTIR_DEPTH_THRESHOLD * a.depth;
+}
+
+CpuRestir::CpuRestir()
+{
+	m_tracer			= nullptr;
+	m_isTemporalEnabled	= true;
+	m_isSpatialEnabled	= true;
+	m_hasPrevFrame		= false;
+}
+
+void	CpuRestir::init(const CpuPathTracer* tracer)
+{
+	m_tracer	= tracer;
+	int num		= tracer->m_width * tracer->m_height;
+	m_rays.resize(num);
+	m_hits.resize(num);
+	m_randSeeds.resize(num);
+	m_surfaces.resize(num);
+	m_prevSurfaces.resize(num);
+	m_reservoirs.resize(num);
+	m_spatialReservoirs.resize(num);
+	m_prevReservoirs.resize(num);
+	reset();
+}
+
+void	CpuRestir::reset()
+{
+	m_hasPrevFrame = false;
+}
+
+void	CpuRestir::sampleCandidates(const RestirSurface& surface, unsigned int* randSeed, RestirReservoir* out) const
+{
+	// resampled importance sampling: candidates are drawn in proportion to the light power,
+	// then 1 of them is kept in proportion to target pdf / source pdf
+	const Scene&	scene		= *m_tracer->m_scene;
+	float			targetPdf	= 0.0f;
+	out->lightIdx				= -1;
+	out->M						= 0;
+	out->weightSum				= 0.0f;
+	out->W						= 0.0f;
+	if (scene.emissiveTri.empty() || surface.depth < 0.0f)
+		return;
+
+	int numEmissive = (int)scene.emissiveTable.size();
+	for (int i = 0; i < RESTIR_CANDIDATE_NUM; ++i)
+	{
+		RestirReservoir	candidate;
+		candidate.lightIdx	= aliasTableSample(&scene.emissiveTable[0], numEmissive, randFloat(randSeed));
+		float	su			= sqrtf(randFloat(randSeed));
+		float	v			= randFloat(randSeed);
+		float	area		= getEmissivePoint(scene, candidate.lightIdx, su, v, &candidate.lightPos, &candidate.lightNormal);
+		float	sourcePdf	= scene.emissiveTable[candidate.lightIdx].pdf / area;
+		float	candidatePdf= getTargetPdf(scene, surface, candidate);
+		float	weight		= candidatePdf / sourcePdf;
+		out->weightSum		+= weight;
+		if (weight > 0.0f && randFloat(randSeed) * out->weightSum < weight)
+		{
+			out->lightIdx		= candidate.lightIdx;
+			out->lightPos		= candidate.lightPos;
+			out->lightNormal	= candidate.lightNormal;
+			targetPdf			= candidatePdf;
+		}
+	}
+	out->M	= RESTIR_CANDIDATE_NUM;
+	out->W	= targetPdf > 0.0f ? out->weightSum / (RESTIR_CANDIDATE_NUM * targetPdf) : 0.0f;
+}
+
+void	CpuRestir::combine(const RestirSurface& surface, const RestirReservoir* const* reservoirs, const RestirSurface* const* surfaces, int num,
+						   unsigned int* randSeed, RestirReservoir* out) const
+{
+	// each reservoir is resampled as 1 candidate with a balance heuristic weight over the pixels which could have produced it,
+	// this costs num^2 target evaluations but no ray, and avoids the fireflies of normalizing by the number of such pixels
+	// where the target differs a lot between neighbours, e.g. close to a light
+	const Scene&	scene		= *m_tracer->m_scene;
+	RestirReservoir	result;
+	float			targetPdf	= 0.0f;
+	result.lightIdx				= -1;
+	result.M					= 0;
+	result.weightSum			= 0.0f;
+	for (int i = 0; i < num; ++i)
+	{
+		const RestirReservoir& r	= *reservoirs[i];
+		result.M					+= r.M;
+		if (r.lightIdx < 0)
+			continue;
+		float	pdfSum				= 0.0f;
+		for (int j = 0; j < num; ++j)
+			pdfSum					+= reservoirs[j]->M * getTargetPdf(scene, *surfaces[j], r);
+		float	misWeight			= pdfSum > 0.0f ? r.M * getTargetPdf(scene, *surfaces[i], r) / pdfSum : 0.0f;
+		float	samplePdf			= getTargetPdf(scene, surface, r);
+		float	weight				= misWeight * samplePdf * r.W;
+		result.weightSum			+= weight;
+		if (weight > 0.0f && randFloat(randSeed) * result.weightSum < weight)
+		{
+			result.lightIdx		= r.lightIdx;
+			result.lightPos		= r.lightPos;
+			result.lightNormal	= r.lightNormal;
+			targetPdf			= samplePdf;
+		}
+	}
+	result.W	= targetPdf > 0.0f ? result.weightSum / targetPdf : 0.0f;
+	*out		= result;
+}
+
+Vector3	CpuRestir::shadeReservoir(const RestirSurface& surface, const RestirReservoir& reservoir) const
+{
+	const Scene& scene = *m_tracer->m_scene;
+	if (surface.depth < 0.0f || reservoir.lightIdx < 0 || reservoir.W <= 0.0f)
+		return Vector3(0, 0, 0);
+	Vector3	dir		= reservoir.lightPos - surface.pos;
+	float	dist2	= dir.length2();
+	float	dist	= sqrtf(dist2);
+	dir				= dir / dist;
+	float	cosX	= dir.dot(surface.normal);
+	float	cosY	= -dir.dot(reservoir.lightNormal);
+	if (cosX <= 0.0f || cosY <= 0.0f)
+		return Vector3(0, 0, 0);
+
+	// the only shadow ray of the pixel, hitting the sampled triangle itself is not a shadow
+	const float	shadowRayEpsilon	= 0.000001f;
+	int2		lightTri			= scene.emissiveTri[reservoir.lightIdx];
+	Ray			shadowRay;
+	RayHit		shadowHit;
+	shadowRay.dir	= dir;
+	shadowRay.pos	= surface.pos + dir * shadowRayEpsilon;
+	if (scene.rayCast(shadowRay, &shadowHit) && shadowHit.t >= shadowRayEpsilon && shadowHit.t < dist && shadowHit.triangle != lightTri.x / 3)
+		return Vector3(0, 0, 0);
+	return scene.meshMaterial[lightTri.y].emissive.xyz() * surface.albedo * (cosX * cosY / dist2 * reservoir.W);
+}
+
+void	CpuRestir::renderFrame(AccumBuffer* accum, int frameIdx)
+{
+	const Scene&	scene	= *m_tracer->m_scene;
+	int				width	= m_tracer->m_width;
+	int				height	= m_tracer->m_height;
+
+	// primary hits, initial candidates and temporal reuse
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			int				i			= y * width + x;
+			Ray&			ray			= m_rays[i];
+			RayHit&			hit			= m_hits[i];
+			RestirSurface&	surface		= m_surfaces[i];
+			unsigned int	randSeed	= m_tracer->initPath(x, y, frameIdx, &ray);
+			surface.depth				= -1.0f;
+			if (scene.rayCast(ray, &hit))
+			{
+				surface.pos		= ray.pos + ray.dir * hit.t;
+				surface.normal	= scene.computeHitNormal(hit);
+				surface.albedo	= scene.meshMaterial[hit.meshIdx].albedo.xyz();
+				surface.depth	= hit.t;
+			}
+			sampleCandidates(surface, &randSeed, &m_reservoirs[i]);
+
+			if (m_isTemporalEnabled && m_hasPrevFrame && isSimilarSurface(surface, m_prevSurfaces[i]))
+			{
+				// clamp the history so a converged reservoir still follows the new candidates
+				RestirReservoir			prev			= m_prevReservoirs[i];
+				prev.M									= prev.M < RESTIR_TEMPORAL_M_MAX * RESTIR_CANDIDATE_NUM ? prev.M : RESTIR_TEMPORAL_M_MAX * RESTIR_CANDIDATE_NUM;
+				const RestirReservoir*	reservoirs[2]	= { &m_reservoirs[i], &prev };
+				const RestirSurface*	surfaces[2]		= { &surface, &m_prevSurfaces[i] };
+				combine(surface, reservoirs, surfaces, 2, &randSeed, &m_reservoirs[i]);
+			}
+			m_randSeeds[i] = randSeed;
+		}
+
+	// spatial reuse, reads the reservoirs above and writes a separate array
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			int i = y * width + x;
+			if (!m_isSpatialEnabled || m_surfaces[i].depth < 0.0f)
+			{
+				m_spatialReservoirs[i] = m_reservoirs[i];
+				continue;
+			}
+			const RestirReservoir*	reservoirs[RESTIR_SPATIAL_NUM + 1]	= { &m_reservoirs[i] };
+			const RestirSurface*	surfaces[RESTIR_SPATIAL_NUM + 1]	= { &m_surfaces[i] };
+			int						num									= 1;
+			for (int n = 0; n < RESTIR_SPATIAL_NUM; ++n)
+			{
+				float	r	= RESTIR_SPATIAL_RADIUS * sqrtf(randFloat(&m_randSeeds[i]));
+				float	phi	= 2.0f * PI * randFloat(&m_randSeeds[i]);
+				int		nx	= x + (int)(r * cosf(phi));
+				int		ny	= y + (int)(r * sinf(phi));
+				if (nx < 0 || ny < 0 || nx >= width || ny >= height || (nx == x && ny == y))
+					continue;
+				int		j	= ny * width + nx;
+				if (!isSimilarSurface(m_surfaces[i], m_surfaces[j]))
+					continue;
+				reservoirs[num]	= &m_reservoirs[j];
+				surfaces[num]	= &m_surfaces[j];
+				++num;
+			}
+			combine(m_surfaces[i], reservoirs, surfaces, num, &m_randSeeds[i], &m_spatialReservoirs[i]);
+		}
+
+	// shade with 1 shadow ray for the emissive triangles, the other lights and the indirect bounces are path traced as usual
+	for (int i = 0; i < width * height; ++i)
+	{
+		Vector3	direct		= shadeReservoir(m_surfaces[i], m_spatialReservoirs[i]);
+		Vector3	radiance	= m_tracer->shadePath(m_rays[i], m_hits[i], m_randSeeds[i], &direct);
+		accum->radianceSum[i].x	+= radiance.x;
+		accum->radianceSum[i].y	+= radiance.y;
+		accum->radianceSum[i].z	+= radiance.z;
+		accum->sampleCount[i]	+= 1;
+	}
+
+	// the final reservoirs are reused by the next frame
+	m_prevReservoirs.swap(m_spatialReservoirs);
+	m_prevSurfaces.swap(m_surfaces);
+	m_hasPrevFrame = true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// all rights reserved
+
+#include "CpuPathTracer.h"
+
+#define RESTIR_CANDIDATE_NUM		(32)		// light samples resampled into the reservoir of each pixel per frame
+#define RESTIR_SPATIAL_NUM			(5)			// neighbour reservoirs combined per pixel
+#define RESTIR_SPATIAL_RADIUS		(30.0f)		// in pixel
+#define RESTIR_TEMPORAL_M_MAX		(4)		// the previous reservoir count is clamped to this multiple of RESTIR_CANDIDATE_NUM, a long history correlates the accumulated frames
+#define RESTIR_NORMAL_THRESHOLD		(0.9f)		// minimum cosine between the normals of reused pixels
+#define RESTIR_DEPTH_THRESHOLD		(0.1f)		// maximum relative depth difference of reused pixels
+
+// 1 emissive triangle sample with its resampling weights
+struct RestirReservoir
+{
+	Vector3	lightPos;
+	Vector3	lightNormal;
+	int		lightIdx;		// index in Scene::emissiveTri, -1 if empty
+	int		M;				// number of candidates seen
+	float	weightSum;
+	float	W;				// contribution weight of the sample, in unit of 1 / area
+};
+
+// primary hit of a pixel, the target function of the reservoirs is evaluated against it
+struct RestirSurface
+{
+	Vector3	pos;
+	Vector3	normal;
+	Vector3	albedo;
+	float	depth;			// negative if nothing is hit
+};
+
+// Reservoir-based spatio-temporal importance resampling of the emissive triangles at the primary hit (ReSTIR DI):
+// each pixel resamples RESTIR_CANDIDATE_NUM light samples in proportion to their unshadowed contribution, combines its
+// reservoir with the previous frame and with random neighbours, then traces a single shadow ray for the chosen sample.
+// The reused reservoirs are weighted by the balance heuristic over the pixels which could produce the sample, so the image is unbiased.
+// The rest of the path is traced by CpuPathTracer::shadePath(), the camera must not move between frames without reset().
+class CpuRestir
+{
+public:
+	const CpuPathTracer*	m_tracer;
+	bool					m_isTemporalEnabled;
+	bool					m_isSpatialEnabled;
+
+	CpuRestir();
+
+	void	init(const CpuPathTracer* tracer);		// call again after the camera or resolution changed
+	void	reset();								// drop the reservoirs of the previous frame
+	void	renderFrame(AccumBuffer* accum, int frameIdx);		// 1 sample for every pixel
+
+private:
+	std::vector<Ray				>	m_rays;
+	std::vector<RayHit			>	m_hits;
+	std::vector<unsigned int	>	m_randSeeds;
+	std::vector<RestirSurface	>	m_surfaces;
+	std::vector<RestirSurface	>	m_prevSurfaces;
+	std::vector<RestirReservoir	>	m_reservoirs;			// initial and temporal
+	std::vector<RestirReservoir	>	m_spatialReservoirs;
+	std::vector<RestirReservoir	>	m_prevReservoirs;
+	bool							m_hasPrevFrame;
+
+	void	sampleCandidates(const RestirSurface& surface, unsigned int* randSeed, RestirReservoir* out) const;
+	void	combine(const RestirSurface& surface, const RestirReservoir* const* reservoirs, const RestirSurface* const* surfaces, int num,
+					unsigned int* randSeed, RestirReservoir* out) const;
+	Vector3	shadeReservoir(const RestirSurface& surface, const RestirReservoir& reservoir) const;
+};
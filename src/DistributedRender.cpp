@@ -0,0 +1,419 @@
+
+// all rights reserved
+
+#include "DistributedRender.h"
+#include "Socket.h"
+#include "Process.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define DISTRIBUTED_SELECT_TIME_OUT_MS		(100)
+#define DISTRIBUTED_MAX_SPAWN_PER_WORKER	(4)
+#define DISTRIBUTED_SCENE_NAME_MAX			(32)
+#define DISTRIBUTED_CONNECT_TIME_OUT_MS		(10000)		// a spawned worker not connected by then is killed and replaced
+#define DISTRIBUTED_HEARTBEAT_TIME_OUT_MS	(30000)		// a worker sending nothing for this long while it has a task is killed and replaced, the scene creation before its first sample included
+
+enum DistributedMsg
+{
+	DistributedMsg_Job,
+	DistributedMsg_Task,
+	DistributedMsg_Result,
+	DistributedMsg_Quit,
+	DistributedMsg_Hello,			// worker -> coordinator, int processIdx, sent after connecting
+	DistributedMsg_Heartbeat,		// worker -> coordinator, sent after each sample of a task
+};
+
+struct DistributedJobMsg
+{
+	char		sceneName[DISTRIBUTED_SCENE_NAME_MAX];
+	Vector3		camPos;
+	Vector3		camLookAt;
+	float		fovY;
+	int			width;
+	int			height;
+};
+
+struct DistributedTaskMsg
+{
+	int			taskIdx;
+	int			sampleStart;
+	int			sampleCount;
+};
+
+struct DistributedProcess
+{
+	HANDLE		handle;			// nullptr after it is lost
+	LONGLONG	spawnTime;
+	bool		isConnected;
+	bool		isLost;			// exited, timed out or disconnected, it is replaced by a new process
+};
+
+struct DistributedWorker
+{
+	SOCKET		socket;
+	int			processIdx;		// -1 until the hello message is received
+	int			taskIdx;		// -1 == idle
+	LONGLONG	lastMsgTime;
+};
+
+// the parent process id keeps the logs of concurrent runs apart
+static void	getWorkerLogFileName(int processIdx, char* fileName, int fileNameSize)
+{
+	sprintf_s(fileName, fileNameSize, "distributed_worker_%u_%i.log", (unsigned int)GetCurrentProcessId(), processIdx);
+}
+
+static void	spawnWorkerProcess(std::vector<DistributedProcess>* processes, int port, int crashAfterTask)
+{
+	char args[96];
+	char logFileName[64];
+	int processIdx = (int)processes->size();
+	sprintf_s(args, sizeof(args), "-worker %i -processIdx %i -crashAfter %i", port, processIdx, crashAfterTask);
+	getWorkerLogFileName(processIdx, logFileName, sizeof(logFileName));
+
+	DistributedProcess process;
+	process.handle		= processSpawnSelf(args, logFileName);
+	process.spawnTime	= timeGetAbsoulteTime();
+	process.isConnected	= false;
+	process.isLost		= process.handle == nullptr;
+	processes->push_back(process);
+}
+
+// kill the process if it is still running, e.g. hung, it is replaced in the next loop of the coordinator
+static void	loseWorkerProcess(DistributedProcess* process, DistributedStats* stats)
+{
+	if (process->isLost)
+		return;
+	processWaitAndClose(process->handle, 0);
+	process->handle	= nullptr;
+	process->isLost	= true;
+	++stats->numWorkerLost;
+}
+
+static void	mergeResult(AccumBuffer* result, const char* pixelData)
+{
+	// the worker sends the radiance sums followed by the sample counts
+	int numPixel = result->width * result->height;
+	result->merge((const Vector4*)pixelData, (const int*)(pixelData + numPixel * sizeof(Vector4)));
+}
+
+bool	distributedRender(const DistributedJob& job, int numWorker, int crashWorkerAfterTask, AccumBuffer* result, DistributedStats* stats)
+{
+	LONGLONG startTime = timeGetAbsoulteTime();
+	memset(stats, 0, sizeof(DistributedStats));
+	if (strlen(job.sceneName) >= DISTRIBUTED_SCENE_NAME_MAX)
+		return false;
+	result->resize(job.width, job.height);
+
+	// split the job into disjoint sample ranges
+	std::vector<DistributedTaskMsg>	tasks;
+	for(int s= 0; s<job.samplePerPixel; s+= job.samplePerTask)
+	{
+		DistributedTaskMsg task;
+		task.taskIdx		= (int)tasks.size();
+		task.sampleStart	= s;
+		task.sampleCount	= min(job.samplePerTask, job.samplePerPixel - s);
+		tasks.push_back(task);
+	}
+	stats->numTask = (int)tasks.size();
+
+	std::vector<int>	pendingTask;
+	for(int i= stats->numTask - 1; i>=0; --i)
+		pendingTask.push_back(i);
+
+	SOCKET listenSocket = socketListenLocalhost(0);
+	if (listenSocket == INVALID_SOCKET)
+		return false;
+	int port = socketGetPort(listenSocket);
+
+	std::vector<DistributedProcess>	processes;
+	for(int i=0; i<numWorker; ++i)
+		spawnWorkerProcess(&processes, port, i == 0 ? crashWorkerAfterTask : -1);
+
+	DistributedJobMsg jobMsg = {};
+	strncpy_s(jobMsg.sceneName, sizeof(jobMsg.sceneName), job.sceneName, _TRUNCATE);
+	jobMsg.camPos		= job.camera.pos;
+	jobMsg.camLookAt	= job.camera.lookAt;
+	jobMsg.fovY			= job.camera.fovY;
+	jobMsg.width		= job.width;
+	jobMsg.height		= job.height;
+
+	std::vector<DistributedWorker>	workers;
+	std::vector<char>				payload;
+	const int						resultSizeByte	= sizeof(DistributedTaskMsg) + job.width * job.height * (sizeof(Vector4) + sizeof(int));
+	int								numTaskDone		= 0;
+	LONGLONG						renderStartTime	= 0;
+	bool							isSucceed		= true;
+	while (numTaskDone < stats->numTask)
+	{
+		// a process which exited or did not connect in time is lost
+		for(int i=0; i<(int)processes.size(); ++i)
+		{
+			DistributedProcess& process = processes[i];
+			if (process.isLost || process.isConnected)
+				continue;
+			if (!processIsAlive(process.handle) || timeGetElapsedTime(process.spawnTime) * 1000.0 > DISTRIBUTED_CONNECT_TIME_OUT_MS)
+				loseWorkerProcess(&process, stats);
+		}
+
+		// spawn a replacement for each lost worker, until the spawn budget is used up
+		int numActiveProcess = 0;
+		for(int i=0; i<(int)processes.size(); ++i)
+			numActiveProcess += processes[i].isLost ? 0 : 1;
+		while (numActiveProcess < numWorker && (int)processes.size() < numWorker * DISTRIBUTED_MAX_SPAWN_PER_WORKER)
+		{
+			spawnWorkerProcess(&processes, port, -1);
+			numActiveProcess += processes.back().isLost ? 0 : 1;
+		}
+		if (numActiveProcess == 0)
+		{
+			isSucceed = false;
+			break;
+		}
+
+		// wait for new connection or result
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		FD_SET(listenSocket, &readSet);
+		SOCKET maxSocket = listenSocket;
+		for(int i=0; i<(int)workers.size(); ++i)
+		{
+			FD_SET(workers[i].socket, &readSet);
+			maxSocket = max(maxSocket, workers[i].socket);
+		}
+		timeval timeOut;
+		timeOut.tv_sec	= 0;
+		timeOut.tv_usec	= DISTRIBUTED_SELECT_TIME_OUT_MS * 1000;
+		if (select((int)maxSocket + 1, &readSet, nullptr, nullptr, &timeOut) < 0)
+		{
+			isSucceed = false;
+			break;
+		}
+
+		// accept new worker, the job is sent once it tells which process it is
+		if (FD_ISSET(listenSocket, &readSet))
+		{
+			DistributedWorker worker;
+			worker.socket		= socketAccept(listenSocket);
+			worker.processIdx	= -1;
+			worker.taskIdx		= -1;
+			worker.lastMsgTime	= timeGetAbsoulteTime();
+			if (worker.socket != INVALID_SOCKET)
+				workers.push_back(worker);
+		}
+
+		// receive hello, heartbeat and result, and drop the workers silent for too long
+		for(int i=0; i<(int)workers.size(); ++i)
+		{
+			DistributedWorker&	worker		= workers[i];
+			double				silentMs	= timeGetElapsedTime(worker.lastMsgTime) * 1000.0;
+			bool				isValid		= true;
+			if (FD_ISSET(worker.socket, &readSet))
+			{
+				int msgType;
+				if (!socketRecvMessage(worker.socket, &msgType, &payload))
+					isValid = false;
+				else if (msgType == DistributedMsg_Hello && worker.processIdx < 0 && payload.size() == sizeof(int))
+				{
+					int processIdx	= *(const int*)payload.data();
+					isValid			=	processIdx >= 0 && processIdx < (int)processes.size() && !processes[processIdx].isLost && !processes[processIdx].isConnected &&
+										socketSendMessage(worker.socket, DistributedMsg_Job, &jobMsg, sizeof(jobMsg));
+					if (isValid)
+					{
+						worker.processIdx					= processIdx;
+						processes[processIdx].isConnected	= true;
+					}
+				}
+				else if (msgType == DistributedMsg_Result && worker.taskIdx >= 0 && (int)payload.size() == resultSizeByte &&
+						 ((const DistributedTaskMsg*)payload.data())->taskIdx == worker.taskIdx)
+				{
+					mergeResult(result, payload.data() + sizeof(DistributedTaskMsg));
+					worker.taskIdx = -1;
+					++numTaskDone;
+				}
+				else if (msgType != DistributedMsg_Heartbeat || worker.taskIdx < 0)
+					isValid = false;
+				worker.lastMsgTime = timeGetAbsoulteTime();
+			}
+			else if (worker.processIdx < 0)
+				isValid = silentMs <= DISTRIBUTED_CONNECT_TIME_OUT_MS;
+			else if (worker.taskIdx >= 0)
+				isValid = silentMs <= DISTRIBUTED_HEARTBEAT_TIME_OUT_MS;
+
+			if (!isValid)
+			{
+				// worker died, hung or sent garbage, re-issue its sample range
+				if (worker.taskIdx >= 0)
+				{
+					pendingTask.push_back(worker.taskIdx);
+					++stats->numTaskReissued;
+				}
+				if (worker.processIdx >= 0)
+					loseWorkerProcess(&processes[worker.processIdx], stats);
+				socketClose(worker.socket);
+				workers.erase(workers.begin() + i);
+				--i;
+			}
+		}
+
+		// assign tasks to idle workers
+		for(int i=0; i<(int)workers.size() && !pendingTask.empty(); ++i)
+		{
+			DistributedWorker& worker = workers[i];
+			if (worker.taskIdx >= 0 || worker.processIdx < 0)
+				continue;
+
+			if (renderStartTime == 0)
+				renderStartTime = timeGetAbsoulteTime();
+
+			int taskIdx = pendingTask.back();
+			pendingTask.pop_back();
+			if (socketSendMessage(worker.socket, DistributedMsg_Task, &tasks[taskIdx], sizeof(DistributedTaskMsg)))
+			{
+				worker.taskIdx		= taskIdx;
+				worker.lastMsgTime	= timeGetAbsoulteTime();
+			}
+			else
+			{
+				pendingTask.push_back(taskIdx);
+				loseWorkerProcess(&processes[worker.processIdx], stats);
+				socketClose(worker.socket);
+				workers.erase(workers.begin() + i);
+				--i;
+			}
+		}
+	}
+	stats->numWorkerSpawned	= (int)processes.size();
+	stats->renderTime		= renderStartTime == 0 ? 0.0 : timeGetElapsedTime(renderStartTime);
+
+	// shut down, a process which never connected is not waited for
+	for(int i=0; i<(int)workers.size(); ++i)
+	{
+		socketSendMessage(workers[i].socket, DistributedMsg_Quit, nullptr, 0);
+		socketClose(workers[i].socket);
+	}
+	socketClose(listenSocket);
+	for(int i=0; i<(int)processes.size(); ++i)
+	{
+		char logFileName[64];
+		char linePrefix[32];
+		if (processes[i].handle)
+			processWaitAndClose(processes[i].handle, processes[i].isConnected ? 5000 : 0);
+		getWorkerLogFileName(i, logFileName, sizeof(logFileName));
+		sprintf_s(linePrefix, sizeof(linePrefix), "[worker %i] ", i);
+		processForwardLog(logFileName, linePrefix);
+	}
+
+	stats->totalTime	= timeGetElapsedTime(startTime);
+	return isSucceed;
+}
+
+int		distributedRenderWorker(int port, int processIdx, int crashAfterTask)
+{
+	if (!socketStartup())
+		return 1;
+
+	SOCKET s = socketConnectLocalhost(port);
+	if (s == INVALID_SOCKET || !socketSendMessage(s, DistributedMsg_Hello, &processIdx, sizeof(processIdx)))
+	{
+		socketClose(s);
+		socketCleanup();
+		return 1;
+	}
+
+	Scene			scene;
+	CpuPathTracer	tracer;
+	AccumBuffer		accum;
+
+	std::vector<char>	payload;
+	int					msgType;
+	int					numTaskReceived	= 0;
+	while (socketRecvMessage(s, &msgType, &payload))
+	{
+		if (msgType == DistributedMsg_Job && payload.size() == sizeof(DistributedJobMsg))
+		{
+			DistributedJobMsg job = *(const DistributedJobMsg*)payload.data();
+			job.sceneName[DISTRIBUTED_SCENE_NAME_MAX - 1] = 0;
+			if (!scene.createByName(job.sceneName))
+			{
+				printf("unknown scene: %s\n", job.sceneName);
+				break;
+			}
+			tracer.init(&scene);
+
+			CpuCamera camera;
+			camera.pos		= job.camPos;
+			camera.lookAt	= job.camLookAt;
+			camera.fovY		= job.fovY;
+			tracer.setCamera(camera, job.width, job.height);
+			accum.resize(job.width, job.height);
+		}
+		else if (msgType == DistributedMsg_Task && payload.size() == sizeof(DistributedTaskMsg))
+		{
+			// simulate a crash in the middle of a task
+			if (numTaskReceived++ == crashAfterTask)
+				ExitProcess(2);
+
+			// 1 sample at a time, so the coordinator can tell a slow task from a hung worker
+			DistributedTaskMsg	task	= *(const DistributedTaskMsg*)payload.data();
+			bool				isSent	= true;
+			accum.clear();
+			for(int i=0; i<task.sampleCount && isSent; ++i)
+			{
+				tracer.renderSamples(&accum, task.sampleStart + i, 1);
+				isSent = socketSendMessage(s, DistributedMsg_Heartbeat, nullptr, 0);
+			}
+
+			int numPixel = accum.width * accum.height;
+			NetMessageHeader header;
+			header.type		= DistributedMsg_Result;
+			header.sizeByte	= sizeof(DistributedTaskMsg) + numPixel * (sizeof(Vector4) + sizeof(int));
+			isSent			=	isSent													&&
+								socketSendAll(s, &header, sizeof(header))								&&
+								socketSendAll(s, &task, sizeof(task))									&&
+								socketSendAll(s, accum.radianceSum.data(), numPixel * sizeof(Vector4))	&&
+								socketSendAll(s, accum.sampleCount.data(), numPixel * sizeof(int));
+			if (!isSent)
+				break;
+		}
+		else
+			break;	// quit or unknown message
+	}
+
+	socketClose(s);
+	socketCleanup();
+	return 0;
+}
+
+void	distributedRenderScalingReport(const DistributedJob& job, int maxWorker)
+{
+	printf("------------  Distributed render scaling  ------------\n");
+	printf("%s, %i x %i, %i spp, %i spp per task\n", job.sceneName, job.width, job.height, job.samplePerPixel, job.samplePerTask);
+	printf("workers | render time (s) | total time (s) | speed up | efficiency\n");
+
+	AccumBuffer			result;
+	DistributedStats	stats;
+	double				baseTime	= 0.0;
+	for(int n=1; n<=maxWorker; ++n)
+	{
+		if (!distributedRender(job, n, -1, &result, &stats))
+		{
+			printf("%7i | failed\n", n);
+			continue;
+		}
+		if (n == 1)
+			baseTime = stats.renderTime;
+
+		double speedUp = baseTime / stats.renderTime;
+		printf("%7i | %15.3f | %14.3f | %8.2f | %9.1f%%\n", n, stats.renderTime, stats.totalTime, speedUp, speedUp / n * 100.0);
+	}
+
+	// fault tolerance: kill one worker at its first task and make sure the frame still completes
+	if (maxWorker > 1)
+	{
+		bool isSucceed = distributedRender(job, maxWorker, 0, &result, &stats);
+		int expectedSample = job.width * job.height * job.samplePerPixel;
+		printf("worker crash test: %s, %i worker lost, %i task re-issued, %i/%i samples merged\n",
+			isSucceed ? "completed" : "failed", stats.numWorkerLost, stats.numTaskReissued, result.getTotalSampleCount(), expectedSample);
+	}
+}
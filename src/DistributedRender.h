@@ -0,0 +1,37 @@
+#pragma once
+
+// all rights reserved
+
+#include "CpuPathTracer.h"
+
+// Split a high spp frame into disjoint sample ranges and render them in worker processes.
+// The coordinator spawns the workers (this executable with "-worker <port>"), talks to them
+// over TCP on localhost, merges the returned accumulation buffers and re-issue the sample
+// range of any worker which died. A worker which exits, does not connect in time or stops sending
+// heartbeats during a task is killed and replaced by a new process.
+struct DistributedJob
+{
+	const char*	sceneName;			// created by Scene::createByName() in each worker
+	CpuCamera	camera;
+	int			width;
+	int			height;
+	int			samplePerPixel;
+	int			samplePerTask;		// size of each sample range sent to a worker
+};
+
+struct DistributedStats
+{
+	double		totalTime;			// including spawning worker processes
+	double		renderTime;			// from first task sent to last result merged
+	int			numTask;
+	int			numTaskReissued;
+	int			numWorkerLost;
+	int			numWorkerSpawned;
+};
+
+// crashWorkerAfterTask >= 0 makes the first worker exit abruptly when it receives that task, for testing fault tolerance
+bool	distributedRender(const DistributedJob& job, int numWorker, int crashWorkerAfterTask, AccumBuffer* result, DistributedStats* stats);
+int		distributedRenderWorker(int port, int processIdx, int crashAfterTask);
+
+// render the same job with 1 to maxWorker workers and print the speed up and scaling efficiency
+void	distributedRenderScalingReport(const DistributedJob& job, int maxWorker);
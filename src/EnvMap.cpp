@@ -0,0 +1,269 @@
+
+// all rights reserved
+
+#include "EnvMap.h"
+#include <stdio.h>
+#include <string.h>
+
+static float	getLuminance(const Vector3& c)
+{
+	return c.dot(Vector3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// theta is measured from +y, phi around the y axis from +x towards +z
+static Vector3	getDirection(float phi, float theta)
+{
+	float sinTheta = sinf(theta);
+	return Vector3(sinTheta * cosf(phi), cosf(theta), sinTheta * sinf(phi));
+}
+
+static bool		loadPfm(FILE* file, int* outWidth, int* outHeight, std::vector<Vector3>* outPixels)
+{
+	// "PF" for RGB, "Pf" for gray scale
+	char	type[2];
+	int		width, height;
+	float	scale;
+	if (fread(type, 1, 2, file) != 2 || type[0] != 'P' || (type[1] != 'F' && type[1] != 'f'))
+		return false;
+	if (fscanf_s(file, "%i %i %f", &width, &height, &scale) != 3 || width <= 0 || height <= 0)
+		return false;
+	int numChannel = type[1] == 'F' ? 3 : 1;
+	fgetc(file);		// single white space before the raster
+
+	// scanlines are stored from bottom to top, a positive scale means big endian
+	outPixels->resize(width * height);
+	std::vector<float> row(width * numChannel);
+	for (int y = height - 1; y >= 0; --y)
+	{
+		if (fread(&row[0], sizeof(float), row.size(), file) != row.size())
+			return false;
+		if (scale > 0.0f)
+			for (int i = 0; i < (int)row.size(); ++i)
+			{
+				unsigned char* b = (unsigned char*)&row[i];
+				unsigned char t;
+				t = b[0]; b[0] = b[3]; b[3] = t;
+				t = b[1]; b[1] = b[2]; b[2] = t;
+			}
+		for (int x = 0; x < width; ++x)
+		{
+			const float* c = &row[x * numChannel];
+			(*outPixels)[y * width + x] = numChannel == 3 ? Vector3(c[0], c[1], c[2]) : Vector3(c[0], c[0], c[0]);
+		}
+	}
+	*outWidth	= width;
+	*outHeight	= height;
+	return true;
+}
+
+// read 1 scanline of RGBE, either flat or with the per channel run length encoding
+static bool		readHdrScanline(FILE* file, int width, unsigned char* rgbe)
+{
+	unsigned char head[4];
+	if (fread(head, 1, 4, file) != 4)
+		return false;
+	if (width < 8 || width > 0x7fff || head[0] != 2 || head[1] != 2 || (head[2] & 0x80) != 0)
+	{
+		memcpy(rgbe, head, 4);
+		return fread(rgbe + 4, 4, width - 1, file) == (size_t)(width - 1);
+	}
+	if (((head[2] << 8) | head[3]) != width)
+		return false;
+	for (int c = 0; c < 4; ++c)
+	{
+		int x = 0;
+		while (x < width)
+		{
+			int count = fgetc(file);
+			if (count == EOF)
+				return false;
+			if (count > 128)
+			{
+				// run of the same value
+				count		-= 128;
+				int value	= fgetc(file);
+				if (value == EOF || x + count > width)
+					return false;
+				for (int i = 0; i < count; ++i)
+					rgbe[(x++) * 4 + c] = (unsigned char)value;
+			}
+			else
+			{
+				if (count == 0 || x + count > width)
+					return false;
+				for (int i = 0; i < count; ++i)
+					rgbe[(x++) * 4 + c] = (unsigned char)fgetc(file);
+			}
+		}
+	}
+	return true;
+}
+
+static bool		loadHdr(FILE* file, int* outWidth, int* outHeight, std::vector<Vector3>* outPixels)
+{
+	// header lines end with an empty line, followed by the resolution, only the standard -Y +X orientation is supported
+	char line[256];
+	if (!fgets(line, sizeof(line), file) || strncmp(line, "#?", 2) != 0)
+		return false;
+	while (true)
+	{
+		if (!fgets(line, sizeof(line), file))
+			return false;
+		if (line[0] == '\n' || line[0] == '\r')
+			break;
+		if (strncmp(line, "FORMAT=", 7) == 0 && strncmp(line + 7, "32-bit_rle_rgbe", 15) != 0)
+			return false;
+	}
+	int width, height;
+	if (!fgets(line, sizeof(line), file) || sscanf_s(line, "-Y %i +X %i", &height, &width) != 2 || width <= 0 || height <= 0)
+		return false;
+
+	outPixels->resize(width * height);
+	std::vector<unsigned char> rgbe(width * 4);
+	for (int y = 0; y < height; ++y)
+	{
+		if (!readHdrScanline(file, width, &rgbe[0]))
+			return false;
+		for (int x = 0; x < width; ++x)
+		{
+			const unsigned char*	c		= &rgbe[x * 4];
+			float					scale	= c[3] == 0 ? 0.0f : ldexpf(1.0f, c[3] - (128 + 8));
+			(*outPixels)[y * width + x]		= c[3] == 0 ? Vector3(0, 0, 0) : Vector3(c[0] + 0.5f, c[1] + 0.5f, c[2] + 0.5f) * scale;
+		}
+	}
+	*outWidth	= width;
+	*outHeight	= height;
+	return true;
+}
+
+EnvMap::EnvMap()
+{
+	width		= 0;
+	height		= 0;
+	sampling	= EnvMapSampling_Importance;
+}
+
+void	EnvMap::clear()
+{
+	width		= 0;
+	height		= 0;
+	pixels.clear();
+	table.clear();
+}
+
+bool	EnvMap::load(const char* fileName)
+{
+	FILE* file;
+	if (fopen_s(&file, fileName, "rb") != 0)
+		return false;
+	int						w, h;
+	std::vector<Vector3>	data;
+	size_t					len		= strlen(fileName);
+	bool					isPfm	= len > 4 && strcmp(fileName + len - 4, ".pfm") == 0;
+	bool					isValid	= isPfm ? loadPfm(file, &w, &h, &data) : loadHdr(file, &w, &h, &data);
+	fclose(file);
+	if (!isValid)
+		return false;
+
+	// negative and NaN values would break the table
+	for (int i = 0; i < (int)data.size(); ++i)
+	{
+		Vector3& c	= data[i];
+		c			= Vector3(c.x > 0.0f ? c.x : 0.0f, c.y > 0.0f ? c.y : 0.0f, c.z > 0.0f ? c.z : 0.0f);
+	}
+	width	= w;
+	height	= h;
+	pixels.swap(data);
+	buildTable();
+	return true;
+}
+
+void	EnvMap::createSky(const Vector3& sunDir, float sunRadiance)
+{
+	const float	sunAngularRadius	= DEGREE_TO_RADIAN(2.5f);
+	const float	cosSunRadius		= cosf(sunAngularRadius);
+	Vector3		sunNormal			= sunDir;
+	sunNormal.normalize();
+
+	width	= ENV_MAP_SKY_WIDTH;
+	height	= ENV_MAP_SKY_HEIGHT;
+	pixels.resize(width * height);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			// blue gradient from the horizon to the zenith, dark ground below the horizon
+			Vector3	dir		= getDirection((x + 0.5f) * (2.0f * PI / width), (y + 0.5f) * (PI / height));
+			float	t		= sqrtf(maxf(dir.y, 0.0f));
+			Vector3	color	= dir.y >= 0.0f ? Vector3(0.60f, 0.65f, 0.70f) * (1.0f - t) + Vector3(0.15f, 0.30f, 0.60f) * t : Vector3(0.10f, 0.09f, 0.08f);
+			if (dir.dot(sunNormal) >= cosSunRadius)
+				color += Vector3(1.0f, 0.95f, 0.85f) * sunRadiance;
+			pixels[y * width + x] = color;
+		}
+	buildTable();
+}
+
+void	EnvMap::buildTable()
+{
+	// the solid angle of a pixel is proportional to sin(theta) at its center
+	table.clear();
+	if (isEmpty())
+		return;
+	std::vector<float> weight(width * height);
+	for (int y = 0; y < height; ++y)
+	{
+		float sinTheta = sinf((y + 0.5f) * (PI / height));
+		for (int x = 0; x < width; ++x)
+			weight[y * width + x] = getLuminance(pixels[y * width + x]) * sinTheta;
+	}
+	aliasTableBuild(&weight[0], width * height, &table);
+}
+
+bool	EnvMap::isEmpty() const
+{
+	return width == 0 || height == 0;
+}
+
+int		EnvMap::getMemorySize() const
+{
+	return (int)(pixels.size() * sizeof(Vector3) + table.size() * sizeof(AliasTableEntry));
+}
+
+Vector3	EnvMap::lookup(const Vector3& dir) const
+{
+	float	theta	= acosf(clampf(dir.y, -1.0f, 1.0f));
+	float	phi		= atan2f(dir.z, dir.x);
+	if (phi < 0.0f)
+		phi += 2.0f * PI;
+	int		x		= (int)(phi * (width / (2.0f * PI)));
+	int		y		= (int)(theta * (height / PI));
+	x				= x < width  - 1 ? x : width  - 1;
+	y				= y < height - 1 ? y : height - 1;
+	return pixels[y * width + x];
+}
+
+float	EnvMap::sample(float u0, float u1, float u2, Vector3* outDir, Vector3* outRadiance) const
+{
+	if (sampling == EnvMapSampling_Uniform)
+	{
+		float	cosTheta	= 1.0f - 2.0f * u1;
+		float	sinTheta	= sqrtf(maxf(1.0f - cosTheta * cosTheta, 0.0f));
+		float	phi			= 2.0f * PI * u2;
+		*outDir				= Vector3(sinTheta * cosf(phi), cosTheta, sinTheta * sinf(phi));
+		*outRadiance		= lookup(*outDir);
+		return 1.0f / (4.0f * PI);
+	}
+	if (table.empty())
+		return 0.0f;
+
+	// pick a pixel, then a uniform (phi, theta) inside it, which has a density of 1 / (pixel size in phi * theta * sin(theta)) in solid angle
+	int		i			= aliasTableSample(&table[0], width * height, u0);
+	int		x			= i % width;
+	int		y			= i / width;
+	float	theta		= (y + u2) * (PI / height);
+	float	sinTheta	= sinf(theta);
+	if (sinTheta <= 0.0f)
+		return 0.0f;
+	*outDir				= getDirection((x + u1) * (2.0f * PI / width), theta);
+	*outRadiance		= pixels[i];
+	return table[i].pdf * (width * height) / (2.0f * PI * PI * sinTheta);
+}
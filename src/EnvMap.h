@@ -0,0 +1,41 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include "math.h"
+#include "AliasTable.h"
+
+#define ENV_MAP_SKY_WIDTH		(512)
+#define ENV_MAP_SKY_HEIGHT		(256)
+
+enum EnvMapSampling
+{
+	EnvMapSampling_Uniform,			// uniform over the sphere
+	EnvMapSampling_Importance,		// each pixel in proportion to its luminance times its solid angle
+};
+
+// HDR environment light for the rays escaping the scene, stored in lat-long layout:
+// row 0 is +y, the column wraps around the y axis starting from +x towards +z.
+// The layout of pixels and table is shared with path_tracer.hlsl.
+struct EnvMap
+{
+	int								width;
+	int								height;
+	int								sampling;		// EnvMapSampling
+	std::vector<Vector3			>	pixels;			// linear radiance
+	std::vector<AliasTableEntry	>	table;			// 1 entry per pixel, empty if the map is black
+
+	EnvMap();
+
+	void	clear();
+	bool	load(const char* fileName);				// .pfm or Radiance .hdr, return false if the file cannot be read
+	void	createSky(const Vector3& sunDir, float sunRadiance);		// procedural sky with a sun disk, for the scenes without an HDR file
+	void	buildTable();
+	bool	isEmpty() const;
+	int		getMemorySize() const;					// byte of pixels and table
+
+	Vector3	lookup(const Vector3& dir) const;		// nearest pixel
+	// u0, u1, u2 in [0, 1), return the pdf in solid angle, or 0 if nothing can be sampled
+	float	sample(float u0, float u1, float u2, Vector3* outDir, Vector3* outRadiance) const;
+};
@@ -0,0 +1,270 @@
+
+// all rights reserved
+
+#include "Mesh.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <algorithm>
+#include <unordered_map>
+
+static void	computeBound(const MeshData& mesh, Vector3* boundMin, Vector3* boundMax)
+{
+	*boundMin = Vector3( 999999999999999.0f,  999999999999999.0f,  999999999999999.0f);
+	*boundMax = Vector3(-999999999999999.0f, -999999999999999.0f, -999999999999999.0f);
+	for (int i = 0; i < (int)mesh.pos.size(); ++i)
+	{
+		*boundMin = vecMin(*boundMin, mesh.pos[i]);
+		*boundMax = vecMax(*boundMax, mesh.pos[i]);
+	}
+}
+
+static const char*	parseObjIndex(const char* str, int numElement, int* outIdx)
+{
+	// 1 based, negative index is relative to the end
+	char*	end;
+	long	idx	= strtol(str, &end, 10);
+	*outIdx		= end == str ? -1 : (idx < 0 ? numElement + (int)idx : (int)idx - 1);
+	return end;
+}
+
+bool	meshLoadObj(const char* fileName, MeshData* mesh)
+{
+	FILE* file;
+	if (fopen_s(&file, fileName, "r") != 0)
+		return false;
+
+	mesh->pos.clear();
+	mesh->nor.clear();
+	mesh->idx.clear();
+	std::vector<Vector3>	objPos;
+	std::vector<Vector3>	objNor;
+	std::vector<int		>	facePos;
+	std::vector<int		>	faceNor;
+	char line[1024];
+	while (fgets(line, sizeof(line), file))
+	{
+		const char* str = line;
+		if (str[0] == 'v' && (str[1] == ' ' || str[1] == 'n'))
+		{
+			bool	isNormal = str[1] == 'n';
+			char*	end;
+			str += 2;
+			float	x	= strtof(str, &end);
+			float	y	= strtof(end, &end);
+			float	z	= strtof(end, &end);
+			if (isNormal)
+				objNor.push_back(Vector3(x, y, z));
+			else
+				objPos.push_back(Vector3(x, y, z));
+		}
+		else if (str[0] == 'f' && str[1] == ' ')
+		{
+			// each corner is v, v/vt, v//vn or v/vt/vn
+			facePos.clear();
+			faceNor.clear();
+			str += 2;
+			while (true)
+			{
+				while (*str == ' ' || *str == '\t')
+					++str;
+				int posIdx, texIdx, norIdx = -1;
+				const char* end = parseObjIndex(str, (int)objPos.size(), &posIdx);
+				if (end == str)
+					break;
+				str = end;
+				if (*str == '/')
+				{
+					str = parseObjIndex(str + 1, 0, &texIdx);
+					if (*str == '/')
+						str = parseObjIndex(str + 1, (int)objNor.size(), &norIdx);
+				}
+				if (posIdx < 0 || posIdx >= (int)objPos.size())
+					break;
+				facePos.push_back(posIdx);
+				faceNor.push_back(norIdx >= 0 && norIdx < (int)objNor.size() ? norIdx : -1);
+			}
+
+			for (int i = 1; i + 1 < (int)facePos.size(); ++i)
+			{
+				int		corner[3]	= { 0, i, i + 1 };
+				Vector3	faceNormal	= (objPos[facePos[i]] - objPos[facePos[0]]).cross(objPos[facePos[i + 1]] - objPos[facePos[0]]);
+				float	len			= faceNormal.length();
+				faceNormal			= len > 0.0f ? faceNormal / len : Vector3(0, 1, 0);
+				for (int j = 0; j < 3; ++j)
+				{
+					int c = corner[j];
+					mesh->idx.push_back((int)mesh->pos.size());
+					mesh->pos.push_back(objPos[facePos[c]]);
+					mesh->nor.push_back(faceNor[c] >= 0 ? objNor[faceNor[c]] : faceNormal);
+				}
+			}
+		}
+	}
+	fclose(file);
+	return !mesh->idx.empty();
+}
+
+void	meshFitToBox(MeshData* mesh, const Vector3& center, float size)
+{
+	Vector3 boundMin, boundMax;
+	computeBound(*mesh, &boundMin, &boundMax);
+	Vector3	extent		= boundMax - boundMin;
+	float	scale		= size / extent.maxComponent();
+	Vector3	offset		= Vector3(	center.x - (boundMin.x + boundMax.x) * 0.5f * scale,
+									center.y - size * 0.5f - boundMin.y * scale,
+									center.z - (boundMin.z + boundMax.z) * 0.5f * scale);
+	for (int i = 0; i < (int)mesh->pos.size(); ++i)
+		mesh->pos[i] = mesh->pos[i] * scale + offset;
+}
+
+void	meshWeldVertices(MeshData* mesh, float tolerance)
+{
+	int numVtx = (int)mesh->pos.size();
+	if (numVtx == 0)
+		return;
+
+	// hash the vertices into a grid with cell size == tolerance, so a match is always inside the 27 neighbor cells
+	Vector3 boundMin, boundMax;
+	computeBound(*mesh, &boundMin, &boundMax);
+	float cellSize		= maxf(tolerance * (boundMax - boundMin).length(), 0.000000001f);
+	float cellSizeInv	= 1.0f / cellSize;
+	float tolerance2	= cellSize * cellSize;
+
+	std::unordered_map<long long, int>	cellHead;		// first welded vertex in the cell
+	std::vector<int>					cellNext;		// next welded vertex in the same cell
+	std::vector<Vector3>				weldedPos;
+	std::vector<Vector3>				weldedNor;
+	std::vector<int>					remap(numVtx);
+	for (int i = 0; i < numVtx; ++i)
+	{
+		const Vector3&	p		= mesh->pos[i];
+		const Vector3&	n		= mesh->nor[i];
+		int				cx		= (int)((p.x - boundMin.x) * cellSizeInv);
+		int				cy		= (int)((p.y - boundMin.y) * cellSizeInv);
+		int				cz		= (int)((p.z - boundMin.z) * cellSizeInv);
+		int				found	= -1;
+		for (int z = cz - 1; z <= cz + 1 && found < 0; ++z)
+			for (int y = cy - 1; y <= cy + 1 && found < 0; ++y)
+				for (int x = cx - 1; x <= cx + 1 && found < 0; ++x)
+				{
+					std::unordered_map<long long, int>::const_iterator it = cellHead.find(((long long)x << 42) ^ ((long long)y << 21) ^ (long long)z);
+					for (int v = it == cellHead.end() ? -1 : it->second; v >= 0; v = cellNext[v])
+						if ((weldedPos[v] - p).length2() <= tolerance2 && weldedNor[v].dot(n) >= MESH_WELD_NORMAL_TOLERANCE)
+						{
+							found = v;
+							break;
+						}
+				}
+
+		if (found < 0)
+		{
+			found				= (int)weldedPos.size();
+			long long	key		= ((long long)cx << 42) ^ ((long long)cy << 21) ^ (long long)cz;
+			std::unordered_map<long long, int>::iterator it = cellHead.find(key);
+			cellNext.push_back(it == cellHead.end() ? -1 : it->second);
+			cellHead[key]		= found;
+			weldedPos.push_back(p);
+			weldedNor.push_back(n);
+		}
+		remap[i] = found;
+	}
+
+	for (int i = 0; i < (int)mesh->idx.size(); ++i)
+		mesh->idx[i] = remap[mesh->idx[i]];
+	mesh->pos.swap(weldedPos);
+	mesh->nor.swap(weldedNor);
+}
+
+void	meshRemoveDegenerate(MeshData* mesh)
+{
+	Vector3 boundMin, boundMax;
+	computeBound(*mesh, &boundMin, &boundMax);
+	float	diagonal2	= (boundMax - boundMin).length2();
+	float	minArea2	= diagonal2 * diagonal2 * 1e-24f;		// squared length of the cross product
+	int		numIdx		= 0;
+	for (int i = 0; i + 2 < (int)mesh->idx.size(); i += 3)
+	{
+		int idx0 = mesh->idx[i	  ];
+		int idx1 = mesh->idx[i + 1];
+		int idx2 = mesh->idx[i + 2];
+		if (idx0 == idx1 || idx1 == idx2 || idx2 == idx0)
+			continue;
+		Vector3 cross = (mesh->pos[idx1] - mesh->pos[idx0]).cross(mesh->pos[idx2] - mesh->pos[idx0]);
+		if (cross.length2() <= minArea2)
+			continue;
+		mesh->idx[numIdx++] = idx0;
+		mesh->idx[numIdx++] = idx1;
+		mesh->idx[numIdx++] = idx2;
+	}
+	mesh->idx.resize(numIdx);
+}
+
+struct MeshMortonTri
+{
+	unsigned int	code;
+	int				tri;
+
+	bool operator< (const MeshMortonTri& rhs) const
+	{
+		return code < rhs.code || (code == rhs.code && tri < rhs.tri);
+	}
+};
+
+void	meshReorderMorton(MeshData* mesh)
+{
+	int numTri = (int)mesh->idx.size() / 3;
+	if (numTri == 0)
+		return;
+
+	Vector3 boundMin, boundMax;
+	computeBound(*mesh, &boundMin, &boundMax);
+	Vector3	extent	= boundMax - boundMin;
+	Vector3	scale	= Vector3(	extent.x > 0.0f ? 1023.0f / extent.x : 0.0f,
+								extent.y > 0.0f ? 1023.0f / extent.y : 0.0f,
+								extent.z > 0.0f ? 1023.0f / extent.z : 0.0f);
+	std::vector<MeshMortonTri> tris(numTri);
+	for (int i = 0; i < numTri; ++i)
+	{
+		const int*	idx			= &mesh->idx[i * 3];
+		Vector3		centroid	= (mesh->pos[idx[0]] + mesh->pos[idx[1]] + mesh->pos[idx[2]]) * (1.0f / 3.0f);
+		tris[i].code			= computeMortonCode(centroid, boundMin, scale);
+		tris[i].tri				= i;
+	}
+	std::sort(tris.begin(), tris.end());
+
+	// renumber the vertices in the order they are first referenced by the sorted triangles
+	std::vector<int		>	remap(mesh->pos.size(), -1);
+	std::vector<int		>	sortedIdx(numTri * 3);
+	std::vector<Vector3	>	sortedPos;
+	std::vector<Vector3	>	sortedNor;
+	sortedPos.reserve(mesh->pos.size());
+	sortedNor.reserve(mesh->nor.size());
+	for (int i = 0; i < numTri; ++i)
+		for (int j = 0; j < 3; ++j)
+		{
+			int v = mesh->idx[tris[i].tri * 3 + j];
+			if (remap[v] < 0)
+			{
+				remap[v] = (int)sortedPos.size();
+				sortedPos.push_back(mesh->pos[v]);
+				sortedNor.push_back(mesh->nor[v]);
+			}
+			sortedIdx[i * 3 + j] = remap[v];
+		}
+	mesh->pos.swap(sortedPos);
+	mesh->nor.swap(sortedNor);
+	mesh->idx.swap(sortedIdx);
+}
+
+void	meshOptimize(MeshData* mesh, MeshOptimizeStats* stats)
+{
+	LONGLONG startTime	= timeGetAbsoulteTime();
+	stats->numVtxBefore	= (int)mesh->pos.size();
+	stats->numTriBefore	= (int)mesh->idx.size() / 3;
+	meshWeldVertices(mesh, MESH_WELD_TOLERANCE);
+	meshRemoveDegenerate(mesh);
+	meshReorderMorton(mesh);		// also drop the vertices no longer referenced
+	stats->numVtxAfter	= (int)mesh->pos.size();
+	stats->numTriAfter	= (int)mesh->idx.size() / 3;
+	stats->time			= timeGetElapsedTime(startTime);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include "math.h"
+
+#define MESH_WELD_TOLERANCE			(0.00001f)		// relative to the bounding box diagonal
+#define MESH_WELD_NORMAL_TOLERANCE	(0.9999f)		// minimum cosine between welded normals
+
+// mesh data between loading and Scene::addMesh()
+struct MeshData
+{
+	std::vector<Vector3	>	pos;
+	std::vector<Vector3	>	nor;
+	std::vector<int		>	idx;
+};
+
+struct MeshOptimizeStats
+{
+	int		numVtxBefore;
+	int		numVtxAfter;
+	int		numTriBefore;
+	int		numTriAfter;
+	double	time;			// second
+};
+
+// every face corner become a vertex, faces are triangulated as fan, missing normals are replaced by the face normal
+bool	meshLoadObj(const char* fileName, MeshData* mesh);
+void	meshFitToBox(MeshData* mesh, const Vector3& center, float size);		// uniform scale to fit a cube, and rest on its bottom
+
+void	meshWeldVertices(MeshData* mesh, float tolerance);		// merge vertices with close position and normal
+void	meshRemoveDegenerate(MeshData* mesh);					// remove triangles with zero area or repeated vertex
+void	meshReorderMorton(MeshData* mesh);						// sort triangles by the Morton code of the centroid, vertices by first use
+void	meshOptimize(MeshData* mesh, MeshOptimizeStats* stats);	// all of the above
@@ -0,0 +1,340 @@
+
+// all rights reserved
+
+#include "PathGuide.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+
+static void		dirToSquare(const Vector3& dir, float* outU, float* outV)
+{
+	float phi	= atan2f(dir.y, dir.x) * (0.5f / PI);
+	*outU		= clampf((dir.z + 1.0f) * 0.5f, 0.0f, 1.0f);
+	*outV		= phi < 0.0f ? phi + 1.0f : phi;
+}
+
+static Vector3	squareToDir(float u, float v)
+{
+	float cosTheta	= u * 2.0f - 1.0f;
+	float sinTheta	= sqrtf(maxf(1.0f - cosTheta * cosTheta, 0.0f));
+	float phi		= v * 2.0f * PI;
+	return Vector3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+}
+
+static int		getQuadrant(float* u, float* v)
+{
+	// return the quadrant of (u, v) and rescale (u, v) to the quadrant
+	int x	= *u < 0.5f ? 0 : 1;
+	int y	= *v < 0.5f ? 0 : 1;
+	*u		= minf(*u * 2.0f - x, 1.0f);
+	*v		= minf(*v * 2.0f - y, 1.0f);
+	return x + 2 * y;
+}
+
+PathGuideQuadNode::PathGuideQuadNode()
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		energy[i]	= 0.0f;
+		child[i]	= 0;
+	}
+}
+
+PathGuideQuadNode::PathGuideQuadNode(const PathGuideQuadNode& other)
+{
+	*this = other;
+}
+
+PathGuideQuadNode&	PathGuideQuadNode::operator=(const PathGuideQuadNode& other)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		energy[i]	= other.energy[i].load(std::memory_order_relaxed);
+		child[i]	= other.child[i];
+	}
+	return *this;
+}
+
+PathGuideDirTree::PathGuideDirTree()
+{
+	nodes.resize(1);
+	sampleCount = 0;
+}
+
+PathGuideDirTree::PathGuideDirTree(const PathGuideDirTree& other)
+{
+	*this = other;
+}
+
+PathGuideDirTree&	PathGuideDirTree::operator=(const PathGuideDirTree& other)
+{
+	nodes		= other.nodes;
+	sampleCount	= other.sampleCount.load(std::memory_order_relaxed);
+	return *this;
+}
+
+float	PathGuideDirTree::getEnergy() const
+{
+	const PathGuideQuadNode& root = nodes[0];
+	return	root.energy[0].load(std::memory_order_relaxed) + root.energy[1].load(std::memory_order_relaxed) +
+			root.energy[2].load(std::memory_order_relaxed) + root.energy[3].load(std::memory_order_relaxed);
+}
+
+void	PathGuideDirTree::record(const Vector3& dir, float value)
+{
+	float u, v;
+	dirToSquare(dir, &u, &v);
+	sampleCount.fetch_add(1, std::memory_order_relaxed);
+	int nodeIdx = 0;
+	for (;;)
+	{
+		PathGuideQuadNode&	node	= nodes[nodeIdx];
+		int					q		= getQuadrant(&u, &v);
+		atomicAddFloat(&node.energy[q], value);
+		if (node.child[q] == 0)
+			return;
+		nodeIdx = node.child[q];
+	}
+}
+
+float	PathGuideDirTree::pdf(const Vector3& dir) const
+{
+	float u, v;
+	dirToSquare(dir, &u, &v);
+	float	density	= 1.0f;
+	int		nodeIdx	= 0;
+	for (;;)
+	{
+		const PathGuideQuadNode&	node	= nodes[nodeIdx];
+		float						total	= node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+		if (total <= 0.0f)
+			break;
+		int							q		= getQuadrant(&u, &v);
+		density								*= 4.0f * node.energy[q] / total;
+		if (node.child[q] == 0 || density <= 0.0f)
+			break;
+		nodeIdx								= node.child[q];
+	}
+	return density * (0.25f / PI);
+}
+
+Vector3	PathGuideDirTree::sample(float u0, float u1, float* outPdf) const
+{
+	// the 2 random numbers are rescaled after choosing the column and the row of each level
+	float	density	= 1.0f;
+	float	originU	= 0.0f;
+	float	originV	= 0.0f;
+	float	size	= 1.0f;
+	int		nodeIdx	= 0;
+	for (;;)
+	{
+		const PathGuideQuadNode&	node	= nodes[nodeIdx];
+		float						e[4]	= { node.energy[0], node.energy[1], node.energy[2], node.energy[3] };
+		float						total	= e[0] + e[1] + e[2] + e[3];
+		if (total <= 0.0f)
+			break;
+
+		float	left		= e[0] + e[2];
+		float	boundary	= left / total;
+		int		x			= 0;
+		if (u0 < boundary)
+		{
+			u0			/= boundary;
+			boundary	= e[0] / left;
+		}
+		else
+		{
+			u0			= (u0 - boundary) / (1.0f - boundary);
+			boundary	= e[1] / (total - left);
+			x			= 1;
+		}
+		int		y			= 0;
+		if (u1 < boundary)
+			u1			/= boundary;
+		else
+		{
+			u1			= (u1 - boundary) / (1.0f - boundary);
+			y			= 1;
+		}
+		u0			= minf(u0, 1.0f);
+		u1			= minf(u1, 1.0f);
+		size		*= 0.5f;
+		originU		+= x * size;
+		originV		+= y * size;
+		int q		= x + 2 * y;
+		density		*= 4.0f * e[q] / total;
+		if (node.child[q] == 0)
+			break;
+		nodeIdx		= node.child[q];
+	}
+	*outPdf		= density * (0.25f / PI);
+	return squareToDir(originU + u0 * size, originV + u1 * size);
+}
+
+void	PathGuideDirTree::refine(const PathGuideDirTree& recorded)
+{
+	nodes.clear();
+	nodes.resize(1);
+	sampleCount		= 0;
+	float energy	= recorded.getEnergy();
+	if (energy > 0.0f)
+		refineNode(0, recorded, 0, energy, energy, 1);
+}
+
+void	PathGuideDirTree::refineNode(int nodeIdx, const PathGuideDirTree& recorded, int recordedIdx, float parentEnergy, float totalEnergy, int depth)
+{
+	// the quadrants not subdivided by the recorded tree share the energy of their parent equally
+	for (int q = 0; q < 4; ++q)
+	{
+		float	energy		= recordedIdx >= 0 ? recorded.nodes[recordedIdx].energy[q].load(std::memory_order_relaxed) : parentEnergy * 0.25f;
+		if (depth >= PATH_GUIDE_QUAD_DEPTH_MAX || energy <= PATH_GUIDE_QUAD_SPLIT * totalEnergy)
+			continue;
+		int		childIdx	= (int)nodes.size();
+		nodes.resize(childIdx + 1);
+		nodes[nodeIdx].child[q]	= childIdx;
+		int		recordedChild	= recordedIdx >= 0 && recorded.nodes[recordedIdx].child[q] != 0 ? recorded.nodes[recordedIdx].child[q] : -1;
+		refineNode(childIdx, recorded, recordedChild, energy, totalEnergy, depth + 1);
+	}
+}
+
+PathGuide::PathGuide()
+{
+	m_boundMin		= Vector3(0, 0, 0);
+	m_boundSizeInv	= Vector3(1, 1, 1);
+	m_iteration		= 0;
+	m_iterationPass	= 0;
+}
+
+void	PathGuide::init(const Scene& scene)
+{
+	// the BVH root also bounds the analytic primitives
+	Aabb bound;
+	if (!scene.bvh.m_nodes.empty())
+	{
+		bound.boundMin	= scene.bvh.m_nodes[0].boundMin;
+		bound.boundMax	= scene.bvh.m_nodes[0].boundMax;
+	}
+	else
+	{
+		bound.setEmpty();
+		for (int i = 0; i < (int)scene.triPos.size(); ++i)
+			bound.grow(scene.triPos[i]);
+	}
+	Vector3	size	= bound.boundMax - bound.boundMin;
+	m_boundMin		= bound.boundMin;
+	m_boundSizeInv	= Vector3(1.0f / maxf(size.x, 1e-4f), 1.0f / maxf(size.y, 1e-4f), 1.0f / maxf(size.z, 1e-4f));
+
+	PathGuideSpatialNode root;
+	root.child		= 0;
+	root.leafIdx	= 0;
+	m_nodes.assign(1, root);
+	m_samplingTrees.assign(1, PathGuideDirTree());
+	m_recordingTrees.assign(1, PathGuideDirTree());
+	m_iteration		= 0;
+	m_iterationPass	= 0;
+}
+
+void	PathGuide::endPass()
+{
+	if (++m_iterationPass < (1 << m_iteration))
+		return;
+	refine();
+	++m_iteration;
+	m_iterationPass = 0;
+}
+
+int		PathGuide::getIteration() const
+{
+	return m_iteration;
+}
+
+int		PathGuide::getLeafNum() const
+{
+	return (int)m_samplingTrees.size();
+}
+
+int		PathGuide::getMemorySize() const
+{
+	int size = (int)(m_nodes.size() * sizeof(PathGuideSpatialNode));
+	for (int i = 0; i < (int)m_samplingTrees.size(); ++i)
+		size += (int)((m_samplingTrees[i].nodes.size() + m_recordingTrees[i].nodes.size()) * sizeof(PathGuideQuadNode));
+	return size;
+}
+
+int		PathGuide::findLeaf(const Vector3& pos) const
+{
+	float	p[3]	= {	clampf((pos.x - m_boundMin.x) * m_boundSizeInv.x, 0.0f, 1.0f),
+						clampf((pos.y - m_boundMin.y) * m_boundSizeInv.y, 0.0f, 1.0f),
+						clampf((pos.z - m_boundMin.z) * m_boundSizeInv.z, 0.0f, 1.0f)	};
+	int		nodeIdx	= 0;
+	int		axis	= 0;
+	while (m_nodes[nodeIdx].child != 0)
+	{
+		int side	= p[axis] < 0.5f ? 0 : 1;
+		p[axis]		= p[axis] * 2.0f - side;
+		nodeIdx		= m_nodes[nodeIdx].child + side;
+		axis		= axis == 2 ? 0 : axis + 1;
+	}
+	return m_nodes[nodeIdx].leafIdx;
+}
+
+const PathGuideDirTree*	PathGuide::findSamplingTree(const Vector3& pos) const
+{
+	if (m_nodes.empty())
+		return NULL;
+	const PathGuideDirTree* tree = &m_samplingTrees[findLeaf(pos)];
+	return tree->sampleCount >= PATH_GUIDE_MIN_SAMPLE && tree->getEnergy() > 0.0f ? tree : NULL;
+}
+
+void	PathGuide::record(const Vector3& pos, const Vector3& dir, float value)
+{
+	if (!m_nodes.empty())
+		m_recordingTrees[findLeaf(pos)].record(dir, value);
+}
+
+void	PathGuide::refine()
+{
+	// the recorded trees are sampled by the next iteration, and their energy decides the quadrants of the new recording trees
+	for (int i = 0; i < (int)m_recordingTrees.size(); ++i)
+	{
+		m_samplingTrees[i] = m_recordingTrees[i];
+		m_recordingTrees[i].refine(m_samplingTrees[i]);
+	}
+
+	// the sample count of a leaf grows with the iteration length, the threshold only grows with its square root, so the leaves get finer
+	float	threshold	= PATH_GUIDE_SPATIAL_SPLIT * sqrtf((float)(1 << m_iteration));
+	int		numNode		= (int)m_nodes.size();
+	std::vector<int>	nodeDepth(numNode, 0);
+	for (int i = 0; i < numNode; ++i)
+	{
+		if (m_nodes[i].child != 0)
+		{
+			nodeDepth[m_nodes[i].child		]	= nodeDepth[i] + 1;
+			nodeDepth[m_nodes[i].child + 1	]	= nodeDepth[i] + 1;
+			continue;
+		}
+		splitLeaf(i, m_samplingTrees[m_nodes[i].leafIdx].sampleCount, nodeDepth[i], threshold);
+	}
+}
+
+void	PathGuide::splitLeaf(int nodeIdx, int sampleCount, int depth, float threshold)
+{
+	// the samples are assumed to be split evenly between the children, both start with a copy of the trees
+	if (sampleCount <= threshold || depth >= PATH_GUIDE_SPATIAL_DEPTH_MAX)
+		return;
+	int leafIdx		= m_nodes[nodeIdx].leafIdx;
+	int newLeafIdx	= (int)m_samplingTrees.size();
+	m_samplingTrees	.push_back(m_samplingTrees	[leafIdx]);
+	m_recordingTrees.push_back(m_recordingTrees	[leafIdx]);
+
+	int childIdx	= (int)m_nodes.size();
+	PathGuideSpatialNode child;
+	child.child		= 0;
+	child.leafIdx	= leafIdx;
+	m_nodes.push_back(child);
+	child.leafIdx	= newLeafIdx;
+	m_nodes.push_back(child);
+	m_nodes[nodeIdx].child		= childIdx;
+	m_nodes[nodeIdx].leafIdx	= -1;
+	splitLeaf(childIdx		, sampleCount / 2, depth + 1, threshold);
+	splitLeaf(childIdx + 1	, sampleCount / 2, depth + 1, threshold);
+}
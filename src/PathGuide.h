@@ -0,0 +1,90 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include <atomic>
+#include "math.h"
+
+#define PATH_GUIDE_SPATIAL_SPLIT		(400)		// a leaf is split when its samples of an iteration exceed this times sqrt(passes of the iteration)
+#define PATH_GUIDE_SPATIAL_DEPTH_MAX	(24)
+#define PATH_GUIDE_QUAD_SPLIT			(0.01f)		// a quadrant is split when it holds more than this fraction of the energy
+#define PATH_GUIDE_QUAD_DEPTH_MAX		(20)
+#define PATH_GUIDE_SAMPLE_RATIO			(0.5f)		// probability to sample the guiding distribution instead of the BRDF
+#define PATH_GUIDE_MIN_SAMPLE			(256)		// a direction tree learnt from fewer samples is too noisy to be sampled
+
+struct Scene;
+
+// 4 quadrants of a square in the directional quadtree, quadrant index is x + 2 * y
+struct PathGuideQuadNode
+{
+	std::atomic<float>	energy[4];		// incident radiance integrated over each quadrant
+	int					child[4];		// node of each quadrant, 0 if the quadrant is a leaf
+
+	PathGuideQuadNode();
+	PathGuideQuadNode(const PathGuideQuadNode& other);
+	PathGuideQuadNode& operator=(const PathGuideQuadNode& other);
+};
+
+// Directional quadtree over the unit square, mapped to the sphere by (cos theta, phi) which preserves area,
+// so the pdf on the sphere is the pdf on the square / 4 PI.
+struct PathGuideDirTree
+{
+	std::vector<PathGuideQuadNode>	nodes;
+	std::atomic<int>				sampleCount;
+
+	PathGuideDirTree();
+	PathGuideDirTree(const PathGuideDirTree& other);
+	PathGuideDirTree& operator=(const PathGuideDirTree& other);
+
+	float	getEnergy() const;
+	void	record(const Vector3& dir, float value);		// thread safe
+	float	pdf(const Vector3& dir) const;					// in solid angle
+	Vector3	sample(float u0, float u1, float* outPdf) const;		// the pdf is found by the same walk, as pdf()
+
+	// rebuild the quadrants from the energy of the recorded tree, the energy is reset to 0
+	void	refine(const PathGuideDirTree& recorded);
+
+private:
+	void	refineNode(int nodeIdx, const PathGuideDirTree& recorded, int recordedIdx, float parentEnergy, float totalEnergy, int depth);
+};
+
+// 1 node of the binary tree over the scene bound, split in the middle along x, y, z alternately
+struct PathGuideSpatialNode
+{
+	int		child;			// first of the 2 children, 0 for a leaf
+	int		leafIdx;		// index of the direction trees of a leaf
+};
+
+// Online learnt incident radiance for guiding the BRDF rays (Muller et al. 2017, Practical Path Guiding).
+// The passes of an iteration sample the trees learnt by the previous iteration and record into a new set of trees,
+// the iteration length is doubled each time, so the later iterations learn from more samples.
+// Recording is lock free, the trees are only refined in endPass() when no path is being traced.
+class PathGuide
+{
+public:
+	PathGuide();
+
+	void	init(const Scene& scene);
+	void	endPass();						// call once per pass after every thread finished
+	int		getIteration() const;
+	int		getLeafNum() const;
+	int		getMemorySize() const;			// byte of the trees
+
+	// NULL if not enough is learnt yet around pos
+	const PathGuideDirTree*	findSamplingTree(const Vector3& pos) const;
+	void					record(const Vector3& pos, const Vector3& dir, float value);		// thread safe
+
+private:
+	std::vector<PathGuideSpatialNode>	m_nodes;
+	std::vector<PathGuideDirTree	>	m_samplingTrees;
+	std::vector<PathGuideDirTree	>	m_recordingTrees;
+	Vector3								m_boundMin;
+	Vector3								m_boundSizeInv;
+	int									m_iteration;
+	int									m_iterationPass;		// passes done in the current iteration
+
+	int		findLeaf(const Vector3& pos) const;
+	void	refine();
+	void	splitLeaf(int nodeIdx, int sampleCount, int depth, float threshold);
+};
@@ -0,0 +1,69 @@
+
+// all rights reserved
+
+#include "Process.h"
+#include <stdio.h>
+#include <string.h>
+#include <io.h>
+
+HANDLE	processSpawnSelf(const char* args, const char* logFileName)
+{
+	char exePath[MAX_PATH];
+	GetModuleFileNameA(nullptr, exePath, MAX_PATH);
+
+	char cmdLine[MAX_PATH * 2 + 256];
+	if (logFileName)
+		sprintf_s(cmdLine, sizeof(cmdLine), "\"%s\" %s -log \"%s\"", exePath, args, logFileName);
+	else
+		sprintf_s(cmdLine, sizeof(cmdLine), "\"%s\" %s", exePath, args);
+
+	STARTUPINFOA		startupInfo = {};
+	PROCESS_INFORMATION	processInfo = {};
+	startupInfo.cb		= sizeof(startupInfo);
+	if (!CreateProcessA(nullptr, cmdLine, nullptr, nullptr, FALSE, CREATE_NO_WINDOW, nullptr, nullptr, &startupInfo, &processInfo))
+		return nullptr;
+	CloseHandle(processInfo.hThread);
+	return processInfo.hProcess;
+}
+
+bool	processIsAlive(HANDLE process)
+{
+	return WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+}
+
+void	processWaitAndClose(HANDLE process, int timeOutMs)
+{
+	if (WaitForSingleObject(process, timeOutMs) != WAIT_OBJECT_0)
+		TerminateProcess(process, 1);
+	CloseHandle(process);
+}
+
+void	processRedirectOutput(const char* logFileName)
+{
+	// stderr share the file descriptor of stdout so their lines are not overwritten by each other,
+	// both are unbuffered so the lines printed before a crash are kept
+	FILE* file;
+	if (freopen_s(&file, logFileName, "w", stdout) != 0)
+		return;
+	_dup2(_fileno(stdout), _fileno(stderr));
+	setvbuf(stdout, nullptr, _IONBF, 0);
+	setvbuf(stderr, nullptr, _IONBF, 0);
+}
+
+void	processForwardLog(const char* logFileName, const char* linePrefix)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, logFileName, "r") != 0 || !file)
+		return;
+	char	line[512];
+	bool	isLineStart	= true;		// a line longer than the buffer is read in several parts
+	while (fgets(line, sizeof(line), file))
+	{
+		printf("%s%s", isLineStart ? linePrefix : "", line);
+		isLineStart = line[strlen(line) - 1] == '\n';
+	}
+	if (!isLineStart)
+		printf("\n");
+	fclose(file);
+	DeleteFileA(logFileName);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// all rights reserved
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// launch another instance of this executable with the given command line args, return nullptr on failure.
+// The child has no console, its stdout and stderr are written to logFileName (passed as "-log <file>"),
+// which is read back by processForwardLog() after the child exits, logFileName can be nullptr to discard the output
+HANDLE	processSpawnSelf(const char* args, const char* logFileName);
+bool	processIsAlive(HANDLE process);
+// wait for the process to exit, terminate it on time out
+void	processWaitAndClose(HANDLE process, int timeOutMs);
+
+// child side of "-log <file>", called before anything is printed
+void	processRedirectOutput(const char* logFileName);
+// print the log of an exited child to stdout with linePrefix before each line, then delete the file
+void	processForwardLog(const char* logFileName, const char* linePrefix);
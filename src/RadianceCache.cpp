@@ -0,0 +1,177 @@
+
+// all rights reserved
+
+#include "RadianceCache.h"
+#include "ThreadPool.h"
+
+RadianceCache::RadianceCache()
+{
+	m_cellSizeInv	= 1.0f / RADIANCE_CACHE_CELL_SIZE;
+	m_frame			= 0;
+}
+
+void	RadianceCache::init(float cellSize)
+{
+	// atomics cannot be copied, so the table is created once and swapped in
+	if (m_cells.empty())
+	{
+		std::vector<RadianceCacheCell> cells(RADIANCE_CACHE_CELL_NUM);
+		m_cells.swap(cells);
+	}
+	m_cellSizeInv	= 1.0f / cellSize;
+	clear();
+}
+
+void	RadianceCache::clear()
+{
+	for (int i = 0; i < (int)m_cells.size(); ++i)
+	{
+		RadianceCacheCell& cell	= m_cells[i];
+		cell.key				= 0;
+		cell.lastFrame			= 0;
+		cell.count				= 0;
+		cell.radianceSum[0]		= 0.0f;
+		cell.radianceSum[1]		= 0.0f;
+		cell.radianceSum[2]		= 0.0f;
+	}
+	m_frame = 0;
+}
+
+void	RadianceCache::nextFrame()
+{
+	m_frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+int		RadianceCache::getMemorySize() const
+{
+	return (int)(m_cells.size() * sizeof(RadianceCacheCell));
+}
+
+int		RadianceCache::getUsedCellNum() const
+{
+	int num = 0;
+	for (int i = 0; i < (int)m_cells.size(); ++i)
+		if (m_cells[i].key.load(std::memory_order_relaxed) != 0)
+			++num;
+	return num;
+}
+
+unsigned int	RadianceCache::computeHash(const Vector3& pos, const Vector3& normal, unsigned int* outKey) const
+{
+	// the normal is quantized to the 6 axis directions, so the 2 sides of a thin wall or the faces meeting at a corner never share a cell
+	float			ax		= fabsf(normal.x);
+	float			ay		= fabsf(normal.y);
+	float			az		= fabsf(normal.z);
+	unsigned int	axis	= ax >= ay && ax >= az ? (normal.x > 0.0f ? 0 : 1) : (ay >= az ? (normal.y > 0.0f ? 2 : 3) : (normal.z > 0.0f ? 4 : 5));
+	unsigned int	x		= (unsigned int)(int)floorf(pos.x * m_cellSizeInv);
+	unsigned int	y		= (unsigned int)(int)floorf(pos.y * m_cellSizeInv);
+	unsigned int	z		= (unsigned int)(int)floorf(pos.z * m_cellSizeInv);
+	unsigned int	hash	= wangHash(wangHash(wangHash(wangHash(x) ^ y) ^ z) ^ axis);
+
+	// an independent second hash is stored to detect collisions, 0 is reserved for the empty cells
+	*outKey					= wangHash(hash ^ 0x9e3779b9u) | 1u;
+	return hash;
+}
+
+// an empty cell, or a cell which is not updated recently can be evicted, a cell being claimed cannot
+static bool	isCellFree(const RadianceCacheCell& cell, unsigned int cellKey, unsigned int frame)
+{
+	if (cellKey == 0)
+		return true;
+	return cellKey != RADIANCE_CACHE_KEY_BUSY && frame - cell.lastFrame.load(std::memory_order_relaxed) > RADIANCE_CACHE_MAX_AGE;
+}
+
+static void	addCellSample(RadianceCacheCell* cell, const Vector3& radiance, unsigned int frame)
+{
+	atomicAddFloat(&cell->radianceSum[0], radiance.x);
+	atomicAddFloat(&cell->radianceSum[1], radiance.y);
+	atomicAddFloat(&cell->radianceSum[2], radiance.z);
+	cell->count.fetch_add(1, std::memory_order_relaxed);
+	cell->lastFrame.store(frame, std::memory_order_relaxed);
+}
+
+void	RadianceCache::update(const Vector3& pos, const Vector3& normal, const Vector3& radiance)
+{
+	unsigned int	key;
+	unsigned int	hash	= computeHash(pos, normal, &key);
+	unsigned int	frame	= m_frame.load(std::memory_order_relaxed);
+	unsigned int	mask	= (unsigned int)m_cells.size() - 1;
+
+	// the whole probing sequence is searched for the key before a cell is claimed,
+	// so a key is not added again in front of its cell after an earlier cell is freed
+	int freeIdx = -1;
+	for (int i = 0; i < RADIANCE_CACHE_PROBE_NUM; ++i)
+	{
+		RadianceCacheCell&	cell		= m_cells[(hash + i) & mask];
+		unsigned int		cellKey		= cell.key.load(std::memory_order_acquire);
+		if (cellKey == key)
+		{
+			addCellSample(&cell, radiance, frame);
+			return;
+		}
+		// the cell being claimed may be for this key, the sample is dropped rather than the key getting a second cell
+		if (cellKey == RADIANCE_CACHE_KEY_BUSY)
+			return;
+		if (freeIdx < 0 && isCellFree(cell, cellKey, frame))
+			freeIdx = i;
+	}
+	if (freeIdx < 0)
+		return;
+
+	// threads adding the same key race for the same first free cell, the compare exchange pick 1 of them
+	// and the others add to its cell, or drop their sample while it is still being claimed
+	for (int i = freeIdx; i < RADIANCE_CACHE_PROBE_NUM; ++i)
+	{
+		RadianceCacheCell&	cell		= m_cells[(hash + i) & mask];
+		unsigned int		cellKey		= cell.key.load(std::memory_order_acquire);
+		if (cellKey != key)
+		{
+			if (!isCellFree(cell, cellKey, frame))
+				continue;
+			if (cell.key.compare_exchange_strong(cellKey, RADIANCE_CACHE_KEY_BUSY, std::memory_order_acquire))
+			{
+				// the payload and the age are reset before the key is published,
+				// so the cell cannot be evicted again or queried with the radiance of the evicted key,
+				// the fence makes a query() reading the reset payload also see the busy key
+				std::atomic_thread_fence(std::memory_order_release);
+				cell.lastFrame.store(frame, std::memory_order_relaxed);
+				cell.count.store(0, std::memory_order_relaxed);
+				cell.radianceSum[0].store(0.0f, std::memory_order_relaxed);
+				cell.radianceSum[1].store(0.0f, std::memory_order_relaxed);
+				cell.radianceSum[2].store(0.0f, std::memory_order_relaxed);
+				cell.key.store(key, std::memory_order_release);
+			}
+			else if (cellKey == RADIANCE_CACHE_KEY_BUSY)
+				return;
+			else if (cellKey != key)
+				continue;
+		}
+		addCellSample(&cell, radiance, frame);
+		return;
+	}
+}
+
+bool	RadianceCache::query(const Vector3& pos, const Vector3& normal, Vector3* outRadiance) const
+{
+	unsigned int	key;
+	unsigned int	hash	= computeHash(pos, normal, &key);
+	unsigned int	mask	= (unsigned int)m_cells.size() - 1;
+	for (int i = 0; i < RADIANCE_CACHE_PROBE_NUM; ++i)
+	{
+		const RadianceCacheCell& cell = m_cells[(hash + i) & mask];
+		if (cell.key.load(std::memory_order_acquire) != key)
+			continue;
+		unsigned int	count		= cell.count.load(std::memory_order_relaxed);
+		Vector3			radianceSum	= Vector3(	cell.radianceSum[0].load(std::memory_order_relaxed),
+												cell.radianceSum[1].load(std::memory_order_relaxed),
+												cell.radianceSum[2].load(std::memory_order_relaxed)	);
+
+		// the cell may be claimed by another key while it is read, the payload is only used if the key is unchanged
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (cell.key.load(std::memory_order_relaxed) != key || count < RADIANCE_CACHE_MIN_SAMPLE)
+			return false;
+		*outRadiance	= radianceSum / (float)count;
+		return true;
+	}
+	return false;
+}
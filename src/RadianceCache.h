@@ -0,0 +1,58 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include <atomic>
+#include "math.h"
+
+#define RADIANCE_CACHE_CELL_NUM			(1 << 16)	// power of 2, the memory never grows
+#define RADIANCE_CACHE_CELL_SIZE		(0.04f)		// in world unit, the Cornell box is about 0.55 wide
+#define RADIANCE_CACHE_PROBE_NUM		(8)			// linear probing length before a key is dropped
+#define RADIANCE_CACHE_MIN_SAMPLE		(16)		// a cell is only queried after this number of updates
+#define RADIANCE_CACHE_MAX_AGE			(64)		// a cell not updated for this number of frames can be evicted
+#define RADIANCE_CACHE_TRAIN_RATIO		(0.125f)	// fraction of the paths traced to the end to update the cache
+#define RADIANCE_CACHE_KEY_BUSY			(2)			// key of a cell being claimed, the stored keys are odd
+
+// 1 slot of the hash table, every field is updated without lock,
+// a racing reader may see a partially added sample, which only adds a little noise.
+// A cell is claimed by setting its key to RADIANCE_CACHE_KEY_BUSY, the payload is reset before the new key is published,
+// so neither the new key nor the evicted one is seen with the payload of the other
+struct RadianceCacheCell
+{
+	std::atomic<unsigned int>	key;			// 0 if empty
+	std::atomic<unsigned int>	lastFrame;
+	std::atomic<unsigned int>	count;
+	std::atomic<float		>	radianceSum[3];
+};
+
+// World space spatial hash of the outgoing radiance of diffuse surfaces, indexed by the quantized position and
+// the dominant axis of the normal. Since every material is Lambertian, the outgoing radiance does not depend on the
+// view direction, so a path can be terminated at a cached cell. The cells are filled by the vertices of a fraction
+// of paths traced to the end, so the cache never feeds on its own estimates, the remaining bias is the averaging
+// of the radiance over a cell.
+class RadianceCache
+{
+public:
+	RadianceCache();
+
+	void	init(float cellSize);
+	void	clear();							// after the scene is modified
+	void	nextFrame();						// advance the age of every cell, call once per pass
+	int		getMemorySize() const;				// byte
+	int		getUsedCellNum() const;				// slow, count the non empty cells
+
+	// both are thread safe, update() silently drops the sample when the probing sequence is full of recent cells
+	void	update(const Vector3& pos, const Vector3& normal, const Vector3& radiance);
+	bool	query(const Vector3& pos, const Vector3& normal, Vector3* outRadiance) const;
+
+private:
+	std::vector<RadianceCacheCell>	m_cells;
+	float							m_cellSizeInv;
+	std::atomic<unsigned int>		m_frame;
+
+	RadianceCache(const RadianceCache&);
+	RadianceCache& operator=(const RadianceCache&);
+
+	unsigned int	computeHash(const Vector3& pos, const Vector3& normal, unsigned int* outKey) const;
+};
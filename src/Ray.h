@@ -0,0 +1,177 @@
+#pragma once
+
+// all rights reserved
+
+#include "math.h"
+
+#define RAY_MAX_T		(999999999999999.0f)
+
+// primitive id of the analytic primitives, the id of a triangle is its triangle index
+#define RAY_PRIM_QUAD		(1 << 28)		// RAY_PRIM_QUAD | quad index
+#define RAY_PRIM_BOX		(2 << 28)		// RAY_PRIM_BOX | (box index * 6 + face), a box take 1 id per face
+#define RAY_PRIM_TYPE_MASK	(3 << 28)
+#define RAY_PRIM_IDX_MASK	((1 << 28) - 1)
+
+struct Ray
+{
+	Vector3		pos;
+	Vector3		dir;
+};
+
+struct RayHit
+{
+	float		t;
+	float		u;
+	float		v;
+	int			meshIdx;
+	int			triIdx[3];		// vertex index, {-1, triangle, -1} for a quad or a box
+	int			triangle;		// primitive id, i.e. index into Scene::triIdx / 3 for a triangle
+};
+
+// parallelogram pos + u * edge0 + v * edge1 with u, v in [0, 1], facing edge0 x edge1
+struct QuadPrim
+{
+	Vector3		pos;
+	Vector3		edge0;
+	Vector3		edge1;
+	int			meshIdx;
+};
+
+// oriented box center + x * axis[0] + y * axis[1] + z * axis[2] with x, y, z in [-1, 1]
+struct BoxPrim
+{
+	Vector3		center;
+	Vector3		axis[3];		// scaled by the half extent
+	int			meshIdx;
+};
+
+inline void		resetRayHit(RayHit* hit)
+{
+	hit->t			= RAY_MAX_T;
+	hit->u			= 0;
+	hit->v			= 0;
+	hit->meshIdx	= 0;
+	hit->triIdx[0]	= 0;
+	hit->triIdx[1]	= 0;
+	hit->triIdx[2]	= 0;
+	hit->triangle	= 0x7fffffff;
+}
+
+// return t < 0 if not intersect, back-face culled as in path_tracer.hlsl
+inline float	rayTriIntersect(const Ray& ray, const Vector3& vertex0, const Vector3& vertex1, const Vector3& vertex2, float* outU, float* outV)
+{
+	const float epsilon = 0.00001f;
+	const float detEpsilon = 0.000000000001f;	// determinant scale with triangle area, keep it small for dense meshes
+	Vector3 edge1 = vertex1 - vertex0;
+	Vector3 edge2 = vertex2 - vertex0;
+	Vector3 h = ray.dir.cross(edge2);
+	float a = edge1.dot(h);
+	if (a < detEpsilon)
+		return -1.0f;
+
+	float f = 1.0f / a;
+	Vector3 s = ray.pos - vertex0;
+	float u = f * s.dot(h);
+	if (u < 0.0f || u > 1.0f)
+		return -1.0f;
+
+	Vector3 q = s.cross(edge1);
+	float v = f * ray.dir.dot(q);
+	if (v < 0.0f || u + v > 1.0f)
+		return -1.0f;
+
+	// At this stage we can compute t to find out where the intersection point is on the line.
+	float t = f * edge2.dot(q);
+	if (t <= epsilon)
+		return -1.0f;	// This means that there is a line intersection but not a ray intersection.
+
+	*outU = u;
+	*outV = v;
+	return t;
+}
+
+// same as rayTriIntersect() with the u + v <= 1 test replaced by v <= 1
+inline float	rayQuadIntersect(const Ray& ray, const QuadPrim& quad, float* outU, float* outV)
+{
+	const float epsilon = 0.00001f;
+	const float detEpsilon = 0.000000000001f;
+	Vector3 h = ray.dir.cross(quad.edge1);
+	float a = quad.edge0.dot(h);
+	if (a < detEpsilon)
+		return -1.0f;
+
+	float f = 1.0f / a;
+	Vector3 s = ray.pos - quad.pos;
+	float u = f * s.dot(h);
+	if (u < 0.0f || u > 1.0f)
+		return -1.0f;
+
+	Vector3 q = s.cross(quad.edge0);
+	float v = f * ray.dir.dot(q);
+	if (v < 0.0f || v > 1.0f)
+		return -1.0f;
+
+	float t = f * quad.edge1.dot(q);
+	if (t <= epsilon)
+		return -1.0f;
+
+	*outU = u;
+	*outV = v;
+	return t;
+}
+
+// slab test in the box space, only the entering face is hit, so a ray starting inside the box is culled like the back-faces of a
+// triangulated box, face is axis * 2 for the -axis side and axis * 2 + 1 for the +axis side, u, v are in [0, 1] on the face
+inline float	rayBoxIntersect(const Ray& ray, const BoxPrim& box, float* outU, float* outV, int* outFace)
+{
+	const float epsilon = 0.00001f;
+	Vector3	s		= ray.pos - box.center;
+	float	pos[3];
+	float	dir[3];
+	float	tNear	= -RAY_MAX_T;
+	float	tFar	= RAY_MAX_T;
+	int		face	= -1;
+	for (int i = 0; i < 3; ++i)
+	{
+		float lenSqInv	= 1.0f / box.axis[i].dot(box.axis[i]);
+		pos[i]			= s.dot(box.axis[i]) * lenSqInv;
+		dir[i]			= ray.dir.dot(box.axis[i]) * lenSqInv;
+		if (dir[i] == 0.0f)
+		{
+			if (pos[i] < -1.0f || pos[i] > 1.0f)
+				return -1.0f;
+			continue;
+		}
+		float dirInv	= 1.0f / dir[i];
+		float t0		= (-1.0f - pos[i]) * dirInv;
+		float t1		= ( 1.0f - pos[i]) * dirInv;
+		if (dirInv < 0.0f)
+		{
+			float tmp	= t0;
+			t0			= t1;
+			t1			= tmp;
+		}
+		if (t0 > tNear)
+		{
+			tNear		= t0;
+			face		= i * 2 + (dir[i] > 0.0f ? 0 : 1);
+		}
+		tFar			= t1 < tFar ? t1 : tFar;
+	}
+	if (face < 0 || tNear > tFar || tNear <= epsilon)
+		return -1.0f;
+
+	int axisU	= face < 2 ? 1 : 0;
+	int axisV	= face < 4 ? 2 : 1;
+	*outU		= (pos[axisU] + dir[axisU] * tNear) * 0.5f + 0.5f;
+	*outV		= (pos[axisV] + dir[axisV] * tNear) * 0.5f + 0.5f;
+	*outFace	= face;
+	return tNear;
+}
+
+// closest hit rule shared by every traversal: on equal t the lower triangle index wins,
+// which is what the brute force loop in sceneRayCast() returns
+inline bool		isCloserHit(float t, int triangle, const RayHit& hit)
+{
+	return t < hit.t || (t == hit.t && triangle < hit.triangle);
+}
@@ -0,0 +1,1938 @@
+
+// all rights reserved
+
+#include "RayBenchmark.h"
+#include "CpuPathTracer.h"
+#include "CpuRestir.h"
+#include "Timer.h"
+#include "ThreadPool.h"
+#include "TileScheduler.h"
+#include "CpuRenderThread.h"
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include <chrono>
+
+#define RAY_BENCHMARK_WIDTH			(512)
+#define RAY_BENCHMARK_HEIGHT		(512)
+#define RAY_BENCHMARK_PATH_TRACE_WIDTH	(256)
+#define RAY_BENCHMARK_PATH_TRACE_HEIGHT	(256)
+#define RAY_BENCHMARK_PATH_TRACE_SPP	(4)
+#define RAY_BENCHMARK_BUILD_REPEAT	(3)		// minimum build time of the repeats is reported
+#define RAY_BENCHMARK_ANIMATION_FRAME	(16)
+#define RAY_BENCHMARK_STATIC_MESH	(3)		// the Cornell box walls never move in the animation benchmark
+#define RAY_BENCHMARK_EDIT_REPEAT	(1000)	// cheap edits are timed in a loop
+#define RAY_BENCHMARK_VERIFY_TEST	(256 * 1024 * 1024)	// number of ray triangle tests spent on verifying against the brute force loop
+#define RAY_BENCHMARK_L1_SIZE		(32 * 1024)			// simulated data cache, 64 byte lines
+#define RAY_BENCHMARK_L1_WAY		(8)
+#define RAY_BENCHMARK_L2_SIZE		(1024 * 1024)
+#define RAY_BENCHMARK_L2_WAY		(16)
+#define RAY_BENCHMARK_LIGHT_WIDTH	(128)
+#define RAY_BENCHMARK_LIGHT_HEIGHT	(128)
+#define RAY_BENCHMARK_LIGHT_REF_SPP	(1024)
+#define RAY_BENCHMARK_LIGHT_TIME	(2.0)		// in second, time budget of each light sampling mode
+#define RAY_BENCHMARK_RESTIR_REF_SPP	(4096)		// direct lighting only, the reference is cheap enough to be less noisy
+#define RAY_BENCHMARK_CACHE_TIME	(8.0)		// in second, the time to the error target is searched up to this budget
+#define RAY_BENCHMARK_CACHE_ROWS	(8)			// rows per job of the multi-threaded passes
+#define RAY_BENCHMARK_GUIDE_TIME	(60.0)		// in second, the guide needs a few iterations to learn
+#define RAY_BENCHMARK_GUIDE_CHECKPOINT	(4)			// the RMSE is printed after RAY_BENCHMARK_GUIDE_TIME / 2^i for each i below this
+#define RAY_BENCHMARK_GUIDE_REF_SPP	(8192)		// the indirect lit scenes are too noisy for a 1024 spp reference
+#define RAY_BENCHMARK_ADJOINT_TIME	(1.0)		// in second, the pre-pass training the radiance cache for the adjoint estimate
+#define RAY_BENCHMARK_ROI_RADIUS	(24)		// in pixel, half size of the region of interest
+#define RAY_BENCHMARK_ROI_REF_SPP	(8192)		// only the region of interest is traced for the reference
+#define RAY_BENCHMARK_PASS_SPP		(16)		// samples per pixel of each run, split into passes of N samples
+#define RAY_BENCHMARK_PASS_BUDGET	(100.0f)	// in ms, time budget of each pass of the automatic pass size, same as the progress interval of the render server benchmark
+#define RAY_BENCHMARK_PASS_TIME		(2.0)		// in second, rendering time of the automatic pass size
+#define RAY_BENCHMARK_INPUT_NUM		(40)		// simulated camera moves of the latency benchmark
+#define RAY_BENCHMARK_INPUT_INTERVAL	(0.2)		// in second, mean time between 2 simulated camera moves, jittered by +-50%
+#define RAY_BENCHMARK_DISPLAY_POLL	(1)			// in ms, the display thread polls for a new frame at this interval
+
+static void	setBenchmarkCamera(CpuPathTracer* tracer, int width, int height)
+{
+	CpuCamera camera;
+	camera.pos		= Vector3(0.278f, 0.273f, -0.800f);
+	camera.lookAt	= Vector3(0.278f, 0.273f, 0.0f);
+	camera.fovY		= DEGREE_TO_RADIAN(60.0f);
+	tracer->setCamera(camera, width, height);
+}
+
+// return path traced samples per second
+static double	measurePathTracing(const Scene* scene)
+{
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_PATH_TRACE_WIDTH, RAY_BENCHMARK_PATH_TRACE_HEIGHT);
+	AccumBuffer accum;
+	accum.resize(RAY_BENCHMARK_PATH_TRACE_WIDTH, RAY_BENCHMARK_PATH_TRACE_HEIGHT);
+	accum.clear();
+	LONGLONG	startTime	= timeGetAbsoulteTime();
+	tracer.renderSamples(&accum, 0, RAY_BENCHMARK_PATH_TRACE_SPP);
+	double		elapsed		= timeGetElapsedTime(startTime);
+	return accum.width * accum.height * RAY_BENCHMARK_PATH_TRACE_SPP / elapsed;
+}
+
+void	rayBenchmarkCreateRaySet(const Scene& scene, int width, int height, RayBenchmarkSet* raySet)
+{
+	CpuPathTracer tracer;
+	tracer.init(&scene);
+	setBenchmarkCamera(&tracer, width, height);
+
+	raySet->rays.clear();
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+			raySet->rays.push_back(tracer.generateCameraRay(x + 0.5f, y + 0.5f));
+	raySet->numPrimary = (int)raySet->rays.size();
+
+	srand(1);
+	for (int i = 0; i < raySet->numPrimary; ++i)
+	{
+		const Ray&	primaryRay	= raySet->rays[i];
+		RayHit		hit;
+		if (!scene.rayCast(primaryRay, &hit))
+			continue;
+
+		Vector3 normal	= scene.computeHitNormal(hit);
+		Vector3 dir;
+		do
+		{
+			dir = Vector3(randf(-1.0f, 1.0f), randf(-1.0f, 1.0f), randf(-1.0f, 1.0f));
+		} while (dir.length2() > 1.0f || dir.length2() < 0.0001f);
+		dir.normalize();
+		dir		+= normal;		// cosine weighted
+		dir.normalize();
+
+		Ray ray;
+		ray.pos	= primaryRay.pos + primaryRay.dir * hit.t;
+		ray.dir	= dir;
+		raySet->rays.push_back(ray);
+	}
+}
+
+double	rayBenchmarkMeasure(const Scene& scene, const Ray* rays, int numRay, std::vector<RayHit>* hits)
+{
+	hits->resize(numRay);
+	LONGLONG startTime = timeGetAbsoulteTime();
+	for (int i = 0; i < numRay; ++i)
+		scene.rayCast(rays[i], &(*hits)[i]);
+	double elapsed = timeGetElapsedTime(startTime);
+	return elapsed > 0.0 ? numRay / elapsed : 0.0;
+}
+
+int		rayBenchmarkCountMismatch(const std::vector<RayHit>& hitsA, const std::vector<RayHit>& hitsB)
+{
+	int numMismatch = 0;
+	for (int i = 0; i < (int)hitsA.size() && i < (int)hitsB.size(); ++i)
+		if (hitsA[i].t != hitsB[i].t || hitsA[i].triangle != hitsB[i].triangle)
+			++numMismatch;
+	return numMismatch;
+}
+
+void	rayBenchmarkCompressedBvhReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+
+	int			numTri		= scene->getNumTriangle();
+	LONGLONG	startTime	= timeGetAbsoulteTime();
+	scene->buildAccel(SceneAccel_Bvh);
+	double		bvhTime		= timeGetElapsedTime(startTime);
+	startTime				= timeGetAbsoulteTime();
+	scene->bvhCompressed.build(&scene->bvh);
+	double		convertTime	= timeGetElapsedTime(startTime);
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	const Ray*	primaryRays		= &raySet.rays[0];
+	const Ray*	diffuseRays		= &raySet.rays[raySet.numPrimary];
+	int			numPrimary		= raySet.numPrimary;
+	int			numDiffuse		= (int)raySet.rays.size() - numPrimary;
+
+	printf("scene %s: %i triangles, BVH build %.3fs, compress %.3fs, %i x %i primary rays, %i diffuse rays\n",
+		sceneName, numTri, bvhTime, convertTime, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, numDiffuse);
+
+	// reference hits from the brute force loop on a subset of rays
+	int					numVerify	= min(max(RAY_BENCHMARK_VERIFY_TEST / numTri, 64), (int)raySet.rays.size());
+	std::vector<Ray>	verifyRays;
+	for (int i = 0; i < numVerify; ++i)
+		verifyRays.push_back(raySet.rays[(int)(i * (long long)raySet.rays.size() / numVerify)]);
+	std::vector<RayHit> verifyHitsRef;
+	scene->accel = SceneAccel_BruteForce;
+	rayBenchmarkMeasure(*scene, &verifyRays[0], (int)verifyRays.size(), &verifyHitsRef);
+
+	printf("                  node memory  bytes/tri  node size  primary Mrays/s  diffuse Mrays/s  mismatch\n");
+	const char*	accelName[]		= { "binary BVH      ", "quantized BVH4  " };
+	SceneAccel	accelType[]		= { SceneAccel_Bvh, SceneAccel_BvhCompressed };
+	int			nodeMemory[]	= { scene->bvh.getNodeMemorySize(), scene->bvhCompressed.getNodeMemorySize() };
+	int			nodeSize[]		= { (int)sizeof(BvhNode), (int)sizeof(BvhCompressedNode) };
+	for (int i = 0; i < 2; ++i)
+	{
+		std::vector<RayHit> hits;
+		scene->accel				= accelType[i];
+		double	primaryRaysPerSec	= rayBenchmarkMeasure(*scene, primaryRays, numPrimary, &hits);
+		double	diffuseRaysPerSec	= rayBenchmarkMeasure(*scene, diffuseRays, numDiffuse, &hits);
+		rayBenchmarkMeasure(*scene, &verifyRays[0], (int)verifyRays.size(), &hits);
+		int		numMismatch			= rayBenchmarkCountMismatch(hits, verifyHitsRef);
+		printf("  %s  %8.2f MB  %9.1f  %7i B  %15.3f  %15.3f  %5i / %i\n",
+			accelName[i], nodeMemory[i] / (1024.0 * 1024.0), nodeMemory[i] / (double)numTri, nodeSize[i],
+			primaryRaysPerSec / 1000000.0, diffuseRaysPerSec / 1000000.0, numMismatch, (int)verifyRays.size());
+	}
+	delete scene;
+}
+
+void	rayBenchmarkWideBvhReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	scene->buildAccel(SceneAccel_Bvh);
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	const Ray*	primaryRays		= &raySet.rays[0];
+	const Ray*	diffuseRays		= &raySet.rays[raySet.numPrimary];
+	int			numPrimary		= raySet.numPrimary;
+	int			numDiffuse		= (int)raySet.rays.size() - numPrimary;
+	bool		isAvx2			= BvhWide::isAvx2Supported();
+	printf("scene %s: %i triangles, %i primary rays, %i diffuse rays, AVX2 %s, runtime selected BVH%i\n",
+		sceneName, scene->getNumTriangle(), numPrimary, numDiffuse, isAvx2 ? "supported" : "not supported", BvhWide::getBestWidth());
+
+	// every layout is checked against the hits of the binary BVH on all rays
+	std::vector<RayHit> primaryHitsRef;
+	std::vector<RayHit> diffuseHitsRef;
+	scene->accel = SceneAccel_Bvh;
+	rayBenchmarkMeasure(*scene, primaryRays, numPrimary, &primaryHitsRef);
+	rayBenchmarkMeasure(*scene, diffuseRays, numDiffuse, &diffuseHitsRef);
+
+	printf("                node memory  node size  primary Mrays/s  diffuse Mrays/s  mismatch vs BVH2\n");
+	const char*	layoutName[]	= { "BVH2 scalar", "BVH4 scalar", "BVH4 SSE   ", "BVH8 scalar", "BVH8 AVX2  " };
+	int			layoutWidth[]	= { 2, 4, 4, 8, 8 };
+	bool		layoutSimd[]	= { false, false, true, false, true };
+	for (int i = 0; i < 5; ++i)
+	{
+		if (layoutWidth[i] == 8 && layoutSimd[i] && !isAvx2)
+		{
+			printf("  %s   skipped, AVX2 is not supported\n", layoutName[i]);
+			continue;
+		}
+
+		int nodeMemory	= scene->bvh.getNodeMemorySize();
+		int nodeSize	= (int)sizeof(BvhNode);
+		scene->accel	= SceneAccel_Bvh;
+		if (layoutWidth[i] > 2)
+		{
+			if (scene->bvhWide.m_width != layoutWidth[i] || scene->bvhWide.m_numNodes == 0)
+				scene->bvhWide.build(&scene->bvh, layoutWidth[i]);
+			scene->bvhWide.m_useSimd	= layoutSimd[i];
+			scene->accel				= SceneAccel_BvhWide;
+			nodeMemory					= scene->bvhWide.getNodeMemorySize();
+			nodeSize					= layoutWidth[i] == 8 ? (int)sizeof(BvhWideNode8) : (int)sizeof(BvhWideNode4);
+		}
+
+		std::vector<RayHit> hits;
+		double	primaryRaysPerSec	= rayBenchmarkMeasure(*scene, primaryRays, numPrimary, &hits);
+		int		numMismatch			= rayBenchmarkCountMismatch(hits, primaryHitsRef);
+		double	diffuseRaysPerSec	= rayBenchmarkMeasure(*scene, diffuseRays, numDiffuse, &hits);
+		numMismatch					+= rayBenchmarkCountMismatch(hits, diffuseHitsRef);
+		printf("  %s  %8.2f MB  %7i B  %15.3f  %15.3f  %i / %i\n",
+			layoutName[i], nodeMemory / (1024.0 * 1024.0), nodeSize,
+			primaryRaysPerSec / 1000000.0, diffuseRaysPerSec / 1000000.0, numMismatch, numPrimary + numDiffuse);
+	}
+	delete scene;
+}
+
+void	rayBenchmarkGeometryReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+
+	int numTri		= scene->getNumTriangle();
+	int numVtx		= (int)scene->triPos.size();
+	int numMesh		= (int)scene->meshIdxRange.size();
+	int numFlat		= 0;
+	for (int i = 0; i < numMesh; ++i)
+		if (scene->meshFlag[i] & MESH_FLAG_FLAT)
+			++numFlat;
+
+	// float4 position + float4 normal per vertex, no mesh flag
+	int memoryVec4	= numVtx * 2 * (int)sizeof(Vector4) + (int)scene->triIdx.size() * (int)sizeof(int) + numMesh * (int)(sizeof(Material) + sizeof(int2));
+	int memory		= scene->getGeometryMemorySize();
+	printf("scene %s: %i triangles, %i vertices, %i / %i meshes flat shaded\n", sceneName, numTri, numVtx, numFlat, numMesh);
+	printf("  float4 position + float4 normal    : %10.2f MB, %6.2f bytes/tri, 32 bytes/vertex\n", memoryVec4 / (1024.0 * 1024.0), memoryVec4 / (double)numTri);
+	printf("  float3 position + octahedral normal: %10.2f MB, %6.2f bytes/tri, %i bytes/vertex\n", memory / (1024.0 * 1024.0), memory / (double)numTri, (int)(sizeof(Vector3) + sizeof(unsigned int)));
+
+	// path tracing throughput, including the normal fetch of every hit
+	double samplePerSec = measurePathTracing(scene);
+	printf("  path tracing %i x %i, %i spp: %.3f M samples/s\n",
+		RAY_BENCHMARK_PATH_TRACE_WIDTH, RAY_BENCHMARK_PATH_TRACE_HEIGHT, RAY_BENCHMARK_PATH_TRACE_SPP, samplePerSec / 1000000.0);
+	delete scene;
+}
+
+void	rayBenchmarkMeshOptimizeReport(const char* sceneName)
+{
+	// the ray set is created from the scene as loaded, so both scenes trace the same rays
+	Scene*			scenes[2];
+	double			loadTime[2];
+	double			buildTime[2];
+	RayBenchmarkSet	raySet;
+	for (int i = 0; i < 2; ++i)
+	{
+		scenes[i]							= new Scene();
+		scenes[i]->isMeshOptimizeEnabled	= i == 1;
+		LONGLONG startTime					= timeGetAbsoulteTime();
+		if (!scenes[i]->createByName(sceneName))
+		{
+			printf("unknown scene: %s\n", sceneName);
+			delete scenes[i];
+			if (i == 1)
+				delete scenes[0];
+			return;
+		}
+		loadTime[i]							= timeGetElapsedTime(startTime);
+		startTime							= timeGetAbsoulteTime();
+		scenes[i]->buildAccel(SceneAccel_BvhWide);
+		buildTime[i]						= timeGetElapsedTime(startTime);
+		if (i == 0)
+			rayBenchmarkCreateRaySet(*scenes[i], RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	}
+
+	const Ray*	primaryRays	= &raySet.rays[0];
+	const Ray*	diffuseRays	= &raySet.rays[raySet.numPrimary];
+	int			numPrimary	= raySet.numPrimary;
+	int			numDiffuse	= (int)raySet.rays.size() - numPrimary;
+	printf("scene %s: %i primary rays, %i diffuse rays, BVH%i\n", sceneName, numPrimary, numDiffuse, BvhWide::getBestWidth());
+	printf("              vertices  triangles  geometry MB  load s (incl. BVH)  BVH build s  primary Mrays/s  diffuse Mrays/s  path trace M samples/s\n");
+	const char* name[] = { "as loaded", "optimized" };
+	for (int i = 0; i < 2; ++i)
+	{
+		std::vector<RayHit> hits;
+		double	primaryRaysPerSec	= rayBenchmarkMeasure(*scenes[i], primaryRays, numPrimary, &hits);
+		double	diffuseRaysPerSec	= rayBenchmarkMeasure(*scenes[i], diffuseRays, numDiffuse, &hits);
+		double	samplePerSec		= measurePathTracing(scenes[i]);
+		printf("  %s  %10i %10i %12.2f %19.3f %12.3f %16.3f %16.3f %23.3f\n",
+			name[i], (int)scenes[i]->triPos.size(), scenes[i]->getNumTriangle(), scenes[i]->getGeometryMemorySize() / (1024.0 * 1024.0),
+			loadTime[i], buildTime[i], primaryRaysPerSec / 1000000.0, diffuseRaysPerSec / 1000000.0, samplePerSec / 1000000.0);
+	}
+	delete scenes[0];
+	delete scenes[1];
+}
+
+void	rayBenchmarkBvhBuildReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	scene->buildAccel(SceneAccel_Bvh);
+	BvhGeometry geometry	= scene->bvh.m_geometry;
+	int			numTri		= scene->getNumTriangle();
+	int			maxThread	= ThreadPool::getHardwareThreadCount();
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	const Ray*	rays	= &raySet.rays[0];
+	int			numRay	= (int)raySet.rays.size();
+	printf("scene %s: %i triangles, %i hardware threads, %i rays (primary + diffuse) traced with the binary BVH\n", sceneName, numTri, maxThread, numRay);
+
+	std::vector<RayHit> hitsRef;
+	scene->accel = SceneAccel_Bvh;
+	rayBenchmarkMeasure(*scene, rays, numRay, &hitsRef);
+
+	printf("         threads  build s  M tris/s  speedup  SAH cost      nodes  Mrays/s  mismatch\n");
+	const char*		modeName[]			= { "SAH ", "LBVH" };
+	BvhBuildMode	mode[]				= { BvhBuildMode_Sah, BvhBuildMode_Lbvh };
+	double			bestBuildTime[2];
+	double			raysPerSec[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		double singleThreadTime = 0.0;
+		for (int numThread = 1; ; numThread = min(numThread * 2, maxThread))
+		{
+			ThreadPool threadPool;
+			threadPool.init(numThread);
+			double buildTime = 0.0;
+			for (int repeat = 0; repeat < RAY_BENCHMARK_BUILD_REPEAT; ++repeat)
+			{
+				LONGLONG	startTime	= timeGetAbsoulteTime();
+				scene->bvh.build(geometry, mode[i], &threadPool);
+				double		elapsed		= timeGetElapsedTime(startTime);
+				buildTime				= repeat == 0 ? elapsed : min(buildTime, elapsed);
+			}
+			threadPool.release();
+			if (numThread == 1)
+				singleThreadTime = buildTime;
+			bestBuildTime[i] = buildTime;
+
+			// the tree does not depend on the thread count, so it is traced once per build mode
+			if (numThread == maxThread)
+			{
+				std::vector<RayHit> hits;
+				raysPerSec[i]	= rayBenchmarkMeasure(*scene, rays, numRay, &hits);
+				int numMismatch	= rayBenchmarkCountMismatch(hits, hitsRef);
+				printf("  %s  %7i  %7.3f  %8.2f  %6.2fx  %8.2f  %9i  %7.3f  %i / %i\n",
+					modeName[i], numThread, buildTime, numTri / buildTime / 1000000.0, singleThreadTime / buildTime,
+					scene->bvh.computeSahCost(), (int)scene->bvh.m_nodes.size(), raysPerSec[i] / 1000000.0, numMismatch, numRay);
+				break;
+			}
+			printf("  %s  %7i  %7.3f  %8.2f  %6.2fx  %8.2f  %9i\n",
+				modeName[i], numThread, buildTime, numTri / buildTime / 1000000.0, singleThreadTime / buildTime,
+				scene->bvh.computeSahCost(), (int)scene->bvh.m_nodes.size());
+		}
+	}
+
+	// LBVH save build time but cost more per ray, find the number of rays which make both equal
+	double savedTime	= bestBuildTime[0] - bestBuildTime[1];
+	double extraTime	= 1.0 / raysPerSec[1] - 1.0 / raysPerSec[0];
+	if (savedTime > 0.0 && extraTime > 0.0)
+		printf("  LBVH build + trace is faster than SAH below %.2f M rays (%.2f samples per pixel at %i x %i with 1 bounce)\n",
+			savedTime / extraTime / 1000000.0, savedTime / extraTime / numRay, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT);
+	else if (savedTime > 0.0)
+		printf("  LBVH is faster to build and to trace\n");
+	else
+		printf("  SAH is faster to build than LBVH\n");
+	delete scene;
+}
+
+void	rayBenchmarkMeshAnimationReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	int numTri		= scene->getNumTriangle();
+	int numMovable	= (int)scene->meshIdxRange.size() - RAY_BENCHMARK_STATIC_MESH;
+	if (numMovable <= 0)
+	{
+		printf("scene %s has no movable mesh\n", sceneName);
+		delete scene;
+		return;
+	}
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	const Ray*	rays	= &raySet.rays[0];
+	int			numRay	= (int)raySet.rays.size();
+	printf("scene %s: %i triangles, %i movable meshes, %i frames, BVH%i, %i threads\n",
+		sceneName, numTri, numMovable, RAY_BENCHMARK_ANIMATION_FRAME, BvhWide::getBestWidth(), threadPoolGetShared()->getNumThread());
+	printf("  moved meshes  moved tris  update ms/frame  refit/partial/full  SAH updated  SAH rebuilt  rebuild ms  Mrays/s updated  Mrays/s rebuilt\n");
+
+	int numMovedList[] = { 1, max(numMovable / 8, 1), max(numMovable / 4, 1), max(numMovable / 2, 1), numMovable };
+	for (int list = 0; list < 5; ++list)
+	{
+		int numMoved = numMovedList[list];
+		if (list > 0 && numMoved == numMovedList[list - 1])
+			continue;
+		scene->createByName(sceneName);
+
+		// the moved meshes are spread over the scene, each move in a random direction
+		std::vector<int		>	movedMesh;
+		std::vector<Vector3	>	velocity;
+		int						numMovedTri = 0;
+		srand(list);
+		for (int i = 0; i < numMoved; ++i)
+		{
+			int		mesh	= RAY_BENCHMARK_STATIC_MESH + (int)((long long)i * numMovable / numMoved);
+			Vector3	dir		= Vector3(randf(-1.0f, 1.0f), randf(-0.2f, 0.2f), randf(-1.0f, 1.0f));
+			dir.normalize();
+			movedMesh.push_back(mesh);
+			velocity.push_back(dir * 0.01f);
+			numMovedTri		+= (scene->meshIdxRange[mesh].y - scene->meshIdxRange[mesh].x) / 3;
+		}
+
+		double	updateTime			= 0.0;
+		int		numResult[3]		= { 0, 0, 0 };
+		for (int frame = 0; frame < RAY_BENCHMARK_ANIMATION_FRAME; ++frame)
+		{
+			for (int i = 0; i < numMoved; ++i)
+			{
+				Matrix4x4 xform = Matrix4x4::CreateRotationY(0.0f);
+				xform.setTranslation(velocity[i]);
+				scene->transformMesh(movedMesh[i], xform);
+			}
+			LONGLONG startTime	= timeGetAbsoulteTime();
+			++numResult[scene->updateAccel()];
+			updateTime			+= timeGetElapsedTime(startTime);
+		}
+		float	sahUpdated			= scene->bvh.computeSahCost();
+		std::vector<RayHit> hits;
+		double	raysPerSecUpdated	= rayBenchmarkMeasure(*scene, rays, numRay, &hits);
+
+		LONGLONG startTime			= timeGetAbsoulteTime();
+		scene->buildAccel(SceneAccel_BvhWide);
+		double	rebuildTime			= timeGetElapsedTime(startTime);
+		float	sahRebuilt			= scene->bvh.computeSahCost();
+		std::vector<RayHit> hitsRebuilt;
+		double	raysPerSecRebuilt	= rayBenchmarkMeasure(*scene, rays, numRay, &hitsRebuilt);
+		int		numMismatch			= rayBenchmarkCountMismatch(hits, hitsRebuilt);
+
+		printf("  %12i  %9.1f%%  %15.3f  %6i/%i/%i  %11.2f  %11.2f  %10.3f  %15.3f  %15.3f%s\n",
+			numMoved, numMovedTri * 100.0 / numTri, updateTime * 1000.0 / RAY_BENCHMARK_ANIMATION_FRAME,
+			numResult[BvhUpdate_Refit], numResult[BvhUpdate_PartialRebuild], numResult[BvhUpdate_FullRebuild],
+			sahUpdated, sahRebuilt, rebuildTime * 1000.0, raysPerSecUpdated / 1000000.0, raysPerSecRebuilt / 1000000.0,
+			numMismatch > 0 ? "  hit mismatch" : "");
+	}
+	delete scene;
+}
+
+static int	getDirtyByteSize(const Scene& scene)
+{
+	const int elementSz[SceneBuffer_Num] = { sizeof(Vector3), sizeof(unsigned int), sizeof(int), sizeof(Material), sizeof(int2), sizeof(int) };
+	int byteSize = scene.isConstantDirty ? sizeof(scene.areaLight) : 0;
+	for (int i = 0; i < SceneBuffer_Num; ++i)
+		if (scene.dirtyRange[i].start < scene.dirtyRange[i].end)
+			byteSize += (scene.dirtyRange[i].end - scene.dirtyRange[i].start) * elementSz[i];
+	return byteSize;
+}
+
+// print the edited tree against a rebuilt one, the scene is left with the rebuilt tree
+static void	printEditedAccel(Scene* scene, const char* editName, double editTime, const RayBenchmarkSet& raySet)
+{
+	int		uploadByte			= getDirtyByteSize(*scene);
+	float	sahEdited			= scene->bvh.computeSahCost();
+	std::vector<RayHit> hits;
+	double	raysPerSecEdited	= rayBenchmarkMeasure(*scene, &raySet.rays[0], (int)raySet.rays.size(), &hits);
+
+	LONGLONG startTime			= timeGetAbsoulteTime();
+	scene->buildAccel(scene->accel);
+	double	rebuildTime			= timeGetElapsedTime(startTime);
+	float	sahRebuilt			= scene->bvh.computeSahCost();
+	std::vector<RayHit> hitsRebuilt;
+	double	raysPerSecRebuilt	= rayBenchmarkMeasure(*scene, &raySet.rays[0], (int)raySet.rays.size(), &hitsRebuilt);
+	int		numMismatch			= rayBenchmarkCountMismatch(hits, hitsRebuilt);
+
+	printf("  %-14s  %12.3f  %11i  %10.3f  %10.2f  %11.2f  %14.3f  %15.3f%s\n",
+		editName, editTime * 1000000.0, uploadByte, rebuildTime * 1000.0, sahEdited, sahRebuilt,
+		raysPerSecEdited / 1000000.0, raysPerSecRebuilt / 1000000.0, numMismatch > 0 ? "  hit mismatch" : "");
+	scene->clearDirty();
+}
+
+void	rayBenchmarkSceneEditReport(const char* sceneName)
+{
+	Scene*		scene		= new Scene();
+	LONGLONG	startTime	= timeGetAbsoulteTime();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	double	createTime	= timeGetElapsedTime(startTime);
+	int		numTri		= scene->getNumTriangle();
+	int		lastMesh	= (int)scene->meshIdxRange.size() - 1;
+	scene->clearDirty();
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	printf("scene %s: %i triangles, %i meshes, BVH%i, %i threads, scene created in %.3f ms\n",
+		sceneName, numTri, lastMesh + 1, BvhWide::getBestWidth(), threadPoolGetShared()->getNumThread(), createTime * 1000.0);
+	printf("  edit            edit time us  upload byte  rebuild ms  SAH edited  SAH rebuilt  Mrays/s edited  Mrays/s rebuilt\n");
+
+	// material and light edits never touch the acceleration structure
+	Material	material[2]	= {	scene->meshMaterial[lastMesh], scene->meshMaterial[lastMesh] };
+	material[1].albedo		= Vector4(0.7f, 0.6f, 0.3f, 0.0f) / PI;
+	startTime				= timeGetAbsoulteTime();
+	for (int i = 0; i < RAY_BENCHMARK_EDIT_REPEAT; ++i)
+		scene->setMeshMaterial(lastMesh, material[(i + 1) & 1]);
+	printEditedAccel(scene, "material", timeGetElapsedTime(startTime) / RAY_BENCHMARK_EDIT_REPEAT, raySet);
+
+	Matrix4x4	lightXform[2]	= { scene->areaLight[0].xform, scene->areaLight[0].xform };
+	lightXform[1].f[12]			+= 0.05f;
+	startTime					= timeGetAbsoulteTime();
+	for (int i = 0; i < RAY_BENCHMARK_EDIT_REPEAT; ++i)
+		scene->setAreaLightTransform(0, lightXform[(i + 1) & 1]);
+	printEditedAccel(scene, "area light", timeGetElapsedTime(startTime) / RAY_BENCHMARK_EDIT_REPEAT, raySet);
+
+	// insert a copy of the last mesh next to it, then remove it again
+	int2				vtxRange	= scene->meshVtxRange[lastMesh];
+	int2				idxRange	= scene->meshIdxRange[lastMesh];
+	std::vector<float>	pos;
+	std::vector<float>	nor;
+	std::vector<int	>	idx;
+	for (int i = vtxRange.x; i < vtxRange.y; ++i)
+	{
+		Vector3 p = scene->triPos[i] + Vector3(-0.25f, 0.3f, 0.0f);
+		Vector3 n = decodeOctahedral(scene->triNor[i]);
+		pos.push_back(p.x);		pos.push_back(p.y);		pos.push_back(p.z);
+		nor.push_back(n.x);		nor.push_back(n.y);		nor.push_back(n.z);
+	}
+	for (int i = idxRange.x; i < idxRange.y; ++i)
+		idx.push_back(scene->triIdx[i] - vtxRange.x);
+
+	startTime		= timeGetAbsoulteTime();
+	int newMesh		= scene->insertMesh(&pos[0], &nor[0], (int)pos.size() / 3, &idx[0], (int)idx.size(), material[0]);
+	printEditedAccel(scene, "insert mesh", timeGetElapsedTime(startTime), raySet);
+
+	startTime		= timeGetAbsoulteTime();
+	scene->removeMesh(newMesh);
+	printEditedAccel(scene, "remove mesh", timeGetElapsedTime(startTime), raySet);
+	delete scene;
+}
+
+// return rays per second of CpuPathTracer::tracePrimaryHits() for the full image
+static double	measurePrimaryHits(const CpuPathTracer& tracer, std::vector<RayHit>* hits, RayPacketStats* stats)
+{
+	hits->resize(tracer.m_width * tracer.m_height);
+	rayPacketResetStats(stats);
+	LONGLONG	startTime	= timeGetAbsoulteTime();
+	tracer.tracePrimaryHits(0, 0, tracer.m_width, tracer.m_height, &(*hits)[0], stats);
+	double		elapsed		= timeGetElapsedTime(startTime);
+	return elapsed > 0.0 ? hits->size() / elapsed : 0.0;
+}
+
+void	rayBenchmarkPacketReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	printf("scene %s: %i triangles, %i x %i ray packets, BVH%i single ray\n",
+		sceneName, scene->getNumTriangle(), RAY_PACKET_WIDTH, RAY_PACKET_WIDTH, BvhWide::getBestWidth());
+	printf("  resolution   BVH2 Mrays/s  BVH%i Mrays/s  packet Mrays/s  vs BVH2  vs BVH%i  frustum culled  single ray/packet  mismatch\n",
+		BvhWide::getBestWidth(), BvhWide::getBestWidth());
+
+	const int resolution[][2] = { { 512, 512 }, { 1024, 1024 }, { 2048, 2048 }, { 3840, 2160 } };
+	for (int res = 0; res < 4; ++res)
+	{
+		int width	= resolution[res][0];
+		int height	= resolution[res][1];
+		CpuPathTracer tracer;
+		tracer.init(scene);
+		setBenchmarkCamera(&tracer, width, height);
+
+		RayPacketStats		stats;
+		std::vector<RayHit>	hitsBinary;
+		std::vector<RayHit>	hitsWide;
+		std::vector<RayHit>	hitsPacket;
+		tracer.m_usePacket		= false;
+		scene->accel			= SceneAccel_Bvh;
+		double	raysPerSecBinary= measurePrimaryHits(tracer, &hitsBinary, &stats);
+		scene->accel			= SceneAccel_BvhWide;
+		double	raysPerSecWide	= measurePrimaryHits(tracer, &hitsWide, &stats);
+		tracer.m_usePacket		= true;
+		double	raysPerSecPacket= measurePrimaryHits(tracer, &hitsPacket, &stats);
+		int		numPacket		= ((width + RAY_PACKET_WIDTH - 1) / RAY_PACKET_WIDTH) * ((height + RAY_PACKET_WIDTH - 1) / RAY_PACKET_WIDTH);
+		int		numMismatch		= rayBenchmarkCountMismatch(hitsPacket, hitsBinary) + rayBenchmarkCountMismatch(hitsWide, hitsBinary);
+
+		printf("  %4i x %4i  %12.3f  %12.3f  %14.3f  %6.2fx  %6.2fx  %13.1f%%  %17.2f  %8i\n",
+			width, height, raysPerSecBinary / 1000000.0, raysPerSecWide / 1000000.0, raysPerSecPacket / 1000000.0,
+			raysPerSecPacket / raysPerSecBinary, raysPerSecPacket / raysPerSecWide,
+			stats.numNodeFrustumCulled * 100.0 / (stats.numNodeVisit > 0 ? stats.numNodeVisit : 1),
+			stats.numSingleRayTrace / (double)numPacket, numMismatch);
+	}
+
+	// the path tracer trace its camera rays as packets, the image does not change
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_PATH_TRACE_WIDTH, RAY_BENCHMARK_PATH_TRACE_HEIGHT);
+	AccumBuffer accum[2];
+	double		samplesPerSec[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		tracer.m_usePacket	= i == 1;
+		accum[i].resize(RAY_BENCHMARK_PATH_TRACE_WIDTH, RAY_BENCHMARK_PATH_TRACE_HEIGHT);
+		accum[i].clear();
+		LONGLONG startTime	= timeGetAbsoulteTime();
+		tracer.renderSamples(&accum[i], 0, RAY_BENCHMARK_PATH_TRACE_SPP);
+		samplesPerSec[i]	= RAY_BENCHMARK_PATH_TRACE_WIDTH * RAY_BENCHMARK_PATH_TRACE_HEIGHT * RAY_BENCHMARK_PATH_TRACE_SPP / timeGetElapsedTime(startTime);
+	}
+	int numPixelDiff = 0;
+	for (int i = 0; i < (int)accum[0].radianceSum.size(); ++i)
+		if (memcmp(&accum[0].radianceSum[i], &accum[1].radianceSum[i], sizeof(accum[0].radianceSum[i])) != 0)
+			++numPixelDiff;
+	printf("path tracing %i x %i, %i spp: %.3f Msamples/s single ray, %.3f Msamples/s packet, %i pixels differ\n",
+		RAY_BENCHMARK_PATH_TRACE_WIDTH, RAY_BENCHMARK_PATH_TRACE_HEIGHT, RAY_BENCHMARK_PATH_TRACE_SPP,
+		samplesPerSec[0] / 1000000.0, samplesPerSec[1] / 1000000.0, numPixelDiff);
+	delete scene;
+}
+
+// stackSize 0 is the stackless traversal, BVH_STACK_SIZE is the full stack Bvh::rayCast(), else the short stack
+static double	measureTraversal(const Bvh& bvh, int stackSize, const Ray* rays, int numRay, std::vector<RayHit>* hits)
+{
+	hits->resize(numRay);
+	LONGLONG startTime = timeGetAbsoulteTime();
+	if (stackSize == 0)
+		for (int i = 0; i < numRay; ++i)
+			bvh.rayCastStackless(rays[i], &(*hits)[i]);
+	else if (stackSize == BVH_STACK_SIZE)
+		for (int i = 0; i < numRay; ++i)
+			bvh.rayCast(rays[i], &(*hits)[i]);
+	else
+		for (int i = 0; i < numRay; ++i)
+			bvh.rayCastShortStack(rays[i], stackSize, &(*hits)[i]);
+	double elapsed = timeGetElapsedTime(startTime);
+	return elapsed > 0.0 ? numRay / elapsed : 0.0;
+}
+
+void	rayBenchmarkTraversalReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	scene->buildAccel(SceneAccel_Bvh);
+	BvhGeometry geometry	= scene->bvh.m_geometry;
+	int			numTri		= scene->getNumTriangle();
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	const Ray*	rays	= &raySet.rays[0];
+	int			numRay	= (int)raySet.rays.size();
+	printf("scene %s: %i triangles, %i rays (primary + diffuse)\n", sceneName, numTri, numRay);
+
+	int					numVerify	= min(max(RAY_BENCHMARK_VERIFY_TEST / numTri, 64), numRay);
+	std::vector<Ray>	verifyRays;
+	for (int i = 0; i < numVerify; ++i)
+		verifyRays.push_back(raySet.rays[(int)(i * (long long)numRay / numVerify)]);
+	std::vector<RayHit> verifyHitsRef;
+	scene->accel = SceneAccel_BruteForce;
+	rayBenchmarkMeasure(*scene, &verifyRays[0], numVerify, &verifyHitsRef);
+
+	// LBVH trees are deeper, so they need more stack entries
+	const char*		modeName[]	= { "SAH ", "LBVH" };
+	BvhBuildMode	mode[]		= { BvhBuildMode_Sah, BvhBuildMode_Lbvh };
+	const int		stackSize[]	= { BVH_STACK_SIZE, 8, 4, 2, 1, 0 };
+	for (int i = 0; i < 2; ++i)
+	{
+		scene->bvh.build(geometry, mode[i], threadPoolGetShared());
+		printf("%s tree: %i nodes, max depth %i, parent pointers %.2f MB shared by all rays\n",
+			modeName[i], (int)scene->bvh.m_nodes.size(), scene->bvh.computeMaxDepth(), scene->bvh.m_parents.size() * sizeof(int) / (1024.0 * 1024.0));
+		printf("  traversal       stack bytes/ray  Mrays/s  vs full stack  mismatch vs brute force  mismatch vs full stack\n");
+
+		std::vector<RayHit>	hitsRef;
+		double				raysPerSecRef = 0.0;
+		for (int j = 0; j < 6; ++j)
+		{
+			std::vector<RayHit>	hits;
+			double	raysPerSec		= measureTraversal(scene->bvh, stackSize[j], rays, numRay, &hits);
+			if (j == 0)
+			{
+				hitsRef.swap(hits);
+				raysPerSecRef		= raysPerSec;
+			}
+			int		numMismatch		= j == 0 ? 0 : rayBenchmarkCountMismatch(hits, hitsRef);
+			measureTraversal(scene->bvh, stackSize[j], &verifyRays[0], numVerify, &hits);
+			int		numMismatchRef	= rayBenchmarkCountMismatch(hits, verifyHitsRef);
+
+			char	name[32];
+			if (stackSize[j] == BVH_STACK_SIZE)
+				sprintf_s(name, sizeof(name), "full stack    ");
+			else if (stackSize[j] == 0)
+				sprintf_s(name, sizeof(name), "stackless     ");
+			else
+				sprintf_s(name, sizeof(name), "short stack %i ", stackSize[j]);
+			printf("  %s  %15i  %7.3f  %12.2fx  %12i / %-8i  %12i / %i\n",
+				name, stackSize[j] * (int)(sizeof(int) + sizeof(float)), raysPerSec / 1000000.0, raysPerSec / raysPerSecRef,
+				numMismatchRef, numVerify, numMismatch, numRay);
+		}
+	}
+	delete scene;
+}
+
+// set associative cache with LRU replacement
+struct RayBenchmarkCache
+{
+	std::vector<unsigned long long	>	tags;
+	std::vector<unsigned long long	>	lastUse;
+	int									numSet;
+	int									numWay;
+	unsigned long long					clock;
+	long long							numAccess;
+	long long							numMiss;
+
+	void	init(int byteSize, int way)
+	{
+		numWay		= way;
+		numSet		= byteSize / (BVH_CACHE_LINE_SIZE * way);
+		tags.assign(numSet * numWay, ~0ull);
+		lastUse.assign(numSet * numWay, 0);
+		clock		= 0;
+		numAccess	= 0;
+		numMiss		= 0;
+	}
+
+	// return true if the line is cached
+	bool	access(unsigned long long line)
+	{
+		++numAccess;
+		++clock;
+		int set		= (int)(line % numSet) * numWay;
+		int oldest	= set;
+		for (int i = set; i < set + numWay; ++i)
+		{
+			if (tags[i] == line)
+			{
+				lastUse[i] = clock;
+				return true;
+			}
+			if (lastUse[i] < lastUse[oldest])
+				oldest = i;
+		}
+		++numMiss;
+		tags	[oldest]	= line;
+		lastUse	[oldest]	= clock;
+		return false;
+	}
+};
+
+static void	readCache(RayBenchmarkCache* l1, RayBenchmarkCache* l2, const void* address, int byteSize)
+{
+	unsigned long long first	= (unsigned long long)address / BVH_CACHE_LINE_SIZE;
+	unsigned long long last		= ((unsigned long long)address + byteSize - 1) / BVH_CACHE_LINE_SIZE;
+	for (unsigned long long line = first; line <= last; ++line)
+		if (!l1->access(line))
+			l2->access(line);
+}
+
+// same traversal as Bvh::rayCastNode(), feeding the nodes and triangle data it read to the simulated caches,
+// the node addresses are shifted by nodeOffset byte to simulate other allocation alignments
+static void	simulateRayCast(const Bvh& bvh, const Ray& ray, int nodeOffset, RayBenchmarkCache* l1, RayBenchmarkCache* l2)
+{
+	RayHit hit;
+	resetRayHit(&hit);
+	const BvhNode*	nodes	= &bvh.m_nodes[0];
+	Vector3			dirInv	= rayDirInverse(ray.dir);
+	float			tNear;
+	readCache(l1, l2, (const char*)nodes + nodeOffset, sizeof(BvhNode));
+	if (!rayAabbIntersect(nodes[0].boundMin, nodes[0].boundMax, ray.pos, dirInv, hit.t, &tNear))
+		return;
+
+	int		stackNode[BVH_STACK_SIZE];
+	float	stackT[BVH_STACK_SIZE];
+	int		stackSize	= 1;
+	stackNode[0]		= 0;
+	stackT[0]			= tNear;
+	while (stackSize > 0)
+	{
+		--stackSize;
+		if (stackT[stackSize] > hit.t)
+			continue;
+		const BvhNode* node = &nodes[stackNode[stackSize]];
+		if (node->primCount > 0)
+		{
+			for (int i = node->childOrPrimIdx; i < node->childOrPrimIdx + node->primCount; ++i)
+			{
+				int prim = bvh.m_primTri[i];
+				readCache(l1, l2, &bvh.m_primTri[i], sizeof(int));
+				if ((prim & RAY_PRIM_TYPE_MASK) == RAY_PRIM_QUAD)
+					readCache(l1, l2, &bvh.m_geometry.quads[prim & RAY_PRIM_IDX_MASK], sizeof(QuadPrim));
+				else if ((prim & RAY_PRIM_TYPE_MASK) == RAY_PRIM_BOX)
+					readCache(l1, l2, &bvh.m_geometry.boxes[(prim & RAY_PRIM_IDX_MASK) / 6], sizeof(BoxPrim));
+				else
+				{
+					const int* idx = bvh.m_geometry.triIdx + prim * 3;
+					readCache(l1, l2, idx, sizeof(int) * 3);
+					for (int j = 0; j < 3; ++j)
+						readCache(l1, l2, &bvh.m_geometry.triPos[idx[j]], sizeof(Vector3));
+				}
+			}
+			bvh.intersectLeaf(ray, node->childOrPrimIdx, node->primCount, &hit);
+			continue;
+		}
+
+		int				childIdx	= node->childOrPrimIdx;
+		const BvhNode*	child		= &nodes[childIdx];
+		float			t0, t1;
+		readCache(l1, l2, (const char*)child + nodeOffset, sizeof(BvhNode) * 2);
+		bool			hit0		= rayAabbIntersect(child[0].boundMin, child[0].boundMax, ray.pos, dirInv, hit.t, &t0);
+		bool			hit1		= rayAabbIntersect(child[1].boundMin, child[1].boundMax, ray.pos, dirInv, hit.t, &t1);
+		if (hit0 && hit1)
+		{
+			bool	isNear0				= t0 <= t1;
+			stackNode[stackSize]		= isNear0 ? childIdx + 1 : childIdx;
+			stackT	 [stackSize]		= isNear0 ? t1 : t0;
+			stackNode[stackSize + 1]	= isNear0 ? childIdx : childIdx + 1;
+			stackT	 [stackSize + 1]	= isNear0 ? t0 : t1;
+			stackSize += 2;
+		}
+		else if (hit0 || hit1)
+		{
+			stackNode[stackSize]		= hit0 ? childIdx : childIdx + 1;
+			stackT	 [stackSize]		= hit0 ? t0 : t1;
+			++stackSize;
+		}
+	}
+}
+
+void	rayBenchmarkNodeLayoutReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	scene->buildAccel(SceneAccel_Bvh);
+	BvhGeometry geometry = scene->bvh.m_geometry;
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	const Ray*	rays	= &raySet.rays[0];
+	int			numRay	= (int)raySet.rays.size();
+	printf("scene %s: %i triangles, %.2f MB nodes, %i rays (primary + diffuse), simulated %i KB %i-way L1, %i KB %i-way L2\n",
+		sceneName, scene->getNumTriangle(), scene->bvh.getNodeMemorySize() / (1024.0 * 1024.0), numRay,
+		RAY_BENCHMARK_L1_SIZE / 1024, RAY_BENCHMARK_L1_WAY, RAY_BENCHMARK_L2_SIZE / 1024, RAY_BENCHMARK_L2_WAY);
+
+	std::vector<RayHit> hitsRef;
+	scene->accel = SceneAccel_Bvh;
+	rayBenchmarkMeasure(*scene, rays, numRay, &hitsRef);
+
+	// the caches are not flushed between rays, so the misses depend on the ray order as in the path tracer,
+	// the first row simulate the previous 16 byte aligned node allocation, where every sibling pair span 2 cache lines
+	printf("  layout                    lines/ray  L1 miss  L2 miss  L2 miss/ray  Mrays/s  Mrays/s prefetch  mismatch\n");
+	const char*	layoutName[]	= { "build order, 16B aligned ", "build order              ", "depth first              ", "treelet                  " };
+	BvhLayout	layout[]		= { BvhLayout_BuildOrder, BvhLayout_BuildOrder, BvhLayout_DepthFirst, BvhLayout_Treelet };
+	for (int i = 0; i < 4; ++i)
+	{
+		scene->bvh.m_layout = layout[i];
+		scene->bvh.build(geometry, scene->bvhBuildMode, threadPoolGetShared());
+		if (scene->bvh.m_maxDepth > BVH_STACK_SIZE)
+		{	// simulateRayCast() uses the full stack traversal
+			printf("  %s  depth %i is larger than the traversal stack, skipped\n", layoutName[i], scene->bvh.m_maxDepth);
+			continue;
+		}
+
+		RayBenchmarkCache l1, l2;
+		l1.init(RAY_BENCHMARK_L1_SIZE, RAY_BENCHMARK_L1_WAY);
+		l2.init(RAY_BENCHMARK_L2_SIZE, RAY_BENCHMARK_L2_WAY);
+		for (int j = 0; j < numRay; ++j)
+			simulateRayCast(scene->bvh, rays[j], i == 0 ? 16 : 0, &l1, &l2);
+		printf("  %s  %9.1f  %6.2f%%  %6.2f%%  %11.2f",
+			layoutName[i], l1.numAccess / (double)numRay, l1.numMiss * 100.0 / l1.numAccess, l2.numMiss * 100.0 / l2.numAccess, l2.numMiss / (double)numRay);
+		if (i == 0)
+		{
+			printf("\n");
+			continue;
+		}
+
+		std::vector<RayHit> hits;
+		scene->bvh.m_usePrefetch	= false;
+		double	raysPerSec			= rayBenchmarkMeasure(*scene, rays, numRay, &hits);
+		scene->bvh.m_usePrefetch	= true;
+		double	raysPerSecPrefetch	= rayBenchmarkMeasure(*scene, rays, numRay, &hits);
+		int		numMismatch			= rayBenchmarkCountMismatch(hits, hitsRef);
+		printf("  %7.3f  %16.3f  %i / %i\n", raysPerSec / 1000000.0, raysPerSecPrefetch / 1000000.0, numMismatch, numRay);
+	}
+	delete scene;
+}
+
+static void	spatialSplitReportScene(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	scene->buildAccel(SceneAccel_Bvh);
+	BvhGeometry geometry	= scene->bvh.m_geometry;
+	int			numTri		= scene->getNumTriangle();
+
+	RayBenchmarkSet raySet;
+	rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+	const Ray*	primaryRays		= &raySet.rays[0];
+	const Ray*	diffuseRays		= &raySet.rays[raySet.numPrimary];
+	int			numPrimary		= raySet.numPrimary;
+	int			numDiffuse		= (int)raySet.rays.size() - numPrimary;
+	printf("scene %s: %i triangles, %i primary rays, %i diffuse rays\n", sceneName, numTri, numPrimary, numDiffuse);
+
+	int					numVerify	= min(max(RAY_BENCHMARK_VERIFY_TEST / numTri, 64), (int)raySet.rays.size());
+	std::vector<Ray>	verifyRays;
+	for (int i = 0; i < numVerify; ++i)
+		verifyRays.push_back(raySet.rays[(int)(i * (long long)raySet.rays.size() / numVerify)]);
+	std::vector<RayHit> verifyHitsRef;
+	scene->accel = SceneAccel_BruteForce;
+	rayBenchmarkMeasure(*scene, &verifyRays[0], numVerify, &verifyHitsRef);
+
+	// memory is the nodes and the triangle references of the leaves
+	printf("                 build s  references  memory MB  SAH cost  primary Mrays/s  diffuse Mrays/s  mismatch\n");
+	const char*		modeName[]	= { "SAH        ", "SBVH   10% ", "SBVH   30% ", "SBVH  100% " };
+	BvhBuildMode	mode[]		= { BvhBuildMode_Sah, BvhBuildMode_Sbvh, BvhBuildMode_Sbvh, BvhBuildMode_Sbvh };
+	float			budget[]	= { 0.0f, 0.1f, 0.3f, 1.0f };
+	float			prevBudget	= scene->bvh.m_spatialSplitBudget;
+	scene->accel				= SceneAccel_Bvh;
+	for (int i = 0; i < 4; ++i)
+	{
+		scene->bvh.m_spatialSplitBudget	= budget[i];
+		LONGLONG	startTime			= timeGetAbsoulteTime();
+		scene->bvh.build(geometry, mode[i], threadPoolGetShared());
+		double		buildTime			= timeGetElapsedTime(startTime);
+		int			numRef				= (int)scene->bvh.m_primTri.size();
+		int			memory				= scene->bvh.getNodeMemorySize() + numRef * (int)sizeof(int);
+
+		std::vector<RayHit> hits;
+		double	primaryRaysPerSec	= rayBenchmarkMeasure(*scene, primaryRays, numPrimary, &hits);
+		double	diffuseRaysPerSec	= rayBenchmarkMeasure(*scene, diffuseRays, numDiffuse, &hits);
+		rayBenchmarkMeasure(*scene, &verifyRays[0], numVerify, &hits);
+		int		numMismatch			= rayBenchmarkCountMismatch(hits, verifyHitsRef);
+		printf("  %s  %7.3f  %9.2fx  %9.2f  %8.2f  %15.3f  %15.3f  %i / %i\n",
+			modeName[i], buildTime, numRef / (double)numTri, memory / (1024.0 * 1024.0), scene->bvh.computeSahCost(),
+			primaryRaysPerSec / 1000000.0, diffuseRaysPerSec / 1000000.0, numMismatch, numVerify);
+	}
+	scene->bvh.m_spatialSplitBudget = prevBudget;
+	delete scene;
+}
+
+void	rayBenchmarkSpatialSplitReport(const char* sceneName)
+{
+	spatialSplitReportScene(sceneName);
+
+	// the long and thin triangles are where spatial splits pay off, always cover them
+	if (strcmp(sceneName, "cornell_thin") != 0)
+	{
+		printf("\n");
+		spatialSplitReportScene("cornell_thin");
+	}
+}
+
+static void	analyticPrimReportScene(const char* sceneName)
+{
+	printf("scene %s: Cornell box walls and blocks as triangles vs quads and boxes, %ix%i primary rays + 1 diffuse bounce\n",
+		sceneName, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT);
+	printf("             primitives  tris / quads / boxes  geometry KB  BVH nodes  SAH cost  brute force Mrays/s  primary Mrays/s  diffuse Mrays/s  mismatch\n");
+	const char* modeName[] = { "triangles", "analytic " };
+	for (int i = 0; i < 2; ++i)
+	{
+		Scene* scene					= new Scene();
+		scene->isAnalyticPrimEnabled	= i == 1;
+		if (!scene->createByName(sceneName))
+		{
+			printf("unknown scene: %s\n", sceneName);
+			delete scene;
+			return;
+		}
+		scene->buildAccel(SceneAccel_Bvh);
+		int numPrim		= scene->getNumPrimitive();
+
+		// each version has its own rays, as the analytic blocks are fitted boxes
+		RayBenchmarkSet raySet;
+		rayBenchmarkCreateRaySet(*scene, RAY_BENCHMARK_WIDTH, RAY_BENCHMARK_HEIGHT, &raySet);
+		const Ray*	primaryRays		= &raySet.rays[0];
+		const Ray*	diffuseRays		= &raySet.rays[raySet.numPrimary];
+		int			numPrimary		= raySet.numPrimary;
+		int			numDiffuse		= (int)raySet.rays.size() - numPrimary;
+
+		std::vector<RayHit> hits;
+		double	primaryRaysPerSec	= rayBenchmarkMeasure(*scene, primaryRays, numPrimary, &hits);
+		double	diffuseRaysPerSec	= rayBenchmarkMeasure(*scene, diffuseRays, numDiffuse, &hits);
+
+		int					numVerify	= min(max(RAY_BENCHMARK_VERIFY_TEST / numPrim, 64), (int)raySet.rays.size());
+		std::vector<Ray>	verifyRays;
+		for (int j = 0; j < numVerify; ++j)
+			verifyRays.push_back(raySet.rays[(int)(j * (long long)raySet.rays.size() / numVerify)]);
+		std::vector<RayHit> verifyHits;
+		rayBenchmarkMeasure(*scene, &verifyRays[0], numVerify, &verifyHits);
+		std::vector<RayHit> verifyHitsRef;
+		scene->accel					= SceneAccel_BruteForce;
+		double	bruteForceRaysPerSec	= rayBenchmarkMeasure(*scene, &verifyRays[0], numVerify, &verifyHitsRef);
+		int		numMismatch				= rayBenchmarkCountMismatch(verifyHits, verifyHitsRef);
+
+		printf("  %s  %10i  %8i / %4i / %4i  %11.2f  %9i  %8.2f  %19.3f  %15.3f  %15.3f  %i / %i\n",
+			modeName[i], numPrim, scene->getNumTriangle(), (int)scene->quads.size(), (int)scene->boxes.size(),
+			scene->getGeometryMemorySize() / 1024.0, (int)scene->bvh.m_nodes.size(), scene->bvh.computeSahCost(),
+			bruteForceRaysPerSec / 1000000.0, primaryRaysPerSec / 1000000.0, diffuseRaysPerSec / 1000000.0, numMismatch, numVerify);
+		delete scene;
+	}
+}
+
+void	rayBenchmarkAnalyticPrimReport(const char* sceneName)
+{
+	analyticPrimReportScene(sceneName);
+
+	// the analytic version of the plain cornell box has no triangle at all, always cover it
+	if (strcmp(sceneName, "cornell") != 0)
+	{
+		printf("\n");
+		analyticPrimReportScene("cornell");
+	}
+}
+
+static void	setLightSampling(Scene* scene, AreaLightSampling sampling)
+{
+	for (int i = 0; i < scene->numLight; ++i)
+		scene->setAreaLightSampling(i, sampling);
+}
+
+// pixels are clamped to 1 first, otherwise the anti-aliased edges of the directly visible light dominate the error
+static double	computeRmseRect(const AccumBuffer& accum, const AccumBuffer& reference, int x0, int y0, int x1, int y1)
+{
+	double sum = 0.0;
+	for (int y = y0; y < y1; ++y)
+		for (int x = x0; x < x1; ++x)
+		{
+			Vector3 pixel		= accum.getPixel(x, y);
+			Vector3 pixelRef	= reference.getPixel(x, y);
+			Vector3 diff		= Vector3(minf(pixel.x, 1.0f) - minf(pixelRef.x, 1.0f), minf(pixel.y, 1.0f) - minf(pixelRef.y, 1.0f), minf(pixel.z, 1.0f) - minf(pixelRef.z, 1.0f));
+			sum += diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
+		}
+	return sqrt(sum / ((x1 - x0) * (y1 - y0) * 3));
+}
+
+static double	computeRmse(const AccumBuffer& accum, const AccumBuffer& reference)
+{
+	return computeRmseRect(accum, reference, 0, 0, accum.width, accum.height);
+}
+
+// render 1 spp passes until the time is used up, return the elapsed time
+static double	renderForTime(const CpuPathTracer& tracer, AccumBuffer* accum, double time, int* outSpp)
+{
+	LONGLONG	startTime	= timeGetAbsoulteTime();
+	double		elapsed		= 0.0;
+	int			spp			= 0;
+	while (elapsed < time)
+	{
+		tracer.renderSamples(accum, spp++, 1);
+		elapsed = timeGetElapsedTime(startTime);
+	}
+	*outSpp = spp;
+	return elapsed;
+}
+
+void	rayBenchmarkLightSamplingReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+
+	// both modes converge to the same image, the reference uses sample indices not used by the measured renders
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	setLightSampling(scene, AreaLightSampling_SolidAngle);
+	tracer.renderSamples(&reference, refSampleStart, RAY_BENCHMARK_LIGHT_REF_SPP);
+	printf("scene %s: %i lights, %ix%i, RMSE against a %i spp reference after %.1fs of CPU path tracing\n",
+		sceneName, scene->numLight, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT, RAY_BENCHMARK_LIGHT_REF_SPP, RAY_BENCHMARK_LIGHT_TIME);
+
+	printf("  sampling       spp  Msamples/s      RMSE  RMSE^2 vs area\n");
+	const char*			modeName[]	= { "area       ", "solid angle" };
+	AreaLightSampling	mode[]		= { AreaLightSampling_Area, AreaLightSampling_SolidAngle };
+	double				areaMse		= 0.0;
+	for (int i = 0; i < 2; ++i)
+	{
+		setLightSampling(scene, mode[i]);
+		AccumBuffer accum;
+		accum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+		int		spp;
+		double	elapsed	= renderForTime(tracer, &accum, RAY_BENCHMARK_LIGHT_TIME, &spp);
+		double	rmse	= computeRmse(accum, reference);
+		if (i == 0)
+			areaMse = rmse * rmse;
+		printf("  %s  %5i  %10.3f  %8.5f  %14.2fx\n", modeName[i], spp, accum.width * accum.height * (double)spp / elapsed / 1000000.0,
+			rmse, rmse * rmse / areaMse);
+	}
+	delete scene;
+}
+
+void	rayBenchmarkEmissiveSamplingReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	scene->isEmissiveSamplingEnabled = true;
+	scene->buildEmissiveTable();
+	tracer.renderSamples(&reference, refSampleStart, RAY_BENCHMARK_LIGHT_REF_SPP);
+	printf("scene %s: %i area lights, %i emissive triangles, %ix%i, RMSE against a %i spp reference after %.1fs of CPU path tracing\n",
+		sceneName, scene->numLight, (int)scene->emissiveTri.size(), RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT, RAY_BENCHMARK_LIGHT_REF_SPP, RAY_BENCHMARK_LIGHT_TIME);
+
+	printf("  emissive triangles    spp  Msamples/s      RMSE  RMSE^2 vs hit only\n");
+	const char*	modeName[]	= { "hit by BRDF rays only", "light sampled        " };
+	double		hitOnlyMse	= 0.0;
+	for (int i = 0; i < 2; ++i)
+	{
+		scene->isEmissiveSamplingEnabled = i == 1;
+		scene->buildEmissiveTable();
+		AccumBuffer accum;
+		accum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+		int		spp;
+		double	elapsed	= renderForTime(tracer, &accum, RAY_BENCHMARK_LIGHT_TIME, &spp);
+		double	rmse	= computeRmse(accum, reference);
+		if (i == 0)
+			hitOnlyMse = rmse * rmse;
+		printf("  %s  %5i  %10.3f  %8.5f  %18.3fx\n", modeName[i], spp, accum.width * accum.height * (double)spp / elapsed / 1000000.0,
+			rmse, rmse * rmse / hitOnlyMse);
+	}
+	delete scene;
+}
+
+void	rayBenchmarkEnvMapSamplingReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName) || scene->envMap.isEmpty())
+	{
+		printf("unknown scene or no environment map: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+
+	EnvMap&		envMap		= scene->envMap;
+	LONGLONG	startTime	= timeGetAbsoulteTime();
+	envMap.buildTable();
+	double		buildTime	= timeGetElapsedTime(startTime);
+	printf("scene %s: %ix%i environment map, pixels %.1f KB, alias table %.1f KB, table built in %.2f ms\n",
+		sceneName, envMap.width, envMap.height, envMap.pixels.size() * sizeof(Vector3) / 1024.0, envMap.table.size() * sizeof(AliasTableEntry) / 1024.0, buildTime * 1000.0);
+
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	scene->setEnvMapSampling(EnvMapSampling_Importance);
+	tracer.renderSamples(&reference, refSampleStart, RAY_BENCHMARK_LIGHT_REF_SPP);
+	printf("%ix%i, RMSE against a %i spp reference after %.1fs of CPU path tracing\n",
+		RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT, RAY_BENCHMARK_LIGHT_REF_SPP, RAY_BENCHMARK_LIGHT_TIME);
+
+	printf("  sampling          spp  Msamples/s      RMSE  RMSE^2 vs uniform\n");
+	const char*		modeName[]	= { "uniform sphere", "importance    " };
+	EnvMapSampling	mode[]		= { EnvMapSampling_Uniform, EnvMapSampling_Importance };
+	double			uniformMse	= 0.0;
+	for (int i = 0; i < 2; ++i)
+	{
+		scene->setEnvMapSampling(mode[i]);
+		AccumBuffer accum;
+		accum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+		int		spp;
+		double	elapsed	= renderForTime(tracer, &accum, RAY_BENCHMARK_LIGHT_TIME, &spp);
+		double	rmse	= computeRmse(accum, reference);
+		if (i == 0)
+			uniformMse = rmse * rmse;
+		printf("  %s  %5i  %10.3f  %8.5f  %17.3fx\n", modeName[i], spp, accum.width * accum.height * (double)spp / elapsed / 1000000.0,
+			rmse, rmse * rmse / uniformMse);
+	}
+	delete scene;
+}
+
+// render 1 ReSTIR frame per pass until the time is used up, return the elapsed time
+static double	renderRestirForTime(CpuRestir* restir, AccumBuffer* accum, double time, int* outSpp)
+{
+	LONGLONG	startTime	= timeGetAbsoulteTime();
+	double		elapsed		= 0.0;
+	int			spp			= 0;
+	restir->reset();
+	while (elapsed < time)
+	{
+		restir->renderFrame(accum, spp++);
+		elapsed = timeGetElapsedTime(startTime);
+	}
+	*outSpp = spp;
+	return elapsed;
+}
+
+void	rayBenchmarkRestirReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+
+	// direct lighting only, so the noise of the emissive triangle sampling is not hidden by the indirect bounces
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	tracer.m_traceDepth = 1;
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	tracer.renderSamples(&reference, refSampleStart, RAY_BENCHMARK_RESTIR_REF_SPP);
+	printf("scene %s: %i emissive triangles, direct lighting at %ix%i, RMSE against a %i spp reference after %.1fs of CPU rendering\n",
+		sceneName, (int)scene->emissiveTri.size(), RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT, RAY_BENCHMARK_RESTIR_REF_SPP, RAY_BENCHMARK_LIGHT_TIME);
+
+	printf("  mode                                   spp  Msamples/s      RMSE  RMSE^2 vs light sampling\n");
+	const char*	modeName[]	= { "light sampling, 1 candidate          ", "RIS, 32 candidates                   ", "ReSTIR temporal                      ", "ReSTIR temporal + spatial            " };
+	bool		isTemporal[]= { false, false, true, true };
+	bool		isSpatial[]	= { false, false, false, true };
+	double		baseMse		= 0.0;
+	CpuRestir	restir;
+	restir.init(&tracer);
+	for (int i = 0; i < 4; ++i)
+	{
+		AccumBuffer accum;
+		accum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+		int		spp;
+		double	elapsed;
+		if (i == 0)
+			elapsed = renderForTime(tracer, &accum, RAY_BENCHMARK_LIGHT_TIME, &spp);
+		else
+		{
+			restir.m_isTemporalEnabled	= isTemporal[i];
+			restir.m_isSpatialEnabled	= isSpatial[i];
+			elapsed = renderRestirForTime(&restir, &accum, RAY_BENCHMARK_LIGHT_TIME, &spp);
+		}
+		double	rmse	= computeRmse(accum, reference);
+		if (i == 0)
+			baseMse = rmse * rmse;
+		printf("  %s  %5i  %10.3f  %8.5f  %24.3fx\n", modeName[i], spp, accum.width * accum.height * (double)spp / elapsed / 1000000.0,
+			rmse, rmse * rmse / baseMse);
+	}
+	delete scene;
+}
+
+struct RayBenchmarkPassJob
+{
+	const CpuPathTracer*	tracer;
+	AccumBuffer*			accum;
+	int						sampleIdx;
+	int						sampleCount;
+};
+
+static void	renderPassRowsJob(void* userData, int jobIdx)
+{
+	RayBenchmarkPassJob*	job	= (RayBenchmarkPassJob*)userData;
+	int						y0	= jobIdx * RAY_BENCHMARK_CACHE_ROWS;
+	int						y1	= min(y0 + RAY_BENCHMARK_CACHE_ROWS, job->accum->height);
+	job->tracer->renderTile(job->accum, 0, y0, job->accum->width, y1, job->sampleIdx, job->sampleCount);
+}
+
+// mean luminance of the image over the reference, pixels are clamped to 1 as computeRmse()
+static double	computeMeanRatio(const AccumBuffer& accum, const AccumBuffer& reference)
+{
+	double sum		= 0.0;
+	double sumRef	= 0.0;
+	for (int y = 0; y < accum.height; ++y)
+		for (int x = 0; x < accum.width; ++x)
+		{
+			Vector3 pixel		= accum.getPixel(x, y);
+			Vector3 pixelRef	= reference.getPixel(x, y);
+			sum		+= minf(pixel.x, 1.0f) + minf(pixel.y, 1.0f) + minf(pixel.z, 1.0f);
+			sumRef	+= minf(pixelRef.x, 1.0f) + minf(pixelRef.y, 1.0f) + minf(pixelRef.z, 1.0f);
+		}
+	return sum / sumRef;
+}
+
+// render 1 spp passes on the shared thread pool until the RMSE reaches the target or the time is used up,
+// the sample index continues from inOutSpp, the RMSE is computed outside of the timing, return the elapsed time of the rendering
+static double	renderToError(const CpuPathTracer& tracer, AccumBuffer* accum, const AccumBuffer& reference, double targetRmse, double time, int* inOutSpp)
+{
+	ThreadPool*			threadPool	= threadPoolGetShared();
+	RayBenchmarkPassJob	job;
+	job.tracer						= &tracer;
+	job.accum						= accum;
+	job.sampleCount					= 1;
+	double				elapsed		= 0.0;
+	int					spp			= *inOutSpp;
+	while (elapsed < time)
+	{
+		LONGLONG startTime	= timeGetAbsoulteTime();
+		job.sampleIdx		= spp++;
+		threadPool->parallelFor(renderPassRowsJob, &job, (accum->height + RAY_BENCHMARK_CACHE_ROWS - 1) / RAY_BENCHMARK_CACHE_ROWS);
+		if (tracer.m_radianceCache)
+			tracer.m_radianceCache->nextFrame();
+		if (tracer.m_pathGuide)
+			tracer.m_pathGuide->endPass();
+		elapsed				+= timeGetElapsedTime(startTime);
+		if (targetRmse > 0.0 && computeRmse(*accum, reference) <= targetRmse)
+			break;
+	}
+	*inOutSpp = spp;
+	return elapsed;
+}
+
+void	rayBenchmarkRadianceCacheReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+
+	// the reference is traced to the full depth without the cache
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	tracer.renderSamples(&reference, refSampleStart, RAY_BENCHMARK_LIGHT_REF_SPP);
+
+	// the error target is the RMSE of the plain path tracer after RAY_BENCHMARK_LIGHT_TIME
+	AccumBuffer	baseline;
+	baseline.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	int			baseSpp		= 0;
+	renderToError(tracer, &baseline, reference, 0.0, RAY_BENCHMARK_LIGHT_TIME, &baseSpp);
+	double		targetRmse	= computeRmse(baseline, reference);
+	printf("scene %s: %ix%i, trace depth %i, %i threads, time to reach the RMSE %.5f of %.1fs path tracing, against a %i spp reference\n",
+		sceneName, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT, tracer.m_traceDepth, threadPoolGetShared()->getNumThread(),
+		targetRmse, RAY_BENCHMARK_LIGHT_TIME, RAY_BENCHMARK_LIGHT_REF_SPP);
+	printf("radiance cache: %i cells of %.3f, %i KB, %.1f%% of the paths are traced to the end to train it\n",
+		RADIANCE_CACHE_CELL_NUM, RADIANCE_CACHE_CELL_SIZE, (int)(RADIANCE_CACHE_CELL_NUM * sizeof(RadianceCacheCell) / 1024), RADIANCE_CACHE_TRAIN_RATIO * 100.0f);
+
+	// the bias is shown by the mean brightness and the RMSE after the whole budget, where the noise of the plain path tracer is lower
+	printf("  mode                     spp  time to target   speedup  used cells  mean ratio  RMSE after %.0fs\n", RAY_BENCHMARK_CACHE_TIME);
+	const char*		modeName[]	= { "path tracing          ", "cache from 2nd bounce ", "cache from 1st bounce " };
+	int				cacheDepth[]= { 0, 2, 1 };
+	double			baseTime	= 0.0;
+	RadianceCache*	cache		= new RadianceCache();
+	cache->init(RADIANCE_CACHE_CELL_SIZE);
+	for (int i = 0; i < 3; ++i)
+	{
+		tracer.m_radianceCache		= cacheDepth[i] > 0 ? cache : NULL;
+		tracer.m_radianceCacheDepth	= cacheDepth[i];
+		cache->clear();
+
+		AccumBuffer accum;
+		accum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+		int		spp			= 0;
+		double	elapsed		= renderToError(tracer, &accum, reference, targetRmse, RAY_BENCHMARK_CACHE_TIME, &spp);
+		bool	isReached	= computeRmse(accum, reference) <= targetRmse;
+		if (i == 0)
+			baseTime = elapsed;		// measured again, so the speedup is not affected by the warm up of the first render
+
+		// continue to the whole budget for the bias
+		int		sppTarget	= spp;
+		renderToError(tracer, &accum, reference, 0.0, RAY_BENCHMARK_CACHE_TIME - elapsed, &spp);
+		if (isReached)
+			printf("  %s  %5i  %13.2fs  %7.2fx", modeName[i], sppTarget, elapsed, baseTime / elapsed);
+		else
+			printf("  %s  %5i  %13s   %7s ", modeName[i], sppTarget, "not reached", "-");
+		printf("  %10i  %10.4f  %15.5f\n", tracer.m_radianceCache ? cache->getUsedCellNum() : 0, computeMeanRatio(accum, reference), computeRmse(accum, reference));
+	}
+	tracer.m_radianceCache = NULL;
+	delete cache;
+	delete scene;
+}
+
+void	rayBenchmarkPathGuidingReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	tracer.renderSamples(&reference, refSampleStart, RAY_BENCHMARK_GUIDE_REF_SPP);
+	printf("scene %s: %ix%i, trace depth %i, %i threads, RMSE against a %i spp reference, the guide is learnt during the render\n",
+		sceneName, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT, tracer.m_traceDepth, threadPoolGetShared()->getNumThread(), RAY_BENCHMARK_GUIDE_REF_SPP);
+
+	// the efficiency is 1 / (MSE * time) at the end of the budget, relative to BRDF sampling
+	printf("  mode          ");
+	for (int c = RAY_BENCHMARK_GUIDE_CHECKPOINT - 1; c >= 0; --c)
+		printf("   RMSE %4.1fs", RAY_BENCHMARK_GUIDE_TIME / (1 << c));
+	printf("    spp  efficiency  iteration  leaves  tree KB\n");
+	const char*	modeName[]	= { "BRDF sampling", "path guiding " };
+	double		baseMse		= 0.0;
+	for (int i = 0; i < 2; ++i)
+	{
+		PathGuide* guide = NULL;
+		if (i == 1)
+		{
+			guide = new PathGuide();
+			guide->init(*scene);
+		}
+		tracer.m_pathGuide = guide;
+
+		AccumBuffer accum;
+		accum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+		int		spp			= 0;
+		double	elapsed		= 0.0;
+		double	rmse		= 0.0;
+		printf("  %s", modeName[i]);
+		for (int c = RAY_BENCHMARK_GUIDE_CHECKPOINT - 1; c >= 0; --c)
+		{
+			elapsed	+= renderToError(tracer, &accum, reference, 0.0, RAY_BENCHMARK_GUIDE_TIME / (1 << c) - elapsed, &spp);
+			rmse	= computeRmse(accum, reference);
+			printf("  %11.5f", rmse);
+		}
+		if (i == 0)
+			baseMse = rmse * rmse;
+		printf("  %5i  %9.2fx", spp, baseMse / (rmse * rmse));
+		if (guide)
+			printf("  %9i  %6i  %7i", guide->getIteration(), guide->getLeafNum(), guide->getMemorySize() / 1024);
+		printf("\n");
+		tracer.m_pathGuide = NULL;
+		delete guide;
+	}
+	delete scene;
+}
+
+void	rayBenchmarkPathTerminationReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+
+	// every policy is unbiased for the same trace depth, so a single reference is traced with the current policy
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	tracer.renderSamples(&reference, refSampleStart, RAY_BENCHMARK_GUIDE_REF_SPP);
+
+	AccumBuffer	baseline;
+	baseline.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+	int			baseSpp		= 0;
+	renderToError(tracer, &baseline, reference, 0.0, RAY_BENCHMARK_LIGHT_TIME, &baseSpp);
+	double		targetRmse	= computeRmse(baseline, reference);
+	printf("scene %s: %ix%i, trace depth %i, %i threads, time to reach the RMSE %.5f of %.1fs path tracing, against a %i spp reference\n",
+		sceneName, RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT, tracer.m_traceDepth, threadPoolGetShared()->getNumThread(),
+		targetRmse, RAY_BENCHMARK_LIGHT_TIME, RAY_BENCHMARK_GUIDE_REF_SPP);
+	printf("the adjoint estimate is a radiance cache trained by a %.1fs pre-pass, which is included in the time\n", RAY_BENCHMARK_ADJOINT_TIME);
+
+	printf("  mode                        spp  time to target   speedup  mean ratio  RMSE after %.0fs\n", RAY_BENCHMARK_CACHE_TIME);
+	const char*		modeName[]		= { "albedo roulette after 5   ", "throughput roulette from 3", "adjoint roulette + split  " };
+	PathTermination	termination[]	= { PathTermination_Albedo, PathTermination_Throughput, PathTermination_Adjoint };
+	double			baseTime		= 0.0;
+	RadianceCache*	cache			= new RadianceCache();
+	cache->init(RADIANCE_CACHE_CELL_SIZE);
+	for (int i = 0; i < 3; ++i)
+	{
+		double elapsed = 0.0;
+		if (termination[i] == PathTermination_Adjoint)
+		{
+			// the pre-pass renders to its own image, only its cache is kept
+			CpuPathTracer	trainTracer	= tracer;
+			trainTracer.m_radianceCache	= cache;
+			AccumBuffer		trainAccum;
+			trainAccum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+			int				trainSpp	= 0;
+			elapsed						= renderToError(trainTracer, &trainAccum, reference, 0.0, RAY_BENCHMARK_ADJOINT_TIME, &trainSpp);
+		}
+		tracer.m_termination		= termination[i];
+		tracer.m_terminationCache	= termination[i] == PathTermination_Adjoint ? cache : NULL;
+
+		AccumBuffer accum;
+		accum.resize(RAY_BENCHMARK_LIGHT_WIDTH, RAY_BENCHMARK_LIGHT_HEIGHT);
+		int		spp			= 0;
+		elapsed				+= renderToError(tracer, &accum, reference, targetRmse, RAY_BENCHMARK_CACHE_TIME - elapsed, &spp);
+		bool	isReached	= computeRmse(accum, reference) <= targetRmse;
+		if (i == 0)
+			baseTime = elapsed;
+
+		int		sppTarget	= spp;
+		renderToError(tracer, &accum, reference, 0.0, RAY_BENCHMARK_CACHE_TIME - elapsed, &spp);
+		if (isReached)
+			printf("  %s  %5i  %13.2fs  %7.2fx", modeName[i], sppTarget, elapsed, baseTime / elapsed);
+		else
+			printf("  %s  %5i  %13s   %7s ", modeName[i], sppTarget, "not reached", "-");
+		printf("  %10.4f  %15.5f\n", computeMeanRatio(accum, reference), computeRmse(accum, reference));
+	}
+	tracer.m_termination		= PathTermination_Albedo;
+	tracer.m_terminationCache	= NULL;
+	delete cache;
+	delete scene;
+}
+
+struct RayBenchmarkTileJob
+{
+	const CpuPathTracer*					tracer;
+	AccumBuffer*							accum;
+	const std::vector<TileSchedulerTile>*	tiles;
+};
+
+static void	renderScheduledTileJob(void* userData, int jobIdx)
+{
+	RayBenchmarkTileJob*		job		= (RayBenchmarkTileJob*)userData;
+	const TileSchedulerTile&	tile	= (*job->tiles)[jobIdx];
+	job->tracer->renderTile(job->accum, tile.x0, tile.y0, tile.x1, tile.y1, tile.sampleStart, tile.sampleCount);
+}
+
+// render the passes of the scheduler until the RMSE inside the rect reaches the target or the time is used up,
+// return the elapsed time of the rendering
+static double	renderScheduledToError(const CpuPathTracer& tracer, TileScheduler* scheduler, AccumBuffer* accum, const AccumBuffer& reference, const int* rect,
+										double targetRmse, double time)
+{
+	std::vector<TileSchedulerTile>	tiles;
+	RayBenchmarkTileJob				job;
+	job.tracer						= &tracer;
+	job.accum						= accum;
+	job.tiles						= &tiles;
+	double							elapsed		= 0.0;
+	while (elapsed < time)
+	{
+		LONGLONG startTime	= timeGetAbsoulteTime();
+		scheduler->buildPass(&tiles);
+		threadPoolGetShared()->parallelFor(renderScheduledTileJob, &job, (int)tiles.size());
+		elapsed				+= timeGetElapsedTime(startTime);
+		if (targetRmse > 0.0 && computeRmseRect(*accum, reference, rect[0], rect[1], rect[2], rect[3]) <= targetRmse)
+			break;
+	}
+	return elapsed;
+}
+
+// mean samples per pixel inside and outside of the rect
+static void	computeRectSampleCount(const AccumBuffer& accum, const int* rect, double* outInside, double* outOutside)
+{
+	double	sumInside	= 0.0;
+	double	sumOutside	= 0.0;
+	for (int y = 0; y < accum.height; ++y)
+		for (int x = 0; x < accum.width; ++x)
+		{
+			bool isInside = x >= rect[0] && x < rect[2] && y >= rect[1] && y < rect[3];
+			(isInside ? sumInside : sumOutside) += accum.sampleCount[y * accum.width + x];
+		}
+	int numInside	= (rect[2] - rect[0]) * (rect[3] - rect[1]);
+	*outInside		= sumInside / numInside;
+	*outOutside		= sumOutside / (accum.width * accum.height - numInside);
+}
+
+void	rayBenchmarkRegionOfInterestReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	const int	width	= RAY_BENCHMARK_PATH_TRACE_WIDTH;
+	const int	height	= RAY_BENCHMARK_PATH_TRACE_HEIGHT;
+	CpuPathTracer tracer;
+	tracer.init(scene);
+	setBenchmarkCamera(&tracer, width, height);
+
+	// the region is on the shadowed side of the tall block, where the noise is the slowest to clear
+	float		focusX	= width		* 0.35f;
+	float		focusY	= height	* 0.55f;
+	int			rect[4]	= {	(int)focusX - RAY_BENCHMARK_ROI_RADIUS, (int)focusY - RAY_BENCHMARK_ROI_RADIUS,
+							(int)focusX + RAY_BENCHMARK_ROI_RADIUS, (int)focusY + RAY_BENCHMARK_ROI_RADIUS };
+
+	// the reference is a crop render of the region only
+	const int	refSampleStart	= 1 << 20;
+	AccumBuffer	reference;
+	reference.resize(width, height);
+	TileScheduler refScheduler;
+	refScheduler.init(width, height);
+	refScheduler.setCrop(rect[0], rect[1], rect[2], rect[3]);
+	std::vector<TileSchedulerTile> refTiles;
+	refScheduler.buildPass(&refTiles);
+	for (int i = 0; i < (int)refTiles.size(); ++i)
+	{
+		refTiles[i].sampleStart	= refSampleStart;
+		refTiles[i].sampleCount	= RAY_BENCHMARK_ROI_REF_SPP;
+	}
+	RayBenchmarkTileJob refJob;
+	refJob.tracer	= &tracer;
+	refJob.accum	= &reference;
+	refJob.tiles	= &refTiles;
+	threadPoolGetShared()->parallelFor(renderScheduledTileJob, &refJob, (int)refTiles.size());
+
+	TileScheduler scheduler;
+	AccumBuffer baseline;
+	baseline.resize(width, height);
+	scheduler.init(width, height);
+	renderScheduledToError(tracer, &scheduler, &baseline, reference, rect, 0.0, RAY_BENCHMARK_LIGHT_TIME);
+	double		targetRmse	= computeRmseRect(baseline, reference, rect[0], rect[1], rect[2], rect[3]);
+	printf("scene %s: %ix%i, %i threads, %ix%i region at (%i, %i), %ix%i tiles,\n", sceneName, width, height, threadPoolGetShared()->getNumThread(),
+		rect[2] - rect[0], rect[3] - rect[1], rect[0], rect[1], TILE_SCHEDULER_TILE_SIZE, TILE_SCHEDULER_TILE_SIZE);
+	printf("time to reach the RMSE %.5f inside the region of %.1fs uniform rendering, against a %i spp reference of the region\n",
+		targetRmse, RAY_BENCHMARK_LIGHT_TIME, RAY_BENCHMARK_ROI_REF_SPP);
+
+	printf("  mode                        time to target   speedup  spp inside  spp outside\n");
+	const char*	modeName[]	= { "uniform 1 spp per pass    ", "focus priority            ", "crop to the region        " };
+	double		baseTime	= 0.0;
+	for (int i = 0; i < 3; ++i)
+	{
+		scheduler.init(width, height);
+		scheduler.setFocus(focusX, focusY, i == 1 ? (float)RAY_BENCHMARK_ROI_RADIUS : 0.0f);
+		if (i == 2)
+			scheduler.setCrop(rect[0], rect[1], rect[2], rect[3]);
+		else
+			scheduler.clearCrop();
+
+		AccumBuffer accum;
+		accum.resize(width, height);
+		double	elapsed		= renderScheduledToError(tracer, &scheduler, &accum, reference, rect, targetRmse, RAY_BENCHMARK_CACHE_TIME);
+		bool	isReached	= computeRmseRect(accum, reference, rect[0], rect[1], rect[2], rect[3]) <= targetRmse;
+		if (i == 0)
+			baseTime = elapsed;
+
+		double	sppInside, sppOutside;
+		computeRectSampleCount(accum, rect, &sppInside, &sppOutside);
+		if (isReached)
+			printf("  %s  %13.2fs  %7.2fx", modeName[i], elapsed, baseTime / elapsed);
+		else
+			printf("  %s  %13s   %7s ", modeName[i], "not reached", "-");
+		printf("  %10.1f  %11.1f\n", sppInside, sppOutside);
+	}
+	delete scene;
+}
+
+// render passes of sampleCount samples on the shared thread pool, starting from sample sampleStart, return the elapsed time
+static double	renderPass(const CpuPathTracer& tracer, AccumBuffer* accum, int sampleStart, int sampleCount)
+{
+	RayBenchmarkPassJob job;
+	job.tracer		= &tracer;
+	job.accum		= accum;
+	job.sampleIdx	= sampleStart;
+	job.sampleCount	= sampleCount;
+	LONGLONG startTime = timeGetAbsoulteTime();
+	threadPoolGetShared()->parallelFor(renderPassRowsJob, &job, (accum->height + RAY_BENCHMARK_CACHE_ROWS - 1) / RAY_BENCHMARK_CACHE_ROWS);
+	return timeGetElapsedTime(startTime);
+}
+
+void	rayBenchmarkPassSampleCountReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+	CpuPathTracer tracer;
+	tracer.init(scene);
+
+	// every pass reads and writes the radiance sum and sample count of each pixel once
+	const int	pixelBytes	= 2 * (int)(sizeof(Vector4) + sizeof(int));
+	const int	numRes		= 3;
+	const int	resolution[numRes]	= { 128, 256, 512 };
+	printf("scene %s: %i threads, %i spp per run, the accumulation buffer is read and written once per pass (%i byte per pixel)\n",
+		sceneName, threadPoolGetShared()->getNumThread(), RAY_BENCHMARK_PASS_SPP, pixelBytes);
+	printf("  resolution  spp per pass  passes  accum traffic (MB)  byte per sample  M samples/s  speed up\n");
+	for (int r = 0; r < numRes; ++r)
+	{
+		int		res		= resolution[r];
+		double	baseRate= 0.0;
+		setBenchmarkCamera(&tracer, res, res);
+		for (int passSpp = 1; passSpp <= RAY_BENCHMARK_PASS_SPP; passSpp *= 2)
+		{
+			AccumBuffer accum;
+			accum.resize(res, res);
+			int		numPass	= RAY_BENCHMARK_PASS_SPP / passSpp;
+			double	elapsed	= 0.0;
+			for (int i = 0; i < numPass; ++i)
+				elapsed += renderPass(tracer, &accum, i * passSpp, passSpp);
+			double	rate	= (double)res * res * RAY_BENCHMARK_PASS_SPP / elapsed;
+			if (passSpp == 1)
+				baseRate = rate;
+			printf("  %4i x %4i  %12i  %6i  %18.2f  %15.2f  %11.3f  %7.2fx\n", res, res, passSpp, numPass,
+				(double)res * res * pixelBytes * numPass / (1024.0 * 1024.0), pixelBytes / (double)passSpp, rate / 1000000.0, rate / baseRate);
+		}
+	}
+
+	printf("automatic spp per pass for a %.0f ms budget, rendered for %.1fs\n", RAY_BENCHMARK_PASS_BUDGET, RAY_BENCHMARK_PASS_TIME);
+	printf("  resolution  passes  last spp per pass  mean pass (ms)  max pass (ms)  M samples/s\n");
+	for (int r = 0; r < numRes; ++r)
+	{
+		int		res		= resolution[r];
+		setBenchmarkCamera(&tracer, res, res);
+		AccumBuffer accum;
+		accum.resize(res, res);
+		CpuPassBudget budget;
+		budget.init(RAY_BENCHMARK_PASS_BUDGET);
+		double	elapsed	= 0.0;
+		double	maxPass	= 0.0;
+		int		numPass	= 0;
+		int		spp		= 0;
+		int		passSpp	= 0;
+		while (elapsed < RAY_BENCHMARK_PASS_TIME)
+		{
+			passSpp			= budget.getSampleCount(INT_MAX);
+			double passTime	= renderPass(tracer, &accum, spp, passSpp);
+			budget.addPass(passSpp, passTime * 1000.0);
+			elapsed			+= passTime;
+			maxPass			= passTime > maxPass ? passTime : maxPass;
+			spp				+= passSpp;
+			++numPass;
+		}
+		printf("  %4i x %4i  %6i  %17i  %14.2f  %13.2f  %11.3f\n", res, res, numPass, passSpp, elapsed * 1000.0 / numPass, maxPass * 1000.0,
+			(double)res * res * spp / elapsed / 1000000.0);
+	}
+	delete scene;
+}
+
+// camera of the simulated input, a small orbit around the default camera
+static CpuCamera	getSimulatedInputCamera(int inputIdx)
+{
+	float		angle	= inputIdx * 0.7f;
+	CpuCamera	camera;
+	camera.pos			= Vector3(0.278f + 0.05f * sinf(angle), 0.273f + 0.03f * cosf(angle), -0.800f);
+	camera.lookAt		= Vector3(0.278f, 0.273f, 0.0f);
+	camera.fovY			= DEGREE_TO_RADIAN(60.0f);
+	return camera;
+}
+
+// the input i is shown by the first frame rendered with input i or a later one, return the number of inputs shown by the frame
+static int	recordInputLatency(const double* inputTime, int frameInput, double displayTime, int* inOutNextShown, std::vector<double>* latency)
+{
+	int num = 0;
+	for (; *inOutNextShown <= frameInput; ++*inOutNextShown, ++num)
+		latency->push_back((displayTime - inputTime[*inOutNextShown]) * 1000.0);
+	return num;
+}
+
+static void	printLatency(const char* modeName, std::vector<double>* latency, int numFrame)
+{
+	std::sort(latency->begin(), latency->end());
+	double sum = 0.0;
+	for (int i = 0; i < (int)latency->size(); ++i)
+		sum += (*latency)[i];
+	int num = (int)latency->size();
+	printf("  %s  %6i  %9.2f  %8.2f  %8.2f  %8.2f\n", modeName, numFrame, sum / num, (*latency)[num / 2], (*latency)[(num * 9) / 10], (*latency)[num - 1]);
+}
+
+void	rayBenchmarkInputLatencyReport(const char* sceneName)
+{
+	Scene* scene = new Scene();
+	if (!scene->createByName(sceneName))
+	{
+		printf("unknown scene: %s\n", sceneName);
+		delete scene;
+		return;
+	}
+
+	// the same jittered input times are used by every mode
+	double			inputTime[RAY_BENCHMARK_INPUT_NUM];
+	unsigned int	randSeed	= 1;
+	double			time		= RAY_BENCHMARK_INPUT_INTERVAL;
+	for (int i = 0; i < RAY_BENCHMARK_INPUT_NUM; ++i)
+	{
+		inputTime[i]	= time;
+		time			+= RAY_BENCHMARK_INPUT_INTERVAL * (0.5 + randFloat(&randSeed));
+	}
+
+	printf("scene %s: %i threads, %i simulated camera moves %.0f ms apart on average, %ix%i tiles, input to display latency in ms\n",
+		sceneName, threadPoolGetShared()->getNumThread(), RAY_BENCHMARK_INPUT_NUM, RAY_BENCHMARK_INPUT_INTERVAL * 1000.0,
+		TILE_SCHEDULER_TILE_SIZE, TILE_SCHEDULER_TILE_SIZE);
+	const int numRes			= 2;
+	const int resolution[numRes]= { 128, 256 };
+	for (int r = 0; r < numRes; ++r)
+	{
+		int res = resolution[r];
+		printf("%i x %i\n", res, res);
+		printf("  mode                         frames       mean       p50       p90       max\n");
+
+		// synchronous loop as the viewer: the input is read at the start of a frame, then a full pass is rendered and displayed
+		{
+			CpuPathTracer tracer;
+			tracer.init(scene);
+			tracer.setCamera(getSimulatedInputCamera(-1), res, res);
+			AccumBuffer		accum;
+			accum.resize(res, res);
+			TileScheduler	scheduler;
+			scheduler.init(res, res);
+			std::vector<TileSchedulerTile>	tiles;
+			RayBenchmarkTileJob				job;
+			job.tracer		= &tracer;
+			job.accum		= &accum;
+			job.tiles		= &tiles;
+
+			std::vector<double>	latency;
+			LONGLONG	startTime	= timeGetAbsoulteTime();
+			int			nextShown	= 0;
+			int			frameInput	= -1;
+			int			numFrame	= 0;
+			while (nextShown < RAY_BENCHMARK_INPUT_NUM)
+			{
+				double	now			= timeGetElapsedTime(startTime);
+				int		latestInput	= frameInput;
+				while (latestInput + 1 < RAY_BENCHMARK_INPUT_NUM && inputTime[latestInput + 1] <= now)
+					++latestInput;
+				if (latestInput != frameInput)
+				{
+					frameInput = latestInput;
+					tracer.setCamera(getSimulatedInputCamera(frameInput), res, res);
+					accum.clear();
+					scheduler.init(res, res);
+				}
+				scheduler.buildPass(&tiles);
+				threadPoolGetShared()->parallelFor(renderScheduledTileJob, &job, (int)tiles.size());
+				++numFrame;
+				recordInputLatency(inputTime, frameInput, timeGetElapsedTime(startTime), &nextShown, &latency);
+			}
+			printLatency("synchronous loop          ", &latency, numFrame);
+		}
+
+		// the render thread picks up the camera between tiles and the display polls the finished frames
+		{
+			CpuRenderThread renderThread;
+			unsigned int	inputVersion[RAY_BENCHMARK_INPUT_NUM];
+			renderThread.start(scene, res, res, INT_MAX, getSimulatedInputCamera(-1));
+
+			std::vector<double>	latency;
+			std::vector<double>	restartDelay;
+			LONGLONG	startTime	= timeGetAbsoulteTime();
+			int			nextInput	= 0;
+			int			nextShown	= 0;
+			int			numFrame	= 0;
+			while (nextShown < RAY_BENCHMARK_INPUT_NUM)
+			{
+				double now = timeGetElapsedTime(startTime);
+				for (; nextInput < RAY_BENCHMARK_INPUT_NUM && inputTime[nextInput] <= now; ++nextInput)
+					inputVersion[nextInput] = renderThread.setCamera(getSimulatedInputCamera(nextInput));
+
+				const CpuRenderFrame* frame = renderThread.acquireFrame();
+				if (frame)
+				{
+					// the frame shows the last input with a version not newer than its camera
+					int frameInput = nextShown - 1;
+					while (frameInput + 1 < nextInput && inputVersion[frameInput + 1] <= frame->cameraVersion)
+						++frameInput;
+					++numFrame;
+					if (frame->samplePerPixel == 1 && frameInput >= 0 && inputVersion[frameInput] == frame->cameraVersion)
+						restartDelay.push_back(timeCalculateElapsedTime(timeGetClockFrequency(), frame->cameraPublishTime, frame->cameraAcquireTime) * 1000.0);
+					recordInputLatency(inputTime, frameInput, timeGetElapsedTime(startTime), &nextShown, &latency);
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(RAY_BENCHMARK_DISPLAY_POLL));
+			}
+			renderThread.stop();
+			printLatency("render thread             ", &latency, numFrame);
+			printLatency("  camera to render thread ", &restartDelay, (int)restartDelay.size());
+		}
+	}
+	delete scene;
+}
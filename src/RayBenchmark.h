@@ -0,0 +1,101 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include "Scene.h"
+
+// fixed ray sets for comparing acceleration structures on the same scene:
+// camera rays through every pixel, followed by 1 bounce cosine weighted diffuse rays from their hit points
+struct RayBenchmarkSet
+{
+	std::vector<Ray>	rays;
+	int					numPrimary;
+};
+
+void	rayBenchmarkCreateRaySet(const Scene& scene, int width, int height, RayBenchmarkSet* raySet);
+
+// return rays per second of Scene::rayCast() using the current scene.accel
+double	rayBenchmarkMeasure(const Scene& scene, const Ray* rays, int numRay, std::vector<RayHit>* hits);
+
+// number of rays whose closest hit differ
+int		rayBenchmarkCountMismatch(const std::vector<RayHit>& hitsA, const std::vector<RayHit>& hitsB);
+
+// print node memory and rays/s of the full precision binary BVH vs the quantized 4-wide BVH
+void	rayBenchmarkCompressedBvhReport(const char* sceneName);
+
+// print rays/s of BVH2, BVH4 and BVH8 with scalar and SIMD slab tests
+void	rayBenchmarkWideBvhReport(const char* sceneName);
+
+// print geometry bytes per triangle against the previous 32 byte per vertex layout, and CPU path tracing throughput
+void	rayBenchmarkGeometryReport(const char* sceneName);
+
+// print memory and trace throughput of a scene as loaded vs after meshOptimize()
+void	rayBenchmarkMeshOptimizeReport(const char* sceneName);
+
+// print build time, triangles/s and SAH cost of the parallel SAH and LBVH builds from 1 thread to all hardware threads,
+// with the trace throughput of each tree
+void	rayBenchmarkBvhBuildReport(const char* sceneName);
+
+// move an increasing number of meshes of the scene for a few frames, print the cost of Scene::updateAccel()
+// per frame against a full rebuild, and the SAH cost and trace throughput of both trees
+void	rayBenchmarkMeshAnimationReport(const char* sceneName);
+
+// print the cost of the runtime scene edits (material, area light, insert and remove a mesh) with the bytes to upload,
+// against re-creating the scene, and the SAH cost and trace throughput of the edited tree against a rebuilt one
+void	rayBenchmarkSceneEditReport(const char* sceneName);
+
+// print primary ray throughput of 8x8 ray packets with frustum culling against single ray traversal
+// of the binary BVH and the wide BVH, from 512 x 512 to 4K
+void	rayBenchmarkPacketReport(const char* sceneName);
+
+// print stack memory per ray and rays/s of the short stack and stackless traversal against the full stack traversal,
+// on the SAH and the deeper LBVH tree, with their mismatch against the brute force loop
+void	rayBenchmarkTraversalReport(const char* sceneName);
+
+// print the simulated L1 and L2 miss rates of the binary BVH traversal and its rays/s with and without prefetching,
+// for the nodes in build order, depth first and treelet layout
+void	rayBenchmarkNodeLayoutReport(const char* sceneName);
+
+// print build time, memory, SAH cost and rays/s of the plain SAH BVH against the SBVH with a few reference budgets,
+// followed by cornell_thin whose long and thin triangles are the case spatial splits are made for
+void	rayBenchmarkSpatialSplitReport(const char* sceneName);
+
+// print primitive count, geometry memory, SAH cost and rays/s of the scene with the Cornell box walls and blocks
+// stored as triangles and as analytic quads and boxes, followed by the plain cornell box whose analytic version has no triangle
+void	rayBenchmarkAnalyticPrimReport(const char* sceneName);
+
+// print RMSE at equal time of the CPU path tracer with area and solid angle sampling of the rect lights
+void	rayBenchmarkLightSamplingReport(const char* sceneName);
+
+// print RMSE at equal time of the CPU path tracer with the emissive triangles sampled as lights or only hit by chance
+void	rayBenchmarkEmissiveSamplingReport(const char* sceneName);
+
+// print the memory of the environment map alias table and RMSE at equal time of uniform sphere against importance sampling
+void	rayBenchmarkEnvMapSamplingReport(const char* sceneName);
+
+// print RMSE at equal time of the direct lighting from the emissive triangles with light sampling, RIS and ReSTIR
+void	rayBenchmarkRestirReport(const char* sceneName);
+
+// print the time to reach the error of the plain CPU path tracer with the radiance cache queried from the first or second bounce,
+// and the mean brightness against the reference to show the bias of the cache
+void	rayBenchmarkRadianceCacheReport(const char* sceneName);
+
+// print RMSE over time of the CPU path tracer with BRDF sampling and with path guiding learnt online
+void	rayBenchmarkPathGuidingReport(const char* sceneName);
+
+// print the time to reach the error of the CPU path tracer with the russian roulette by albedo, by throughput,
+// and the adjoint driven roulette and splitting, with the mean brightness against the reference
+void	rayBenchmarkPathTerminationReport(const char* sceneName);
+
+// print the time to reach the error inside a region of interest of the CPU path tracer with every tile sampled uniformly,
+// with the tiles near the region given more samples per pass, and with only the region rendered as a crop
+void	rayBenchmarkRegionOfInterestReport(const char* sceneName);
+
+// print the accumulation buffer traffic and samples/s of the CPU path tracer with N samples per pixel per pass at a few resolutions,
+// and the samples per pass chosen by CpuPassBudget for a frame time budget
+void	rayBenchmarkPassSampleCountReport(const char* sceneName);
+
+// print the latency from a simulated camera move to the display of the CPU path tracer rendering in a synchronous loop,
+// against rendering on CpuRenderThread, with the time for the camera to reach the render thread
+void	rayBenchmarkInputLatencyReport(const char* sceneName);
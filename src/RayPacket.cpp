@@ -0,0 +1,364 @@
+
+// all rights reserved
+
+#include "RayPacket.h"
+#include <immintrin.h>
+
+#define RAY_PACKET_GROUP		(RAY_PACKET_SIZE / 4)		// SSE lane groups
+#define RAY_PACKET_MIN_ACTIVE	(8)			// below this number of rays hitting a node, its subtree is traversed ray by ray
+#define RAY_PACKET_MIN_COS		(0.5f)		// the frustum corner directions must be within 60 degree of the center direction
+
+typedef unsigned long long	RayMask;		// 1 bit per ray
+
+// SoA rays padded to a full packet, and their hits during traversal
+struct alignas(16) RayPacketState
+{
+	float		dirX[RAY_PACKET_SIZE];
+	float		dirY[RAY_PACKET_SIZE];
+	float		dirZ[RAY_PACKET_SIZE];
+	float		invX[RAY_PACKET_SIZE];
+	float		invY[RAY_PACKET_SIZE];
+	float		invZ[RAY_PACKET_SIZE];
+	float		hitT[RAY_PACKET_SIZE];
+	float		hitU[RAY_PACKET_SIZE];
+	float		hitV[RAY_PACKET_SIZE];
+	int			hitTri[RAY_PACKET_SIZE];
+};
+
+static int	countRay(RayMask mask)
+{
+	int count = 0;
+	for (; mask != 0; mask &= mask - 1)
+		++count;
+	return count;
+}
+
+void	rayPacketInit(RayPacket* packet, const Vector3& pos)
+{
+	packet->pos			= pos;
+	packet->numRay		= 0;
+	packet->isCoherent	= false;
+}
+
+void	rayPacketAddRay(RayPacket* packet, const Vector3& dir)
+{
+	if (packet->numRay >= RAY_PACKET_SIZE)
+		return;
+	packet->dirX[packet->numRay] = dir.x;
+	packet->dirY[packet->numRay] = dir.y;
+	packet->dirZ[packet->numRay] = dir.z;
+	++packet->numRay;
+}
+
+void	rayPacketSetFrustum(RayPacket* packet, const Vector3* cornerDir)
+{
+	Vector3 center = cornerDir[0] + cornerDir[1] + cornerDir[2] + cornerDir[3];
+	center.normalize();
+	packet->isCoherent = true;
+	for (int i = 0; i < 4; ++i)
+	{
+		Vector3 corner = cornerDir[i];
+		corner.normalize();
+		if (corner.dot(center) < RAY_PACKET_MIN_COS)
+			packet->isCoherent = false;
+
+		Vector3 normal = cornerDir[i].cross(cornerDir[(i + 1) % 4]);
+		if (normal.dot(center) < 0.0f)
+			normal = normal * -1.0f;
+		packet->frustumNormal[i] = normal;
+	}
+}
+
+void	rayPacketResetStats(RayPacketStats* stats)
+{
+	stats->numNodeVisit			= 0;
+	stats->numNodeFrustumCulled	= 0;
+	stats->numSingleRayTrace	= 0;
+}
+
+static bool	isFrustumCulled(const RayPacket& packet, const BvhNode& node)
+{
+	// the box is outside if its corner furthest along the plane normal is still behind the plane
+	for (int i = 0; i < 4; ++i)
+	{
+		const Vector3&	n	= packet.frustumNormal[i];
+		Vector3			p	= Vector3(	n.x >= 0.0f ? node.boundMax.x : node.boundMin.x,
+										n.y >= 0.0f ? node.boundMax.y : node.boundMin.y,
+										n.z >= 0.0f ? node.boundMax.z : node.boundMin.z);
+		if (n.dot(p - packet.pos) < 0.0f)
+			return true;
+	}
+	return false;
+}
+
+// same slab test as rayAabbIntersect(), with the same NaN behavior of minf() / maxf(), return the rays hitting the box
+static RayMask	intersectBox(const RayPacketState& state, const RayPacket& packet, const BvhNode& node, RayMask mask)
+{
+	Vector3	lo			= node.boundMin - packet.pos;
+	Vector3	hi			= node.boundMax - packet.pos;
+	__m128	loX			= _mm_set1_ps(lo.x);
+	__m128	loY			= _mm_set1_ps(lo.y);
+	__m128	loZ			= _mm_set1_ps(lo.z);
+	__m128	hiX			= _mm_set1_ps(hi.x);
+	__m128	hiY			= _mm_set1_ps(hi.y);
+	__m128	hiZ			= _mm_set1_ps(hi.z);
+	__m128	zero		= _mm_setzero_ps();
+	__m128	farScale	= _mm_set1_ps(1.00000024f);
+	RayMask	hitMask		= 0;
+	for (int g = 0; g < RAY_PACKET_GROUP; ++g)
+	{
+		if (((mask >> (g * 4)) & 0xF) == 0)
+			continue;
+		__m128	invX	= _mm_load_ps(state.invX + g * 4);
+		__m128	invY	= _mm_load_ps(state.invY + g * 4);
+		__m128	invZ	= _mm_load_ps(state.invZ + g * 4);
+		__m128	tx0		= _mm_mul_ps(loX, invX);
+		__m128	tx1		= _mm_mul_ps(hiX, invX);
+		__m128	ty0		= _mm_mul_ps(loY, invY);
+		__m128	ty1		= _mm_mul_ps(hiY, invY);
+		__m128	tz0		= _mm_mul_ps(loZ, invZ);
+		__m128	tz1		= _mm_mul_ps(hiZ, invZ);
+		__m128	t0		= _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_min_ps(tz0, tz1));
+		__m128	t1		= _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_max_ps(tz0, tz1));
+		t1				= _mm_mul_ps(t1, farScale);
+		__m128	miss	= _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(t0, t1), _mm_cmplt_ps(t1, zero)), _mm_cmpgt_ps(t0, _mm_load_ps(state.hitT + g * 4)));
+		hitMask			|= (RayMask)(~_mm_movemask_ps(miss) & 0xF) << (g * 4);
+	}
+	return hitMask & mask;
+}
+
+// quads and boxes are intersected ray by ray
+static void	intersectAnalyticPrim(RayPacketState* state, const RayPacket& packet, const BvhGeometry& geometry, int prim, RayMask mask)
+{
+	for (int r = 0; r < RAY_PACKET_SIZE; ++r)
+	{
+		if ((mask & ((RayMask)1 << r)) == 0)
+			continue;
+		Ray		ray;
+		ray.pos			= packet.pos;
+		ray.dir			= Vector3(state->dirX[r], state->dirY[r], state->dirZ[r]);
+		float	u, v;
+		int		id;
+		float	t		= bvhIntersectPrim(geometry, prim, ray, &u, &v, &id);
+		if (t < 0 || !(t < state->hitT[r] || (t == state->hitT[r] && id < state->hitTri[r])))
+			continue;
+		state->hitT[r]	= t;
+		state->hitU[r]	= u;
+		state->hitV[r]	= v;
+		state->hitTri[r]= id;
+	}
+}
+
+// same arithmetic as rayTriIntersect() evaluated for 4 rays at once, the origin dependent terms are shared by the packet
+static void	intersectLeaf(RayPacketState* state, const RayPacket& packet, const Bvh& bvh, const BvhNode& node, RayMask mask)
+{
+	const BvhGeometry&	geometry	= bvh.m_geometry;
+	__m128				detEpsilon	= _mm_set1_ps(0.000000000001f);
+	__m128				epsilon		= _mm_set1_ps(0.00001f);
+	__m128				zero		= _mm_setzero_ps();
+	__m128				one			= _mm_set1_ps(1.0f);
+	for (int i = node.childOrPrimIdx; i < node.childOrPrimIdx + node.primCount; ++i)
+	{
+		int				tri		= bvh.m_primTri[i];
+		if (tri & RAY_PRIM_TYPE_MASK)
+		{
+			intersectAnalyticPrim(state, packet, geometry, tri, mask);
+			continue;
+		}
+		const int*		idx		= geometry.triIdx + tri * 3;
+		const Vector3&	v0		= geometry.triPos[idx[0]];
+		Vector3			edge1	= geometry.triPos[idx[1]] - v0;
+		Vector3			edge2	= geometry.triPos[idx[2]] - v0;
+		Vector3			s		= packet.pos - v0;
+		Vector3			q		= s.cross(edge1);
+		__m128			e1X		= _mm_set1_ps(edge1.x);
+		__m128			e1Y		= _mm_set1_ps(edge1.y);
+		__m128			e1Z		= _mm_set1_ps(edge1.z);
+		__m128			e2X		= _mm_set1_ps(edge2.x);
+		__m128			e2Y		= _mm_set1_ps(edge2.y);
+		__m128			e2Z		= _mm_set1_ps(edge2.z);
+		__m128			sX		= _mm_set1_ps(s.x);
+		__m128			sY		= _mm_set1_ps(s.y);
+		__m128			sZ		= _mm_set1_ps(s.z);
+		__m128			qX		= _mm_set1_ps(q.x);
+		__m128			qY		= _mm_set1_ps(q.y);
+		__m128			qZ		= _mm_set1_ps(q.z);
+		__m128			e2DotQ	= _mm_set1_ps(edge2.dot(q));
+		__m128i			triIdx	= _mm_set1_epi32(tri);
+		for (int g = 0; g < RAY_PACKET_GROUP; ++g)
+		{
+			int laneMask = (int)((mask >> (g * 4)) & 0xF);
+			if (laneMask == 0)
+				continue;
+			__m128	dX		= _mm_load_ps(state->dirX + g * 4);
+			__m128	dY		= _mm_load_ps(state->dirY + g * 4);
+			__m128	dZ		= _mm_load_ps(state->dirZ + g * 4);
+			__m128	hX		= _mm_sub_ps(_mm_mul_ps(dY, e2Z), _mm_mul_ps(dZ, e2Y));
+			__m128	hY		= _mm_sub_ps(_mm_mul_ps(dZ, e2X), _mm_mul_ps(dX, e2Z));
+			__m128	hZ		= _mm_sub_ps(_mm_mul_ps(dX, e2Y), _mm_mul_ps(dY, e2X));
+			__m128	a		= _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1X, hX), _mm_mul_ps(e1Y, hY)), _mm_mul_ps(e1Z, hZ));
+			__m128	f		= _mm_div_ps(one, a);
+			__m128	u		= _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, hX), _mm_mul_ps(sY, hY)), _mm_mul_ps(sZ, hZ)));
+			__m128	v		= _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dX, qX), _mm_mul_ps(dY, qY)), _mm_mul_ps(dZ, qZ)));
+			__m128	t		= _mm_mul_ps(f, e2DotQ);
+			__m128	hitT	= _mm_load_ps(state->hitT + g * 4);
+			__m128i	hitTri	= _mm_load_si128((const __m128i*)(state->hitTri + g * 4));
+			__m128	valid	= _mm_and_ps(_mm_cmpge_ps(a, detEpsilon), _mm_cmpgt_ps(t, epsilon));
+			valid			= _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+			valid			= _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+			__m128	closer	= _mm_or_ps(_mm_cmplt_ps(t, hitT), _mm_and_ps(_mm_cmpeq_ps(t, hitT), _mm_castsi128_ps(_mm_cmplt_epi32(triIdx, hitTri))));
+			int		update	= _mm_movemask_ps(_mm_and_ps(valid, closer)) & laneMask;
+			if (update == 0)
+				continue;
+
+			alignas(16) float laneT[4];
+			alignas(16) float laneU[4];
+			alignas(16) float laneV[4];
+			_mm_store_ps(laneT, t);
+			_mm_store_ps(laneU, u);
+			_mm_store_ps(laneV, v);
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				if ((update & (1 << lane)) == 0)
+					continue;
+				int r				= g * 4 + lane;
+				state->hitT[r]		= laneT[lane];
+				state->hitU[r]		= laneU[lane];
+				state->hitV[r]		= laneV[lane];
+				state->hitTri[r]	= tri;
+			}
+		}
+	}
+}
+
+// the remaining rays of a diverged packet continue with the single ray traversal
+static void	traceSingleRays(RayPacketState* state, const RayPacket& packet, const Bvh& bvh, int nodeIdx, RayMask mask)
+{
+	for (int r = 0; r < RAY_PACKET_SIZE; ++r)
+	{
+		if ((mask & ((RayMask)1 << r)) == 0)
+			continue;
+		Ray		ray;
+		RayHit	hit;
+		ray.pos			= packet.pos;
+		ray.dir			= Vector3(state->dirX[r], state->dirY[r], state->dirZ[r]);
+		resetRayHit(&hit);
+		hit.t			= state->hitT[r];
+		hit.u			= state->hitU[r];
+		hit.v			= state->hitV[r];
+		hit.triangle	= state->hitTri[r];
+		bvh.rayCastNode(ray, nodeIdx, &hit);
+		state->hitT[r]	= hit.t;
+		state->hitU[r]	= hit.u;
+		state->hitV[r]	= hit.v;
+		state->hitTri[r]= hit.triangle;
+	}
+}
+
+void	rayPacketCast(const Bvh& bvh, const RayPacket& packet, RayHit* hits, RayPacketStats* stats)
+{
+	int numRay = packet.numRay;
+	for (int i = 0; i < numRay; ++i)
+		resetRayHit(&hits[i]);
+	if (bvh.m_nodes.empty() || numRay == 0)
+		return;
+	// the packet stack holds at most 1 node per level, as Bvh::rayCastNode()
+	if (!packet.isCoherent || bvh.m_maxDepth > BVH_STACK_SIZE)
+	{
+		for (int i = 0; i < numRay; ++i)
+		{
+			Ray ray;
+			ray.pos	= packet.pos;
+			ray.dir	= Vector3(packet.dirX[i], packet.dirY[i], packet.dirZ[i]);
+			bvh.rayCast(ray, &hits[i]);
+		}
+		if (stats)
+			stats->numSingleRayTrace += numRay;
+		return;
+	}
+
+	// the unused lanes of a partial packet repeat the first ray, they are excluded by the ray mask
+	RayPacketState state;
+	for (int i = 0; i < RAY_PACKET_SIZE; ++i)
+	{
+		int r			= i < numRay ? i : 0;
+		state.dirX[i]	= packet.dirX[r];
+		state.dirY[i]	= packet.dirY[r];
+		state.dirZ[i]	= packet.dirZ[r];
+		state.invX[i]	= 1.0f / state.dirX[i];
+		state.invY[i]	= 1.0f / state.dirY[i];
+		state.invZ[i]	= 1.0f / state.dirZ[i];
+		state.hitT[i]	= RAY_MAX_T;
+		state.hitU[i]	= 0.0f;
+		state.hitV[i]	= 0.0f;
+		state.hitTri[i]	= 0x7fffffff;
+	}
+	Vector3	centerDir	= Vector3(packet.dirX[numRay / 2], packet.dirY[numRay / 2], packet.dirZ[numRay / 2]);
+
+	// every node on the stack carry the rays which hit its parent
+	int		stackNode[BVH_STACK_SIZE];
+	RayMask	stackMask[BVH_STACK_SIZE];
+	int		stackSize	= 1;
+	stackNode[0]		= 0;
+	stackMask[0]		= numRay == RAY_PACKET_SIZE ? ~(RayMask)0 : ((RayMask)1 << numRay) - 1;
+	long long	numNodeVisit			= 0;
+	long long	numNodeFrustumCulled	= 0;
+	long long	numSingleRayTrace		= 0;
+	while (stackSize > 0)
+	{
+		--stackSize;
+		int				nodeIdx	= stackNode[stackSize];
+		const BvhNode&	node	= bvh.m_nodes[nodeIdx];
+		++numNodeVisit;
+		if (isFrustumCulled(packet, node))
+		{
+			++numNodeFrustumCulled;
+			continue;
+		}
+		RayMask mask = intersectBox(state, packet, node, stackMask[stackSize]);
+		if (mask == 0)
+			continue;
+		if (countRay(mask) < RAY_PACKET_MIN_ACTIVE)
+		{
+			traceSingleRays(&state, packet, bvh, nodeIdx, mask);
+			++numSingleRayTrace;
+			continue;
+		}
+		if (node.primCount > 0)
+		{
+			intersectLeaf(&state, packet, bvh, node, mask);
+			continue;
+		}
+
+		// push the far child first, ordered along the center ray
+		int				childIdx	= node.childOrPrimIdx;
+		const BvhNode*	child		= &bvh.m_nodes[childIdx];
+		float			dist0		= centerDir.dot(child[0].boundMin + child[0].boundMax);
+		float			dist1		= centerDir.dot(child[1].boundMin + child[1].boundMax);
+		bool			isNear0		= dist0 <= dist1;
+		stackNode[stackSize	   ]	= isNear0 ? childIdx + 1 : childIdx;
+		stackNode[stackSize + 1]	= isNear0 ? childIdx : childIdx + 1;
+		stackMask[stackSize	   ]	= mask;
+		stackMask[stackSize + 1]	= mask;
+		stackSize += 2;
+	}
+	if (stats)
+	{
+		stats->numNodeVisit			+= numNodeVisit;
+		stats->numNodeFrustumCulled	+= numNodeFrustumCulled;
+		stats->numSingleRayTrace	+= numSingleRayTrace;
+	}
+
+	const BvhGeometry& geometry = bvh.m_geometry;
+	for (int i = 0; i < numRay; ++i)
+	{
+		int tri = state.hitTri[i];
+		if (state.hitT[i] == RAY_MAX_T)
+			continue;
+		RayHit& hit		= hits[i];
+		hit.t			= state.hitT[i];
+		hit.u			= state.hitU[i];
+		hit.v			= state.hitV[i];
+		bvhSetPrimHit(geometry, tri, &hit);
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// all rights reserved
+
+#include "Bvh.h"
+
+#define RAY_PACKET_WIDTH		(8)			// a packet cover a RAY_PACKET_WIDTH x RAY_PACKET_WIDTH pixel block
+#define RAY_PACKET_SIZE			(RAY_PACKET_WIDTH * RAY_PACKET_WIDTH)
+
+// camera rays of a pixel block, all rays share the same origin and are stored in SoA layout,
+// so 4 rays are slab tested and triangle tested with one SSE instruction
+struct RayPacket
+{
+	float		dirX[RAY_PACKET_SIZE];
+	float		dirY[RAY_PACKET_SIZE];
+	float		dirZ[RAY_PACKET_SIZE];
+	Vector3		pos;
+	int			numRay;
+	Vector3		frustumNormal[4];		// side planes through pos enclosing all rays, pointing inwards
+	bool		isCoherent;				// false if the frustum is too wide, then the rays are traced one by one
+};
+
+struct RayPacketStats
+{
+	long long	numNodeVisit;
+	long long	numNodeFrustumCulled;	// whole packet culled by the frustum without any slab test
+	long long	numSingleRayTrace;		// subtree traversed by a single ray after the packet diverge
+};
+
+void	rayPacketInit(RayPacket* packet, const Vector3& pos);
+void	rayPacketAddRay(RayPacket* packet, const Vector3& dir);
+void	rayPacketSetFrustum(RayPacket* packet, const Vector3* cornerDir);		// 4 directions enclosing all rays, in winding order
+void	rayPacketResetStats(RayPacketStats* stats);
+
+// closest hit of every ray in the packet with the binary Bvh, same result as Bvh::rayCast() on each ray, stats can be NULL
+void	rayPacketCast(const Bvh& bvh, const RayPacket& packet, RayHit* hits, RayPacketStats* stats);
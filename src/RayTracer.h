@@ -1,121 +1,212 @@
-#pragma once
-
-// by simon yeung, 06/05/2018
-// all rights reserved
-
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-#include <d3d12.h>
-#include "math.h"
-
-#define FRAME_CNT		(2)
-
-enum Key
-{
-	Key_CamForward,
-	Key_CamBackward,
-	Key_CamLeft,
-	Key_CamRight,
-	Key_CamUp,
-	Key_CamDown,
-	
-	Key_Num
-};
-
-class RayTracer
-{
-private:
-	struct BufferResource
-	{
-		ID3D12Resource*	resourceDefault;
-		ID3D12Resource*	resourceUpload;
-	};
-
-	BufferResource				createBufferResource(int sizeByte, LPCWSTR debugName);
-	void						createBufferSRV(ID3D12Resource* res, int descriptorHeapOffset, int numElements, int structSzByte);
-	ID3D12PipelineState*		createPipelineState(LPCSTR vs, LPCSTR ps, LPCWSTR debugName, bool isBlendEnable, D3D12_BLEND destBlend, DXGI_FORMAT rtvFormat);
-	
-	void						waitForGpu();
-	void						moveToNextFrame();
-
-	void						createRTV();
-	void						createPathTraceTex();
-	void						updateViewConstantBuffer();
-	void						resetCamera();
-
-	void						allocaConsole();
-
-public:
-	HWND						m_hwnd;
-	ID3D12Device*				m_device;
-	ID3D12CommandQueue*			m_commandQueue;
-	ID3D12CommandQueue*			m_copyQueue;
-	struct IDXGISwapChain3*		m_swapChain;
-	ID3D12DescriptorHeap*		m_rtvHeap;
-	ID3D12DescriptorHeap*		m_cbSrvHeap;
-	UINT						m_rtvDescriptorSize;
-	UINT						m_cbSrvDescriptorSize;
-	int							m_currentCbIdx;
-	UINT						m_frameIndex;
-	ID3D12Resource*				m_renderTargets[FRAME_CNT];
-	ID3D12CommandAllocator*		m_commandAllocators[FRAME_CNT];
-	ID3D12CommandAllocator*		m_copyCommandAllocator;
-	ID3D12RootSignature*		m_rootSignature;
-	ID3D12GraphicsCommandList*	m_commandList;
-	ID3D12GraphicsCommandList*	m_copyCommandList;
-	ID3D12Resource*				m_vertexBuffer;
-	ID3D12Resource*				m_constantBuffer;
-	ID3D12Resource*				m_pathTraceTex;
-
-	ID3D12Resource*				m_scene_bufferTriPos;
-	ID3D12Resource*				m_scene_bufferTriNor;
-	ID3D12Resource*				m_scene_bufferTriIdx;
-	ID3D12Resource*				m_scene_bufferMeshMaterial;
-	ID3D12Resource*				m_scene_bufferMeshIdxRange;
-
-	D3D12_VERTEX_BUFFER_VIEW	m_vertexBufferView;
-	ID3D12PipelineState*		m_pipelineStateToneMap;
-	ID3D12PipelineState*		m_pipelineStatePathTrace;
-
-	int							m_pathTraceFrameIdx;	// for averaging the result
-
-	int							m_constantBufferOffset[FRAME_CNT + 1];
-
-	// Synchronization objects.
-	ID3D12Fence*				m_fence;
-	UINT64						m_fenceValues[FRAME_CNT];
-	HANDLE						m_fenceEvent;
-
-	int							m_windowWidth;
-	int							m_windowHeight;
-	
-	int2						m_windowPos;
-	int2						m_mousePos;
-	
-	Vector3						m_camPos;
-	Vector3						m_camLookAt;
-	Vector2						m_camJitter;
-	int							m_randSeedOffset;
-	int							m_randSeedInterval;
-	int							m_randSeedAdd;
-	bool						m_isFirstFrame;
-	bool						m_isEnableBlur;
-
-	bool						m_isKeyDown[Key_Num];
-	bool						m_isMouseDown;
-
-	void	init(int windowWidth, int windowHeight);
-	void	release();
-
-	void	update();
-	void	render();
-
-	void	onKeyUp(UINT8 key);
-	void	onKeyDown(UINT8 key);
-	
-	void	onMouseUp();
-	void	onMouseDown();
-
-	void	setWindowPos(int x, int y);
-	void	resize(int w, int h);
-};
+#pragma once
+
+// by simon yeung, 06/05/2018
+// all rights reserved
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <d3d12.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "math.h"
+#include "Scene.h"
+#include "CpuRenderThread.h"
+
+#define FRAME_CNT		(2)
+
+enum Key
+{
+	Key_CamForward,
+	Key_CamBackward,
+	Key_CamLeft,
+	Key_CamRight,
+	Key_CamUp,
+	Key_CamDown,
+	
+	Key_Num
+};
+
+// key presses applied by the render thread, counted in RayTracerView
+enum ViewAction
+{
+	ViewAction_ToggleBlur,
+	ViewAction_ToggleDynamicRes,
+	ViewAction_ToggleMaterial,
+	ViewAction_MoveLight,
+
+	ViewAction_Num
+};
+
+// snapshot of the input published by the message thread to the render thread
+struct RayTracerView
+{
+	Vector3			camPos;
+	Vector3			camLookAt;
+	unsigned int	cameraVersion;					// incremented every time the camera moves or is reset
+	bool			isCamDriven;					// a move key is held or the mouse is down, so the camera keeps moving between the snapshots
+	int				actionCount[ViewAction_Num];	// key presses so far, the render thread applies the ones since its previous snapshot
+	int				windowWidth;
+	int				windowHeight;
+	LONGLONG		publishTime;
+};
+
+class RayTracer
+{
+private:
+	struct BufferResource
+	{
+		ID3D12Resource*	resourceDefault;
+		ID3D12Resource*	resourceUpload;
+	};
+
+	BufferResource				createBufferResource(int sizeByte, LPCWSTR debugName);
+	void						createBufferSRV(ID3D12Resource* res, int descriptorHeapOffset, int numElements, int structSzByte);
+	ID3D12PipelineState*		createPipelineState(LPCSTR vs, LPCSTR ps, LPCWSTR debugName, bool isBlendEnable, D3D12_BLEND destBlend, DXGI_FORMAT rtvFormat);
+	
+	void						waitForGpu();
+	void						moveToNextFrame();
+
+	void						createRTV();
+	void						createPathTraceTex();
+	void						updateViewConstantBuffer();
+	void						updateSceneConstantBuffer();
+	void						uploadSceneChanges();		// copy the dirty ranges of m_scene to the scene buffers
+	void						resetCamera();
+	void						applyView(const RayTracerView& view);	// actions, window size and camera of a newly acquired snapshot
+	void						publishView();				// message thread, m_inputView to the render thread
+	void						renderThreadMain();
+	void						update();
+	void						render();
+	void						resize(int w, int h);
+	void						readGpuTimestamp();			// path trace pass time of the last frame rendered with m_frameIndex
+	void						updateRenderScale(bool isCamMoved);
+	void						updateFlyThrough();			// move the camera along the scripted path, print the report at the end
+	void						setFlyThroughRun(int run);
+
+	void						allocaConsole();
+
+public:
+	HWND						m_hwnd;
+	ID3D12Device*				m_device;
+	ID3D12CommandQueue*			m_commandQueue;
+	ID3D12CommandQueue*			m_copyQueue;
+	struct IDXGISwapChain3*		m_swapChain;
+	ID3D12DescriptorHeap*		m_rtvHeap;
+	ID3D12DescriptorHeap*		m_cbSrvHeap;
+	UINT						m_rtvDescriptorSize;
+	UINT						m_cbSrvDescriptorSize;
+	int							m_currentCbIdx;
+	UINT						m_frameIndex;
+	ID3D12Resource*				m_renderTargets[FRAME_CNT];
+	ID3D12CommandAllocator*		m_commandAllocators[FRAME_CNT];
+	ID3D12CommandAllocator*		m_copyCommandAllocator;
+	ID3D12RootSignature*		m_rootSignature;
+	ID3D12GraphicsCommandList*	m_commandList;
+	ID3D12GraphicsCommandList*	m_copyCommandList;
+	ID3D12Resource*				m_vertexBuffer;
+	ID3D12Resource*				m_constantBuffer;
+	ID3D12Resource*				m_pathTraceTex;
+
+	ID3D12Resource*				m_scene_bufferTriPos;
+	ID3D12Resource*				m_scene_bufferTriNor;
+	ID3D12Resource*				m_scene_bufferTriIdx;
+	ID3D12Resource*				m_scene_bufferMeshMaterial;
+	ID3D12Resource*				m_scene_bufferMeshIdxRange;
+	ID3D12Resource*				m_scene_bufferMeshFlag;
+	ID3D12Resource*				m_scene_bufferQuad;
+	ID3D12Resource*				m_scene_bufferBox;
+	ID3D12Resource*				m_scene_bufferEmissiveTri;
+	ID3D12Resource*				m_scene_bufferEmissiveTable;
+	ID3D12Resource*				m_scene_bufferEnvMapPixel;
+	ID3D12Resource*				m_scene_bufferEnvMapTable;
+	ID3D12Resource*				m_scene_bufferUpload[SceneBuffer_Num];		// kept for uploading the runtime scene edits
+	Scene						m_scene;
+
+	D3D12_VERTEX_BUFFER_VIEW	m_vertexBufferView;
+	ID3D12PipelineState*		m_pipelineStateToneMap;
+	ID3D12PipelineState*		m_pipelineStatePathTrace;
+	ID3D12QueryHeap*			m_timestampHeap;		// begin and end of the path trace pass of each frame
+	ID3D12Resource*				m_timestampReadback;
+	UINT64						m_timestampFreq;
+	bool						m_isTimestampResolved[FRAME_CNT];	// a resolve of the slot is recorded and not read back yet
+
+	int							m_pathTraceFrameIdx;	// for averaging the result
+
+	// dynamic resolution: while the camera moves, the path trace pass renders to the top left of m_pathTraceTex at a lower
+	// resolution and path depth to stay within the frame time budget, the tone map pass upsamples it to the window.
+	// The accumulation restarts at full resolution when the camera stops. The resolution and the depth are toggled separately
+	bool						m_isDynamicResEnabled;
+	bool						m_isNavigationDepthEnabled;	// limit the path depth to TRACE_DEPTH_NAVIGATION while the camera moves
+	bool						m_isNavigating;			// the last frame is rendered with the navigation settings
+	float						m_frameTimeBudget;		// in ms, of the path trace pass
+	float						m_renderScale;			// of each axis, 1 when the camera is still
+	float						m_pixelTimeAvg;			// in ms, smoothed path trace pass time at render scale 1
+	float						m_frameRenderScale[FRAME_CNT];	// render scale of the frame in flight, 0 if it is not timed
+	float						m_gpuFrameTime;			// in ms, path trace pass of the latest completed frame
+	int							m_traceDepth;
+	int							m_renderWidth;
+	int							m_renderHeight;
+
+	// scripted fly-through, run at full resolution and depth, at full resolution with the navigation depth and
+	// with both the dynamic resolution and the navigation depth, so the gain of each is reported separately
+	int							m_flyThroughFrameIdx;	// -1 if not running
+	int							m_flyThroughRun;
+	std::vector<float>			m_flyThroughTime[3];	// in ms, path trace pass time of each frame of each run
+	std::vector<float>			m_flyThroughScale;		// render scale of each frame of the dynamic resolution run
+
+	int							m_constantBufferOffset[FRAME_CNT + 1];
+
+	// Synchronization objects.
+	ID3D12Fence*				m_fence;
+	UINT64						m_fenceValues[FRAME_CNT];
+	HANDLE						m_fenceEvent;
+
+	int							m_windowWidth;
+	int							m_windowHeight;
+	
+	int2						m_windowPos;
+	int2						m_mousePos;
+	
+	Vector3						m_camPos;				// render thread, from m_view or the fly-through
+	Vector3						m_camLookAt;
+	Vector2						m_camJitter;
+	int							m_randSeedOffset;
+	int							m_randSeedInterval;
+	int							m_randSeedAdd;
+	bool						m_isFirstFrame;
+	bool						m_isEnableBlur;
+
+	bool						m_isKeyDown[Key_Num];
+	bool						m_isMouseDown;
+
+	// the message thread only handles the input and publishes it as a RayTracerView snapshot, update() and render() run on
+	// the render thread, which applies the latest snapshot at the start of each frame, so a slow frame never delays the input
+	RayTracerView				m_inputView;			// message thread, the latest input
+	LONGLONG					m_inputTime;			// message thread, of the previous updateInput()
+	RayTracerView				m_viewSlots[3];
+	TripleBuffer				m_viewBuffer;
+	RayTracerView				m_view;					// render thread, the snapshot in use
+	std::thread					m_renderThread;
+	std::atomic<bool>			m_isRenderThreadQuit;
+
+	void	init(int windowWidth, int windowHeight);
+	void	release();
+
+	void	startRenderThread();
+	void	stopRenderThread();
+
+	// message thread
+	void	updateInput();			// move the camera by the held keys and the mouse drag since the previous call, publish it if moved
+
+	void	onKeyUp(UINT8 key);
+	void	onKeyDown(UINT8 key);
+	
+	void	onMouseUp();
+	void	onMouseDown();
+
+	void	setWindowPos(int x, int y);
+	void	setWindowSize(int w, int h);
+
+	void	startFlyThrough();
+};
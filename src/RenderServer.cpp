@@ -0,0 +1,419 @@
+
+// all rights reserved
+
+#include "RenderServer.h"
+#include "Socket.h"
+#include "Process.h"
+#include "Timer.h"
+#include "ThreadPool.h"
+#include <stdio.h>
+#include <string.h>
+
+#define RENDER_SERVER_ROWS_PER_POLL		(16)	// check for cancel after each thread traced this number of rows
+#define RENDER_SERVER_PASS_BUDGET_MS	(33.0f)	// time of each pass when the job has no progress interval
+
+enum RenderJobResult
+{
+	RenderJobResult_Completed,
+	RenderJobResult_Cancelled,
+	RenderJobResult_Shutdown,
+	RenderJobResult_Disconnected,
+};
+
+// resident scene, kept alive across jobs
+struct RenderServerScene
+{
+	char			name[RENDER_SERVER_SCENE_NAME_MAX];
+	Scene			scene;
+	float			loadMs;
+};
+
+struct RenderServer
+{
+	std::vector<RenderServerScene*>	sceneCache;
+	std::vector<float>				resolveBuffer;
+	RenderServerJobMsg				pendingJob;
+	bool							hasPendingJob;
+};
+
+static RenderServerScene*	findOrLoadScene(RenderServer* server, const char* name, bool* isCached)
+{
+	for(int i=0; i<(int)server->sceneCache.size(); ++i)
+		if (strcmp(server->sceneCache[i]->name, name) == 0)
+		{
+			*isCached = true;
+			return server->sceneCache[i];
+		}
+
+	*isCached = false;
+	LONGLONG			startTime	= timeGetAbsoulteTime();
+	RenderServerScene*	scene		= new RenderServerScene();
+	if (!scene->scene.createByName(name))
+	{
+		delete scene;
+		return nullptr;
+	}
+	strncpy_s(scene->name, sizeof(scene->name), name, _TRUNCATE);
+	scene->loadMs = (float)(timeGetElapsedTime(startTime) * 1000.0);
+	server->sceneCache.push_back(scene);
+	return scene;
+}
+
+// rows of a pass traced on the thread pool, 1 row per job
+struct RenderServerRowJob
+{
+	const CpuPathTracer*	tracer;
+	AccumBuffer*			accum;
+	int						width;
+	int						rowStart;
+	int						sampleStart;
+	int						sampleCount;
+};
+
+static void	renderRowJob(void* userData, int jobIdx)
+{
+	RenderServerRowJob* job	= (RenderServerRowJob*)userData;
+	int					y	= job->rowStart + jobIdx;
+	job->tracer->renderTile(job->accum, 0, y, job->width, y + 1, job->sampleStart, job->sampleCount);
+}
+
+static bool	sendProgress(SOCKET client, RenderServer* server, const RenderServerJobMsg& job, const AccumBuffer& accum, int samplePerPixel, float elapsedMs)
+{
+	std::vector<float>& buffer = server->resolveBuffer;
+	buffer.resize((size_t)job.width * job.height * 3);
+	for(int y=0; y<job.height; ++y)
+		for(int x=0; x<job.width; ++x)
+		{
+			Vector3 c	= accum.getPixel(x, y);
+			size_t	idx	= ((size_t)y * job.width + x) * 3;
+			buffer[idx + 0] = c.x;
+			buffer[idx + 1] = c.y;
+			buffer[idx + 2] = c.z;
+		}
+
+	RenderServerProgressMsg msg;
+	msg.jobId			= job.jobId;
+	msg.samplePerPixel	= samplePerPixel;
+	msg.elapsedMs		= elapsedMs;
+	return socketSendMessage(client, RenderServerMsg_Progress, &msg, sizeof(msg), buffer.data(), (int)(buffer.size() * sizeof(float)));
+}
+
+// handle messages arrived while rendering, return true if the current job need to stop
+static bool	pollClient(SOCKET client, RenderServer* server, int currentJobId, RenderJobResult* result)
+{
+	std::vector<char>	payload;
+	int					msgType;
+	while (socketWaitReadable(client, 0))
+	{
+		if (!socketRecvMessage(client, &msgType, &payload))
+		{
+			*result = RenderJobResult_Disconnected;
+			return true;
+		}
+
+		if (msgType == RenderServerMsg_Cancel && payload.size() == sizeof(int) && *(const int*)payload.data() == currentJobId)
+		{
+			*result = RenderJobResult_Cancelled;
+			return true;
+		}
+		else if (msgType == RenderServerMsg_Job && payload.size() == sizeof(RenderServerJobMsg))
+		{
+			// a new job replace the current one, e.g. the camera moved
+			server->pendingJob		= *(const RenderServerJobMsg*)payload.data();
+			server->hasPendingJob	= true;
+			*result = RenderJobResult_Cancelled;
+			return true;
+		}
+		else if (msgType == RenderServerMsg_Shutdown)
+		{
+			*result = RenderJobResult_Shutdown;
+			return true;
+		}
+	}
+	return false;
+}
+
+// the job comes from any local client, reject it before anything is allocated for it
+static bool	isJobValid(const RenderServerJobMsg& job)
+{
+	return	job.width			> 0 && job.width			<= RENDER_SERVER_RESOLUTION_MAX	&&
+			job.height			> 0 && job.height			<= RENDER_SERVER_RESOLUTION_MAX	&&
+			job.samplePerPixel	> 0 && job.samplePerPixel	<= RENDER_SERVER_SPP_MAX;
+}
+
+static RenderJobResult	runJob(SOCKET client, RenderServer* server, const RenderServerJobMsg& job)
+{
+	LONGLONG			startTime	= timeGetAbsoulteTime();
+	bool				isValid		= isJobValid(job);
+	bool				isCached	= false;
+	RenderServerScene*	scene		= isValid ? findOrLoadScene(server, job.sceneName, &isCached) : nullptr;
+
+	RenderServerDoneMsg done;
+	done.jobId			= job.jobId;
+	done.samplePerPixel	= 0;
+	done.isCancelled	= 0;
+	done.isSceneCached	= isCached ? 1 : 0;
+	done.sceneLoadMs	= isCached ? 0.0f : (scene ? scene->loadMs : 0.0f);
+	done.renderMs		= 0.0f;
+	if (!scene)
+	{
+		done.isCancelled = 1;
+		return socketSendMessage(client, RenderServerMsg_Done, &done, sizeof(done)) ? RenderJobResult_Cancelled : RenderJobResult_Disconnected;
+	}
+
+	CpuCamera camera;
+	camera.pos		= job.camPos;
+	camera.lookAt	= job.camLookAt;
+	camera.fovY		= job.fovY;
+
+	CpuPathTracer	tracer;
+	AccumBuffer		accum;
+	tracer.init(&scene->scene);
+	tracer.setCamera(camera, job.width, job.height);
+	accum.resize(job.width, job.height);
+
+	// each pass takes as many samples per pixel as fit in the progress interval, the first pass takes 1 sample to show a result early
+	float			passBudgetMs	= job.progressIntervalMs > 0 ? (float)job.progressIntervalMs : RENDER_SERVER_PASS_BUDGET_MS;
+	CpuPassBudget	passBudget;
+	passBudget.init(passBudgetMs);
+
+	ThreadPool*			pool		= threadPoolGetShared();
+	int					rowsPerPoll	= RENDER_SERVER_ROWS_PER_POLL * pool->getNumThread();
+	RenderServerRowJob	rowJob;
+	rowJob.tracer					= &tracer;
+	rowJob.accum					= &accum;
+	rowJob.width					= job.width;
+
+	RenderJobResult	result			= RenderJobResult_Completed;
+	LONGLONG		renderStartTime	= timeGetAbsoulteTime();
+	float			elapsedMs		= 0.0f;
+	float			lastProgressMs	= 0.0f;
+	int				spp				= 0;
+	bool			isStopped		= false;
+	while (spp < job.samplePerPixel && !isStopped)
+	{
+		if (job.timeBudgetMs > 0)
+			passBudget.budgetMs = minf(passBudgetMs, job.timeBudgetMs - elapsedMs);
+		int			passSpp			= passBudget.getSampleCount(job.samplePerPixel - spp);
+		LONGLONG	passStartTime	= timeGetAbsoulteTime();
+		rowJob.sampleStart		= spp;
+		rowJob.sampleCount		= passSpp;
+		for(int y= 0; y<job.height; y+= rowsPerPoll)
+		{
+			rowJob.rowStart		= y;
+			pool->parallelFor(renderRowJob, &rowJob, min(rowsPerPoll, job.height - y));
+			if (pollClient(client, server, job.jobId, &result))
+			{
+				isStopped = true;
+				break;
+			}
+		}
+		if (isStopped)
+			break;
+		passBudget.addPass(passSpp, timeGetElapsedTime(passStartTime) * 1000.0);
+		bool	isFirstPass		= spp == 0;
+		spp						+= passSpp;
+
+		elapsedMs				= (float)(timeGetElapsedTime(renderStartTime) * 1000.0);
+		bool	isOutOfTime		= job.timeBudgetMs > 0 && elapsedMs >= job.timeBudgetMs;
+		bool	isLastPass		= isOutOfTime || spp == job.samplePerPixel;
+		if (isFirstPass || isLastPass || elapsedMs - lastProgressMs >= job.progressIntervalMs)
+		{
+			if (!sendProgress(client, server, job, accum, spp, elapsedMs))
+				return RenderJobResult_Disconnected;
+			lastProgressMs = elapsedMs;
+		}
+		if (isOutOfTime)
+			break;
+	}
+
+	if (result == RenderJobResult_Disconnected)
+		return result;
+
+	done.samplePerPixel	= spp;
+	done.isCancelled	= result != RenderJobResult_Completed ? 1 : 0;
+	done.renderMs		= (float)(timeGetElapsedTime(startTime) * 1000.0);
+	if (!socketSendMessage(client, RenderServerMsg_Done, &done, sizeof(done)))
+		return RenderJobResult_Disconnected;
+	return result;
+}
+
+int		renderServerRun(int port)
+{
+	if (!socketStartup())
+		return 1;
+
+	SOCKET listenSocket = socketListenLocalhost(port);
+	if (listenSocket == INVALID_SOCKET)
+	{
+		socketCleanup();
+		return 1;
+	}
+	printf("render server listening on port %i\n", socketGetPort(listenSocket));
+
+	RenderServer		server;
+	std::vector<char>	payload;
+	bool				isShutdown		= false;
+	server.hasPendingJob= false;
+	while (!isShutdown)
+	{
+		SOCKET client = socketAccept(listenSocket);
+		if (client == INVALID_SOCKET)
+			break;
+
+		bool isConnected = true;
+		while (isConnected && !isShutdown)
+		{
+			if (!server.hasPendingJob)
+			{
+				int msgType;
+				if (!socketRecvMessage(client, &msgType, &payload))
+					break;
+
+				if (msgType == RenderServerMsg_Job && payload.size() == sizeof(RenderServerJobMsg))
+				{
+					server.pendingJob		= *(const RenderServerJobMsg*)payload.data();
+					server.hasPendingJob	= true;
+				}
+				else if (msgType == RenderServerMsg_Shutdown)
+					isShutdown = true;
+				continue;	// a cancel without running job is ignored
+			}
+
+			RenderServerJobMsg job = server.pendingJob;
+			job.sceneName[RENDER_SERVER_SCENE_NAME_MAX - 1] = 0;
+			server.hasPendingJob = false;
+
+			RenderJobResult result = runJob(client, &server, job);
+			printf("job %i (%s) %s\n", job.jobId, job.sceneName, result == RenderJobResult_Completed ? "completed" : "stopped");
+			if (result == RenderJobResult_Shutdown)
+				isShutdown = true;
+			else if (result == RenderJobResult_Disconnected)
+				isConnected = false;
+		}
+		server.hasPendingJob = false;
+		socketClose(client);
+	}
+
+	for(int i=0; i<(int)server.sceneCache.size(); ++i)
+		delete server.sceneCache[i];
+	socketClose(listenSocket);
+	socketCleanup();
+	return 0;
+}
+
+// client side, run a job and wait until it is done
+static bool	runClientJob(SOCKET s, const RenderServerJobMsg& job, bool isCancelAfterFirstResult, double* firstResultMs, double* totalMs, double* cancelMs, RenderServerDoneMsg* done)
+{
+	std::vector<char>	payload;
+	int					msgType;
+	LONGLONG			startTime	= timeGetAbsoulteTime();
+	LONGLONG			cancelTime	= 0;
+	*firstResultMs	= -1.0;
+	*cancelMs		= -1.0;
+	if (!socketSendMessage(s, RenderServerMsg_Job, &job, sizeof(job)))
+		return false;
+
+	while (socketRecvMessage(s, &msgType, &payload))
+	{
+		if (msgType == RenderServerMsg_Progress)
+		{
+			if (*firstResultMs < 0.0)
+				*firstResultMs = timeGetElapsedTime(startTime) * 1000.0;
+			if (isCancelAfterFirstResult && cancelTime == 0)
+			{
+				cancelTime = timeGetAbsoulteTime();
+				if (!socketSendMessage(s, RenderServerMsg_Cancel, &job.jobId, sizeof(int)))
+					return false;
+			}
+		}
+		else if (msgType == RenderServerMsg_Done && payload.size() == sizeof(RenderServerDoneMsg))
+		{
+			*done		= *(const RenderServerDoneMsg*)payload.data();
+			*totalMs	= timeGetElapsedTime(startTime) * 1000.0;
+			if (cancelTime != 0)
+				*cancelMs = timeGetElapsedTime(cancelTime) * 1000.0;
+			return true;
+		}
+	}
+	return false;
+}
+
+void	renderServerLatencyReport(int port)
+{
+	printf("------------  Render server latency  ------------\n");
+	if (!socketStartup())
+		return;
+
+	char args[64];
+	char logFileName[64];
+	sprintf_s(args, sizeof(args), "-server %i", port);
+	sprintf_s(logFileName, sizeof(logFileName), "render_server_%u.log", (unsigned int)GetCurrentProcessId());
+	LONGLONG	spawnTime	= timeGetAbsoulteTime();
+	HANDLE		process		= processSpawnSelf(args, logFileName);
+	if (!process)
+	{
+		printf("failed to start render server\n");
+		socketCleanup();
+		return;
+	}
+
+	// wait for the server to start listening
+	SOCKET s = INVALID_SOCKET;
+	for(int retry= 0; retry<100 && s == INVALID_SOCKET; ++retry)
+	{
+		s = socketConnectLocalhost(port);
+		if (s == INVALID_SOCKET)
+			Sleep(50);
+	}
+	double startUpMs = timeGetElapsedTime(spawnTime) * 1000.0;
+	if (s == INVALID_SOCKET)
+	{
+		printf("failed to connect to render server\n");
+		processWaitAndClose(process, 0);
+		processForwardLog(logFileName, "[server] ");
+		socketCleanup();
+		return;
+	}
+	printf("server process start up: %.2f ms\n", startUpMs);
+	printf("job | scene  | scene load (ms) | first result (ms) | total (ms) | spp\n");
+
+	RenderServerJobMsg job = {};
+	strncpy_s(job.sceneName, sizeof(job.sceneName), "cornell", _TRUNCATE);
+	job.camPos				= Vector3(0.278f, 0.273f, -0.800f);
+	job.camLookAt			= Vector3(0.278f, 0.273f, 0.0f);
+	job.fovY				= DEGREE_TO_RADIAN(60.0f);
+	job.width				= 128;
+	job.height				= 128;
+	job.samplePerPixel		= 16;
+	job.timeBudgetMs		= 0;
+	job.progressIntervalMs	= 100;
+
+	const int			numJob = 5;
+	RenderServerDoneMsg	done;
+	double				firstResultMs, totalMs, cancelMs;
+	double				coldFirstResultMs = 0.0;
+	for(int i=0; i<numJob; ++i)
+	{
+		job.jobId		= i;
+		job.camPos.x	= 0.278f + 0.01f * i;
+		if (!runClientJob(s, job, false, &firstResultMs, &totalMs, &cancelMs, &done))
+			break;
+		if (i == 0)
+			coldFirstResultMs = firstResultMs;
+		printf("%3i | %s | %15.2f | %17.2f | %10.2f | %i\n", i, done.isSceneCached ? "warm  " : "cold  ", done.sceneLoadMs, firstResultMs, totalMs, done.samplePerPixel);
+	}
+	printf("cold process + cold scene to first result: %.2f ms\n", startUpMs + coldFirstResultMs);
+
+	// cancel a long job after its first progressive result
+	job.jobId			= numJob;
+	job.samplePerPixel	= 1 << 20;
+	if (runClientJob(s, job, true, &firstResultMs, &totalMs, &cancelMs, &done))
+		printf("cancel: stopped after %i spp, %.2f ms from cancel request to done\n", done.samplePerPixel, cancelMs);
+
+	socketSendMessage(s, RenderServerMsg_Shutdown, nullptr, 0);
+	socketClose(s);
+	processWaitAndClose(process, 5000);
+	processForwardLog(logFileName, "[server] ");
+	socketCleanup();
+}
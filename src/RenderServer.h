@@ -0,0 +1,60 @@
+#pragma once
+
+// all rights reserved
+
+#include "CpuPathTracer.h"
+
+// Long-lived render server: scenes are loaded once and kept resident together with
+// their acceleration data, jobs are received over TCP on localhost and the progressive
+// result is streamed back until the sample count or the time budget is reached.
+// The rows of each pass are traced on the shared thread pool.
+// A new job or a cancel message stops the job currently rendering.
+#define RENDER_SERVER_DEFAULT_PORT		(27182)
+#define RENDER_SERVER_SCENE_NAME_MAX	(32)
+#define RENDER_SERVER_RESOLUTION_MAX	(4096)		// jobs with a larger width or height are rejected, the progress message must fit in 1 socket message
+#define RENDER_SERVER_SPP_MAX			(1 << 20)	// jobs with more samples per pixel are rejected
+
+enum RenderServerMsg
+{
+	RenderServerMsg_Job,			// client -> server, RenderServerJobMsg
+	RenderServerMsg_Cancel,			// client -> server, int jobId
+	RenderServerMsg_Shutdown,		// client -> server
+	RenderServerMsg_Progress,		// server -> client, RenderServerProgressMsg + width * height * float3 radiance
+	RenderServerMsg_Done,			// server -> client, RenderServerDoneMsg
+};
+
+struct RenderServerJobMsg
+{
+	int			jobId;
+	char		sceneName[RENDER_SERVER_SCENE_NAME_MAX];
+	Vector3		camPos;
+	Vector3		camLookAt;
+	float		fovY;
+	int			width;
+	int			height;
+	int			samplePerPixel;
+	int			timeBudgetMs;			// 0 == no limit
+	int			progressIntervalMs;		// minimum time between 2 progress messages
+};
+
+struct RenderServerProgressMsg
+{
+	int			jobId;
+	int			samplePerPixel;
+	float		elapsedMs;
+};
+
+struct RenderServerDoneMsg
+{
+	int			jobId;
+	int			samplePerPixel;
+	int			isCancelled;
+	int			isSceneCached;			// whether the scene was already resident when the job arrived
+	float		sceneLoadMs;
+	float		renderMs;
+};
+
+int		renderServerRun(int port);
+
+// spawn a server process and print the per job latency for cold and warm scenes, and the cancel latency
+void	renderServerLatencyReport(int port);
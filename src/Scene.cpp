@@ -0,0 +1,1069 @@
+
+// all rights reserved
+
+#include "Scene.h"
+#include "ThreadPool.h"
+#include <string.h>
+
+#define QUAD_MAX_SKEW		(0.0001f)	// relative to the edge length, for 2 triangles to be merged into a quad
+
+Scene::Scene()
+{
+	numLight= 0;
+	tallBlockMeshIdx		= -1;
+	accel	= SceneAccel_BruteForce;
+	bvhBuildMode			= BvhBuildMode_Sah;
+	isMeshOptimizeEnabled	= true;
+	isAnalyticPrimEnabled	= false;
+	isLightMeshEnabled		= false;
+	isEmissiveSamplingEnabled	= true;
+	clearDirty();
+}
+
+void	Scene::clear()
+{
+	triPos.clear();
+	triNor.clear();
+	triIdx.clear();
+	meshMaterial.clear();
+	meshIdxRange.clear();
+	meshFlag.clear();
+	tallBlockMeshIdx		= -1;
+	quads.clear();
+	boxes.clear();
+	emissiveTri.clear();
+	emissiveTable.clear();
+	numLight= 0;
+	triMeshIdx.clear();
+	meshVtxRange.clear();
+	bvhWide.clear();
+	bvhCompressed.clear();
+	bvh.clear();
+	accel	= SceneAccel_BruteForce;
+	bvhBuildMode			= BvhBuildMode_Sah;
+	clearDirty();
+	isConstantDirty			= true;
+}
+
+void	Scene::addMesh(const float* pos, const float* nor, int numVtx, const int* idx, int numIdx, Material material)
+{
+	int numVtxPrev = (int)triPos.size();
+	int numIdxPrev = (int)triIdx.size();
+	for(int i=0; i<numVtx; ++i)
+	{
+		int vtxIdx = i * 3;
+		triPos.push_back(Vector3(pos[vtxIdx + 0], pos[vtxIdx + 1], pos[vtxIdx + 2]));
+		triNor.push_back(encodeOctahedral(Vector3(nor[vtxIdx + 0], nor[vtxIdx + 1], nor[vtxIdx + 2])));
+	}
+	for (int i = 0; i<numIdx; ++i)
+		triIdx.push_back(idx[i] + numVtxPrev);
+	meshMaterial.push_back(material);
+
+	// flat shaded if every vertex normal is the face normal
+	bool isFlat = true;
+	for (int i = 0; i + 2 < numIdx && isFlat; i += 3)
+	{
+		const float*	p0			= pos + idx[i	 ] * 3;
+		const float*	p1			= pos + idx[i + 1] * 3;
+		const float*	p2			= pos + idx[i + 2] * 3;
+		Vector3			edge1		= Vector3(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+		Vector3			edge2		= Vector3(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+		Vector3			faceNormal	= edge1.cross(edge2);
+		faceNormal.normalize();
+		for (int j = 0; j < 3; ++j)
+		{
+			const float* n = nor + idx[i + j] * 3;
+			if (faceNormal.dot(Vector3(n[0], n[1], n[2])) < 0.999999f)
+				isFlat = false;
+		}
+	}
+	meshFlag.push_back(isFlat ? MESH_FLAG_FLAT : 0);
+
+	int2 meshRange = { numIdxPrev, numIdxPrev + numIdx };
+	meshIdxRange.push_back(meshRange);
+	int2 vtxRange = { numVtxPrev, numVtxPrev + numVtx };
+	meshVtxRange.push_back(vtxRange);
+
+	int numMesh = (int)meshIdxRange.size();
+	markDirty(SceneBuffer_TriPos		, numVtxPrev	, numVtxPrev + numVtx	);
+	markDirty(SceneBuffer_TriNor		, numVtxPrev	, numVtxPrev + numVtx	);
+	markDirty(SceneBuffer_TriIdx		, numIdxPrev	, numIdxPrev + numIdx	);
+	markDirty(SceneBuffer_MeshMaterial	, numMesh - 1	, numMesh				);
+	markDirty(SceneBuffer_MeshIdxRange	, numMesh - 1	, numMesh				);
+	markDirty(SceneBuffer_MeshFlag		, numMesh - 1	, numMesh				);
+	isConstantDirty = true;
+}
+
+void	Scene::addAreaLight(const Matrix4x4& xform, float width, float height, const Vector3& radiance)
+{
+	if (numLight >= MAX_LIGHT)
+		return;
+
+	AreaLight& light	= areaLight[numLight++];
+	light.xform			= xform;
+	light.xformInv		= xform.inverse();
+	light.radiance		= Vector4(radiance.x, radiance.y, radiance.z, 0.0f);
+	light.halfWidth		= width		* 0.5f;
+	light.halfHeight	= height	* 0.5f;
+	light.oneOverArea	= 1.0f/(width * height);
+	light.sampling		= AreaLightSampling_SolidAngle;
+	isConstantDirty		= true;
+}
+
+void	Scene::addMeshData(MeshData* mesh, Material material)
+{
+	if (isMeshOptimizeEnabled)
+	{
+		MeshOptimizeStats stats;
+		meshOptimize(mesh, &stats);
+	}
+	if (mesh->idx.empty())
+		return;
+	addMesh(&mesh->pos[0].x, &mesh->nor[0].x, (int)mesh->pos.size(), &mesh->idx[0], (int)mesh->idx.size(), material);
+}
+
+bool	Scene::addObjMesh(const char* fileName, const Vector3& center, float size, Material material)
+{
+	MeshData mesh;
+	if (!meshLoadObj(fileName, &mesh))
+		return false;
+	meshFitToBox(&mesh, center, size);
+	addMeshData(&mesh, material);
+	return true;
+}
+
+void	Scene::addSphere(const Vector3& center, float radius, int numSlice, int numStack, Material material)
+{
+	// the seam and pole vertices are duplicated, they are merged when the mesh is optimized
+	MeshData mesh;
+	for (int j = 0; j <= numStack; ++j)
+	{
+		float theta = PI * j / numStack;
+		for (int i = 0; i <= numSlice; ++i)
+		{
+			float	phi	= 2.0f * PI * i / numSlice;
+			Vector3	n	= Vector3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			mesh.pos.push_back(center + n * radius);
+			mesh.nor.push_back(n);
+		}
+	}
+	for (int j = 0; j < numStack; ++j)
+	{
+		for (int i = 0; i < numSlice; ++i)
+		{
+			int idx0 =  j		* (numSlice + 1) + i;
+			int idx1 =  j		* (numSlice + 1) + i + 1;
+			int idx2 = (j + 1)	* (numSlice + 1) + i + 1;
+			int idx3 = (j + 1)	* (numSlice + 1) + i;
+			if (j != 0)
+			{	// skip the degenerated triangle at the pole
+				mesh.idx.push_back(idx0);
+				mesh.idx.push_back(idx1);
+				mesh.idx.push_back(idx2);
+			}
+			if (j != numStack - 1)
+			{
+				mesh.idx.push_back(idx0);
+				mesh.idx.push_back(idx2);
+				mesh.idx.push_back(idx3);
+			}
+		}
+	}
+	addMeshData(&mesh, material);
+}
+
+// an analytic mesh only hold a material, its triangle and vertex range are empty
+static void	addAnalyticMesh(Scene* scene, Material material)
+{
+	int2 meshRange	= { (int)scene->triIdx.size(), (int)scene->triIdx.size() };
+	int2 vtxRange	= { (int)scene->triPos.size(), (int)scene->triPos.size() };
+	scene->meshMaterial.push_back(material);
+	scene->meshIdxRange.push_back(meshRange);
+	scene->meshVtxRange.push_back(vtxRange);
+	scene->meshFlag.push_back(MESH_FLAG_FLAT | MESH_FLAG_ANALYTIC);
+
+	int numMesh = (int)scene->meshIdxRange.size();
+	scene->markDirty(SceneBuffer_MeshMaterial	, numMesh - 1, numMesh);
+	scene->markDirty(SceneBuffer_MeshIdxRange	, numMesh - 1, numMesh);
+	scene->markDirty(SceneBuffer_MeshFlag		, numMesh - 1, numMesh);
+	scene->isConstantDirty = true;
+}
+
+void	Scene::addQuads(const QuadPrim* quad, int numQuad, Material material)
+{
+	int meshIdx		= (int)meshIdxRange.size();
+	int numQuadPrev	= (int)quads.size();
+	for (int i = 0; i < numQuad; ++i)
+	{
+		quads.push_back(quad[i]);
+		quads.back().meshIdx = meshIdx;
+	}
+	addAnalyticMesh(this, material);
+	markDirty(SceneBuffer_Quad, numQuadPrev, numQuadPrev + numQuad);
+}
+
+void	Scene::addBoxes(const BoxPrim* box, int numBox, Material material)
+{
+	int meshIdx		= (int)meshIdxRange.size();
+	int numBoxPrev	= (int)boxes.size();
+	for (int i = 0; i < numBox; ++i)
+	{
+		boxes.push_back(box[i]);
+		boxes.back().meshIdx = meshIdx;
+	}
+	addAnalyticMesh(this, material);
+	markDirty(SceneBuffer_Box, numBoxPrev, numBoxPrev + numBox);
+}
+
+// 2 triangles sharing a diagonal, return false if they do not form a parallelogram
+static bool	getQuadFromTriangles(const float* pos, const int* idx, QuadPrim* quad)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		// rotate the first triangle so that its corner opposite to the diagonal is in the middle
+		int idx0 = idx[i];
+		int idx1 = idx[(i + 1) % 3];
+		int idx2 = idx[(i + 2) % 3];
+		if (idx1 == idx[3] || idx1 == idx[4] || idx1 == idx[5])
+			continue;
+		int idx3 = -1;
+		for (int j = 3; j < 6; ++j)
+			if (idx[j] != idx0 && idx[j] != idx2)
+				idx3 = idx[j];
+		if (idx3 < 0)
+			return false;
+
+		Vector3	p0		= Vector3(pos[idx0 * 3], pos[idx0 * 3 + 1], pos[idx0 * 3 + 2]);
+		Vector3	p1		= Vector3(pos[idx1 * 3], pos[idx1 * 3 + 1], pos[idx1 * 3 + 2]);
+		Vector3	p2		= Vector3(pos[idx2 * 3], pos[idx2 * 3 + 1], pos[idx2 * 3 + 2]);
+		Vector3	p3		= Vector3(pos[idx3 * 3], pos[idx3 * 3 + 1], pos[idx3 * 3 + 2]);
+		quad->pos		= p0;
+		quad->edge0		= p1 - p0;
+		quad->edge1		= p2 - p1;
+		quad->meshIdx	= 0;
+		Vector3 skew	= p0 + quad->edge1 - p3;
+		return skew.length() <= QUAD_MAX_SKEW * (quad->edge0.length() + quad->edge1.length());
+	}
+	return false;
+}
+
+// a mesh made of triangle pairs is added as quads, otherwise as triangles
+static void	addMeshAsQuads(Scene* scene, const float* pos, const float* nor, int numVtx, const int* idx, int numIdx, Material material)
+{
+	std::vector<QuadPrim> quads(numIdx / 6);
+	bool isQuad = numIdx % 6 == 0;
+	for (int i = 0; i < (int)quads.size() && isQuad; ++i)
+		isQuad = getQuadFromTriangles(pos, idx + i * 6, &quads[i]);
+	if (isQuad)
+		scene->addQuads(&quads[0], (int)quads.size(), material);
+	else
+		scene->addMesh(pos, nor, numVtx, idx, numIdx, material);
+}
+
+// the Cornell box blocks stand on the floor, fitted with the average edges of the 4 top face corners
+static BoxPrim	getBlockBox(const float* topPos)
+{
+	Vector3 p[4];
+	for (int i = 0; i < 4; ++i)
+		p[i]		= Vector3(topPos[i * 3], topPos[i * 3 + 1], topPos[i * 3 + 2]);
+	Vector3 axisX	= ((p[3] - p[0]) + (p[2] - p[1])) * 0.25f;
+	Vector3 axisZ	= ((p[1] - p[0]) + (p[2] - p[3])) * 0.25f;
+	axisZ			= axisZ - axisX * (axisZ.dot(axisX) / axisX.dot(axisX));	// the measured corners are not exactly rectangular
+
+	BoxPrim box;
+	box.center		= (p[0] + p[1] + p[2] + p[3]) * 0.25f;
+	box.center.y	*= 0.5f;
+	box.axis[0]		= axisX;
+	box.axis[1]		= Vector3(0.0f, p[0].y * 0.5f, 0.0f);
+	box.axis[2]		= axisZ;
+	box.meshIdx		= 0;
+	return box;
+}
+
+void	Scene::createCornellBox()
+{
+	clear();
+
+	Material redMaterial = { Vector4(0.7f	, 0.45f	, 0.45f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	Material blueMaterial = { Vector4(0.45f	, 0.45f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	Material whiteMaterial = { Vector4(0.7f	, 0.7f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	float cornellBoxVtxData_white_pos[]=
+	{
+		0.55f   , 0.0f		, 0.0f			, 0.0f    , 0.0f	, 0.0f			, 0.0f    , 0.0f	, 0.560f	, 0.55f   , 0.0f	, 0.560f  ,		// floor
+		0.550f  , 0.550f	, 0.0f			, 0.550f  , 0.550f	, 0.560f		, 0.0f    , 0.550f	, 0.560f	, 0.0f    , 0.550f	, 0.0f    ,		// ceiling
+		0.550f  , 0.0f		, 0.560f		, 0.0f    , 0.0f	, 0.560f		, 0.0f    , 0.550f	, 0.560f	, 0.550f  , 0.550f	, 0.560f  ,		// back wall
+		0.550f  , 0.0f		, 0.0f			, 0.0f    , 0.0f	, 0.0f			, 0.0f    , 0.550f	, 0.0f		, 0.550f  , 0.550f	, 0.0f    ,		// front wall
+	};
+	float cornellBoxVtxData_white_nor[] =
+	{
+		0.0f, 1.0f, 0.0f	, 0.0f, 1.0f, 0.0f		, 0.0f, 1.0f, 0.0f		, 0.0f, 1.0f, 0.0f		,  // floor
+		0.0f, -1.0f, 0.0f	, 0.0f, -1.0f, 0.0f		, 0.0f, -1.0f, 0.0f		, 0.0f, -1.0f, 0.0f		,  // ceiling
+		0.0f, 0.0f, -1.0f	, 0.0f, 0.0f, -1.0f		, 0.0f, 0.0f, -1.0f		, 0.0f, 0.0f, -1.0f		,  // back wall
+		0.0f, 0.0f, 1.0f	, 0.0f, 0.0f, 1.0f		, 0.0f, 0.0f, 1.0f		, 0.0f, 0.0f, 1.0f		,  // front wall
+	};
+	int cornellBoxIdxData_white[] =
+	{
+		0, 1, 2				, 0, 2, 3		,	// floor
+		4, 5, 6				, 4, 6, 7		,	// ceiling
+		8, 9, 10			, 8, 10, 11		,	// back wall
+		13, 12, 14			, 14, 12, 15	,	// front wall
+	};
+
+	float cornellBoxVtxData_blue_pos[] =
+	{	// right wall
+		0.0f, 0.0f, 0.560f	, 0.0f, 0.0f, 0.0f	, 0.0f, 0.550f, 0.0f	, 0.0f, 0.550f, 0.560f,
+	};
+	float cornellBoxVtxData_blue_nor[] =
+	{	// right wall
+		1.0f, 0.0f, 0.0f	, 1.0f, 0.0f, 0.0f	, 1.0f, 0.0f, 0.0f		, 1.0f, 0.0f, 0.0f,
+	};
+	int cornellBoxIdxData_blue[] =
+	{	// right wall
+		0, 1, 2,        0, 2, 3,
+	};
+
+	float cornellBoxVtxData_red_pos[] =
+	{	// left wall
+		0.550f, 0.0f, 0.0f		, 0.550f, 0.0f, 0.560f		, 0.550f, 0.550f, 0.560f	, 0.550f, 0.550f, 0.0f,
+	};
+	float cornellBoxVtxData_red_nor[] =
+	{	// left wall
+		-1.0f, 0.0f, 0.0f		, -1.0f, 0.0f, 0.0f			, -1.0f, 0.0f, 0.0f			, -1.0f, 0.0f, 0.0f,
+	};
+	int cornellBoxIdxData_red[] =
+	{// left wall
+		0, 1, 2,        0, 2, 3,
+	};
+
+	float shortBlockVtxData_pos[] =
+	{
+		0.130f, 0.165f, 0.065f					, 0.082f, 0.165f, 0.225f				, 0.240f, 0.165f, 0.272f				, 0.290f, 0.165f, 0.114f,
+		0.290f,   0.0f, 0.114f					, 0.290f, 0.165f, 0.114f				, 0.240f, 0.165f, 0.272f				, 0.240f,   0.0f, 0.272f,
+		0.130f,   0.0f, 0.065f					, 0.130f, 0.165f, 0.065f				, 0.290f, 0.165f, 0.114f				, 0.290f,   0.0f, 0.114f,
+		0.082f,   0.0f, 0.225f					, 0.082f, 0.165f, 0.225f				, 0.130f, 0.165f, 0.065f				, 0.130f,   0.0f, 0.065f,
+		0.240f,   0.0f, 0.272f					, 0.240f, 0.165f, 0.272f				, 0.082f, 0.165f, 0.225f				, 0.082f,   0.0f, 0.225f,
+	};
+
+	float shortBlockVtxData_nor[] =
+	{
+		0.000000f, 1.000000f, -0.000000f		, 0.000000f, 1.000000f, -0.000000f		, 0.000000f, 1.000000f, -0.000000f		, 0.000000f, 1.000000f, -0.000000f	,
+		0.953400f, -0.000000f, 0.301709f		, 0.953400f, -0.000000f, 0.301709f		, 0.953400f, -0.000000f, 0.301709f		, 0.953400f, -0.000000f, 0.301709f	,
+		0.292826f, 0.000000f, -0.956166f		, 0.292826f, 0.000000f, -0.956166f		, 0.292826f, 0.000000f, -0.956166f		, 0.292826f, 0.000000f, -0.956166f	,
+		-0.957826f, 0.000000f, -0.287348f		, -0.957826f, 0.000000f, -0.287348f		, -0.957826f, 0.000000f, -0.287348f		, -0.957826f, 0.000000f, -0.287348f	,
+		-0.285121f, 0.000000f, 0.958492f		, -0.285121f, 0.000000f, 0.958492f		, -0.285121f, 0.000000f, 0.958492f		, -0.285121f, 0.000000f, 0.958492f	,
+	};
+	int shortBlockIdxData[] =
+	{
+		0, 1, 2,        0, 2, 3,
+		4, 5, 6,        4, 6, 7,
+		8, 9, 10,       8, 10, 11,
+		12, 13, 14,     12, 14, 15,
+		16, 17, 18,     16, 18, 19,
+	};
+
+	float tallBlockVtxData_pos[] =
+	{
+		0.423f,  0.330f,  0.247f		, 0.265f,  0.330f,  0.296f		, 0.314f,  0.330f,  0.456f		, 0.472f,  0.330f,  0.406f,
+		0.423f,    0.0f,  0.247f		, 0.423f,  0.330f,  0.247f		, 0.472f,  0.330f,  0.406f		, 0.472f,    0.0f,  0.406f,
+		0.472f,    0.0f,  0.406f		, 0.472f,  0.330f,  0.406f		, 0.314f,  0.330f,  0.456f		, 0.314f,    0.0f,  0.456f,
+		0.314f,    0.0f,  0.456f		, 0.314f,  0.330f,  0.456f		, 0.265f,  0.330f,  0.296f		, 0.265f,    0.0f,  0.296f,
+		0.265f,    0.0f,  0.296f		, 0.265f,  0.330f,  0.296f		, 0.423f,  0.330f,  0.247f		, 0.423f,    0.0f,  0.247f,
+	};
+
+	float tallBlockVtxData_nor[] =
+	{
+		0.000000f, 1.000000f, 0.000000f			, 0.000000f, 1.000000f, 0.000000f		, 0.000000f, 1.000000f, 0.000000f		, 0.000000f, 1.000000f, 0.000000f			,
+		0.955649f, 0.000000f, -0.294508f		, 0.955649f, 0.000000f, -0.294508f		, 0.955649f, 0.000000f, -0.294508f		, 0.955649f, 0.000000f, -0.294508f		,
+		0.301709f, -0.000000f, 0.953400f		, 0.301709f, -0.000000f, 0.953400f		, 0.301709f, -0.000000f, 0.953400f		, 0.301709f, -0.000000f, 0.953400f		,
+		-0.956166f, 0.000000f, 0.292826f		, -0.956166f, 0.000000f, 0.292826f		, -0.956166f, 0.000000f, 0.292826f		, -0.956166f, 0.000000f, 0.292826f		,
+		-0.296209f, 0.000000f, -0.955123f		, -0.296209f, 0.000000f, -0.955123f		, -0.296209f, 0.000000f, -0.955123f		, -0.296209f, 0.000000f, -0.955123f		,
+	};
+	int tallBlockIdxData[] =
+	{
+		0, 1, 2,        0, 2, 3,
+		4, 5, 6,        4, 6, 7,
+		8, 9, 10,       8, 10, 11,
+		12, 13, 14,     12, 14, 15,
+		16, 17, 18,     16, 18, 19,
+	};
+
+	if (isAnalyticPrimEnabled)
+	{
+		// same mesh order as the triangle meshes, the blocks get a bottom face, which is hidden by the floor
+		BoxPrim shortBlock	= getBlockBox(shortBlockVtxData_pos);
+		BoxPrim tallBlock	= getBlockBox(tallBlockVtxData_pos);
+		addMeshAsQuads(this, cornellBoxVtxData_white_pos, cornellBoxVtxData_white_nor	, sizeof(cornellBoxVtxData_white_pos) / (sizeof(float)*3)	, cornellBoxIdxData_white	, sizeof(cornellBoxIdxData_white)/sizeof(int)	, whiteMaterial	);
+		addMeshAsQuads(this, cornellBoxVtxData_blue_pos	, cornellBoxVtxData_blue_nor	, sizeof(cornellBoxVtxData_blue_pos	) / (sizeof(float)*3)	, cornellBoxIdxData_blue	, sizeof(cornellBoxIdxData_blue	)/sizeof(int)	, blueMaterial	);
+		addMeshAsQuads(this, cornellBoxVtxData_red_pos	, cornellBoxVtxData_red_nor		, sizeof(cornellBoxVtxData_red_pos	) / (sizeof(float)*3)	, cornellBoxIdxData_red		, sizeof(cornellBoxIdxData_red	)/sizeof(int)	, redMaterial	);
+		addBoxes(&shortBlock, 1, whiteMaterial);
+		addBoxes(&tallBlock	, 1, whiteMaterial);
+	}
+	else
+	{
+		addMesh(cornellBoxVtxData_white_pos	, cornellBoxVtxData_white_nor	, sizeof(cornellBoxVtxData_white_pos) / (sizeof(float)*3)	, cornellBoxIdxData_white	, sizeof(cornellBoxIdxData_white)/sizeof(int)	, whiteMaterial	);
+		addMesh(cornellBoxVtxData_blue_pos	, cornellBoxVtxData_blue_nor	, sizeof(cornellBoxVtxData_blue_pos	) / (sizeof(float)*3)	, cornellBoxIdxData_blue	, sizeof(cornellBoxIdxData_blue	)/sizeof(int)	, blueMaterial	);
+		addMesh(cornellBoxVtxData_red_pos	, cornellBoxVtxData_red_nor		, sizeof(cornellBoxVtxData_red_pos	) / (sizeof(float)*3)	, cornellBoxIdxData_red		, sizeof(cornellBoxIdxData_red	)/sizeof(int)	, redMaterial	);
+		addMesh(shortBlockVtxData_pos		, shortBlockVtxData_nor			, sizeof(shortBlockVtxData_pos		) / (sizeof(float)*3)	, shortBlockIdxData			, sizeof(shortBlockIdxData		)/sizeof(int)	, whiteMaterial	);
+		addMesh(tallBlockVtxData_pos		, tallBlockVtxData_nor			, sizeof(tallBlockVtxData_pos		) / (sizeof(float)*3)	, tallBlockIdxData			, sizeof(tallBlockIdxData		)/sizeof(int)	, whiteMaterial	);
+	}
+	tallBlockMeshIdx = (int)meshMaterial.size() - 1;
+
+	// set up light
+	const float lightWidth		= 0.130f;
+	const float lightHeight		= 0.105f;
+	const float lightIntensity	= 0.2f;
+	Vector3		lightRadiance	= Vector3(lightIntensity, lightIntensity, lightIntensity)*(PI / (lightWidth*lightHeight));
+	if (isLightMeshEnabled)
+	{
+		// light mesh
+		float lightVtxData_pos[] =
+		{
+			(lightWidth * ( 0.5f)	+ 0.278f), 0.549f, (lightHeight * (-0.5f) + 0.2795f),
+			(lightWidth * ( 0.5f)	+ 0.278f), 0.549f, (lightHeight * ( 0.5f) + 0.2795f),
+			(lightWidth * (-0.5f)   + 0.278f), 0.549f, (lightHeight * ( 0.5f) + 0.2795f),
+			(lightWidth * (-0.5f)   + 0.278f), 0.549f, (lightHeight * (-0.5f) + 0.2795f),
+		};
+
+		float lightVtxData_nor[] =
+		{
+			0, -1, 0,
+			0, -1, 0,
+			0, -1, 0,
+			0, -1, 0,
+		};
+		int lightdxData_white[] =
+		{
+			0, 1, 2,        0, 2, 3,
+		};
+		Material lightMaterial = { whiteMaterial.albedo, Vector4(lightRadiance.x, lightRadiance.y, lightRadiance.z, 0) };
+		addMesh(lightVtxData_pos		, lightVtxData_nor			, sizeof(lightVtxData_pos		) / (sizeof(float)*3)	, lightdxData_white			, sizeof(lightdxData_white		)/sizeof(int)	, lightMaterial	);
+	}
+	else
+	{
+		Matrix4x4 lightTransform = Matrix4x4::CreateRotationX(DEGREE_TO_RADIAN(180.0f));
+		lightTransform.setTranslation(Vector3(0.278f, 0.549f, 0.2795f));
+//		lightTransform.setTranslation(Vector3(0.275f, 0.549f, 0.28f));
+		addAreaLight(lightTransform, lightWidth, lightHeight, lightRadiance);
+	}
+}
+
+void	Scene::createCornellBoxWithSphere(int numSlice, int numStack)
+{
+	createCornellBox();
+	Material whiteMaterial = { Vector4(0.7f	, 0.7f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	addSphere(Vector3(0.40f, 0.09f, 0.12f), 0.09f, numSlice, numStack, whiteMaterial);
+}
+
+void	Scene::createCornellBoxWithSpheres(int numSphereX, int numSphereZ, int numSlice, int numStack)
+{
+	// a layer of small spheres above the blocks, used by the mesh animation benchmark
+	createCornellBox();
+	Material	whiteMaterial	= { Vector4(0.7f	, 0.7f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	float		spacingX		= 0.45f / numSphereX;
+	float		spacingZ		= 0.45f / numSphereZ;
+	float		radius			= minf(spacingX, spacingZ) * 0.4f;
+	for (int z = 0; z < numSphereZ; ++z)
+		for (int x = 0; x < numSphereX; ++x)
+			addSphere(Vector3(0.05f + (x + 0.5f) * spacingX, 0.42f, 0.05f + (z + 0.5f) * spacingZ), radius, numSlice, numStack, whiteMaterial);
+}
+
+void	Scene::createCornellBoxWithLargeLight()
+{
+	// the ceiling light enlarged to cover most of the ceiling with the same power,
+	// so the ceiling and the top of the tall block are close to the light
+	createCornellBox();
+	if (numLight == 0)		// isLightMeshEnabled
+		return;
+	const float lightWidth		= 0.400f;
+	const float lightHeight		= 0.400f;
+	const float lightIntensity	= 0.2f;
+	Vector3		lightRadiance	= Vector3(lightIntensity, lightIntensity, lightIntensity)*(PI / (lightWidth*lightHeight));
+	Matrix4x4	lightTransform	= areaLight[0].xform;
+	numLight					= 0;
+	addAreaLight(lightTransform, lightWidth, lightHeight, lightRadiance);
+}
+
+void	Scene::createCornellBoxWithIndirectLight()
+{
+	// the ceiling light is turned upward below the ceiling and shaded from below, so the room is only lit
+	// by the bright spot it makes on the ceiling, which is small as seen from the rest of the room
+	createCornellBox();
+	if (numLight == 0)		// isLightMeshEnabled
+		return;
+	Matrix4x4	lightTransform	= Matrix4x4::CreateRotationX(0.0f);
+	Vector3		lightRadiance	= areaLight[0].radiance.xyz();
+	float		lightWidth		= areaLight[0].halfWidth	* 2.0f;
+	float		lightHeight		= areaLight[0].halfHeight	* 2.0f;
+	lightTransform.setTranslation(Vector3(0.278f, 0.480f, 0.2795f));
+	numLight					= 0;
+	addAreaLight(lightTransform, lightWidth, lightHeight, lightRadiance);
+
+	Material	whiteMaterial	= { Vector4(0.7f	, 0.7f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	BoxPrim		shade;
+	shade.center				= Vector3(0.278f, 0.475f, 0.2795f);
+	shade.axis[0]				= Vector3(lightWidth * 0.6f, 0.0f, 0.0f);
+	shade.axis[1]				= Vector3(0.0f, 0.003f, 0.0f);
+	shade.axis[2]				= Vector3(0.0f, 0.0f, lightHeight * 0.6f);
+	addBoxes(&shade, 1, whiteMaterial);
+}
+
+void	Scene::createCornellBoxWithEmissiveSphere()
+{
+	// lit only by a small emissive sphere above the short block, its triangles are the only light source
+	createCornellBox();
+	numLight				= 0;
+	const float	radius		= 0.04f;
+	const float	intensity	= 0.2f;
+	float		radiance	= intensity / (radius * radius);		// same power as the area light, emitted over 4 pi r^2 with cosine falloff
+	Material	material	= { Vector4(0.0f, 0.0f, 0.0f, 0.0f), Vector4(radiance, radiance, radiance, 0.0f) };
+	addSphere(Vector3(0.185f, 0.32f, 0.17f), radius, 32, 16, material);
+}
+
+void	Scene::createCornellBoxWithManyLights(int numSphere)
+{
+	// half of the spheres are below the ceiling, the other half along the red and blue walls clear of the blocks,
+	// so the important lights differ a lot between pixels, the total power is the same as the area light
+	createCornellBox();
+	numLight				= 0;
+	const float	radius		= 0.008f;
+	const float	intensity	= 0.2f / numSphere;
+	unsigned int randSeed	= 1;
+	for (int i = 0; i < numSphere; ++i)
+	{
+		Vector3	center;
+		center.x			= i % 2 == 0 ? 0.03f + randFloat(&randSeed) * 0.49f : (randFloat(&randSeed) < 0.5f ? 0.02f + randFloat(&randSeed) * 0.08f : 0.45f + randFloat(&randSeed) * 0.08f);
+		center.y			= i % 2 == 0 ? 0.36f + randFloat(&randSeed) * 0.16f : 0.02f + randFloat(&randSeed) * 0.50f;
+		center.z			= 0.03f + randFloat(&randSeed) * 0.50f;
+		Vector3	color		= Vector3(0.2f + randFloat(&randSeed), 0.2f + randFloat(&randSeed), 0.2f + randFloat(&randSeed));
+		color				= color * (1.0f / color.dot(Vector3(0.2126f, 0.7152f, 0.0722f)));
+		float	radiance	= intensity / (radius * radius) * (0.2f + 1.6f * randFloat(&randSeed));
+		Material material	= { Vector4(0.0f, 0.0f, 0.0f, 0.0f), Vector4(color.x * radiance, color.y * radiance, color.z * radiance, 0.0f) };
+		addSphere(center, radius, 8, 4, material);
+	}
+}
+
+void	Scene::createCornellBoxWithThinTriangles(int numTri)
+{
+	// long and thin triangles lying in random directions across the room like a pile of straws, next to the small triangles of the sphere,
+	// their bounds are large and overlap each other, which is the worst case of an object split and the case of a spatial split
+	createCornellBoxWithSphere(128, 64);
+	Material		whiteMaterial	= { Vector4(0.7f	, 0.7f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	const float		length			= 0.30f;
+	const float		width			= 0.004f;
+	unsigned int	randSeed		= 1;
+	MeshData		mesh;
+	for (int i = 0; i < numTri; ++i)
+	{
+		Vector3	center	= Vector3(0.10f + randFloat(&randSeed) * 0.35f, 0.10f + randFloat(&randSeed) * 0.35f, 0.10f + randFloat(&randSeed) * 0.35f);
+		float	theta	= acosf(1.0f - 2.0f * randFloat(&randSeed));
+		float	phi		= 2.0f * PI * randFloat(&randSeed);
+		Vector3	dir		= Vector3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+		Vector3	side	= dir.cross(fabsf(dir.y) < 0.9f ? Vector3(0.0f, 1.0f, 0.0f) : Vector3(1.0f, 0.0f, 0.0f));
+		side.normalize();
+		Vector3	n		= side.cross(dir);
+		int		idx		= (int)mesh.pos.size();
+		mesh.pos.push_back(center - dir * (length * 0.5f) - side * (width * 0.5f));
+		mesh.pos.push_back(center - dir * (length * 0.5f) + side * (width * 0.5f));
+		mesh.pos.push_back(center + dir * (length * 0.5f));
+		for (int j = 0; j < 3; ++j)
+		{
+			mesh.nor.push_back(n);
+			mesh.idx.push_back(idx + j);
+		}
+	}
+	addMeshData(&mesh, whiteMaterial);
+}
+
+void	Scene::createSkySpheres()
+{
+	// 3 spheres on a large ground plane in front of the benchmark camera, no area light, small enough for the GPU scene buffers
+	clear();
+	if (envMap.isEmpty())
+		createSkyEnvMap();
+
+	Material groundMaterial	= { Vector4(0.6f	, 0.6f	, 0.6f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	Material redMaterial	= { Vector4(0.7f	, 0.2f	, 0.2f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	Material whiteMaterial	= { Vector4(0.8f	, 0.8f	, 0.8f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	Material blueMaterial	= { Vector4(0.2f	, 0.3f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+	const float	groundSize	= 10.0f;
+	float groundPos[] =
+	{
+		-groundSize, 0.0f, -groundSize	, -groundSize, 0.0f, groundSize	, groundSize, 0.0f, groundSize	, groundSize, 0.0f, -groundSize	,
+	};
+	float groundNor[] =
+	{
+		0.0f, 1.0f, 0.0f	, 0.0f, 1.0f, 0.0f		, 0.0f, 1.0f, 0.0f		, 0.0f, 1.0f, 0.0f		,
+	};
+	int groundIdx[] = { 0, 1, 2, 0, 2, 3 };
+	addMesh(groundPos, groundNor, 4, groundIdx, 6, groundMaterial);
+	addSphere(Vector3(0.100f, 0.100f, 0.250f), 0.100f, 24, 12, redMaterial);
+	addSphere(Vector3(0.278f, 0.120f, 0.400f), 0.120f, 24, 12, whiteMaterial);
+	addSphere(Vector3(0.456f, 0.080f, 0.150f), 0.080f, 24, 12, blueMaterial);
+}
+
+bool	Scene::createByName(const char* name)
+{
+	if (strcmp(name, "cornell") == 0)
+		createCornellBox();
+	else if (strcmp(name, "cornell_sphere") == 0)
+		createCornellBoxWithSphere(256, 128);		//  65k triangles
+	else if (strcmp(name, "cornell_sphere_large") == 0)
+		createCornellBoxWithSphere(1024, 512);		//   1M triangles
+	else if (strcmp(name, "cornell_spheres") == 0)
+		createCornellBoxWithSpheres(8, 8, 64, 32);	// 64 spheres, 250k triangles
+	else if (strcmp(name, "cornell_large_light") == 0)
+		createCornellBoxWithLargeLight();
+	else if (strcmp(name, "cornell_light_mesh") == 0)
+	{
+		isLightMeshEnabled = true;
+		createCornellBox();
+	}
+	else if (strcmp(name, "cornell_indirect") == 0)
+		createCornellBoxWithIndirectLight();
+	else if (strcmp(name, "cornell_emissive_sphere") == 0)
+		createCornellBoxWithEmissiveSphere();
+	else if (strcmp(name, "cornell_many_lights") == 0)
+		createCornellBoxWithManyLights(256);			// 12k emissive triangles
+	else if (strcmp(name, "cornell_thin") == 0)
+		createCornellBoxWithThinTriangles(512);		// 16k sphere triangles + 512 long and thin triangles
+	else if (strcmp(name, "sky_spheres") == 0)
+		createSkySpheres();
+	else if (strlen(name) > 4 && (strcmp(name + strlen(name) - 4, ".hdr") == 0 || strcmp(name + strlen(name) - 4, ".pfm") == 0))
+	{
+		if (!loadEnvMap(name))
+			return false;
+		createSkySpheres();
+	}
+	else if (strlen(name) > 4 && strcmp(name + strlen(name) - 4, ".obj") == 0)
+	{
+		createCornellBox();
+		Material whiteMaterial = { Vector4(0.7f	, 0.7f	, 0.7f	, 0.0f) / PI, Vector4(0.0f, 0.0f, 0.0f, 0.0f) };
+		if (!addObjMesh(name, Vector3(0.40f, 0.09f, 0.12f), 0.18f, whiteMaterial))
+			return false;
+	}
+	else
+		return false;
+	buildAccel(SceneAccel_BvhWide);
+	return true;
+}
+
+static BvhGeometry	getBvhGeometry(const Scene& scene)
+{
+	BvhGeometry geometry;
+	geometry.triPos		= scene.triPos.data();			// empty in the analytic cornell box
+	geometry.triIdx		= scene.triIdx.data();
+	geometry.triMeshIdx	= scene.triMeshIdx.data();
+	geometry.quads		= scene.quads.empty() ? NULL : &scene.quads[0];
+	geometry.boxes		= scene.boxes.empty() ? NULL : &scene.boxes[0];
+	geometry.numTri		= scene.getNumTriangle();
+	geometry.numQuad	= (int)scene.quads.size();
+	geometry.numBox		= (int)scene.boxes.size();
+	return geometry;
+}
+
+void	Scene::buildAccel(SceneAccel type)
+{
+	int numTri = getNumTriangle();
+	triMeshIdx.resize(numTri);
+	for (int mesh = 0; mesh < (int)meshIdxRange.size(); ++mesh)
+		for (int i = meshIdxRange[mesh].x; i < meshIdxRange[mesh].y; i += 3)
+			triMeshIdx[i / 3] = mesh;
+
+	buildEmissiveTable();
+
+	bvhWide.clear();
+	bvhCompressed.clear();
+	bvh.clear();
+	accel = type;
+	if (type == SceneAccel_BruteForce || getNumPrimitive() == 0)
+		return;
+
+	bvh.build(getBvhGeometry(*this), bvhBuildMode, threadPoolGetShared());
+	if (type == SceneAccel_BvhCompressed)
+		bvhCompressed.build(&bvh);
+	else if (type == SceneAccel_BvhWide)
+		bvhWide.build(&bvh, BvhWide::getBestWidth());
+}
+
+static bool	isEmissive(const Material& material)
+{
+	return material.emissive.x > 0.0f || material.emissive.y > 0.0f || material.emissive.z > 0.0f;
+}
+
+void	Scene::buildEmissiveTable()
+{
+	int numPrev		= (int)emissiveTri.size();
+	emissiveTri.clear();
+	emissiveTable.clear();
+	std::vector<float> power;
+	for (int mesh = 0; mesh < (int)meshIdxRange.size() && isEmissiveSamplingEnabled; ++mesh)
+	{
+		Vector3	emissive	= meshMaterial[mesh].emissive.xyz();
+		float	luminance	= emissive.dot(Vector3(0.2126f, 0.7152f, 0.0722f));
+		if (luminance <= 0.0f)
+			continue;
+		for (int i = meshIdxRange[mesh].x; i < meshIdxRange[mesh].y; i += 3)
+		{
+			Vector3	pos0	= triPos[triIdx[i]];
+			float	area	= (triPos[triIdx[i + 1]] - pos0).cross(triPos[triIdx[i + 2]] - pos0).length() * 0.5f;
+			if (area <= 0.0f)
+				continue;		// also skip the collapsed triangles of a removed mesh
+			int2 tri = { i, mesh };
+			emissiveTri.push_back(tri);
+			power.push_back(luminance * area);
+		}
+	}
+	if (!power.empty())
+		aliasTableBuild(&power[0], (int)power.size(), &emissiveTable);
+
+	int num = (int)emissiveTri.size();
+	markDirty(SceneBuffer_EmissiveTri	, 0, num);
+	markDirty(SceneBuffer_EmissiveTable	, 0, num);
+	if (num != numPrev)
+		isConstantDirty = true;
+}
+
+void	Scene::transformMesh(int meshIdx, const Matrix4x4& xform)
+{
+	// normals are transformed by the inverse transpose
+	Matrix4x4	xformInv	= xform.inverse();
+	const float*	m		= xformInv.f;
+	int2		range		= meshVtxRange[meshIdx];
+	for (int i = range.x; i < range.y; ++i)
+	{
+		Vector4 pos	= xform * Vector4(triPos[i].x, triPos[i].y, triPos[i].z, 1.0f);
+		triPos[i]	= pos.xyz();
+
+		Vector3 n	= decodeOctahedral(triNor[i]);
+		Vector3 nor	= Vector3(	m[0] * n.x + m[1] * n.y + m[ 2] * n.z,
+								m[4] * n.x + m[5] * n.y + m[ 6] * n.z,
+								m[8] * n.x + m[9] * n.y + m[10] * n.z);
+		nor.normalize();
+		triNor[i]	= encodeOctahedral(nor);
+	}
+	markDirty(SceneBuffer_TriPos, range.x, range.y);
+	markDirty(SceneBuffer_TriNor, range.x, range.y);
+}
+
+void	Scene::setMeshVertices(int meshIdx, const Vector3* pos, const Vector3* nor)
+{
+	int2 range = meshVtxRange[meshIdx];
+	for (int i = range.x; i < range.y; ++i)
+	{
+		triPos[i] = pos[i - range.x];
+		if (nor)
+			triNor[i] = encodeOctahedral(nor[i - range.x]);
+	}
+	markDirty(SceneBuffer_TriPos, range.x, range.y);
+	if (nor)
+		markDirty(SceneBuffer_TriNor, range.x, range.y);
+}
+
+BvhUpdateResult	Scene::updateAccel()
+{
+	if (accel == SceneAccel_BruteForce || bvh.m_nodes.empty())
+		return BvhUpdate_Refit;
+
+	// the area of the emissive triangles may have changed
+	if (!emissiveTri.empty())
+		buildEmissiveTable();
+
+	ThreadPool*		threadPool	= threadPoolGetShared();
+	BvhUpdateResult	result		= bvh.update(threadPool);
+	if (accel == SceneAccel_BvhCompressed)
+		bvhCompressed.build(&bvh);		// quantized relative to the parent bound, so it is always rebuilt
+	else if (accel == SceneAccel_BvhWide)
+	{
+		if (result == BvhUpdate_Refit)
+			bvhWide.refit(threadPool);
+		else
+			bvhWide.build(&bvh, bvhWide.m_width);
+	}
+	return result;
+}
+
+int		Scene::insertMesh(const float* pos, const float* nor, int numVtx, const int* idx, int numIdx, Material material)
+{
+	int meshIdx		= (int)meshIdxRange.size();
+	int triStart	= getNumTriangle();
+	addMesh(pos, nor, numVtx, idx, numIdx, material);
+	triMeshIdx.resize(getNumTriangle(), meshIdx);
+	if (isEmissive(material))
+		buildEmissiveTable();
+	if (accel == SceneAccel_BruteForce || triStart == getNumTriangle())
+		return meshIdx;
+	if (bvh.m_nodes.empty())
+	{
+		buildAccel(accel);
+		return meshIdx;
+	}
+
+	// the new triangles are built as a subtree, the geometry is passed again as addMesh() may reallocate the arrays
+	bvh.insert(getBvhGeometry(*this), triStart, threadPoolGetShared());
+	if (accel == SceneAccel_BvhCompressed)
+		bvhCompressed.build(&bvh);
+	else if (accel == SceneAccel_BvhWide)
+		bvhWide.build(&bvh, bvhWide.m_width);
+	return meshIdx;
+}
+
+bool	Scene::removeMesh(int meshIdx)
+{
+	if (meshIdx < 0 || meshIdx >= (int)meshIdxRange.size() || meshIdxRange[meshIdx].x == meshIdxRange[meshIdx].y)
+		return false;
+
+	// an empty index range is skipped by the brute force loop and path_tracer.hlsl, the storage is kept until the scene is re-created
+	int2 vtxRange			= meshVtxRange[meshIdx];
+	meshIdxRange[meshIdx].y	= meshIdxRange[meshIdx].x;
+	meshVtxRange[meshIdx].y	= vtxRange.x;
+	markDirty(SceneBuffer_MeshIdxRange, meshIdx, meshIdx + 1);
+	if (isEmissive(meshMaterial[meshIdx]))
+		buildEmissiveTable();
+	if (accel == SceneAccel_BruteForce || bvh.m_nodes.empty() || vtxRange.x == vtxRange.y)
+		return true;
+
+	// the BVH still reference the triangles, collapse them to a point so they are never hit, and refit the nodes around the mesh
+	Aabb bound;
+	bound.setEmpty();
+	for (int i = vtxRange.x; i < vtxRange.y; ++i)
+		bound.grow(triPos[i]);
+	for (int i = vtxRange.x + 1; i < vtxRange.y; ++i)
+		triPos[i] = triPos[vtxRange.x];
+	bvh.refitRegion(bound);
+	if (accel == SceneAccel_BvhCompressed)
+		bvhCompressed.build(&bvh);
+	else if (accel == SceneAccel_BvhWide)
+		bvhWide.refit(threadPoolGetShared());
+	return true;
+}
+
+bool	Scene::setMeshMaterial(int meshIdx, const Material& material)
+{
+	if (meshIdx < 0 || meshIdx >= (int)meshMaterial.size() || memcmp(&meshMaterial[meshIdx], &material, sizeof(Material)) == 0)
+		return false;
+	bool isEmissiveChanged	= isEmissive(meshMaterial[meshIdx]) || isEmissive(material);
+	meshMaterial[meshIdx]	= material;
+	if (meshIdxRange[meshIdx].x == meshIdxRange[meshIdx].y && (meshFlag[meshIdx] & MESH_FLAG_ANALYTIC) == 0)
+		return false;		// removed mesh, the GPU copy is never read
+	markDirty(SceneBuffer_MeshMaterial, meshIdx, meshIdx + 1);
+	if (isEmissiveChanged && (meshFlag[meshIdx] & MESH_FLAG_ANALYTIC) == 0)
+		buildEmissiveTable();
+	return true;
+}
+
+bool	Scene::setAreaLightTransform(int lightIdx, const Matrix4x4& xform)
+{
+	if (lightIdx < 0 || lightIdx >= numLight || memcmp(&areaLight[lightIdx].xform, &xform, sizeof(Matrix4x4)) == 0)
+		return false;
+	areaLight[lightIdx].xform		= xform;
+	areaLight[lightIdx].xformInv	= xform.inverse();
+	isConstantDirty					= true;
+	return true;
+}
+
+bool	Scene::setAreaLightSampling(int lightIdx, AreaLightSampling sampling)
+{
+	if (lightIdx < 0 || lightIdx >= numLight || areaLight[lightIdx].sampling == sampling)
+		return false;
+	areaLight[lightIdx].sampling	= sampling;
+	isConstantDirty					= true;
+	return true;
+}
+
+static void	markEnvMapDirty(Scene* scene)
+{
+	int num = scene->envMap.width * scene->envMap.height;
+	scene->markDirty(SceneBuffer_EnvMapPixel, 0, num);
+	scene->markDirty(SceneBuffer_EnvMapTable, 0, num);
+	scene->isConstantDirty = true;
+}
+
+bool	Scene::loadEnvMap(const char* fileName)
+{
+	if (!envMap.load(fileName))
+		return false;
+	markEnvMapDirty(this);
+	return true;
+}
+
+void	Scene::createSkyEnvMap()
+{
+	envMap.createSky(Vector3(-0.4f, 0.6f, -0.7f), 800.0f);
+	markEnvMapDirty(this);
+}
+
+void	Scene::setEnvMapSampling(EnvMapSampling sampling)
+{
+	if (envMap.sampling == sampling)
+		return;
+	envMap.sampling	= sampling;
+	isConstantDirty	= true;
+}
+
+void	Scene::markDirty(SceneBuffer buffer, int start, int end)
+{
+	if (start >= end)
+		return;
+	SceneDirtyRange& range = dirtyRange[buffer];
+	if (range.start >= range.end)
+	{
+		range.start	= start;
+		range.end	= end;
+	}
+	else
+	{	// a single range to keep the upload to one copy per buffer
+		range.start	= start < range.start	? start	: range.start;
+		range.end	= end	> range.end		? end	: range.end;
+	}
+}
+
+void	Scene::clearDirty()
+{
+	for (int i = 0; i < SceneBuffer_Num; ++i)
+	{
+		dirtyRange[i].start	= 0;
+		dirtyRange[i].end	= 0;
+	}
+	isConstantDirty = false;
+}
+
+bool	Scene::isDirty() const
+{
+	for (int i = 0; i < SceneBuffer_Num; ++i)
+		if (dirtyRange[i].start < dirtyRange[i].end)
+			return true;
+	return isConstantDirty;
+}
+
+int		Scene::getNumTriangle() const
+{
+	return (int)triIdx.size() / 3;
+}
+
+int		Scene::getNumPrimitive() const
+{
+	return getNumTriangle() + (int)quads.size() + (int)boxes.size();
+}
+
+int		Scene::getGeometryMemorySize() const
+{
+	return	(int)(	triPos.size()		* sizeof(Vector3		) +
+					triNor.size()		* sizeof(unsigned int	) +
+					triIdx.size()		* sizeof(int			) +
+					quads.size()		* sizeof(QuadPrim		) +
+					boxes.size()		* sizeof(BoxPrim		) +
+					meshMaterial.size()	* sizeof(Material		) +
+					meshIdxRange.size()	* sizeof(int2			) +
+					meshFlag.size()		* sizeof(int			));
+}
+
+Vector3	Scene::computeHitNormal(const RayHit& hit) const
+{
+	int primType = hit.triangle & RAY_PRIM_TYPE_MASK;
+	if (primType == RAY_PRIM_QUAD)
+	{
+		const QuadPrim&	quad	= quads[hit.triangle & RAY_PRIM_IDX_MASK];
+		Vector3			normal	= quad.edge0.cross(quad.edge1);
+		normal.normalize();
+		return normal;
+	}
+	if (primType == RAY_PRIM_BOX)
+	{
+		int		face	= (hit.triangle & RAY_PRIM_IDX_MASK) % 6;
+		Vector3	normal	= boxes[(hit.triangle & RAY_PRIM_IDX_MASK) / 6].axis[face >> 1];
+		normal.normalize();
+		return (face & 1) ? normal : normal * -1.0f;
+	}
+
+	if (meshFlag[hit.meshIdx] & MESH_FLAG_FLAT)
+	{
+		const Vector3&	p0		= triPos[hit.triIdx[0]];
+		Vector3			normal	= (triPos[hit.triIdx[1]] - p0).cross(triPos[hit.triIdx[2]] - p0);
+		normal.normalize();
+		return normal;
+	}
+
+	Vector3 normal	=	decodeOctahedral(triNor[hit.triIdx[0]]) * (1.0f - hit.u - hit.v)	+
+						decodeOctahedral(triNor[hit.triIdx[1]]) * hit.u					+
+						decodeOctahedral(triNor[hit.triIdx[2]]) * hit.v						;
+	normal.normalize();
+	return normal;
+}
+
+bool	Scene::rayCast(const Ray& ray, RayHit* hit) const
+{
+	if (accel == SceneAccel_BvhWide)
+		return bvhWide.rayCast(ray, hit);
+	if (accel == SceneAccel_BvhCompressed)
+		return bvhCompressed.rayCast(ray, hit);
+	if (accel == SceneAccel_Bvh)
+		return bvh.rayCast(ray, hit);
+
+	// same brute force loop as sceneRayCast() in path_tracer.hlsl
+	const float MAX_T	= 999999999999999.0f;
+	hit->t				= MAX_T;
+	hit->u				= 0;
+	hit->v				= 0;
+	hit->meshIdx		= 0;
+	hit->triIdx[0]		= 0;
+	hit->triIdx[1]		= 0;
+	hit->triIdx[2]		= 0;
+	hit->triangle		= 0x7fffffff;
+	int	numMesh			= (int)meshIdxRange.size();
+	for (int mesh = 0; mesh < numMesh; ++mesh)
+	{
+		int2 range = meshIdxRange[mesh];
+		for (int i = range.x; i < range.y; i += 3)
+		{
+			int idx0	= triIdx[i  ];
+			int idx1	= triIdx[i+1];
+			int idx2	= triIdx[i+2];
+
+			float u, v;
+			float t		= rayTriIntersect(ray, triPos[idx0], triPos[idx1], triPos[idx2], &u, &v);
+			if (t < hit->t && t >= 0)
+			{
+				hit->t			= t;
+				hit->u			= u;
+				hit->v			= v;
+				hit->meshIdx	= mesh;
+				hit->triIdx[0]	= idx0;
+				hit->triIdx[1]	= idx1;
+				hit->triIdx[2]	= idx2;
+				hit->triangle	= i / 3;
+			}
+		}
+	}
+
+	// the analytic primitives are tested in increasing id after the triangles, so a tie is still won by the lower id,
+	// the geometry is only used to look up their mesh index
+	BvhGeometry geometry;
+	geometry.quads		= quads.empty() ? NULL : &quads[0];
+	geometry.boxes		= boxes.empty() ? NULL : &boxes[0];
+	for (int i = 0; i < (int)quads.size(); ++i)
+	{
+		float u, v;
+		float t		= rayQuadIntersect(ray, quads[i], &u, &v);
+		if (t < hit->t && t >= 0)
+		{
+			hit->t		= t;
+			hit->u		= u;
+			hit->v		= v;
+			bvhSetPrimHit(geometry, RAY_PRIM_QUAD | i, hit);
+		}
+	}
+	for (int i = 0; i < (int)boxes.size(); ++i)
+	{
+		float	u, v;
+		int		face;
+		float	t	= rayBoxIntersect(ray, boxes[i], &u, &v, &face);
+		if (t < hit->t && t >= 0)
+		{
+			hit->t		= t;
+			hit->u		= u;
+			hit->v		= v;
+			bvhSetPrimHit(geometry, RAY_PRIM_BOX | (i * 6 + face), hit);
+		}
+	}
+	return hit->t != MAX_T;
+}
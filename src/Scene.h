@@ -0,0 +1,168 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include "math.h"
+#include "Ray.h"
+#include "Mesh.h"
+#include "Bvh.h"
+#include "BvhCompressed.h"
+#include "BvhWide.h"
+#include "AliasTable.h"
+#include "EnvMap.h"
+
+#define MAX_LIGHT				(4)
+#define AREA_LIGHT_SOLID_ANGLE_MIN	(0.05f)		// in steradian, lights subtending less are area sampled, the noise reduction does not pay for the cost
+
+#define MESH_FLAG_FLAT			(1 << 0)	// all vertex normals equal to the face normal, the normal is derived from the hit triangle instead
+#define MESH_FLAG_ANALYTIC		(1 << 1)	// made of quads or boxes instead of triangles, the index range is empty
+
+enum AreaLightSampling
+{
+	AreaLightSampling_Area,			// uniform over the light surface
+	AreaLightSampling_SolidAngle,	// uniform over the solid angle subtended by the light, less noise close to the light
+};
+
+struct AreaLight
+{	// a rect light, xform must not contain scale
+	Matrix4x4	xform;
+	Matrix4x4	xformInv;
+	Vector4		radiance;
+	float		halfWidth;
+	float		halfHeight;
+	float		oneOverArea;
+	int			sampling;		// AreaLightSampling
+};
+
+struct Material
+{
+	Vector4	albedo;
+	Vector4	emissive;
+};
+
+enum SceneAccel
+{
+	SceneAccel_BruteForce,
+	SceneAccel_Bvh,
+	SceneAccel_BvhCompressed,
+	SceneAccel_BvhWide,				// BVH8 if the CPU support AVX2, else BVH4
+};
+
+// scene arrays uploaded to the structured buffers in path_tracer.hlsl
+enum SceneBuffer
+{
+	SceneBuffer_TriPos,
+	SceneBuffer_TriNor,
+	SceneBuffer_TriIdx,
+	SceneBuffer_MeshMaterial,
+	SceneBuffer_MeshIdxRange,
+	SceneBuffer_MeshFlag,
+	SceneBuffer_Quad,
+	SceneBuffer_Box,
+	SceneBuffer_EmissiveTri,
+	SceneBuffer_EmissiveTable,
+	SceneBuffer_EnvMapPixel,
+	SceneBuffer_EnvMapTable,
+
+	SceneBuffer_Num
+};
+
+struct SceneDirtyRange
+{	// element range [start, end) modified since the last clearDirty(), empty if start >= end
+	int		start;
+	int		end;
+};
+
+// scene content shared by the GPU path tracer and the CPU path tracer,
+// the arrays are laid out in the same way as the structured buffers in path_tracer.hlsl
+struct Scene
+{
+	std::vector<Vector3	>	triPos;
+	std::vector<unsigned int>	triNor;			// octahedral encoded
+	std::vector<int		>	triIdx;
+	std::vector<Material>	meshMaterial;
+	std::vector<int2	>	meshIdxRange;
+	std::vector<int		>	meshFlag;		// MESH_FLAG_XXX
+	int						tallBlockMeshIdx;	// mesh of the Cornell box tall block, -1 for the other scenes
+	std::vector<QuadPrim>	quads;
+	std::vector<BoxPrim	>	boxes;
+
+	// emissive triangles for next event estimation, built by buildEmissiveTable() and sampled in proportion to their power
+	std::vector<int2	>	emissiveTri;		// x: first index in triIdx, y: mesh index
+	std::vector<AliasTableEntry>	emissiveTable;
+
+	AreaLight				areaLight[MAX_LIGHT];
+	int						numLight;
+	EnvMap					envMap;			// lights the rays escaping the scene, not removed by clear() so it can be set before creating the scene
+
+	// modification not yet uploaded to the GPU
+	SceneDirtyRange			dirtyRange[SceneBuffer_Num];
+	bool					isConstantDirty;		// area light, mesh count or environment map size changed
+
+	bool					isMeshOptimizeEnabled;		// run meshOptimize() on meshes added by addMeshData()
+	bool					isAnalyticPrimEnabled;		// create the Cornell box walls and blocks from quads and boxes instead of triangles
+	bool					isLightMeshEnabled;			// create the Cornell box light as an emissive mesh instead of an area light
+	bool					isEmissiveSamplingEnabled;	// sample the emissive triangles as lights, otherwise they are only hit by chance
+
+	// CPU acceleration structure, built by buildAccel() after all meshes are added
+	std::vector<int		>	triMeshIdx;
+	std::vector<int2	>	meshVtxRange;		// vertex range of each mesh for mesh animation
+	Bvh						bvh;
+	BvhCompressed			bvhCompressed;
+	BvhWide					bvhWide;
+	SceneAccel				accel;
+	BvhBuildMode			bvhBuildMode;
+
+	Scene();
+
+	void	clear();
+	void	addMesh(const float* pos, const float* nor, int numVtx, const int* idx, int numIdx, Material material);
+	void	addAreaLight(const Matrix4x4& xform, float width, float height, const Vector3& radiance);
+	void	addMeshData(MeshData* mesh, Material material);
+	bool	addObjMesh(const char* fileName, const Vector3& center, float size, Material material);
+	void	addSphere(const Vector3& center, float radius, int numSlice, int numStack, Material material);
+	void	addQuads(const QuadPrim* quad, int numQuad, Material material);		// added as 1 mesh, the meshIdx of the input is ignored
+	void	addBoxes(const BoxPrim* box, int numBox, Material material);
+	void	createCornellBox();
+	void	createCornellBoxWithSphere(int numSlice, int numStack);
+	void	createCornellBoxWithSpheres(int numSphereX, int numSphereZ, int numSlice, int numStack);
+	void	createCornellBoxWithLargeLight();
+	void	createCornellBoxWithIndirectLight();		// lit by the bounce of an upward light on the ceiling
+	void	createCornellBoxWithEmissiveSphere();
+	void	createCornellBoxWithManyLights(int numSphere);		// small emissive spheres of random color along the walls and below the ceiling
+	void	createCornellBoxWithThinTriangles(int numTri);		// the sphere with long and thin overlapping triangles, used by the SBVH benchmark
+	void	createSkySpheres();					// open scene lit by envMap only, the procedural sky is used if envMap is empty
+	bool	createByName(const char* name);		// return false if the scene name is unknown, a name ending with ".obj" is loaded into the Cornell box,
+												// a name ending with ".hdr" or ".pfm" is loaded as the environment map of the sky scene
+
+	void	buildAccel(SceneAccel type);
+	void	buildEmissiveTable();		// called by buildAccel(), updateAccel() and the mesh edits
+
+	// mesh animation, the acceleration structure is updated by updateAccel() after all meshes are modified
+	void	transformMesh(int meshIdx, const Matrix4x4& xform);						// apply to the current vertices
+	void	setMeshVertices(int meshIdx, const Vector3* pos, const Vector3* nor);	// nor can be NULL to keep the normals
+	BvhUpdateResult	updateAccel();
+	// runtime editing, only the modified elements are marked dirty and the acceleration structure is updated in place,
+	// return false if the edit does not change the rendered image
+	int		insertMesh(const float* pos, const float* nor, int numVtx, const int* idx, int numIdx, Material material);	// return the mesh index
+	bool	removeMesh(int meshIdx);			// the index of the other meshes are unchanged, an analytic mesh cannot be removed
+	bool	setMeshMaterial(int meshIdx, const Material& material);
+	bool	setAreaLightTransform(int lightIdx, const Matrix4x4& xform);
+	bool	setAreaLightSampling(int lightIdx, AreaLightSampling sampling);
+	bool	loadEnvMap(const char* fileName);
+	void	createSkyEnvMap();
+	void	setEnvMapSampling(EnvMapSampling sampling);
+	void	markDirty(SceneBuffer buffer, int start, int end);
+	void	clearDirty();
+	bool	isDirty() const;
+
+	int		getNumTriangle() const;
+	int		getNumPrimitive() const;			// triangles, quads and boxes
+	int		getGeometryMemorySize() const;		// byte of vertex, index, analytic primitive and per mesh data
+
+	Vector3	computeHitNormal(const RayHit& hit) const;
+
+	// return true if the ray hit any primitive, hit->t is measured in unit of ray.dir
+	bool	rayCast(const Ray& ray, RayHit* hit) const;
+};
@@ -0,0 +1,152 @@
+
+// all rights reserved
+
+#include "Socket.h"
+#include <ws2tcpip.h>
+
+#define NET_MESSAGE_SIZE_MAX	(256 * 1024 * 1024)
+
+bool	socketStartup()
+{
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+}
+
+void	socketCleanup()
+{
+	WSACleanup();
+}
+
+SOCKET	socketListenLocalhost(int port)
+{
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	sockaddr_in addr	= {};
+	addr.sin_family		= AF_INET;
+	addr.sin_port		= htons((u_short)port);
+	addr.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+	if (bind(s, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+		listen(s, SOMAXCONN) == SOCKET_ERROR)
+	{
+		closesocket(s);
+		return INVALID_SOCKET;
+	}
+	return s;
+}
+
+int		socketGetPort(SOCKET s)
+{
+	sockaddr_in addr;
+	int			addrLen = sizeof(addr);
+	if (getsockname(s, (sockaddr*)&addr, &addrLen) == SOCKET_ERROR)
+		return 0;
+	return ntohs(addr.sin_port);
+}
+
+SOCKET	socketAccept(SOCKET listenSocket)
+{
+	SOCKET s = accept(listenSocket, nullptr, nullptr);
+	if (s != INVALID_SOCKET)
+	{
+		// messages are small and latency sensitive
+		BOOL noDelay = TRUE;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+	}
+	return s;
+}
+
+SOCKET	socketConnectLocalhost(int port)
+{
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	sockaddr_in addr	= {};
+	addr.sin_family		= AF_INET;
+	addr.sin_port		= htons((u_short)port);
+	addr.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+	if (connect(s, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+	{
+		closesocket(s);
+		return INVALID_SOCKET;
+	}
+
+	BOOL noDelay = TRUE;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+	return s;
+}
+
+void	socketClose(SOCKET s)
+{
+	if (s != INVALID_SOCKET)
+		closesocket(s);
+}
+
+bool	socketWaitReadable(SOCKET s, int timeOutMs)
+{
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(s, &readSet);
+	timeval timeOut;
+	timeOut.tv_sec	= timeOutMs / 1000;
+	timeOut.tv_usec	= (timeOutMs % 1000) * 1000;
+	return select((int)s + 1, &readSet, nullptr, nullptr, &timeOut) > 0;
+}
+
+bool	socketSendAll(SOCKET s, const void* data, int sizeByte)
+{
+	const char* ptr = (const char*)data;
+	while (sizeByte > 0)
+	{
+		int sent = send(s, ptr, sizeByte, 0);
+		if (sent <= 0)
+			return false;
+		ptr			+= sent;
+		sizeByte	-= sent;
+	}
+	return true;
+}
+
+bool	socketRecvAll(SOCKET s, void* data, int sizeByte)
+{
+	char* ptr = (char*)data;
+	while (sizeByte > 0)
+	{
+		int received = recv(s, ptr, sizeByte, 0);
+		if (received <= 0)	// 0 == connection closed
+			return false;
+		ptr			+= received;
+		sizeByte	-= received;
+	}
+	return true;
+}
+
+bool	socketSendMessage(SOCKET s, int type, const void* payload, int sizeByte)
+{
+	return socketSendMessage(s, type, payload, sizeByte, nullptr, 0);
+}
+
+bool	socketSendMessage(SOCKET s, int type, const void* payload0, int sizeByte0, const void* payload1, int sizeByte1)
+{
+	NetMessageHeader header;
+	header.type		= type;
+	header.sizeByte	= sizeByte0 + sizeByte1;
+	return	socketSendAll(s, &header, sizeof(header))	&&
+			socketSendAll(s, payload0, sizeByte0)		&&
+			socketSendAll(s, payload1, sizeByte1);
+}
+
+bool	socketRecvMessage(SOCKET s, int* type, std::vector<char>* payload)
+{
+	NetMessageHeader header;
+	if (!socketRecvAll(s, &header, sizeof(header)))
+		return false;
+	if (header.sizeByte < 0 || header.sizeByte > NET_MESSAGE_SIZE_MAX)
+		return false;
+
+	*type = header.type;
+	payload->resize(header.sizeByte);
+	return socketRecvAll(s, payload->data(), header.sizeByte);
+}
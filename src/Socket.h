@@ -0,0 +1,32 @@
+#pragma once
+
+// all rights reserved
+
+#include <winsock2.h>
+#include <vector>
+
+// minimal blocking TCP helpers for talking between processes on localhost,
+// every message is sent as a { type, sizeByte } header followed by the payload
+struct NetMessageHeader
+{
+	int		type;
+	int		sizeByte;
+};
+
+bool	socketStartup();
+void	socketCleanup();
+
+SOCKET	socketListenLocalhost(int port);		// pass port 0 to let the OS pick a free port
+int		socketGetPort(SOCKET s);
+SOCKET	socketAccept(SOCKET listenSocket);
+SOCKET	socketConnectLocalhost(int port);
+void	socketClose(SOCKET s);
+
+// wait until the socket has data to read, return false on time out
+bool	socketWaitReadable(SOCKET s, int timeOutMs);
+
+bool	socketSendAll(SOCKET s, const void* data, int sizeByte);
+bool	socketRecvAll(SOCKET s, void* data, int sizeByte);
+bool	socketSendMessage(SOCKET s, int type, const void* payload, int sizeByte);
+bool	socketSendMessage(SOCKET s, int type, const void* payload0, int sizeByte0, const void* payload1, int sizeByte1);
+bool	socketRecvMessage(SOCKET s, int* type, std::vector<char>* payload);
@@ -0,0 +1,131 @@
+
+// all rights reserved
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool()
+{
+	m_isQuit = false;
+}
+
+ThreadPool::~ThreadPool()
+{
+	release();
+}
+
+void	ThreadPool::init(int numThread)
+{
+	release();
+	m_isQuit = false;
+	for (int i = 1; i < numThread; ++i)
+		m_threads.push_back(std::thread(&ThreadPool::workerMain, this));
+}
+
+void	ThreadPool::release()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isQuit = true;
+	}
+	m_jobAdded.notify_all();
+	for (int i = 0; i < (int)m_threads.size(); ++i)
+		m_threads[i].join();
+	m_threads.clear();
+	m_jobs.clear();
+}
+
+int		ThreadPool::getNumThread() const
+{
+	return (int)m_threads.size() + 1;
+}
+
+int		ThreadPool::getHardwareThreadCount()
+{
+	int numThread = (int)std::thread::hardware_concurrency();
+	return numThread > 0 ? numThread : 1;
+}
+
+void	ThreadPool::addJob(ThreadPoolJobFunc func, void* userData, int numJob, std::atomic<int>* counter)
+{
+	if (numJob <= 0)
+		return;
+	*counter += numJob;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (int i = numJob - 1; i >= 0; --i)
+		{	// pushed in reverse, so the LIFO queue start from job 0
+			ThreadPoolJob job;
+			job.func		= func;
+			job.userData	= userData;
+			job.jobIdx		= i;
+			job.counter		= counter;
+			m_jobs.push_back(job);
+		}
+	}
+	if (numJob == 1)
+		m_jobAdded.notify_one();
+	else
+		m_jobAdded.notify_all();
+}
+
+bool	ThreadPool::runJob()
+{
+	ThreadPoolJob job;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_jobs.empty())
+			return false;
+		job = m_jobs.back();
+		m_jobs.pop_back();
+	}
+	job.func(job.userData, job.jobIdx);
+	--(*job.counter);
+	return true;
+}
+
+void	ThreadPool::wait(std::atomic<int>* counter)
+{
+	while (*counter > 0)
+	{
+		if (!runJob())
+			std::this_thread::yield();		// the remaining jobs are running on other threads
+	}
+}
+
+void	ThreadPool::parallelFor(ThreadPoolJobFunc func, void* userData, int numJob)
+{
+	std::atomic<int> counter(0);
+	addJob(func, userData, numJob, &counter);
+	wait(&counter);
+}
+
+void	ThreadPool::workerMain()
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_isQuit && m_jobs.empty())
+				m_jobAdded.wait(lock);
+			if (m_isQuit)
+				return;
+		}
+		runJob();
+	}
+}
+
+static ThreadPool*		s_sharedThreadPool	= NULL;
+static std::once_flag	s_sharedThreadPoolInit;
+
+static void	initSharedThreadPool()
+{
+	s_sharedThreadPool = new ThreadPool();
+	s_sharedThreadPool->init(ThreadPool::getHardwareThreadCount());
+}
+
+ThreadPool*	threadPoolGetShared()
+{
+	// may be first called by the scene loading and a render thread at the same time
+	std::call_once(s_sharedThreadPoolInit, initSharedThreadPool);
+	return s_sharedThreadPool;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+typedef void (*ThreadPoolJobFunc)(void* userData, int jobIdx);
+
+// lock free float accumulation for the jobs writing to shared data
+inline void	atomicAddFloat(std::atomic<float>* dst, float x)
+{
+	float old = dst->load(std::memory_order_relaxed);
+	while (!dst->compare_exchange_weak(old, old + x, std::memory_order_relaxed))
+		;
+}
+
+struct ThreadPoolJob
+{
+	ThreadPoolJobFunc	func;
+	void*				userData;
+	int					jobIdx;
+	std::atomic<int>*	counter;		// decremented after the job is completed
+};
+
+// fixed number of worker threads executing jobs from a shared LIFO queue,
+// a thread waiting for a counter keeps executing queued jobs, so jobs can add and wait for nested jobs
+class ThreadPool
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	void	init(int numThread);		// number of threads including the calling thread, 1 run all jobs on the thread calling wait()
+	void	release();
+	int		getNumThread() const;
+
+	// counter is incremented by numJob before return, and decremented when each job is completed
+	void	addJob(ThreadPoolJobFunc func, void* userData, int numJob, std::atomic<int>* counter);
+	void	wait(std::atomic<int>* counter);						// execute queued jobs until counter reach 0
+	void	parallelFor(ThreadPoolJobFunc func, void* userData, int numJob);
+
+	static int	getHardwareThreadCount();
+
+private:
+	std::vector<std::thread	>	m_threads;
+	std::deque<ThreadPoolJob>	m_jobs;
+	std::mutex					m_mutex;
+	std::condition_variable		m_jobAdded;
+	bool						m_isQuit;
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	bool	runJob();				// return false if the queue is empty
+	void	workerMain();
+};
+
+// shared by scene loading, created with getHardwareThreadCount() threads on first use
+ThreadPool*	threadPoolGetShared();
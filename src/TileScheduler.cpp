@@ -0,0 +1,89 @@
+
+// all rights reserved
+
+#include "TileScheduler.h"
+#include "math.h"
+#include <limits.h>
+#include <algorithm>
+
+TileScheduler::TileScheduler()
+{
+	m_width			= 0;
+	m_height		= 0;
+	m_numTileX		= 0;
+	m_numTileY		= 0;
+	m_focusX		= 0.0f;
+	m_focusY		= 0.0f;
+	m_focusRadius	= 0.0f;
+	clearCrop();
+}
+
+void	TileScheduler::init(int width, int height)
+{
+	m_width			= width;
+	m_height		= height;
+	m_numTileX		= (width	+ TILE_SCHEDULER_TILE_SIZE - 1) / TILE_SCHEDULER_TILE_SIZE;
+	m_numTileY		= (height	+ TILE_SCHEDULER_TILE_SIZE - 1) / TILE_SCHEDULER_TILE_SIZE;
+	m_tileSampleIdx.assign(m_numTileX * m_numTileY, 0);
+}
+
+void	TileScheduler::setFocus(float x, float y, float radius)
+{
+	m_focusX		= x;
+	m_focusY		= y;
+	m_focusRadius	= radius;
+}
+
+void	TileScheduler::setCrop(int x0, int y0, int x1, int y1)
+{
+	m_crop[0]		= x0;
+	m_crop[1]		= y0;
+	m_crop[2]		= x1;
+	m_crop[3]		= y1;
+}
+
+void	TileScheduler::clearCrop()
+{
+	setCrop(0, 0, INT_MAX, INT_MAX);
+}
+
+int		TileScheduler::computeTileSampleCount(int x0, int y0, int x1, int y1) const
+{
+	if (m_focusRadius <= 0.0f)
+		return 1;
+
+	// distance from the focus to the closest point of the tile
+	float	dx		= maxf(maxf(x0 - m_focusX, m_focusX - x1), 0.0f);
+	float	dy		= maxf(maxf(y0 - m_focusY, m_focusY - y1), 0.0f);
+	float	dist	= sqrtf(dx * dx + dy * dy);
+	float	weight	= clampf(2.0f - dist / m_focusRadius, 0.0f, 1.0f);
+	return 1 + (int)((TILE_SCHEDULER_FOCUS_SPP - 1) * weight + 0.5f);
+}
+
+static bool	compareTileSampleCount(const TileSchedulerTile& a, const TileSchedulerTile& b)
+{
+	return a.sampleCount > b.sampleCount;
+}
+
+void	TileScheduler::buildPass(std::vector<TileSchedulerTile>* outTiles)
+{
+	outTiles->clear();
+	for(int ty=0; ty<m_numTileY; ++ty)
+		for(int tx=0; tx<m_numTileX; ++tx)
+		{
+			TileSchedulerTile tile;
+			tile.x0	= std::max(tx * TILE_SCHEDULER_TILE_SIZE, m_crop[0]);
+			tile.y0	= std::max(ty * TILE_SCHEDULER_TILE_SIZE, m_crop[1]);
+			tile.x1	= std::min(std::min((tx + 1) * TILE_SCHEDULER_TILE_SIZE, m_width	), m_crop[2]);
+			tile.y1	= std::min(std::min((ty + 1) * TILE_SCHEDULER_TILE_SIZE, m_height	), m_crop[3]);
+			if (tile.x0 >= tile.x1 || tile.y0 >= tile.y1)
+				continue;
+
+			int& sampleIdx		= m_tileSampleIdx[ty * m_numTileX + tx];
+			tile.sampleStart	= sampleIdx;
+			tile.sampleCount	= computeTileSampleCount(tile.x0, tile.y0, tile.x1, tile.y1);
+			sampleIdx			+= tile.sampleCount;
+			outTiles->push_back(tile);
+		}
+	std::stable_sort(outTiles->begin(), outTiles->end(), compareTileSampleCount);
+}
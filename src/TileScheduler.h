@@ -0,0 +1,50 @@
+#pragma once
+
+// all rights reserved
+
+#include <vector>
+
+#define TILE_SCHEDULER_TILE_SIZE	(16)
+#define TILE_SCHEDULER_FOCUS_SPP	(8)		// samples per pass of the tiles within the focus radius
+
+// rect [x0, x1) x [y0, y1) of a tile with the sample range to trace in a pass
+struct TileSchedulerTile
+{
+	int		x0;
+	int		y0;
+	int		x1;
+	int		y1;
+	int		sampleStart;
+	int		sampleCount;
+};
+
+// Decide the samples of each tile per pass for CpuPathTracer::renderTile(). Without a focus every tile gets 1 sample per pass,
+// same as renderSamples(). With a focus point (e.g. the cursor), the tiles within the focus radius get TILE_SCHEDULER_FOCUS_SPP
+// samples, falling off linearly to 1 at twice the radius. A crop rect restricts the passes to the pixels inside it.
+// Each tile keeps its own sample index, AccumBuffer averages each pixel by its own sample count, so the image stays unbiased.
+class TileScheduler
+{
+public:
+	TileScheduler();
+
+	void	init(int width, int height);				// restart the sample index of every tile
+	void	setFocus(float x, float y, float radius);	// in pixel, radius <= 0 for uniform sampling
+	void	setCrop(int x0, int y0, int x1, int y1);	// only trace the rect [x0, x1) x [y0, y1)
+	void	clearCrop();
+
+	// tiles of the next pass sorted by decreasing sample count, so the focus is rendered first and the longest jobs start early
+	void	buildPass(std::vector<TileSchedulerTile>* outTiles);
+
+private:
+	int					m_width;
+	int					m_height;
+	int					m_numTileX;
+	int					m_numTileY;
+	int					m_crop[4];				// x0, y0, x1, y1
+	float				m_focusX;
+	float				m_focusY;
+	float				m_focusRadius;
+	std::vector<int>	m_tileSampleIdx;		// next sample index of each tile
+
+	int		computeTileSampleCount(int x0, int y0, int x1, int y1) const;
+};
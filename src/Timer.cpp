@@ -0,0 +1,29 @@
+
+// all rights reserved
+
+#include "Timer.h"
+
+LONGLONG	timeGetClockFrequency()
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return freq.QuadPart;
+}
+
+LONGLONG	timeGetAbsoulteTime()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+double		timeCalculateElapsedTime(LONGLONG clockFreqency, LONGLONG startTime, LONGLONG endTime)
+{
+	return ((double)(endTime - startTime)) / (double)clockFreqency;
+}
+
+double		timeGetElapsedTime(LONGLONG startTime)
+{
+	static LONGLONG s_freq = timeGetClockFrequency();
+	return timeCalculateElapsedTime(s_freq, startTime, timeGetAbsoulteTime());
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// all rights reserved
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+LONGLONG	timeGetClockFrequency();
+LONGLONG	timeGetAbsoulteTime();
+double		timeCalculateElapsedTime(LONGLONG clockFreqency, LONGLONG startTime, LONGLONG endTime);
+
+// elapsed time in second since startTime
+double		timeGetElapsedTime(LONGLONG startTime);
@@ -1,163 +1,398 @@
-
-// by simon yeung, 06/05/2018
-// all rights reserved
-
-#include <stdio.h>
-#include <conio.h>
-
-#include "RayTracer.h"
-
-RayTracer		s_rayTracer;
-volatile bool	s_isQuit			= false;
-volatile bool	s_isQuitCompleted	= false;
-
-static BOOL consoleHandlerRoutine(DWORD dwCtrlType)
-{
-	s_isQuit= true;
-
-	// wait for the main thread to be completed
-	while(!s_isQuitCompleted)
-		Sleep(10);
-
-	return FALSE;
-}
-
-static void	allocConsole()
-{
-	AllocConsole();
-	SetConsoleCtrlHandler((PHANDLER_ROUTINE)consoleHandlerRoutine, TRUE);
-	SetConsoleTitle("Console");
-	
-	_cprintf("------------  Key Config  ------------\n");
-	_cprintf("Mouse drag           : Rotate camera\n");
-	_cprintf("Key W, A, S, D, Q, E : Move camera\n");
-	_cprintf("Key C                : Reset camera\n");
-	_cprintf("Key B                : Toggle simple de-noise\n");
-}
-
-LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
-{
-	RayTracer* rayTracer = reinterpret_cast<RayTracer*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
-
-	switch (message)
-	{
-	case WM_CREATE:
-	{
-		// Save the RayTracer* passed in to CreateWindow.
-		LPCREATESTRUCT pCreateStruct = reinterpret_cast<LPCREATESTRUCT>(lParam);
-		SetWindowLongPtr(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(pCreateStruct->lpCreateParams));
-	}
-	return 0;
-
-	case WM_KEYDOWN:
-		if (rayTracer)
-			rayTracer->onKeyDown(static_cast<UINT8>(wParam));
-		return 0;
-
-	case WM_KEYUP:
-	{
-		UINT8 key = static_cast<UINT8>(wParam);
-		if (rayTracer)
-			rayTracer->onKeyUp(key);
-		if (key == VK_ESCAPE)
-			PostQuitMessage(0);
-		return 0;
-	}
-	
-	case WM_LBUTTONDOWN:
-		if (rayTracer)
-			rayTracer->onMouseDown();
-		return 0;
-
-	case WM_LBUTTONUP:
-		if (rayTracer)
-			rayTracer->onMouseUp();
-		return 0;
-
-	case WM_PAINT:
-		if (rayTracer)
-		{
-			rayTracer->update();
-			rayTracer->render();
-		}
-		return 0;
-	case WM_MOVE:
-		{
-			int xPos = (int) LOWORD(lParam);
-			int yPos = (int) HIWORD(lParam);
-			if (rayTracer)
-				rayTracer->setWindowPos(xPos, yPos);
-		}
-		return 0;
-	case WM_SIZE:
-		{
-			int w = (int) LOWORD(lParam);
-			int h = (int) HIWORD(lParam);
-			if (rayTracer)
-				rayTracer->resize(w, h);
-		}
-		return 0;
-
-	case WM_DESTROY:
-		PostQuitMessage(0);
-		return 0;
-	}
-
-	// Handle any messages the switch statement didn't.
-	return DefWindowProc(hWnd, message, wParam, lParam);
-}
-
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
-{
-	// Initialize the window class.
-	WNDCLASSEX windowClass = { 0 };
-	windowClass.cbSize = sizeof(WNDCLASSEX);
-	windowClass.style = CS_HREDRAW | CS_VREDRAW;
-	windowClass.lpfnWndProc = WindowProc;
-	windowClass.hInstance = hInstance;
-	windowClass.hCursor = LoadCursor(NULL, IDC_ARROW);
-	windowClass.lpszClassName = "Path Tracer DX12";
-	RegisterClassEx(&windowClass);
-
-	int windowWidth	= 512;
-	int windowHeight= 512;
-	RECT windowRect = { 0, 0, (LONG)windowWidth, (LONG)windowHeight };
-	AdjustWindowRect(&windowRect, WS_OVERLAPPEDWINDOW, FALSE);
-
-	// Create the window and store a handle to it.
-	s_rayTracer.m_hwnd = CreateWindow(		windowClass.lpszClassName,
-											"DX12 Path Tracer",
-											WS_OVERLAPPEDWINDOW,
-											CW_USEDEFAULT,
-											CW_USEDEFAULT,
-											windowRect.right - windowRect.left,
-											windowRect.bottom - windowRect.top,
-											nullptr,		// We have no parent window.
-											nullptr,		// We aren't using menus.
-											hInstance,
-											&s_rayTracer);
-
-	s_rayTracer.init(windowWidth, windowHeight);
-
-	allocConsole();
-	ShowWindow(s_rayTracer.m_hwnd, nCmdShow);
-
-	// Main loop.
-	MSG msg = {};
-	while (msg.message != WM_QUIT && !s_isQuit)
-	{
-		// Process any messages in the queue.
-		if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
-		{
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
-		}
-	}
-
-	s_rayTracer.release();
-	s_isQuitCompleted= true;
-
-	FreeConsole();
-	return 0;
-}
-
+
+// by simon yeung, 06/05/2018
+// all rights reserved
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <conio.h>
+
+#include "RayTracer.h"
+#include "DistributedRender.h"
+#include "RenderServer.h"
+#include "Socket.h"
+#include "Process.h"
+#include "RayBenchmark.h"
+
+#define INPUT_UPDATE_INTERVAL_MS	(4)		// of the camera moved by a held key when no message arrives
+
+RayTracer		s_rayTracer;
+volatile bool	s_isQuit			= false;
+volatile bool	s_isQuitCompleted	= false;
+
+static BOOL consoleHandlerRoutine(DWORD dwCtrlType)
+{
+	s_isQuit= true;
+
+	// wait for the main thread to be completed
+	while(!s_isQuitCompleted)
+		Sleep(10);
+
+	return FALSE;
+}
+
+static void	allocConsole()
+{
+	AllocConsole();
+	SetConsoleCtrlHandler((PHANDLER_ROUTINE)consoleHandlerRoutine, TRUE);
+	SetConsoleTitle("Console");
+	
+	_cprintf("------------  Key Config  ------------\n");
+	_cprintf("Mouse drag           : Rotate camera\n");
+	_cprintf("Key W, A, S, D, Q, E : Move camera\n");
+	_cprintf("Key C                : Reset camera\n");
+	_cprintf("Key B                : Toggle simple de-noise\n");
+	_cprintf("Key R                : Toggle dynamic resolution while moving\n");
+	_cprintf("Key M                : Toggle tall block material\n");
+	_cprintf("Key L                : Move light\n");
+}
+
+LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+	RayTracer* rayTracer = reinterpret_cast<RayTracer*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
+
+	switch (message)
+	{
+	case WM_CREATE:
+	{
+		// Save the RayTracer* passed in to CreateWindow.
+		LPCREATESTRUCT pCreateStruct = reinterpret_cast<LPCREATESTRUCT>(lParam);
+		SetWindowLongPtr(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(pCreateStruct->lpCreateParams));
+	}
+	return 0;
+
+	case WM_KEYDOWN:
+		if (rayTracer)
+			rayTracer->onKeyDown(static_cast<UINT8>(wParam));
+		return 0;
+
+	case WM_KEYUP:
+	{
+		UINT8 key = static_cast<UINT8>(wParam);
+		if (rayTracer)
+			rayTracer->onKeyUp(key);
+		if (key == VK_ESCAPE)
+			PostQuitMessage(0);
+		return 0;
+	}
+	
+	case WM_LBUTTONDOWN:
+		if (rayTracer)
+			rayTracer->onMouseDown();
+		return 0;
+
+	case WM_LBUTTONUP:
+		if (rayTracer)
+			rayTracer->onMouseUp();
+		return 0;
+
+	case WM_PAINT:
+		// the render thread presents every frame, validate the window so WM_PAINT is not sent again
+		ValidateRect(hWnd, NULL);
+		return 0;
+	case WM_MOVE:
+		{
+			int xPos = (int) LOWORD(lParam);
+			int yPos = (int) HIWORD(lParam);
+			if (rayTracer)
+				rayTracer->setWindowPos(xPos, yPos);
+		}
+		return 0;
+	case WM_SIZE:
+		{
+			int w = (int) LOWORD(lParam);
+			int h = (int) HIWORD(lParam);
+			if (rayTracer)
+				rayTracer->setWindowSize(w, h);
+		}
+		return 0;
+
+	case WM_DESTROY:
+		PostQuitMessage(0);
+		return 0;
+	}
+
+	// Handle any messages the switch statement didn't.
+	return DefWindowProc(hWnd, message, wParam, lParam);
+}
+
+static int	findCommandLineArg(const char* name)
+{
+	for(int i=1; i<__argc; ++i)
+		if (strcmp(__argv[i], name) == 0)
+			return i;
+	return 0;
+}
+
+static int	getCommandLineInt(const char* name, int defaultValue)
+{
+	// the value is the number following the arg name
+	int i = findCommandLineArg(name);
+	if (i == 0 || i + 1 >= __argc)
+		return defaultValue;
+	const char* value = __argv[i + 1];
+	bool isNumber = isdigit(value[0]) || (value[0] == '-' && isdigit(value[1]));
+	return isNumber ? atoi(value) : defaultValue;
+}
+
+static float	getCommandLineFloat(const char* name, float defaultValue)
+{
+	int i = findCommandLineArg(name);
+	if (i == 0 || i + 1 >= __argc)
+		return defaultValue;
+	const char* value = __argv[i + 1];
+	if (value[0] == '-')
+		++value;
+	bool isNumber = isdigit(value[0]) || (value[0] == '.' && isdigit(value[1]));
+	return isNumber ? (float)atof(__argv[i + 1]) : defaultValue;
+}
+
+static const char*	getCommandLineString(const char* name, const char* defaultValue)
+{
+	int i = findCommandLineArg(name);
+	if (i == 0 || i + 1 >= __argc || __argv[i + 1][0] == '-')
+		return defaultValue;
+	return __argv[i + 1];
+}
+
+static void	allocReportConsole()
+{
+	AllocConsole();
+	FILE* file;
+	freopen_s(&file, "CONOUT$", "w", stdout);
+}
+
+// command line modes which run without a window, return false to start the interactive viewer
+static bool	runCommandLineMode(int* exitCode)
+{
+	// a child process spawned by processSpawnSelf() prints to the log read by its parent
+	const char* logFileName = getCommandLineString("-log", NULL);
+	if (logFileName)
+		processRedirectOutput(logFileName);
+
+	if (findCommandLineArg("-worker"))
+	{
+		*exitCode = distributedRenderWorker(getCommandLineInt("-worker", 0), getCommandLineInt("-processIdx", -1), getCommandLineInt("-crashAfter", -1));
+		return true;
+	}
+
+	if (findCommandLineArg("-server"))
+	{
+		*exitCode = renderServerRun(getCommandLineInt("-server", RENDER_SERVER_DEFAULT_PORT));
+		return true;
+	}
+
+	if (findCommandLineArg("-serverBenchmark"))
+	{
+		allocReportConsole();
+		renderServerLatencyReport(getCommandLineInt("-port", RENDER_SERVER_DEFAULT_PORT));
+		printf("press any key to exit\n");
+		_getch();
+		*exitCode = 0;
+		return true;
+	}
+
+	if (findCommandLineArg("-bvhBenchmark"))
+	{
+		allocReportConsole();
+		const char* sceneName = getCommandLineString("-bvhBenchmark", "cornell_sphere_large");
+		if (findCommandLineArg("-wide"))
+			rayBenchmarkWideBvhReport(sceneName);
+		else if (findCommandLineArg("-build"))
+			rayBenchmarkBvhBuildReport(sceneName);
+		else if (findCommandLineArg("-animate"))
+			rayBenchmarkMeshAnimationReport(sceneName);
+		else if (findCommandLineArg("-edit"))
+			rayBenchmarkSceneEditReport(sceneName);
+		else if (findCommandLineArg("-packet"))
+			rayBenchmarkPacketReport(sceneName);
+		else if (findCommandLineArg("-traversal"))
+			rayBenchmarkTraversalReport(sceneName);
+		else if (findCommandLineArg("-layout"))
+			rayBenchmarkNodeLayoutReport(sceneName);
+		else if (findCommandLineArg("-sbvh"))
+			rayBenchmarkSpatialSplitReport(sceneName);
+		else if (findCommandLineArg("-analytic"))
+			rayBenchmarkAnalyticPrimReport(sceneName);
+		else
+			rayBenchmarkCompressedBvhReport(sceneName);
+		printf("press any key to exit\n");
+		_getch();
+		*exitCode = 0;
+		return true;
+	}
+
+	if (findCommandLineArg("-geometryReport"))
+	{
+		allocReportConsole();
+		const char* sceneName = getCommandLineString("-geometryReport", "cornell_sphere_large");
+		if (findCommandLineArg("-meshOptimize"))
+			rayBenchmarkMeshOptimizeReport(sceneName);
+		else
+			rayBenchmarkGeometryReport(sceneName);
+		printf("press any key to exit\n");
+		_getch();
+		*exitCode = 0;
+		return true;
+	}
+
+	if (findCommandLineArg("-lightSamplingReport"))
+	{
+		allocReportConsole();
+		if (findCommandLineArg("-restir"))
+			rayBenchmarkRestirReport(getCommandLineString("-lightSamplingReport", "cornell_many_lights"));
+		else if (findCommandLineArg("-env"))
+			rayBenchmarkEnvMapSamplingReport(getCommandLineString("-lightSamplingReport", "sky_spheres"));
+		else if (findCommandLineArg("-emissive"))
+			rayBenchmarkEmissiveSamplingReport(getCommandLineString("-lightSamplingReport", "cornell_emissive_sphere"));
+		else
+			rayBenchmarkLightSamplingReport(getCommandLineString("-lightSamplingReport", "cornell_large_light"));
+		printf("press any key to exit\n");
+		_getch();
+		*exitCode = 0;
+		return true;
+	}
+
+	if (findCommandLineArg("-convergenceReport"))
+	{
+		allocReportConsole();
+		if (findCommandLineArg("-guide"))
+			rayBenchmarkPathGuidingReport(getCommandLineString("-convergenceReport", "cornell_indirect"));
+		else if (findCommandLineArg("-termination"))
+			rayBenchmarkPathTerminationReport(getCommandLineString("-convergenceReport", "cornell"));
+		else if (findCommandLineArg("-roi"))
+			rayBenchmarkRegionOfInterestReport(getCommandLineString("-convergenceReport", "cornell"));
+		else if (findCommandLineArg("-passSpp"))
+			rayBenchmarkPassSampleCountReport(getCommandLineString("-convergenceReport", "cornell"));
+		else
+			rayBenchmarkRadianceCacheReport(getCommandLineString("-convergenceReport", "cornell"));
+		printf("press any key to exit\n");
+		_getch();
+		*exitCode = 0;
+		return true;
+	}
+
+	if (findCommandLineArg("-latencyReport"))
+	{
+		allocReportConsole();
+		rayBenchmarkInputLatencyReport(getCommandLineString("-latencyReport", "cornell"));
+		printf("press any key to exit\n");
+		_getch();
+		*exitCode = 0;
+		return true;
+	}
+
+	if (findCommandLineArg("-distributed"))
+	{
+		allocReportConsole();
+		socketStartup();
+
+		DistributedJob job;
+		job.sceneName		= getCommandLineString("-scene", "cornell");
+		job.camera.pos		= Vector3(0.278f, 0.273f, -0.800f);
+		job.camera.lookAt	= Vector3(0.278f, 0.273f, 0.0f);
+		job.camera.fovY		= DEGREE_TO_RADIAN(60.0f);
+		job.width			= getCommandLineInt("-width"	, 512);
+		job.height			= getCommandLineInt("-height"	, 512);
+		job.samplePerPixel	= getCommandLineInt("-spp"		, 256);
+		job.samplePerTask	= getCommandLineInt("-sppPerTask", 8);
+		int numWorker		= max(getCommandLineInt("-distributed", 4), 1);
+
+		if (findCommandLineArg("-scaling"))
+			distributedRenderScalingReport(job, numWorker);
+		else
+		{
+			AccumBuffer			result;
+			DistributedStats	stats;
+			bool				isSucceed = distributedRender(job, numWorker, -1, &result, &stats);
+			printf("distributed render %s: %i workers, %.3fs render, %.3fs total, %i task re-issued\n",
+				isSucceed ? "completed" : "failed", numWorker, stats.renderTime, stats.totalTime, stats.numTaskReissued);
+			if (isSucceed)
+				result.savePfm("distributed.pfm");
+		}
+
+		socketCleanup();
+		printf("press any key to exit\n");
+		_getch();
+		*exitCode = 0;
+		return true;
+	}
+
+	return false;
+}
+
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
+{
+	int exitCode;
+	if (runCommandLineMode(&exitCode))
+		return exitCode;
+
+	// Initialize the window class.
+	WNDCLASSEX windowClass = { 0 };
+	windowClass.cbSize = sizeof(WNDCLASSEX);
+	windowClass.style = CS_HREDRAW | CS_VREDRAW;
+	windowClass.lpfnWndProc = WindowProc;
+	windowClass.hInstance = hInstance;
+	windowClass.hCursor = LoadCursor(NULL, IDC_ARROW);
+	windowClass.lpszClassName = "Path Tracer DX12";
+	RegisterClassEx(&windowClass);
+
+	int windowWidth	= 512;
+	int windowHeight= 512;
+	RECT windowRect = { 0, 0, (LONG)windowWidth, (LONG)windowHeight };
+	AdjustWindowRect(&windowRect, WS_OVERLAPPEDWINDOW, FALSE);
+
+	// Create the window and store a handle to it.
+	s_rayTracer.m_hwnd = CreateWindow(		windowClass.lpszClassName,
+											"DX12 Path Tracer",
+											WS_OVERLAPPEDWINDOW,
+											CW_USEDEFAULT,
+											CW_USEDEFAULT,
+											windowRect.right - windowRect.left,
+											windowRect.bottom - windowRect.top,
+											nullptr,		// We have no parent window.
+											nullptr,		// We aren't using menus.
+											hInstance,
+											&s_rayTracer);
+
+	s_rayTracer.m_scene.isAnalyticPrimEnabled = findCommandLineArg("-analytic") != 0;
+	s_rayTracer.m_scene.isLightMeshEnabled = findCommandLineArg("-lightMesh") != 0;
+	if (findCommandLineArg("-envMap"))
+	{
+		// the sky scene is created instead of the Cornell box, lit by the procedural sky if no file is given
+		const char* envMapFile = getCommandLineString("-envMap", NULL);
+		if (envMapFile == NULL || !s_rayTracer.m_scene.loadEnvMap(envMapFile))
+			s_rayTracer.m_scene.createSkyEnvMap();
+	}
+	s_rayTracer.init(windowWidth, windowHeight);
+	s_rayTracer.m_frameTimeBudget = getCommandLineFloat("-frameBudget", s_rayTracer.m_frameTimeBudget);
+	if (findCommandLineArg("-flyThrough"))
+		s_rayTracer.startFlyThrough();
+
+	allocConsole();
+	ShowWindow(s_rayTracer.m_hwnd, nCmdShow);
+	s_rayTracer.startRenderThread();
+
+	// Main loop, only the input is handled here, update() and render() run on the render thread.
+	MSG msg = {};
+	while (msg.message != WM_QUIT && !s_isQuit)
+	{
+		// sleep until a message arrives, or the input interval to keep moving the camera while a key is held
+		MsgWaitForMultipleObjects(0, NULL, FALSE, INPUT_UPDATE_INTERVAL_MS, QS_ALLINPUT);
+
+		// Process any messages in the queue.
+		while (msg.message != WM_QUIT && PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+		s_rayTracer.updateInput();
+	}
+
+	s_rayTracer.release();
+	s_isQuitCompleted= true;
+
+	FreeConsole();
+	return 0;
+}
+